@@ -3,6 +3,7 @@
 #include "./ayumi.h"
 
 #include <string>
+#include <utility>
 #include "engine/oglwrap_config.h"
 #include <GLFW/glfw3.h>
 
@@ -25,10 +26,17 @@ engine::ShaderFile* Ayumi::loadShadowVertexShader(
   return manager->publish("ayumi_shadow.vert", shadow_vs_src);
 }
 
-Ayumi::Ayumi(engine::GameObject* parent)
+static const char* kMeshFile = "src/resources/models/ayumi/ayumi.dae";
+
+std::unique_ptr<Assimp::Importer> Ayumi::ImportMesh() {
+  return engine::MeshRenderer::Import(kMeshFile,
+      aiProcessPreset_TargetRealtime_Quality | aiProcess_FlipUVs);
+}
+
+Ayumi::Ayumi(engine::GameObject* parent,
+             std::unique_ptr<Assimp::Importer> mesh)
     : engine::GameObject(parent)
-    , mesh_("src/resources/models/ayumi/ayumi.dae",
-            aiProcessPreset_TargetRealtime_Quality | aiProcess_FlipUVs)
+    , mesh_(kMeshFile, std::move(mesh))
     , anim_(mesh_.getAnimData())
     , prog_(loadVertexShader(scene_->shader_manager()),
             scene_->shader_manager()->get("ayumi.frag"))
@@ -63,39 +71,40 @@ Ayumi::Ayumi(engine::GameObject* parent)
 
   using engine::AnimFlag;
 
-  mesh_.addAnimation("src/resources/models/ayumi/ayumi_idle.dae", "Stand",
-                     {AnimFlag::Repeat, AnimFlag::Interruptable});
+  mesh_.addAnimations({
+    {"src/resources/models/ayumi/ayumi_idle.dae", "Stand",
+     {AnimFlag::Repeat, AnimFlag::Interruptable}},
 
-  mesh_.addAnimation("src/resources/models/ayumi/ayumi_walk.dae", "Walk",
-                     {AnimFlag::Repeat, AnimFlag::Interruptable});
+    {"src/resources/models/ayumi/ayumi_walk.dae", "Walk",
+     {AnimFlag::Repeat, AnimFlag::Interruptable}},
 
-  mesh_.addAnimation("src/resources/models/ayumi/ayumi_walk.dae", "MoonWalk",
-                     {AnimFlag::Repeat, AnimFlag::Mirrored,
-                     AnimFlag::Interruptable});
+    {"src/resources/models/ayumi/ayumi_walk.dae", "MoonWalk",
+     {AnimFlag::Repeat, AnimFlag::Mirrored, AnimFlag::Interruptable}},
 
-  mesh_.addAnimation("src/resources/models/ayumi/ayumi_run.dae", "Run",
-                     {AnimFlag::Repeat, AnimFlag::Interruptable});
+    {"src/resources/models/ayumi/ayumi_run.dae", "Run",
+     {AnimFlag::Repeat, AnimFlag::Interruptable}},
 
-  mesh_.addAnimation("src/resources/models/ayumi/ayumi_jump_rise.dae", "JumpRise",
-                     {AnimFlag::MirroredRepeat, AnimFlag::Interruptable}, 0.5f);
+    {"src/resources/models/ayumi/ayumi_jump_rise.dae", "JumpRise",
+     {AnimFlag::MirroredRepeat, AnimFlag::Interruptable}, 0.5f},
 
-  mesh_.addAnimation("src/resources/models/ayumi/ayumi_jump_fall.dae", "JumpFall",
-                     {AnimFlag::MirroredRepeat, AnimFlag::Interruptable}, 0.5f);
+    {"src/resources/models/ayumi/ayumi_jump_fall.dae", "JumpFall",
+     {AnimFlag::MirroredRepeat, AnimFlag::Interruptable}, 0.5f},
 
-  mesh_.addAnimation("src/resources/models/ayumi/ayumi_flip.dae", "Flip",
-                     AnimFlag::None, 1.5f);
+    {"src/resources/models/ayumi/ayumi_flip.dae", "Flip",
+     AnimFlag::None, 1.5f},
 
-  mesh_.addAnimation("src/resources/models/ayumi/ayumi_attack.dae", "Attack",
-                     AnimFlag::None, 2.5f);
+    {"src/resources/models/ayumi/ayumi_attack.dae", "Attack",
+     AnimFlag::None, 2.5f},
 
-  mesh_.addAnimation("src/resources/models/ayumi/ayumi_attack2.dae", "Attack2",
-                     AnimFlag::None, 1.4f);
+    {"src/resources/models/ayumi/ayumi_attack2.dae", "Attack2",
+     AnimFlag::None, 1.4f},
 
-  mesh_.addAnimation("src/resources/models/ayumi/ayumi_attack3.dae", "Attack3",
-                     AnimFlag::None, 3.0f);
+    {"src/resources/models/ayumi/ayumi_attack3.dae", "Attack3",
+     AnimFlag::None, 3.0f},
 
-  mesh_.addAnimation("src/resources/models/ayumi/ayumi_attack_chain0.dae", "Attack_Chain0",
-                     AnimFlag::None, 0.9f);
+    {"src/resources/models/ayumi/ayumi_attack_chain0.dae", "Attack_Chain0",
+     AnimFlag::None, 0.9f}
+  });
 
   anim_.setDefaultAnimation("Stand", 0.3f);
   anim_.forceAnimToDefault(0);
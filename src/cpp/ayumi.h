@@ -13,9 +13,13 @@
 
 class Ayumi : public engine::GameObject {
  public:
-  explicit Ayumi(GameObject* parent);
+  Ayumi(GameObject* parent, std::unique_ptr<Assimp::Importer> mesh);
   virtual ~Ayumi() {}
 
+  // Loads in the mesh. It doesn't need the OpenGL context, so the scene can
+  // do it on the TaskScheduler.
+  static std::unique_ptr<Assimp::Importer> ImportMesh();
+
   engine::AnimatedMeshRenderer& getMesh();
   engine::Animation& getAnimation();
 
@@ -21,7 +21,10 @@ class CameraTransform : public Transform {
 
   // We shouldn't inherit the parent's rotation, like how a normal Transform does
   virtual const quat rot() const override { return rot_; }
-  virtual void set_rot(const quat& new_rot) override { rot_ = new_rot; }
+  virtual void set_rot(const quat& new_rot) override {
+    rot_ = new_rot;
+    localChanged();
+  }
 
   // We have custom up and right vectors
   virtual vec3 up() const override { return up_; }
@@ -97,49 +100,7 @@ class Camera : public GameObject {
   }
 
   void updateFrustum() {
-    glm::mat4 m = proj_mat_ * cam_mat_;
-
-    // REMEMBER: m[i][j] is j-th row, i-th column!!!
-
-    frustum_ = Frustum{{
-      // left
-     {m[0][3] + m[0][0],
-      m[1][3] + m[1][0],
-      m[2][3] + m[2][0],
-      m[3][3] + m[3][0]},
-
-      // right
-     {m[0][3] - m[0][0],
-      m[1][3] - m[1][0],
-      m[2][3] - m[2][0],
-      m[3][3] - m[3][0]},
-
-      // top
-     {m[0][3] - m[0][1],
-      m[1][3] - m[1][1],
-      m[2][3] - m[2][1],
-      m[3][3] - m[3][1]},
-
-      // bottom
-     {m[0][3] + m[0][1],
-      m[1][3] + m[1][1],
-      m[2][3] + m[2][1],
-      m[3][3] + m[3][1]},
-
-      // near
-     {m[0][2],
-      m[1][2],
-      m[2][2],
-      m[3][2]},
-
-      // far
-     {m[0][3] - m[0][2],
-      m[1][3] - m[1][2],
-      m[2][3] - m[2][2],
-      m[3][3] - m[3][2]}
-    }};
-
-    // Note: there's no need to normalize the plane parameters
+    frustum_ = Frustum::FromMatrix(proj_mat_ * cam_mat_);
   }
 };
 
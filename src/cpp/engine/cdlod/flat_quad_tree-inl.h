@@ -0,0 +1,54 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_CDLOD_FLAT_QUAD_TREE_INL_H_
+#define ENGINE_CDLOD_FLAT_QUAD_TREE_INL_H_
+
+#include "./flat_quad_tree.h"
+
+namespace engine {
+namespace cdlod {
+
+template<typename RenderList>
+void FlatQuadTree::selectNodes(size_t node, GLubyte level,
+                               const glm::vec3& cam_pos,
+                               const CullBatch::PreparedFrustum& frustum,
+                               const LodSettings& lod,
+                               RenderList& render_list) const {
+  float scale = 1 << level;
+  float lod_range = lod.range(level);
+
+  // if we can cover the whole area or if we are a leaf
+  if (level == 0 || !collidesWithSphere(node, cam_pos, lod_range)) {
+    render_list.addToRenderList(x(node), z(node), scale, level);
+  } else {
+    size_t tl = FirstChild(node), tr = tl+1, bl = tl+2, br = tl+3;
+    bool btl = collidesWithSphere(tl, cam_pos, lod_range);
+    bool btr = collidesWithSphere(tr, cam_pos, lod_range);
+    bool bbl = collidesWithSphere(bl, cam_pos, lod_range);
+    bool bbr = collidesWithSphere(br, cam_pos, lod_range);
+
+    // Ask childs to render what we can't (if they are visible)
+    uint32_t visible = Children{*this, node}.cull(frustum);
+    if (btl && (visible & 1)) {
+      selectNodes(tl, level-1, cam_pos, frustum, lod, render_list);
+    }
+    if (btr && (visible & 2)) {
+      selectNodes(tr, level-1, cam_pos, frustum, lod, render_list);
+    }
+    if (bbl && (visible & 4)) {
+      selectNodes(bl, level-1, cam_pos, frustum, lod, render_list);
+    }
+    if (bbr && (visible & 8)) {
+      selectNodes(br, level-1, cam_pos, frustum, lod, render_list);
+    }
+
+    // Render, what the childs didn't do
+    render_list.addToRenderList(x(node), z(node), scale, level,
+                                !btl, !btr, !bbl, !bbr);
+  }
+}
+
+}  // namespace cdlod
+}  // namespace engine
+
+#endif
@@ -0,0 +1,117 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <cmath>
+#include <algorithm>
+#include "./flat_quad_tree.h"
+#include "../task_scheduler.h"
+
+namespace engine {
+namespace cdlod {
+
+FlatQuadTree::FlatQuadTree(const HeightMapInterface& hmap, int node_dimension)
+    : max_level_(std::max(log2(std::max(hmap.w(), hmap.h()))
+                          - log2(node_dimension), 0.0))
+    , node_dimension_(node_dimension) {
+  size_t node_count = FirstNodeOfDepth(max_level_ + 1);
+  bbox_mins_.resize(node_count);
+  bbox_maxes_.resize(node_count);
+
+  // Place the nodes top-down, the heights are filled in later
+  setNode(0, hmap.w()/2, hmap.h()/2, size(max_level_), 0, 0);
+  for (int depth = 0; depth < max_level_; ++depth) {
+    GLint size = this->size(max_level_ - depth);
+    GLint child_size = size / 2;
+    for (size_t node = FirstNodeOfDepth(depth);
+         node < FirstNodeOfDepth(depth+1); ++node) {
+      GLint x = this->x(node), z = this->z(node);
+      size_t tl = FirstChild(node), tr = tl+1, bl = tl+2, br = tl+3;
+      setNode(tl, x-size/4, z+size/4, child_size, 0, 0);
+      setNode(tr, x+size/4, z+size/4, child_size, 0, 0);
+      setNode(bl, x-size/4, z-size/4, child_size, 0, 0);
+      setNode(br, x+size/4, z-size/4, child_size, 0, 0);
+    }
+  }
+
+  // The leaves are the only ones that have to read the heightmap, and that's
+  // the slow part of the creation, so do it in parallel.
+  size_t leaves_begin = FirstNodeOfDepth(max_level_);
+  TaskScheduler::Default().parallelFor(leaves_begin, node_count,
+    [this, &hmap](size_t begin, size_t end) {
+      countMinMaxOfLeaves(hmap, begin, end);
+    }, 64);
+
+  // Then the inner nodes bottom-up, from their childrens' bounding boxes
+  for (int depth = max_level_ - 1; depth >= 0; --depth) {
+    for (size_t node = FirstNodeOfDepth(depth);
+         node < FirstNodeOfDepth(depth+1); ++node) {
+      countMinMaxOfChildren(node);
+    }
+  }
+}
+
+void FlatQuadTree::countMinMaxOfChildren(size_t node) {
+  size_t first_child = FirstChild(node);
+  float min = bbox_mins_[first_child].y, max = bbox_maxes_[first_child].y;
+  for (size_t child = first_child+1; child < first_child+4; ++child) {
+    min = std::min(min, bbox_mins_[child].y);
+    max = std::max(max, bbox_maxes_[child].y);
+  }
+  bbox_mins_[node].y = min;
+  bbox_maxes_[node].y = max;
+}
+
+void FlatQuadTree::updateHeights(size_t node, int depth,
+                                 const HeightMapInterface& hmap,
+                                 int x0, int y0, int x1, int y1) {
+  if (x1 < bbox_mins_[node].x || bbox_maxes_[node].x < x0 ||
+      y1 < bbox_mins_[node].z || bbox_maxes_[node].z < y0) {
+    return;
+  }
+
+  if (depth == max_level_) {
+    countMinMaxOfLeaves(hmap, node, node+1);
+  } else {
+    size_t first_child = FirstChild(node);
+    for (size_t child = first_child; child < first_child+4; ++child) {
+      updateHeights(child, depth+1, hmap, x0, y0, x1, y1);
+    }
+    countMinMaxOfChildren(node);
+  }
+}
+
+FlatQuadTree::Children::Children(const FlatQuadTree& tree, size_t node) {
+  size_t first_child = FirstChild(node);
+  for (int i = 0; i < 4; ++i) {
+    BoundingBox bbox{tree.bbox_mins_[first_child + i],
+                     tree.bbox_maxes_[first_child + i]};
+    glm::vec3 center = bbox.center(), extent = bbox.extent();
+    center_x_[i] = center.x;
+    center_y_[i] = center.y;
+    center_z_[i] = center.z;
+    extent_x_[i] = extent.x;
+    extent_y_[i] = extent.y;
+    extent_z_[i] = extent.z;
+  }
+}
+
+uint32_t FlatQuadTree::Children::cull(
+    const CullBatch::PreparedFrustum& frustum) const {
+  uint32_t visible;
+  CullBatch::Cull(frustum, CullBatch::Volumes{center_x_, center_y_, center_z_,
+                                              extent_x_, extent_y_, extent_z_,
+                                              nullptr}, 4, &visible);
+  return visible;
+}
+
+void FlatQuadTree::countMinMaxOfLeaves(const HeightMapInterface& hmap,
+                                       size_t begin, size_t end) {
+  GLint size = this->size(0);
+  for (size_t node = begin; node < end; ++node) {
+    glm::dvec2 min_max_y = hmap.getMinMaxOfArea(x(node), z(node), size, size);
+    bbox_mins_[node].y = min_max_y.x;
+    bbox_maxes_[node].y = min_max_y.y;
+  }
+}
+
+}  // namespace cdlod
+}  // namespace engine
@@ -0,0 +1,140 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_CDLOD_FLAT_QUAD_TREE_H_
+#define ENGINE_CDLOD_FLAT_QUAD_TREE_H_
+
+#include <vector>
+#include "../oglwrap_config.h"
+#include "../collision/frustum.h"
+#include "../collision/bounding_box.h"
+#include "../collision/cull_batch.h"
+#include "./lod_settings.h"
+#include "../height_map_interface.h"
+
+namespace engine {
+namespace cdlod {
+
+// A complete quadtree, stored in breadth-first order in a few flat arrays,
+// instead of a separately allocated object for every node. The children of
+// the i-th node are the nodes 4i+1 ... 4i+4 (tl, tr, bl, br), so the nodes
+// of a level, and the siblings are next to each other in the memory, and the
+// traversal doesn't have to chase pointers.
+class FlatQuadTree {
+  GLubyte max_level_;  // the level of the root
+  GLubyte node_dimension_;
+
+  // The bounding boxes in structure of arrays layout. The center of a node
+  // isn't stored, it is always the center of its bounding box.
+  std::vector<glm::vec3> bbox_mins_, bbox_maxes_;
+
+  static size_t FirstChild(size_t node) { return 4*node + 1; }
+
+  // Returns the index of the first node on a given depth (the root is depth 0)
+  static size_t FirstNodeOfDepth(int depth) {
+    return ((size_t(1) << (2*depth)) - 1) / 3;
+  }
+
+  GLint size(GLubyte level) const { return node_dimension_ * (1 << level); }
+
+  // The coordinates are exact, as long as they fit into a float's mantissa
+  GLint x(size_t node) const {
+    return (bbox_mins_[node].x + bbox_maxes_[node].x) / 2;
+  }
+
+  GLint z(size_t node) const {
+    return (bbox_mins_[node].z + bbox_maxes_[node].z) / 2;
+  }
+
+  bool collidesWithSphere(size_t node, const glm::vec3& center,
+                          float radius) const {
+    return BoundingBox{bbox_mins_[node], bbox_maxes_[node]}
+             .collidesWithSphere(center, radius);
+  }
+
+  float squaredDistanceTo(size_t node, const glm::vec3& point) const {
+    return BoundingBox{bbox_mins_[node], bbox_maxes_[node]}
+             .squaredDistanceTo(point);
+  }
+
+  bool collidesWithFrustum(size_t node, const Frustum& frustum) const {
+    return BoundingBox{bbox_mins_[node], bbox_maxes_[node]}
+             .collidesWithFrustum(frustum);
+  }
+
+  bool collidesWithFrustum(size_t node, const Frustum& frustum,
+                           unsigned* plane_mask) const {
+    return BoundingBox{bbox_mins_[node], bbox_maxes_[node]}
+             .collidesWithFrustum(frustum, plane_mask);
+  }
+
+  void setNode(size_t node, GLint x, GLint z, GLint size,
+               float min_y, float max_y) {
+    bbox_mins_[node] = glm::vec3(x-size/2, min_y, z-size/2);
+    bbox_maxes_[node] = glm::vec3(x+size/2, max_y, z+size/2);
+  }
+
+  void countMinMaxOfLeaves(const HeightMapInterface& hmap,
+                           size_t begin, size_t end);
+
+  // The heights of an inner node from its childrens' bounding boxes
+  void countMinMaxOfChildren(size_t node);
+
+  void updateHeights(size_t node, int depth, const HeightMapInterface& hmap,
+                     int x0, int y0, int x1, int y1);
+
+  // The bounding boxes of the four children of a node, that are culled
+  // together with a CullBatch
+  class Children {
+    float center_x_[4], center_y_[4], center_z_[4];
+    float extent_x_[4], extent_y_[4], extent_z_[4];
+
+   public:
+    Children() = default;
+    Children(const FlatQuadTree& tree, size_t node);
+
+    // Bit i is set if the i-th child is visible
+    uint32_t cull(const CullBatch::PreparedFrustum& frustum) const;
+  };
+
+  // The node has to be visible
+  template<typename RenderList>
+  void selectNodes(size_t node, GLubyte level, const glm::vec3& cam_pos,
+                   const CullBatch::PreparedFrustum& frustum,
+                   const LodSettings& lod, RenderList& render_list) const;
+
+  friend class IncrementalSelection;
+
+ public:
+  FlatQuadTree(const HeightMapInterface& hmap, int node_dimension);
+
+  size_t node_count() const { return bbox_mins_.size(); }
+  GLubyte max_level() const { return max_level_; }
+
+  // Recomputes the heights of the bounding boxes, after the heights of the
+  // inclusive texel rectangle between (x0, y0) and (x1, y1) changed. Only
+  // the leaves over the rectangle and their ancestors are visited.
+  void updateHeights(const HeightMapInterface& hmap,
+                     int x0, int y0, int x1, int y1) {
+    updateHeights(0, 0, hmap, x0, y0, x1, y1);
+  }
+
+  // Adds the nodes that should be rendered from cam_pos to the render_list.
+  // RenderList has to provide the addToRenderList functions of QuadGridMesh.
+  // The levels are chosen by the ranges of lod.
+  template<typename RenderList>
+  void selectNodes(const glm::vec3& cam_pos, const Frustum& frustum,
+                   RenderList& render_list,
+                   const LodSettings& lod = LodSettings{}) const {
+    if (collidesWithFrustum(0, frustum)) {
+      selectNodes(0, max_level_, cam_pos, CullBatch::PreparedFrustum{frustum},
+                  lod, render_list);
+    }
+  }
+};
+
+}  // namespace cdlod
+}  // namespace engine
+
+#include "./flat_quad_tree-inl.h"
+
+#endif
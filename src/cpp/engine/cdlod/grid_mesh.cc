@@ -6,7 +6,9 @@
 namespace engine {
 namespace cdlod {
 
-GridMesh::GridMesh(GLubyte dimension) : dimension_(dimension) { }
+GridMesh::GridMesh(GLubyte dimension)
+    : render_data_attrib_(0), is_setup_render_data_(false)
+    , dimension_(dimension) { }
 
 GLushort GridMesh::indexOf(int x, int y) {
   x += dimension_/2;
@@ -54,11 +56,13 @@ void GridMesh::setupPositions(gl::VertexAttrib attrib) {
 void GridMesh::setupRenderData(gl::VertexAttrib attrib) {
 #ifdef glVertexAttribDivisor
   if (glVertexAttribDivisor) {
+    // The pointer is set up before every draw call
     gl::Bind(vao_);
-    gl::Bind(aRenderData_);
-    attrib.setup<glm::vec4>().enable();
+    attrib.enable();
     attrib.divisor(1);
     gl::Unbind(vao_);
+    render_data_attrib_ = attrib;
+    is_setup_render_data_ = true;
   }
 #endif
 }
@@ -68,34 +72,50 @@ void GridMesh::addToRenderList(const glm::vec4& render_data) {
 }
 
 void GridMesh::clearRenderList() {
-  render_data_.erase(render_data_.begin(), render_data_.end());
+  render_data_.clear();  // keeps the capacity
 }
 
 void GridMesh::render() {
+  render(render_data_);
+}
+
+void GridMesh::render(gl::UniformObject<glm::vec4> uRenderData) const {
+  render(render_data_, uRenderData);
+}
+
+void GridMesh::render(const std::vector<glm::vec4>& render_data) {
 #if defined(glDrawElementsInstanced) && defined(glVertexAttribDivisor)
-  if (glVertexAttribDivisor) {
+  if (glVertexAttribDivisor && is_setup_render_data_ &&
+      !render_data.empty()) {
     using gl::PrimType;
     using gl::IndexType;
 
+    size_t offset = aRenderData_.write(render_data);
+
     gl::Bind(vao_);
-    gl::Bind(aRenderData_);
-    aRenderData_.data(render_data_);
+    glBindBuffer(GL_ARRAY_BUFFER, aRenderData_.expose());
+    render_data_attrib_.pointer(4, gl::DataType::kFloat, false, 0,
+                                reinterpret_cast<const void*>(offset));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     gl::DrawElementsInstanced(PrimType::kTriangleStrip,
                               index_count_,
                               IndexType::kUnsignedShort,
-                              render_data_.size());   // instance count
+                              render_data.size());   // instance count
     gl::Unbind(vao_);
+
+    aRenderData_.fence();
   }
 #endif
 }
 
-void GridMesh::render(gl::UniformObject<glm::vec4> uRenderData) const {
+void GridMesh::render(const std::vector<glm::vec4>& render_data,
+                      gl::UniformObject<glm::vec4> uRenderData) const {
   using gl::PrimType;
   using gl::IndexType;
 
   gl::Bind(vao_);
-  for(auto& data : render_data_) {
+  for(auto& data : render_data) {
     uRenderData = data;
     gl::DrawElements(PrimType::kTriangleStrip,
                     index_count_,
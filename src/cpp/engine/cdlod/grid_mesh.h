@@ -4,6 +4,7 @@
 #define ENGINE_CDLOD_GRID_MESH_H_
 
 #include "../oglwrap_config.h"
+#include "../stream_buffer.h"
 #include "../../oglwrap/buffer.h"
 #include "../../oglwrap/vertex_attrib.h"
 #include "../../oglwrap/uniform.h"
@@ -29,11 +30,18 @@ struct svec2 {
 //
 // For performance reasons, GridMesh's maximum size is 255*255 (so that it can
 // use unsigned shorts instead of ints or floats), but for CDLOD, you need
-// pow2 sizes, so there 128*128 is the max
+// pow2 sizes, so there 128*128 is the max. The positions are local to an
+// instance, the world position comes from the render data, so the shorts
+// don't limit the size of the world.
 class GridMesh {
   gl::VertexArray vao_;
   gl::IndexBuffer aIndices_;
-  gl::ArrayBuffer aPositions_, aRenderData_;
+  gl::ArrayBuffer aPositions_;
+  // The render data of every instanced draw call goes into the next part of
+  // the ring, and the attribute is pointed there before the draw call.
+  StreamBuffer aRenderData_;
+  gl::VertexAttrib render_data_attrib_;
+  bool is_setup_render_data_;
   int index_count_, dimension_;
   std::vector<glm::vec4> render_data_; // xy: offset, z: scale, w: level
 
@@ -54,7 +62,20 @@ class GridMesh {
   // render with uniforms
   void render(gl::UniformObject<glm::vec4> uRenderData) const;
 
+  // The same, but with a render list, that isn't stored in the mesh
+  void render(const std::vector<glm::vec4>& render_data);
+  void render(const std::vector<glm::vec4>& render_data,
+              gl::UniformObject<glm::vec4> uRenderData) const;
+
   int dimension() const {return dimension_;}
+
+  // The number of instances in the render list
+  size_t instance_count() const { return render_data_.size(); }
+
+  // Without the degenerate triangles between the rows
+  size_t triangles_per_instance() const {
+    return 2 * dimension_ * dimension_;
+  }
 };
 
 } // namespace cdlod
@@ -0,0 +1,69 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_CDLOD_INCREMENTAL_SELECTION_INL_H_
+#define ENGINE_CDLOD_INCREMENTAL_SELECTION_INL_H_
+
+#include "./incremental_selection.h"
+
+namespace engine {
+namespace cdlod {
+
+template<typename RenderList>
+void IncrementalSelection::addToRenderList(const CutNode& cut_node,
+                                           RenderList& render_list) const {
+  GLint x = tree_.x(cut_node.node), z = tree_.z(cut_node.node);
+  float scale = 1 << cut_node.level;
+  if (!cut_node.split) {
+    render_list.addToRenderList(x, z, scale, cut_node.level);
+  } else {
+    // Render, what the childs don't
+    GLubyte c = cut_node.children;
+    render_list.addToRenderList(x, z, scale, cut_node.level,
+                                !(c & 1), !(c & 2), !(c & 4), !(c & 8));
+  }
+}
+
+template<typename RenderList>
+void IncrementalSelection::selectNodes(const glm::vec3& cam_pos,
+                                       const Frustum& frustum,
+                                       RenderList& render_list,
+                                       const LodSettings& lod) {
+  if (fallBack(cam_pos, lod)) {
+    tree_.selectNodes(cam_pos, frustum, render_list, lod);
+    return;
+  }
+  update(cam_pos, lod);
+
+  // The planes, that a node is completely inside of, are removed from the
+  // plane mask of its subtree (that ends at the given cut index), as the
+  // descendants are also inside of them.
+  struct PlaneMask {
+    size_t end;
+    unsigned planes;
+  } stack[LodSettings::kMaxLevelCount + 1];
+  int depth = 0;
+  stack[0] = PlaneMask{cut_.size(), (1 << 6) - 1};
+
+  for (size_t i = 0; i < cut_.size();) {
+    while (stack[depth].end <= i) {
+      depth--;
+    }
+    const CutNode& cut_node = cut_[i];
+    unsigned planes = stack[depth].planes;
+    if (!tree_.collidesWithFrustum(cut_node.node, frustum, &planes)) {
+      i += cut_node.size;
+      continue;
+    }
+
+    addToRenderList(cut_node, render_list);
+    if (cut_node.size > 1) {
+      stack[++depth] = PlaneMask{i + cut_node.size, planes};
+    }
+    ++i;
+  }
+}
+
+}  // namespace cdlod
+}  // namespace engine
+
+#endif
@@ -0,0 +1,195 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "./incremental_selection.h"
+
+namespace engine {
+namespace cdlod {
+
+// The distances are measured in floats, so the travelled distance is reset
+// from time to time (with a full re-evaluation), before it gets imprecise.
+static constexpr float kMaxTravelled = 1 << 14;
+
+IncrementalSelection::IncrementalSelection(const FlatQuadTree& tree)
+    : tree_(tree) { }
+
+bool IncrementalSelection::fallBack(const glm::vec3& cam_pos,
+                                    const LodSettings& lod) {
+  float step = has_last_cam_pos_ ? glm::length(cam_pos - last_cam_pos_) : 0;
+  float max_step = max_step_ < 0 ? lod.range(0) : max_step_;
+  float max_speed = max_speed_ < 0 ? lod.range(0) / 320 : max_speed_;
+
+  // A camera cut doesn't tell anything about the speed
+  speed_ = max_step < step ? 0 : speed_ + (step - speed_) * 0.25f;
+  fell_back_ = max_speed < speed_;
+  if (fell_back_) {
+    last_cam_pos_ = cam_pos;
+    has_last_cam_pos_ = true;
+    updated_node_count_ = 0;
+    cut_.clear();
+    valid_ = false;
+  }
+  return fell_back_;
+}
+
+void IncrementalSelection::update(const glm::vec3& cam_pos,
+                                  const LodSettings& lod) {
+  float step = valid_ ? glm::length(cam_pos - last_cam_pos_) : 0;
+  float max_step = max_step_ < 0 ? lod.range(0) : max_step_;
+  last_cam_pos_ = cam_pos;
+  has_last_cam_pos_ = true;
+  updated_node_count_ = 0;
+
+  if (!valid_ || max_step < step || lod.ranges() != lod_.ranges() ||
+      kMaxTravelled < travelled_ + step) {
+    lod_ = lod;
+    valid_ = true;
+    travelled_ = 0;
+    cut_.clear();
+    last_cut_.clear();
+    rebuild(0, tree_.max_level(), -1, cam_pos);
+    return;
+  }
+
+  travelled_ += step;
+  if (!refresh(0, cam_pos)) {
+    std::swap(cut_, last_cut_);
+    cut_.clear();
+    rebuild(0, tree_.max_level(), 0, cam_pos);
+    flushCopy();
+  }
+}
+
+float IncrementalSelection::decide(size_t node, GLubyte level,
+                                   const glm::vec3& cam_pos, bool* split,
+                                   GLubyte* children) const {
+  *split = false;
+  *children = 0;
+  if (level == 0) {
+    return std::numeric_limits<float>::infinity();
+  }
+
+  // The same sphere tests as in FlatQuadTree::selectNodes. The distance of
+  // the nearest one to the range tells how far the camera can travel,
+  // without changing any of them.
+  float range = lod_.range(level);
+  float slack = std::numeric_limits<float>::max();
+  auto collides = [&](size_t n) {
+    float squared_dist = tree_.squaredDistanceTo(n, cam_pos);
+    slack = std::min(slack, std::abs(std::sqrt(squared_dist) - range));
+    return squared_dist <= sqr(range);
+  };
+
+  if (collides(node)) {
+    *split = true;
+    size_t first_child = FlatQuadTree::FirstChild(node);
+    for (int i = 0; i < 4; ++i) {
+      if (collides(first_child + i)) {
+        *children |= 1 << i;
+      }
+    }
+  }
+
+  // Leave some room for the rounding errors
+  return travelled_ + std::max(0.0f, slack*0.999f - 0.01f);
+}
+
+bool IncrementalSelection::refresh(size_t index, const glm::vec3& cam_pos) {
+  CutNode& cut_node = cut_[index];
+  if (travelled_ < cut_node.expiry) {
+    return true;
+  }
+
+  if (cut_node.decisions_expiry <= travelled_) {
+    updated_node_count_++;
+    bool split;
+    GLubyte children;
+    float expiry = decide(cut_node.node, cut_node.level, cam_pos,
+                          &split, &children);
+    if (split != cut_node.split || children != cut_node.children) {
+      return false;
+    }
+    cut_node.decisions_expiry = expiry;
+  }
+
+  float expiry = cut_node.decisions_expiry;
+  for (size_t child = index + 1; child < index + cut_node.size;
+       child += cut_[child].size) {
+    if (!refresh(child, cam_pos)) {
+      return false;
+    }
+    expiry = std::min(expiry, cut_[child].expiry);
+  }
+  cut_node.expiry = expiry;
+  return true;
+}
+
+void IncrementalSelection::flushCopy() {
+  cut_.insert(cut_.end(), last_cut_.begin() + copy_begin_,
+              last_cut_.begin() + copy_end_);
+  copy_begin_ = copy_end_ = 0;
+}
+
+float IncrementalSelection::rebuild(size_t node, GLubyte level,
+                                    long last_index,
+                                    const glm::vec3& cam_pos) {
+  const CutNode* last = last_index != -1 ? &last_cut_[last_index] : nullptr;
+  if (last && travelled_ < last->expiry) {
+    // The valid subtrees are often next to each other, they are copied
+    // together
+    if (copy_end_ != last_index) {
+      flushCopy();
+      copy_begin_ = last_index;
+    }
+    copy_end_ = last_index + last->size;
+    return last->expiry;
+  }
+  flushCopy();
+
+  CutNode cut_node{GLuint(node), 1, level, false, 0, 0, 0};
+  if (last && travelled_ < last->decisions_expiry) {
+    cut_node.split = last->split;
+    cut_node.children = last->children;
+    cut_node.decisions_expiry = last->decisions_expiry;
+  } else {
+    updated_node_count_++;
+    cut_node.decisions_expiry = decide(node, level, cam_pos, &cut_node.split,
+                                       &cut_node.children);
+  }
+  size_t index = cut_.size();
+  cut_.push_back(cut_node);
+
+  float expiry = cut_node.decisions_expiry;
+  if (cut_node.split) {
+    // The children of the node in the last cut follow it in the same order
+    long last_child = -1;
+    GLubyte last_children = 0;
+    if (last && last->split) {
+      last_child = last_index + 1;
+      last_children = last->children;
+    }
+
+    size_t first_child = FlatQuadTree::FirstChild(node);
+    for (int i = 0; i < 4; ++i) {
+      bool was_in_cut = last_children & (1 << i);
+      if (cut_node.children & (1 << i)) {
+        expiry = std::min(expiry, rebuild(first_child + i, level - 1,
+                                          was_in_cut ? last_child : -1,
+                                          cam_pos));
+      }
+      if (was_in_cut) {
+        last_child += last_cut_[last_child].size;
+      }
+    }
+  }
+
+  // The subtree's end might still be waiting to be copied
+  cut_[index].size = cut_.size() + (copy_end_ - copy_begin_) - index;
+  cut_[index].expiry = expiry;
+  return expiry;
+}
+
+}  // namespace cdlod
+}  // namespace engine
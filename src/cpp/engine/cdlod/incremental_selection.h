@@ -0,0 +1,134 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_CDLOD_INCREMENTAL_SELECTION_H_
+#define ENGINE_CDLOD_INCREMENTAL_SELECTION_H_
+
+#include <vector>
+#include "./flat_quad_tree.h"
+#include "./lod_settings.h"
+
+namespace engine {
+namespace cdlod {
+
+// Selects the same nodes as FlatQuadTree::selectNodes, but reuses the
+// previous frame's work, as the camera usually moves only a little between
+// two frames.
+//
+// The LOD decisions (which nodes are split, and which of their children are
+// needed) don't depend on the frustum, only on the camera's distance to the
+// nodes. They are kept for the whole tree around the camera as a "cut": the
+// visited nodes in depth-first order, so that the subtree of every node is a
+// contiguous range. Every decision is a comparison of a distance with a
+// range, so it can't change until the camera travels farther than the
+// difference of the two. The cut nodes store the travelled distance until
+// which their decisions, and their subtrees are certainly valid, and only
+// the expired nodes are re-evaluated. Usually none of the decisions change,
+// and the cut is updated in place. If some of them do, the cut is rebuilt,
+// but the still valid subtrees are copied from the previous one.
+//
+// The frustum culling is a linear walk on the cut, that skips the subtrees
+// of the culled nodes, and doesn't test the planes, that the parent node is
+// completely inside of.
+//
+// A camera cut (a step longer than max_step), or a change of the LodSettings
+// re-evaluates every node.
+//
+// If the camera moves fast, too many decisions expire in every frame, and
+// updating the cut costs more than a full traversal (in
+// incremental_selection_benchmark, the two are about even at 0.4 units per
+// frame with the default LodSettings). Above max_speed, it falls back to
+// FlatQuadTree::selectNodes.
+class IncrementalSelection {
+ public:
+  explicit IncrementalSelection(const FlatQuadTree& tree);
+
+  const FlatQuadTree& tree() const { return tree_; }
+
+  // Steps longer than this are treated as camera cuts. If it's negative
+  // (that's the default), range(0) of the LodSettings is used.
+  float max_step() const { return max_step_; }
+  void set_max_step(float max_step) { max_step_ = max_step; }
+
+  // If the camera's speed (in units per frame, averaged over a few frames)
+  // is above this, the full traversal is used. If it's negative (that's the
+  // default), range(0) / 320 of the LodSettings is used.
+  float max_speed() const { return max_speed_; }
+  void set_max_speed(float max_speed) { max_speed_ = max_speed; }
+
+  // Forces a full re-evaluation in the next frame
+  void invalidate() { valid_ = false; }
+
+  // The number of nodes, whose decisions had to be re-evaluated in the last
+  // frame, and the number of all the nodes in the cut.
+  size_t updated_node_count() const { return updated_node_count_; }
+  size_t cut_size() const { return cut_.size(); }
+
+  // Whether the last frame fell back to the full traversal
+  bool fell_back() const { return fell_back_; }
+
+  // Adds the nodes that should be rendered from cam_pos to the render_list,
+  // just like FlatQuadTree::selectNodes, though in a different order.
+  template<typename RenderList>
+  void selectNodes(const glm::vec3& cam_pos, const Frustum& frustum,
+                   RenderList& render_list,
+                   const LodSettings& lod = LodSettings{});
+
+ private:
+  struct CutNode {
+    GLuint node;
+    GLuint size;          // the number of cut nodes in the subtree (with this)
+    GLubyte level;
+    bool split;
+    GLubyte children;     // bit i is set if the i-th child is in the cut
+    // Compared to travelled_
+    float decisions_expiry;  // of split and children
+    float expiry;            // of the whole subtree
+  };
+
+  const FlatQuadTree& tree_;
+  std::vector<CutNode> cut_, last_cut_;
+  LodSettings lod_;
+  glm::vec3 last_cam_pos_;
+  float travelled_ = 0;
+  float max_step_ = -1;
+  float max_speed_ = -1;
+  float speed_ = 0;
+  bool has_last_cam_pos_ = false;
+  bool valid_ = false;
+  bool fell_back_ = false;
+  size_t updated_node_count_ = 0;
+  // The range of last_cut_, that rebuild() still has to copy to cut_
+  long copy_begin_ = 0, copy_end_ = 0;
+
+  // Updates the camera's average speed, and decides whether this frame
+  // should use the full traversal
+  bool fallBack(const glm::vec3& cam_pos, const LodSettings& lod);
+
+  // Updates the cut for the camera position
+  void update(const glm::vec3& cam_pos, const LodSettings& lod);
+
+  // Decides whether node is split, and which of its children are needed.
+  // Returns the travelled distance until which the decisions are valid.
+  float decide(size_t node, GLubyte level, const glm::vec3& cam_pos,
+               bool* split, GLubyte* children) const;
+
+  // Updates the subtree of the index-th cut node in place. Returns false if
+  // one of its decisions has changed, so the cut has to be rebuilt.
+  bool refresh(size_t index, const glm::vec3& cam_pos);
+
+  // Appends the subtree of node to cut_. last_index is the node's index in
+  // last_cut_, or -1 if it wasn't in it. Returns the subtree's expiry.
+  float rebuild(size_t node, GLubyte level, long last_index,
+                const glm::vec3& cam_pos);
+  void flushCopy();
+
+  template<typename RenderList>
+  void addToRenderList(const CutNode& cut_node, RenderList& render_list) const;
+};
+
+}  // namespace cdlod
+}  // namespace engine
+
+#include "./incremental_selection-inl.h"
+
+#endif
@@ -0,0 +1,50 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "./lod_settings.h"
+
+namespace engine {
+namespace cdlod {
+
+constexpr int LodSettings::kMaxLevelCount;
+
+LodSettings::LodSettings() {
+  for (int level = 0; level < kMaxLevelCount; ++level) {
+    ranges_[level] = std::ldexp(128.0f, level);
+  }
+}
+
+LodSettings LodSettings::FromScreenSpaceError(float max_pixel_error,
+                                              float fovy,
+                                              int viewport_height,
+                                              int node_dimension,
+                                              float geometric_error) {
+  if (max_pixel_error <= 0 || viewport_height <= 0 || node_dimension <= 0 ||
+      geometric_error <= 0) {
+    throw std::invalid_argument("engine::cdlod::LodSettings: the error, the "
+                                "viewport height and the node dimension must "
+                                "be positive");
+  }
+  if (fovy <= 0 || M_PI <= fovy) {
+    throw std::invalid_argument("engine::cdlod::LodSettings: fovy must be "
+                                "in (0, pi) radians");
+  }
+
+  // An error of e at the distance d is e * viewport_height /
+  // (2 * d * tan(fovy/2)) pixels on the screen, this is solved for d.
+  float pixels_per_unit = viewport_height / (2 * std::tan(fovy / 2));
+  float unit_range = geometric_error * pixels_per_unit / max_pixel_error;
+
+  LodSettings settings;
+  for (int level = 0; level < kMaxLevelCount; ++level) {
+    settings.ranges_[level] = std::ldexp(std::max(unit_range,
+                                                  float(node_dimension)),
+                                         level);
+  }
+  return settings;
+}
+
+}  // namespace cdlod
+}  // namespace engine
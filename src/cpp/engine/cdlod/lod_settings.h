@@ -0,0 +1,50 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_CDLOD_LOD_SETTINGS_H_
+#define ENGINE_CDLOD_LOD_SETTINGS_H_
+
+#include <array>
+
+namespace engine {
+namespace cdlod {
+
+// The distance ranges of the LOD levels. A node of a level is used up to its
+// level's range from the camera, and closer than that, its children are used.
+// The vertices of a node morph into the next level's grid near the end of the
+// next level's range, so the CPU selection and the shader have to use the
+// same ranges (TerrainMesh uploads them as CDLODTerrain_uLodRanges).
+class LodSettings {
+ public:
+  // Has to match the size of CDLODTerrain_uLodRanges in cdlod_terrain.vert.
+  // A quadtree with 32 bit coordinates can't have more levels than this.
+  static constexpr int kMaxLevelCount = 32;
+
+  // The ranges, that were used before they became configurable:
+  // 128 * 2^level.
+  LodSettings();
+
+  // Derives the ranges from the largest allowed error on the screen (in
+  // pixels), for a camera with the given vertical field of view (in radians)
+  // and viewport height (in pixels).
+  //
+  // The error of a level in world space is estimated as the distance of its
+  // vertices (2^level texels) times geometric_error. A bumpy terrain needs a
+  // bigger geometric_error than a smooth one. A range is never smaller than
+  // the size of the nodes of its level, because a node, that is in the range
+  // of its level, has to be covered by its children.
+  static LodSettings FromScreenSpaceError(float max_pixel_error, float fovy,
+                                          int viewport_height,
+                                          int node_dimension,
+                                          float geometric_error = 1.0f);
+
+  float range(int level) const { return ranges_[level]; }
+  const std::array<float, kMaxLevelCount>& ranges() const { return ranges_; }
+
+ private:
+  std::array<float, kMaxLevelCount> ranges_;
+};
+
+}  // namespace cdlod
+}  // namespace engine
+
+#endif
@@ -0,0 +1,52 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_CDLOD_POINTER_QUAD_TREE_INL_H_
+#define ENGINE_CDLOD_POINTER_QUAD_TREE_INL_H_
+
+#include "./pointer_quad_tree.h"
+
+namespace engine {
+namespace cdlod {
+
+template<typename RenderList>
+void PointerQuadTree::Node::selectNodes(const glm::vec3& cam_pos,
+                                        const Frustum& frustum,
+                                        const LodSettings& lod,
+                                        RenderList& render_list) const {
+  float scale = 1 << level;
+  float lod_range = lod.range(level);
+
+  if (!bbox.collidesWithFrustum(frustum)) { return; }
+
+  // if we can cover the whole area or if we are a leaf
+  if (!bbox.collidesWithSphere(cam_pos, lod_range) || level == 0) {
+    render_list.addToRenderList(x, z, scale, level);
+  } else {
+    bool btl = tl->collidesWithSphere(cam_pos, lod_range);
+    bool btr = tr->collidesWithSphere(cam_pos, lod_range);
+    bool bbl = bl->collidesWithSphere(cam_pos, lod_range);
+    bool bbr = br->collidesWithSphere(cam_pos, lod_range);
+
+    // Ask childs to render what we can't
+    if (btl) {
+      tl->selectNodes(cam_pos, frustum, lod, render_list);
+    }
+    if (btr) {
+      tr->selectNodes(cam_pos, frustum, lod, render_list);
+    }
+    if (bbl) {
+      bl->selectNodes(cam_pos, frustum, lod, render_list);
+    }
+    if (bbr) {
+      br->selectNodes(cam_pos, frustum, lod, render_list);
+    }
+
+    // Render, what the childs didn't do
+    render_list.addToRenderList(x, z, scale, level, !btl, !btr, !bbl, !bbr);
+  }
+}
+
+}  // namespace cdlod
+}  // namespace engine
+
+#endif
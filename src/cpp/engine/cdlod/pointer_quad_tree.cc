@@ -0,0 +1,128 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "./pointer_quad_tree.h"
+#include "../misc.h"
+#include "../task_scheduler.h"
+
+namespace engine {
+namespace cdlod {
+
+PointerQuadTree::Node::Node(GLint x, GLint z, GLubyte level,
+                            GLubyte dimension, int parallel_levels)
+    : x(x), z(z), size(dimension * (1 << level)), level(level)
+    , tl(nullptr), tr(nullptr), bl(nullptr), br(nullptr) {
+  if (level > 0) {
+    if (parallel_levels > 0) {
+      auto& scheduler = TaskScheduler::Default();
+      int next = parallel_levels - 1;
+      std::vector<TaskScheduler::Handle> tasks;
+      tasks.push_back(scheduler.schedule([=]{
+        tl = make_unique<Node>(x-size/4, z+size/4, level-1, dimension, next);
+      }));
+      tasks.push_back(scheduler.schedule([=]{
+        tr = make_unique<Node>(x+size/4, z+size/4, level-1, dimension, next);
+      }));
+      tasks.push_back(scheduler.schedule([=]{
+        bl = make_unique<Node>(x-size/4, z-size/4, level-1, dimension, next);
+      }));
+      tasks.push_back(scheduler.schedule([=]{
+        br = make_unique<Node>(x+size/4, z-size/4, level-1, dimension, next);
+      }));
+      scheduler.wait(tasks);
+    } else {
+      tl = std::unique_ptr<Node>(new Node(x-size/4, z+size/4, level-1, dimension));
+      tr = std::unique_ptr<Node>(new Node(x+size/4, z+size/4, level-1, dimension));
+      bl = std::unique_ptr<Node>(new Node(x-size/4, z-size/4, level-1, dimension));
+      br = std::unique_ptr<Node>(new Node(x+size/4, z-size/4, level-1, dimension));
+    }
+  }
+}
+
+void PointerQuadTree::Node::countMinMaxOfArea(const HeightMapInterface& hmap,
+                                              double *min, double *max,
+                                              int parallel_levels) {
+  glm::dvec2 min_xz(x-size/2, z-size/2);
+  glm::dvec2 max_xz(x+size/2, z+size/2);
+
+  if (level == 0) {
+    glm::dvec2 min_max_y = hmap.getMinMaxOfArea(x, z, size, size);
+    *min = min_max_y.x;
+    *max = min_max_y.y;
+  } else {
+    double mins[4], maxes[4];
+    Node* children[4] = {tl.get(), tr.get(), bl.get(), br.get()};
+    if (parallel_levels > 0) {
+      auto& scheduler = TaskScheduler::Default();
+      std::vector<TaskScheduler::Handle> tasks;
+      for (int i = 0; i < 4; ++i) {
+        tasks.push_back(scheduler.schedule([&, i]{
+          children[i]->countMinMaxOfArea(hmap, &mins[i], &maxes[i],
+                                         parallel_levels - 1);
+        }));
+      }
+      scheduler.wait(tasks);
+    } else {
+      for (int i = 0; i < 4; ++i) {
+        children[i]->countMinMaxOfArea(hmap, &mins[i], &maxes[i]);
+      }
+    }
+    *min = *std::min_element(mins, mins + 4);
+    *max = *std::max_element(maxes, maxes + 4);
+  }
+
+  bbox = BoundingBox{glm::vec3(min_xz.x, *min, min_xz.y),
+                     glm::vec3(max_xz.x, *max, max_xz.y)};
+}
+
+void PointerQuadTree::Node::updateHeights(const HeightMapInterface& hmap,
+                                          int x0, int y0, int x1, int y1) {
+  if (x1 < x-size/2 || x+size/2 < x0 || y1 < z-size/2 || z+size/2 < y0) {
+    return;
+  }
+
+  double min, max;
+  if (level == 0) {
+    glm::dvec2 min_max_y = hmap.getMinMaxOfArea(x, z, size, size);
+    min = min_max_y.x;
+    max = min_max_y.y;
+  } else {
+    Node* children[4] = {tl.get(), tr.get(), bl.get(), br.get()};
+    for (int i = 0; i < 4; ++i) {
+      children[i]->updateHeights(hmap, x0, y0, x1, y1);
+    }
+    min = children[0]->bbox.mins().y;
+    max = children[0]->bbox.maxes().y;
+    for (int i = 1; i < 4; ++i) {
+      min = std::min(min, double(children[i]->bbox.mins().y));
+      max = std::max(max, double(children[i]->bbox.maxes().y));
+    }
+  }
+
+  bbox = BoundingBox{glm::vec3(x-size/2, min, z-size/2),
+                     glm::vec3(x+size/2, max, z+size/2)};
+}
+
+// Splits the top levels into tasks, until there are enough of them to keep
+// every worker busy.
+static int ParallelLevels() {
+  int parallel_levels = 1;
+  while ((1u << 2*parallel_levels) < 4*TaskScheduler::Default().worker_count()) {
+    parallel_levels++;
+  }
+  return parallel_levels;
+}
+
+PointerQuadTree::PointerQuadTree(const HeightMapInterface& hmap,
+                                 int node_dimension)
+    : root_(hmap.w()/2, hmap.h()/2,
+        std::max(log2(std::max(hmap.w(), hmap.h())) - log2(node_dimension), 0.0),
+        node_dimension, ParallelLevels()) {
+  double min, max;
+  root_.countMinMaxOfArea(hmap, &min, &max, ParallelLevels());
+}
+
+}  // namespace cdlod
+}  // namespace engine
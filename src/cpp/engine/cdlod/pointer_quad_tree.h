@@ -0,0 +1,75 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_CDLOD_POINTER_QUAD_TREE_H_
+#define ENGINE_CDLOD_POINTER_QUAD_TREE_H_
+
+#include <memory>
+#include "../oglwrap_config.h"
+#include "../collision/frustum.h"
+#include "../collision/bounding_box.h"
+#include "./lod_settings.h"
+#include "../height_map_interface.h"
+
+namespace engine {
+namespace cdlod {
+
+// The original quadtree layout, where every node is a separate allocation.
+// It is kept as a reference implementation for the FlatQuadTree.
+class PointerQuadTree {
+  struct Node {
+    GLint x, z;
+    BoundingBox bbox;
+    GLint size;
+    GLubyte level;
+    std::unique_ptr<Node> tl, tr, bl, br;
+
+    // The top parallel_levels levels of the subtree create their children
+    // as tasks, as the creation of a deep quadtree is slow.
+    Node(GLint x, GLint z, GLubyte level, GLubyte dimension,
+         int parallel_levels = 0);
+
+    bool collidesWithSphere(const glm::vec3& center, float radius) const {
+      return bbox.collidesWithSphere(center, radius);
+    }
+
+    void countMinMaxOfArea(const HeightMapInterface& hmap,
+                           double *min, double *max, int parallel_levels = 0);
+
+    void updateHeights(const HeightMapInterface& hmap,
+                       int x0, int y0, int x1, int y1);
+
+    template<typename RenderList>
+    void selectNodes(const glm::vec3& cam_pos, const Frustum& frustum,
+                     const LodSettings& lod, RenderList& render_list) const;
+  };
+
+  Node root_;
+
+ public:
+  PointerQuadTree(const HeightMapInterface& hmap, int node_dimension);
+
+  // Recomputes the heights of the bounding boxes, after the heights of the
+  // inclusive texel rectangle between (x0, y0) and (x1, y1) changed. Only
+  // the leaves over the rectangle and their ancestors are visited.
+  void updateHeights(const HeightMapInterface& hmap,
+                     int x0, int y0, int x1, int y1) {
+    root_.updateHeights(hmap, x0, y0, x1, y1);
+  }
+
+  // Adds the nodes that should be rendered from cam_pos to the render_list.
+  // RenderList has to provide the addToRenderList functions of QuadGridMesh.
+  // The levels are chosen by the ranges of lod.
+  template<typename RenderList>
+  void selectNodes(const glm::vec3& cam_pos, const Frustum& frustum,
+                   RenderList& render_list,
+                   const LodSettings& lod = LodSettings{}) const {
+    root_.selectNodes(cam_pos, frustum, lod, render_list);
+  }
+};
+
+}  // namespace cdlod
+}  // namespace engine
+
+#include "./pointer_quad_tree-inl.h"
+
+#endif
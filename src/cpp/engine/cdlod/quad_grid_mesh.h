@@ -3,20 +3,79 @@
 #ifndef ENGINE_CDLOD_QUAD_GRID_MESH_H_
 #define ENGINE_CDLOD_QUAD_GRID_MESH_H_
 
+#include <vector>
 #include "grid_mesh.h"
 
 namespace engine {
 
 namespace cdlod {
 
-// Makes up four, separately renderable GridMeshes.
+// The render data of the subquads of the selected nodes, for a QuadGridMesh.
+//
+// The nodes are added with 32 bit world coordinates, but the render data
+// contains them relative to an origin (set near the camera), so the offsets
+// stay small, and precise as floats, anywhere in a big world.
+class QuadRenderList {
+  std::vector<glm::vec4> render_data_; // xy: offset, z: scale, w: level
+  int dimension_;
+  glm::ivec2 origin_;
+  glm::vec3 lod_origin_;
+
+ public:
+  // The dimension of the 4 subquads together, like at QuadGridMesh
+  explicit QuadRenderList(int dimension) : dimension_(dimension) {}
+
+  // The point in world space, that the render data is relative to
+  glm::ivec2 origin() const { return origin_; }
+  void set_origin(glm::ivec2 origin) { origin_ = origin; }
+
+  // The world space position, that the nodes were selected from. The shader
+  // morphs the vertices by the distance from this.
+  glm::vec3 lod_origin() const { return lod_origin_; }
+  void set_lod_origin(const glm::vec3& lod_origin) { lod_origin_ = lod_origin; }
+
+  // Adds a subquad to the render list.
+  // tl = top left, br = bottom right
+  void addToRenderList(GLint x, GLint z, float scale, float level,
+                       bool tl, bool tr, bool bl, bool br) {
+    // Subtract in integers, so the big coordinates aren't rounded
+    glm::vec4 render_data(x - origin_.x, z - origin_.y, scale, level);
+    float dim4 = scale * dimension_/4; // our dimension / 4
+    if(tl) { render_data_.push_back(render_data + glm::vec4(-dim4, dim4, 0, 0)); }
+    if(tr) { render_data_.push_back(render_data + glm::vec4(dim4, dim4, 0, 0)); }
+    if(bl) { render_data_.push_back(render_data + glm::vec4(-dim4, -dim4, 0, 0)); }
+    if(br) { render_data_.push_back(render_data + glm::vec4(dim4, -dim4, 0, 0)); }
+  }
+
+  // Adds all four subquads
+  void addToRenderList(GLint x, GLint z, float scale, float level) {
+    addToRenderList(x, z, scale, level, true, true, true, true);
+  }
+
+  void clear() {
+    render_data_.clear();
+  }
+
+  const std::vector<glm::vec4>& render_data() const {
+    return render_data_;
+  }
+
+  // Counts the subquads, not the nodes
+  size_t instance_count() const {
+    return render_data_.size();
+  }
+};
+
+// Makes up four, separately renderable GridMeshes, and the render list of
+// the selected subquads.
 class QuadGridMesh {
   GridMesh mesh_;
+  QuadRenderList render_list_;
 
  public:
   // Specify the size of the 4 subquads together, not the size of one subquad
   // It should be between 2 and 256, and should be a power of 2
-  QuadGridMesh(int dimension) : mesh_(dimension/2) {
+  QuadGridMesh(int dimension) : mesh_(dimension/2), render_list_(dimension) {
     assert(2 <= dimension && dimension <= 256);
   }
 
@@ -29,35 +88,55 @@ class QuadGridMesh {
     mesh_.setupRenderData(attrib);
   }
 
+  QuadRenderList& render_list() { return render_list_; }
+  const QuadRenderList& render_list() const { return render_list_; }
+
+  // The point in world space, that the render data is relative to
+  glm::ivec2 origin() const { return render_list_.origin(); }
+  void set_origin(glm::ivec2 origin) { render_list_.set_origin(origin); }
+
   // Adds a subquad to the render list.
   // tl = top left, br = bottom right
-  void addToRenderList(float offset_x, float offset_y, float scale, float level,
+  void addToRenderList(GLint x, GLint z, float scale, float level,
                        bool tl, bool tr, bool bl, bool br) {
-    glm::vec4 render_data(offset_x, offset_y, scale, level);
-    float dim4 = scale * mesh_.dimension()/2; // our dimension / 4
-    if(tl) { mesh_.addToRenderList(render_data + glm::vec4(-dim4, dim4, 0, 0)); }
-    if(tr) { mesh_.addToRenderList(render_data + glm::vec4(dim4, dim4, 0, 0)); }
-    if(bl) { mesh_.addToRenderList(render_data + glm::vec4(-dim4, -dim4, 0, 0)); }
-    if(br) { mesh_.addToRenderList(render_data + glm::vec4(dim4, -dim4, 0, 0)); }
+    render_list_.addToRenderList(x, z, scale, level, tl, tr, bl, br);
   }
 
   // Adds all four subquads
-  void addToRenderList(float offset_x, float offset_y, float scale, float level) {
-    addToRenderList(offset_x, offset_y, scale, level, true, true, true, true);
+  void addToRenderList(GLint x, GLint z, float scale, float level) {
+    render_list_.addToRenderList(x, z, scale, level);
   }
 
   void clearRenderList() {
-    mesh_.clearRenderList();
+    render_list_.clear();
+  }
+
+  // Counts the subquads, not the nodes
+  size_t instance_count() const {
+    return render_list_.instance_count();
+  }
+
+  size_t triangles_per_instance() const {
+    return mesh_.triangles_per_instance();
   }
 
   // render with vertex attrib divisor
   void render() {
-    mesh_.render();
+    render(render_list_);
+  }
+
+  void render(const QuadRenderList& render_list) {
+    mesh_.render(render_list.render_data());
   }
 
   // render with uniforms
   void render(gl::UniformObject<glm::vec4> uRenderData) const {
-    mesh_.render(uRenderData);
+    render(render_list_, uRenderData);
+  }
+
+  void render(const QuadRenderList& render_list,
+              gl::UniformObject<glm::vec4> uRenderData) const {
+    mesh_.render(render_list.render_data(), uRenderData);
   }
 };
 
@@ -3,65 +3,174 @@
 #ifndef ENGINE_CDLOD_QUAD_TREE_H_
 #define ENGINE_CDLOD_QUAD_TREE_H_
 
+#include <cmath>
 #include <memory>
+#include <vector>
+#include <stdexcept>
 #include "./quad_grid_mesh.h"
+#include "./flat_quad_tree.h"
+#include "./pointer_quad_tree.h"
+#include "./tile_cache.h"
+#include "./lod_settings.h"
+#include "./incremental_selection.h"
 #include "../camera.h"
-#include "../collision/bounding_box.h"
+#include "../misc.h"
 #include "../height_map_interface.h"
 
 namespace engine {
 namespace cdlod {
 
 class QuadTree {
-  QuadGridMesh mesh_;
-  GLubyte node_dimension_;
-
-  struct Node {
-    GLshort x, z;
-    BoundingBox bbox;
-    GLushort size;
-    GLubyte level;
-    std::unique_ptr<Node> tl, tr, bl, br;
-
-    Node(GLshort x, GLshort z, GLubyte level, GLubyte dimension, bool root = false);
+ public:
+  // What the last selection sent to the GPU
+  struct Stats {
+    size_t instances;  // the drawn subquads
+    size_t triangles;
+  };
 
-    // Helper to create the quadtree in four threads
-    static void Init(GLshort x, GLshort z, GLubyte level,
-                     GLubyte dimension, std::unique_ptr<Node>* node);
+  // How the nodes of the tree are stored in the memory
+  enum class Layout {
+    kPointer,  // a separate allocation for every node
+    kFlat      // breadth-first order in flat arrays (see FlatQuadTree)
+  };
 
-    bool collidesWithSphere(const glm::vec3& center, float radius) {
-      return bbox.collidesWithSphere(center, radius);
+ private:
+  QuadGridMesh mesh_;
+  GLubyte node_dimension_;
+  Layout layout_;
+
+  // Only the one that matches layout_ is created
+  std::unique_ptr<PointerQuadTree> pointer_tree_;
+  std::unique_ptr<FlatQuadTree> flat_tree_;
+
+  TileCache* tile_cache_ = nullptr;
+  LodSettings lod_settings_;
+  std::unique_ptr<IncrementalSelection> incremental_selection_;
+
+  // Forwards the selected nodes to a render list, and requests their tiles
+  template<typename RenderList>
+  struct StreamingRenderList {
+    RenderList& list;
+    TileCache& tile_cache;
+    int node_dimension;
+
+    void addToRenderList(GLint x, GLint z, float scale, float level) {
+      list.addToRenderList(x, z, scale, level);
+      tile_cache.request(x, z, scale * node_dimension, level);
     }
 
-    void countMinMaxOfArea(const HeightMapInterface& hmap,
-                           double *min, double *max, bool root = false);
-
-    // Helper to run countMinMaxOfArea in thread
-    static void CountMinMaxOfArea(Node* node, const HeightMapInterface& hmap,
-                                  double *min, double *max) {
-      node->countMinMaxOfArea(hmap, min, max);
+    void addToRenderList(GLint x, GLint z, float scale, float level,
+                         bool tl, bool tr, bool bl, bool br) {
+      list.addToRenderList(x, z, scale, level, tl, tr, bl, br);
+      if (tl || tr || bl || br) {
+        tile_cache.request(x, z, scale * node_dimension, level);
+      }
     }
-
-    void selectNodes(const glm::vec3& cam_pos, const Frustum& frustum,
-                     QuadGridMesh& grid_mesh, int node_dimension);
   };
 
-  Node root_;
+  template<typename RenderList>
+  void selectNodes(const engine::Camera& cam, RenderList& render_list) {
+    if (incremental_selection_) {
+      incremental_selection_->selectNodes(cam.transform()->pos(),
+                                          cam.frustum(), render_list,
+                                          lod_settings_);
+    } else if (layout_ == Layout::kFlat) {
+      flat_tree_->selectNodes(cam.transform()->pos(), cam.frustum(),
+                              render_list, lod_settings_);
+    } else {
+      pointer_tree_->selectNodes(cam.transform()->pos(), cam.frustum(),
+                                 render_list, lod_settings_);
+    }
+  }
 
  public:
-  QuadTree(const HeightMapInterface& hmap, int node_dimension = 128)
+  QuadTree(const HeightMapInterface& hmap, int node_dimension = 128,
+           Layout layout = Layout::kFlat)
       : mesh_(node_dimension), node_dimension_(node_dimension)
-      , root_(hmap.w()/2, hmap.h()/2,
-        std::max(log2(std::max(hmap.w(), hmap.h())) - log2(node_dimension), 0.0),
-        node_dimension, true) {
-    double min, max;
-    root_.countMinMaxOfArea(hmap, &min, &max, true);
+      , layout_(layout) {
+    if (layout == Layout::kFlat) {
+      flat_tree_ = make_unique<FlatQuadTree>(hmap, node_dimension);
+    } else {
+      pointer_tree_ = make_unique<PointerQuadTree>(hmap, node_dimension);
+    }
   }
 
   GLubyte node_dimension() const {
     return node_dimension_;
   }
 
+  Layout layout() const {
+    return layout_;
+  }
+
+  // The render data is relative to this point, which is the camera's
+  // position, snapped to the grid of the smallest nodes.
+  glm::ivec2 origin(const engine::Camera& cam) const {
+    return origin(cam.transform()->pos());
+  }
+
+  glm::ivec2 origin(const glm::vec3& pos) const {
+    return glm::ivec2(std::floor(pos.x / node_dimension_),
+                      std::floor(pos.z / node_dimension_)) * int(node_dimension_);
+  }
+
+  // The shader has to use the same ranges for the morphing
+  const LodSettings& lod_settings() const { return lod_settings_; }
+  void set_lod_settings(const LodSettings& lod_settings) {
+    lod_settings_ = lod_settings;
+  }
+
+  Stats stats() const {
+    size_t instances = mesh_.instance_count();
+    return Stats{instances, instances * mesh_.triangles_per_instance()};
+  }
+
+  // The incremental selection reuses the previous frame's selection, which
+  // is faster, if the camera moves slowly (see IncrementalSelection). It
+  // requires the flat layout.
+  bool incremental_selection() const {
+    return incremental_selection_ != nullptr;
+  }
+
+  void set_incremental_selection(bool enabled) {
+    if (!enabled) {
+      incremental_selection_.reset();
+    } else if (!incremental_selection_) {
+      if (layout_ != Layout::kFlat) {
+        throw std::logic_error("engine::cdlod::QuadTree: the incremental "
+                               "selection requires the flat layout");
+      }
+      incremental_selection_ = make_unique<IncrementalSelection>(*flat_tree_);
+    }
+  }
+
+  // Should be called on camera cuts, so that the incremental selection
+  // doesn't try to reuse the previous frame. Big jumps are detected anyway.
+  void invalidateSelection() {
+    if (incremental_selection_) {
+      incremental_selection_->invalidate();
+    }
+  }
+
+  // Recomputes the bounding boxes over the inclusive texel rectangle between
+  // (x0, y0) and (x1, y1), after the heights there changed. It costs
+  // O(area + depth), and the next selection re-evaluates every node.
+  void updateHeights(const HeightMapInterface& hmap,
+                     int x0, int y0, int x1, int y1) {
+    if (layout_ == Layout::kFlat) {
+      flat_tree_->updateHeights(hmap, x0, y0, x1, y1);
+    } else {
+      pointer_tree_->updateHeights(hmap, x0, y0, x1, y1);
+    }
+    invalidateSelection();
+  }
+
+  // The selected nodes will request their tiles from the cache (the cache
+  // isn't owned). nullptr turns the streaming off.
+  void set_tile_cache(TileCache* tile_cache) {
+    tile_cache_ = tile_cache;
+  }
+
   void setupPositions(gl::VertexAttrib attrib) {
     mesh_.setupPositions(attrib);
   }
@@ -71,22 +180,47 @@ class QuadTree {
     mesh_.setupRenderData(attrib);
   }
 
+  // Selects the nodes for the camera into render_list()
+  void selectNodes(const engine::Camera& cam) {
+    QuadRenderList& render_list = mesh_.render_list();
+    render_list.clear();
+    render_list.set_origin(origin(cam));
+    render_list.set_lod_origin(cam.transform()->pos());
+    if (tile_cache_) {
+      StreamingRenderList<QuadRenderList> streaming{render_list, *tile_cache_,
+                                                    node_dimension_};
+      selectNodes(cam, streaming);
+    } else {
+      selectNodes(cam, render_list);
+    }
+  }
+
+  // The result of selectNodes(cam)
+  const QuadRenderList& render_list() const {
+    return mesh_.render_list();
+  }
+
   // render with vertex attrib divisor
   void render(const engine::Camera& cam) {
-    mesh_.clearRenderList();
-    root_.selectNodes(cam.transform()->pos(), cam.frustum(),
-                      mesh_, node_dimension_);
+    selectNodes(cam);
     mesh_.render();
   }
 
+  void render(const QuadRenderList& render_list) {
+    mesh_.render(render_list);
+  }
+
   // render with uniforms
   void render(const engine::Camera& cam,
               const gl::UniformObject<glm::vec4>& uRenderData) {
-    mesh_.clearRenderList();
-    root_.selectNodes(cam.transform()->pos(), cam.frustum(),
-                      mesh_, node_dimension_);
+    selectNodes(cam);
     mesh_.render(uRenderData);
   }
+
+  void render(const QuadRenderList& render_list,
+              const gl::UniformObject<glm::vec4>& uRenderData) {
+    mesh_.render(render_list, uRenderData);
+  }
 };
 
 }  // namespace cdlod
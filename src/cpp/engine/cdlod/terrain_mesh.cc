@@ -1,15 +1,27 @@
 // Copyright (c) 2014, Tamas Csala
 
+#include <algorithm>
 #include "./terrain_mesh.h"
+#include "../tiled_height_map.h"
 #include "../../oglwrap/smart_enums.h"
 
 namespace engine {
 namespace cdlod {
 
 TerrainMesh::TerrainMesh(engine::ShaderManager* manager,
-                         const HeightMapInterface& height_map)
+                         HeightMapInterface& height_map)
     : mesh_(height_map), height_map_(height_map) {
+  auto tiled_height_map = dynamic_cast<const TiledHeightMap*>(&height_map);
+  if (tiled_height_map) {
+    tile_cache_ = engine::make_unique<TileCache>(*tiled_height_map);
+    mesh_.set_tile_cache(tile_cache_.get());
+  } else {
+    normal_map_ = engine::make_unique<NormalMap>(height_map);
+  }
+
   gl::ShaderSource vs_src{"engine/cdlod_terrain.vert"};
+  vs_src.insertMacroValue("CDLODTerrain_STREAMING", tile_cache_ ? 1 : 0);
+  vs_src.insertMacroValue("CDLODTerrain_NORMAL_MAP", normal_map_ ? 1 : 0);
 
   #ifdef glVertexAttribDivisor
     if (glVertexAttribDivisor)
@@ -21,7 +33,15 @@ TerrainMesh::TerrainMesh(engine::ShaderManager* manager,
   manager->publish("engine/cdlod_terrain.vert", vs_src);
 }
 
-void TerrainMesh::setup(const gl::Program& program, int tex_unit) {
+TerrainMesh::~TerrainMesh() {
+  if (tiles_tex_) {
+    glDeleteTextures(1, &tiles_tex_);
+    glDeleteTextures(1, &page_table_tex_);
+  }
+}
+
+void TerrainMesh::setup(const gl::Program& program, int tex_unit,
+                        int page_table_tex_unit, int normal_map_tex_unit) {
   gl::Use(program);
 
   mesh_.setupPositions(program | "CDLODTerrain_aPosition");
@@ -38,17 +58,161 @@ void TerrainMesh::setup(const gl::Program& program, int tex_unit) {
 
   uCamPos_ = engine::make_unique<gl::LazyUniform<glm::vec3>>(
       program, "CDLODTerrain_uCamPos");
+  uOrigin_ = engine::make_unique<gl::LazyUniform<glm::vec2>>(
+      program, "CDLODTerrain_uOrigin");
+  uLodRanges_ = engine::make_unique<gl::LazyUniform<float>>(
+      program, "CDLODTerrain_uLodRanges");
 
   tex_unit_ = tex_unit;
-  gl::UniformSampler(program, "CDLODTerrain_uHeightMap") = tex_unit;
   gl::Uniform<glm::vec2>(program, "CDLODTerrain_uTexSize") =
       glm::vec2(height_map_.w(), height_map_.h());
+  gl::Uniform<float>(program, "CDLODTerrain_uHeightScale") =
+      height_map_.height_scale();
+  gl::Uniform<float>(program, "CDLODTerrain_uHeightOffset") =
+      height_map_.height_offset();
 
+  if (tile_cache_) {
+    setupStreaming(program, page_table_tex_unit);
+    return;
+  }
+
+  if (normal_map_tex_unit == -1) {
+    throw std::invalid_argument("engine::cdlod::TerrainMesh: a heightmap, "
+                                "that isn't streamed requires a "
+                                "normal_map_tex_unit");
+  }
+  normal_map_tex_unit_ = normal_map_tex_unit;
+
+  gl::UniformSampler(program, "CDLODTerrain_uHeightMap") = tex_unit;
   gl::BindToTexUnit(height_map_tex_, tex_unit);
   height_map_.upload(height_map_tex_);
   height_map_tex_.minFilter(gl::kLinear);
   height_map_tex_.magFilter(gl::kLinear);
   gl::Unbind(height_map_tex_);
+
+  gl::UniformSampler(program, "CDLODTerrain_uNormalMap") = normal_map_tex_unit;
+  gl::BindToTexUnit(normal_map_tex_, normal_map_tex_unit);
+  normal_map_->upload(normal_map_tex_);
+  normal_map_tex_.minFilter(gl::kLinear);
+  normal_map_tex_.magFilter(gl::kLinear);
+  normal_map_tex_.wrapS(gl::kClampToEdge);
+  normal_map_tex_.wrapT(gl::kClampToEdge);
+  gl::Unbind(normal_map_tex_);
+}
+
+void TerrainMesh::updateNormals(int x0, int y0, int x1, int y1) {
+  if (!normal_map_) {
+    return;
+  }
+  glm::ivec4 rect = normal_map_->update(x0, y0, x1, y1);
+  if (normal_map_tex_unit_ != -1) {
+    gl::BindToTexUnit(normal_map_tex_, normal_map_tex_unit_);
+    normal_map_->upload(normal_map_tex_, rect);
+    gl::UnbindFromTexUnit(normal_map_tex_, normal_map_tex_unit_);
+  }
+}
+
+void TerrainMesh::setupStreaming(const gl::Program& program,
+                                 int page_table_tex_unit) {
+  if (page_table_tex_unit == -1) {
+    throw std::invalid_argument("engine::cdlod::TerrainMesh: a streamed "
+                                "heightmap requires a page_table_tex_unit");
+  }
+  page_table_tex_unit_ = page_table_tex_unit;
+
+  const TiledHeightMap& hmap = tile_cache_->height_map();
+  gl::UniformSampler(program, "CDLODTerrain_uHeightTiles") = tex_unit_;
+  gl::UniformSampler(program, "CDLODTerrain_uPageTable") = page_table_tex_unit;
+  gl::Uniform<int>(program, "CDLODTerrain_uTileSize") = hmap.tile_size();
+
+  int tile_dim = hmap.tile_size() + 1;
+  glGenTextures(1, &tiles_tex_);
+  glActiveTexture(GL_TEXTURE0 + tex_unit_);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, tiles_tex_);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, tile_dim, tile_dim,
+               tile_cache_->slot_count(), 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  glGenTextures(1, &page_table_tex_);
+  glActiveTexture(GL_TEXTURE0 + page_table_tex_unit);
+  glBindTexture(GL_TEXTURE_2D, page_table_tex_);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16UI, tile_cache_->page_table_w(),
+               tile_cache_->page_table_h(), 0, GL_RG_INTEGER,
+               GL_UNSIGNED_SHORT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  // Load the coarsest level, so the first frame already has a heightmap
+  updateStreaming();
+}
+
+void TerrainMesh::updateStreaming() {
+  // The tiles have an odd size
+  GLint unpack_alignment;
+  glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpack_alignment);
+  gl::PixelStore(gl::kUnpackAlignment, 1);
+
+  int tile_dim = tile_cache_->height_map().tile_size() + 1;
+  glBindTexture(GL_TEXTURE_2D_ARRAY, tiles_tex_);
+  bool page_table_changed = tile_cache_->update(
+      [tile_dim](int slot, const GLubyte* texels) {
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, slot, tile_dim, tile_dim, 1,
+                    GL_RED, GL_UNSIGNED_BYTE, texels);
+  });
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  if (page_table_changed) {
+    glBindTexture(GL_TEXTURE_2D, page_table_tex_);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tile_cache_->page_table_w(),
+                    tile_cache_->page_table_h(), GL_RG_INTEGER,
+                    GL_UNSIGNED_SHORT, tile_cache_->page_table().data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
+
+  gl::PixelStore(gl::kUnpackAlignment, unpack_alignment);
+}
+
+void TerrainMesh::modifyRegion(
+    const glm::ivec4& rect, const HeightMapInterface::HeightModifier& modify) {
+  if (tile_cache_) {
+    throw std::logic_error("engine::cdlod::TerrainMesh: a streamed heightmap "
+                           "can't be modified");
+  }
+
+  int x0 = std::max(rect.x, 0), y0 = std::max(rect.y, 0);
+  int x1 = std::min(rect.z, height_map_.w() - 1);
+  int y1 = std::min(rect.w, height_map_.h() - 1);
+  if (x1 < x0 || y1 < y0) {
+    return;
+  }
+
+  height_map_.modifyHeights(x0, y0, x1, y1, modify);
+  mesh_.updateHeights(height_map_, x0, y0, x1, y1);
+
+  // Before setup() there is no texture yet, it will upload the new heights
+  if (uCamPos_) {
+    gl::BindToTexUnit(height_map_tex_, tex_unit_);
+    height_map_.uploadRect(height_map_tex_, x0, y0, x1, y1);
+    gl::UnbindFromTexUnit(height_map_tex_, tex_unit_);
+  }
+  updateNormals(x0, y0, x1, y1);
+}
+
+void TerrainMesh::set_lod_settings(const LodSettings& lod_settings) {
+  mesh_.set_lod_settings(lod_settings);
+  lod_ranges_changed_ = true;
+}
+
+glm::mat4 TerrainMesh::rebasedCameraMatrix(const Camera& cam) const {
+  const Transform* t = cam.transform();
+  glm::ivec2 origin = this->origin(cam);
+  glm::vec3 pos = t->pos() - glm::vec3(origin.x, 0, origin.y);
+  return glm::lookAt(pos, pos + t->forward(), t->up());
 }
 
 void TerrainMesh::render(const Camera& cam) {
@@ -57,21 +221,55 @@ void TerrainMesh::render(const Camera& cam) {
                            "before the use of the render() function.");
   }
 
-  gl::BindToTexUnit(height_map_tex_, tex_unit_);
+  if (tile_cache_) {
+    // Uses the requests of the previous frame, the selection below makes
+    // the requests for the next one.
+    updateStreaming();
+  }
+  mesh_.selectNodes(cam);
+  draw(mesh_.render_list());
+}
+
+void TerrainMesh::draw(const QuadRenderList& render_list) {
+  if (tile_cache_) {
+    glActiveTexture(GL_TEXTURE0 + tex_unit_);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, tiles_tex_);
+    glActiveTexture(GL_TEXTURE0 + page_table_tex_unit_);
+    glBindTexture(GL_TEXTURE_2D, page_table_tex_);
+  } else {
+    gl::BindToTexUnit(height_map_tex_, tex_unit_);
+    gl::BindToTexUnit(normal_map_tex_, normal_map_tex_unit_);
+  }
 
-  uCamPos_->set(cam.transform()->pos());
+  glm::ivec2 origin = render_list.origin();
+  uOrigin_->set(glm::vec2(origin));
+  uCamPos_->set(render_list.lod_origin() - glm::vec3(origin.x, 0, origin.y));
+  if (lod_ranges_changed_) {
+    const auto& ranges = mesh_.lod_settings().ranges();
+    for (size_t i = 0; i < ranges.size(); ++i) {
+      (*uLodRanges_)[i] = ranges[i];
+    }
+    lod_ranges_changed_ = false;
+  }
 
   gl::FrontFace(gl::kCcw);
   gl::TemporaryEnable cullface{gl::kCullFace};
 
   #ifdef glVertexAttribDivisor
     if (glVertexAttribDivisor)
-      mesh_.render(cam);
+      mesh_.render(render_list);
     else
   #endif
-    mesh_.render(cam, *uRenderData_);
+    mesh_.render(render_list, *uRenderData_);
 
-  gl::UnbindFromTexUnit(height_map_tex_, tex_unit_);
+  if (tile_cache_) {
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0 + tex_unit_);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  } else {
+    gl::UnbindFromTexUnit(normal_map_tex_, normal_map_tex_unit_);
+    gl::UnbindFromTexUnit(height_map_tex_, tex_unit_);
+  }
 }
 
 }  // namespace cdlod
@@ -10,28 +10,105 @@
 #include "../../oglwrap/context.h"
 #include "../../oglwrap/textures/texture_2D.h"
 
+#include <vector>
+
 #include "./quad_tree.h"
+#include "./tile_cache.h"
+#include "../normal_map.h"
 #include "../shader_manager.h"
 
 namespace engine {
 
 namespace cdlod {
 
+// If the heightmap is a TiledHeightMap, it is streamed through a TileCache,
+// instead of being uploaded as a single texture. Otherwise the normals are
+// precomputed into a NormalMap, that is uploaded next to the heightmap (the
+// streamed terrain computes them from the heights in the shader).
 class TerrainMesh {
  public:
+  // The heightmap is only modified through modifyRegion
   explicit TerrainMesh(engine::ShaderManager* manager,
-                       const HeightMapInterface& height_map);
-  void setup(const gl::Program& program, int tex_unit);
+                       HeightMapInterface& height_map);
+  ~TerrainMesh();
+
+  // The page_table_tex_unit is only used (and required) for streaming, the
+  // normal_map_tex_unit is only used (and required) without it.
+  void setup(const gl::Program& program, int tex_unit,
+             int page_table_tex_unit = -1, int normal_map_tex_unit = -1);
   void render(const Camera& cam);
   const HeightMapInterface& height_map() { return height_map_; }
 
+  // The render data, and CDLODTerrain_relativePos() in the shader are
+  // relative to this point (in the xz plane), so they stay precise far from
+  // the world's origin.
+  glm::ivec2 origin(const Camera& cam) const { return mesh_.origin(cam); }
+
+  // The camera matrix, that transforms the positions relative to the origin.
+  // It is built from the camera's relative position, so it doesn't have the
+  // rounding errors of the big world space translations.
+  glm::mat4 rebasedCameraMatrix(const Camera& cam) const;
+
+  // The ranges of the levels, for both the selection and the morphing in
+  // the shader (see LodSettings::FromScreenSpaceError)
+  const LodSettings& lod_settings() const { return mesh_.lod_settings(); }
+  void set_lod_settings(const LodSettings& lod_settings);
+
+  // See QuadTree::set_incremental_selection
+  void set_incremental_selection(bool enabled) {
+    mesh_.set_incremental_selection(enabled);
+  }
+  void invalidateSelection() { mesh_.invalidateSelection(); }
+
+  // What the last render(cam) drew
+  QuadTree::Stats stats() const { return mesh_.stats(); }
+
+  // nullptr if the heightmap isn't streamed
+  const TileCache* tile_cache() const { return tile_cache_.get(); }
+
+  // The normals, that the terrain is lit with, nullptr if the heightmap is
+  // streamed
+  const NormalMap* normal_map() const { return normal_map_.get(); }
+
+  // Recomputes and re-uploads the normals after the heights of the inclusive
+  // texel rectangle between (x0, y0) and (x1, y1) changed
+  void updateNormals(int x0, int y0, int x1, int y1);
+
+  // Edits the terrain (like for craters or editor brushes): modify is called
+  // for every texel of the inclusive texel rectangle {x0, y0, x1, y1}, and
+  // returns its new height (see HeightMapInterface::modifyHeights). Only the
+  // bounding boxes of the quadtree nodes over the rectangle and their
+  // ancestors are recomputed, and only the rectangle of the textures is
+  // re-uploaded, so it costs O(area + depth). The streamed heightmaps are
+  // read-only, it throws std::logic_error for them.
+  void modifyRegion(const glm::ivec4& rect,
+                    const HeightMapInterface::HeightModifier& modify);
+
  private:
   QuadTree mesh_;
   gl::Texture2D height_map_tex_;
   std::unique_ptr<gl::LazyUniform<glm::vec4>> uRenderData_;
   std::unique_ptr<gl::LazyUniform<glm::vec3>> uCamPos_;
-  const HeightMapInterface& height_map_;
+  std::unique_ptr<gl::LazyUniform<glm::vec2>> uOrigin_;
+  std::unique_ptr<gl::LazyUniform<float>> uLodRanges_;
+  bool lod_ranges_changed_ = true;
+  HeightMapInterface& height_map_;
   int tex_unit_;
+
+  std::unique_ptr<NormalMap> normal_map_;
+  gl::Texture2D normal_map_tex_;
+  int normal_map_tex_unit_ = -1;
+
+  // Streaming: the tiles are the layers of a texture array, and the page
+  // table is an RG16UI texture. oglwrap doesn't wrap texture arrays and
+  // integer textures, so they are raw texture names.
+  std::unique_ptr<TileCache> tile_cache_;
+  GLuint tiles_tex_ = 0, page_table_tex_ = 0;
+  int page_table_tex_unit_ = -1;
+
+  void setupStreaming(const gl::Program& program, int page_table_tex_unit);
+  void updateStreaming();
+  void draw(const QuadRenderList& render_list);
 };
 
 }  // namespace cdlod
@@ -0,0 +1,210 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "./tile_cache.h"
+
+namespace engine {
+namespace cdlod {
+
+constexpr size_t TileCache::kNoTile;
+
+TileCache::TileCache(const TiledHeightMap& hmap, int slot_count,
+                     int max_uploads_per_frame)
+    : hmap_(hmap), max_uploads_per_frame_(max_uploads_per_frame)
+    , tile_of_slot_(slot_count, kNoTile)
+    , page_table_(2 * hmap.tiles_x(0) * hmap.tiles_y(0)) {
+  if (slot_count < 1 || 0xFFFF < slot_count) {
+    throw std::invalid_argument("TileCache: slot_count must be in [1, 65535]");
+  }
+
+  size_t tile_count = 0;
+  for (int level = 0; level < hmap.level_count(); ++level) {
+    level_offsets_.push_back(tile_count);
+    tile_count += size_t(hmap.tiles_x(level)) * hmap.tiles_y(level);
+  }
+  states_.resize(tile_count, State::kAbsent);
+  slots_.resize(tile_count, -1);
+  last_requested_.resize(tile_count, 0);
+  fallbacks_.resize(tile_count, 0);
+
+  root_tile_ = tileIndex(hmap.level_count() - 1, 0, 0);
+  startDecode(root_tile_);
+}
+
+TileCache::~TileCache() {
+  // The tasks read the heightmap, they can't outlive it
+  for (const Decode& decode : decodes_) {
+    try {
+      TaskScheduler::Default().wait(decode.handle);
+    } catch (...) {}
+  }
+}
+
+size_t TileCache::resident_count() const {
+  return std::count_if(tile_of_slot_.begin(), tile_of_slot_.end(),
+                       [](size_t tile) { return tile != kNoTile; });
+}
+
+int TileCache::levelOf(size_t tile) const {
+  return std::upper_bound(level_offsets_.begin(), level_offsets_.end(), tile)
+         - level_offsets_.begin() - 1;
+}
+
+void TileCache::request(float x, float z, float size, int level) {
+  level = std::max(0, std::min(level, hmap_.level_count() - 1));
+  float tile_extent = hmap_.tile_size() << level;
+  int max_x = hmap_.tiles_x(level) - 1, max_y = hmap_.tiles_y(level) - 1;
+
+  // The far edge of the node is the first texel of the next tile, but it's
+  // also the shared border of the previous one, so it doesn't need that.
+  int x0 = std::floor((x - size/2) / tile_extent);
+  int x1 = std::ceil((x + size/2) / tile_extent) - 1;
+  int y0 = std::floor((z - size/2) / tile_extent);
+  int y1 = std::ceil((z + size/2) / tile_extent) - 1;
+  x0 = std::max(0, std::min(x0, max_x));
+  x1 = std::max(x0, std::min(x1, max_x));
+  y0 = std::max(0, std::min(y0, max_y));
+  y1 = std::max(y0, std::min(y1, max_y));
+
+  for (int ty = y0; ty <= y1; ++ty) {
+    for (int tx = x0; tx <= x1; ++tx) {
+      size_t tile = tileIndex(level, tx, ty);
+      if (last_requested_[tile] != frame_) {
+        last_requested_[tile] = frame_;
+        if (states_[tile] == State::kAbsent) {
+          requests_.push_back(tile);
+        }
+      }
+    }
+  }
+}
+
+void TileCache::startDecode(size_t tile) {
+  int level = levelOf(tile);
+  size_t level_tile = tile - level_offsets_[level];
+  int tx = level_tile % hmap_.tiles_x(level);
+  int ty = level_tile / hmap_.tiles_x(level);
+
+  hmap_.prefetchTile(level, tx, ty);
+  auto texels = std::make_shared<std::vector<GLubyte>>();
+  const TiledHeightMap* hmap = &hmap_;
+  // The copy is where the pages of the tile are actually read from the disk
+  auto handle = TaskScheduler::Default().schedule([=]() {
+    const GLubyte* data = hmap->tile(level, tx, ty);
+    texels->assign(data, data + hmap->tile_texel_count());
+  });
+
+  states_[tile] = State::kDecoding;
+  decodes_.push_back(Decode{tile, texels, handle});
+}
+
+int TileCache::acquireSlot() {
+  // A free slot, or the least recently requested tile's, that isn't needed
+  // in this frame
+  int best = -1;
+  for (int slot = 0; slot < slot_count(); ++slot) {
+    size_t tile = tile_of_slot_[slot];
+    if (tile == kNoTile) {
+      return slot;
+    }
+    if (tile != root_tile_ && last_requested_[tile] != frame_ &&
+        (best == -1 ||
+         last_requested_[tile] < last_requested_[tile_of_slot_[best]])) {
+      best = slot;
+    }
+  }
+
+  if (best != -1) {
+    size_t evicted = tile_of_slot_[best];
+    states_[evicted] = State::kAbsent;
+    slots_[evicted] = -1;
+    tile_of_slot_[best] = kNoTile;
+  }
+  return best;
+}
+
+bool TileCache::update(const UploadFunc& upload) {
+  TaskScheduler& scheduler = TaskScheduler::Default();
+  bool changed = false;
+
+  // Everything falls back to the coarsest level, so it can't be missing
+  if (states_[root_tile_] != State::kResident) {
+    scheduler.wait(decodes_.front().handle);
+  }
+
+  // Upload the finished tiles. If there's no slot for them, they are kept
+  // until one is freed, and no new decode is started meanwhile.
+  bool out_of_slots = false;
+  int upload_count = 0;
+  for (auto iter = decodes_.begin(); iter != decodes_.end() &&
+       upload_count < max_uploads_per_frame_;) {
+    if (!iter->handle.done()) {
+      ++iter;
+      continue;
+    }
+    scheduler.wait(iter->handle);  // rethrows the exception of the task
+
+    int slot = acquireSlot();
+    if (slot == -1) {
+      out_of_slots = true;
+      break;
+    }
+    upload(slot, iter->texels->data());
+    upload_count++;
+
+    states_[iter->tile] = State::kResident;
+    slots_[iter->tile] = slot;
+    tile_of_slot_[slot] = iter->tile;
+    changed = true;
+    iter = decodes_.erase(iter);
+  }
+
+  // Start decoding the missing tiles, the coarsest ones first, as they cover
+  // the biggest area. The coarser levels have bigger tile indices.
+  if (!out_of_slots) {
+    size_t max_decodes = scheduler.worker_count() + max_uploads_per_frame_;
+    std::sort(requests_.begin(), requests_.end(), std::greater<size_t>());
+    for (size_t tile : requests_) {
+      if (decodes_.size() >= max_decodes) {
+        break;
+      }
+      if (states_[tile] == State::kAbsent) {
+        startDecode(tile);
+      }
+    }
+  }
+  requests_.clear();
+  frame_++;
+
+  if (changed) {
+    updatePageTable();
+  }
+  return changed;
+}
+
+void TileCache::updatePageTable() {
+  // Top-down: a tile falls back to its parent's fallback, if it isn't
+  // resident itself
+  for (int level = hmap_.level_count() - 1; level >= 0; --level) {
+    for (int ty = 0; ty < hmap_.tiles_y(level); ++ty) {
+      for (int tx = 0; tx < hmap_.tiles_x(level); ++tx) {
+        size_t tile = tileIndex(level, tx, ty);
+        if (slots_[tile] != -1) {
+          fallbacks_[tile] = GLuint(slots_[tile]) | GLuint(level) << 16;
+        } else {
+          fallbacks_[tile] = fallbacks_[tileIndex(level + 1, tx/2, ty/2)];
+        }
+      }
+    }
+  }
+
+  for (size_t i = 0; i < page_table_.size() / 2; ++i) {
+    page_table_[2*i] = fallbacks_[i] & 0xFFFF;
+    page_table_[2*i + 1] = fallbacks_[i] >> 16;
+  }
+}
+
+}  // namespace cdlod
+}  // namespace engine
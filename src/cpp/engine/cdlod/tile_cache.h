@@ -0,0 +1,115 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_CDLOD_TILE_CACHE_H_
+#define ENGINE_CDLOD_TILE_CACHE_H_
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include <functional>
+#include "../oglwrap_config.h"
+#include "../task_scheduler.h"
+#include "../tiled_height_map.h"
+
+namespace engine {
+namespace cdlod {
+
+// Streams the tiles of a TiledHeightMap into a fixed number of texture slots
+// (like the layers of a texture array), driven by the quadtree's selection.
+//
+// Every frame, the quadtree requests the tiles under the selected nodes, at
+// the nodes' LOD level. The missing tiles are read from the mapped file and
+// decoded on the TaskScheduler's workers (so the disk reads don't stall the
+// rendering), the coarser levels first, and a limited number of them is
+// uploaded per frame. When the slots run out, the least recently requested
+// tiles are evicted. The single tile of the coarsest level is never evicted,
+// so every area has at least that, and it's the only tile the first frame
+// has to wait for.
+//
+// The shader finds the tiles through a page table, that has an entry for
+// every tile of the finest level, and contains the slot and the level of
+// the finest resident tile, that covers that area.
+//
+// This class doesn't use OpenGL, the uploads are done by a callback.
+class TileCache {
+ public:
+  // Receives a slot, and the tile_texel_count() texels to upload to it.
+  using UploadFunc = std::function<void(int slot, const GLubyte* texels)>;
+
+  TileCache(const TiledHeightMap& hmap, int slot_count = 512,
+            int max_uploads_per_frame = 8);
+  ~TileCache();
+
+  const TiledHeightMap& height_map() const { return hmap_; }
+  int slot_count() const { return tile_of_slot_.size(); }
+  size_t resident_count() const;
+  bool isResident(int level, int x, int y) const {
+    return slots_[tileIndex(level, x, y)] != -1;
+  }
+
+  // The number of tiles, whose decode has been started, but that haven't
+  // been uploaded yet (they may still be decoding on the workers)
+  size_t pending_count() const { return decodes_.size(); }
+
+  // The size of the page table, it's the number of tiles on the finest level
+  int page_table_w() const { return hmap_.tiles_x(0); }
+  int page_table_h() const { return hmap_.tiles_y(0); }
+
+  // A {slot, level} pair per entry, in row-major order
+  const std::vector<GLushort>& page_table() const { return page_table_; }
+
+  // Requests the tiles, that a quadtree node covers, at the node's level.
+  // (x, z) is the center of the node, and size is its extent in texels.
+  void request(float x, float z, float size, int level);
+
+  // Uploads the finished tiles, starts decoding the requested ones, and
+  // starts a new frame. The requests of the previous frame are used, and the
+  // tiles, that weren't requested in it, can be evicted. The first call
+  // blocks until the coarsest level is loaded. Returns whether the page
+  // table has changed.
+  bool update(const UploadFunc& upload);
+
+ private:
+  enum class State : GLubyte { kAbsent, kDecoding, kResident };
+
+  struct Decode {
+    size_t tile;
+    std::shared_ptr<std::vector<GLubyte>> texels;
+    TaskScheduler::Handle handle;
+  };
+
+  const TiledHeightMap& hmap_;
+  int max_uploads_per_frame_;
+
+  // The index of the first tile of every level
+  std::vector<size_t> level_offsets_;
+
+  // Per tile data, indexed by tileIndex()
+  std::vector<State> states_;
+  std::vector<int> slots_;              // -1 if not resident
+  std::vector<unsigned> last_requested_;  // the frame of the last request
+  std::vector<GLuint> fallbacks_;       // the finest resident tile, see below
+
+  std::vector<size_t> tile_of_slot_;    // kNoTile if the slot is free
+  std::vector<size_t> requests_;        // the missing tiles of this frame
+  std::deque<Decode> decodes_;          // in the order they were started
+  std::vector<GLushort> page_table_;
+  size_t root_tile_;
+  unsigned frame_ = 1;
+
+  static constexpr size_t kNoTile = size_t(-1);
+
+  size_t tileIndex(int level, int x, int y) const {
+    return level_offsets_[level] + size_t(y) * hmap_.tiles_x(level) + x;
+  }
+
+  int levelOf(size_t tile) const;
+  void startDecode(size_t tile);
+  int acquireSlot();
+  void updatePageTable();
+};
+
+}  // namespace cdlod
+}  // namespace engine
+
+#endif
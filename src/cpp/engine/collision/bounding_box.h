@@ -24,16 +24,21 @@ class BoundingBox {
   glm::vec3 center() const { return (maxes_+mins_) / 2.0f; }
   glm::vec3 extent() const { return maxes_-mins_; }
 
-  bool collidesWithSphere(const glm::vec3& center, float radius) const {
+  // Zero if the point is inside the box
+  float squaredDistanceTo(const glm::vec3& point) const {
     float dmin = 0;
     for (int i = 0; i < 3; ++i) {
-      if (center[i] < mins_[i]) {
-        dmin += sqr(center[i] - mins_[i]);
-      } else if (center[i] > maxes_[i]) {
-        dmin += sqr(center[i] - maxes_[i]);
+      if (point[i] < mins_[i]) {
+        dmin += sqr(point[i] - mins_[i]);
+      } else if (point[i] > maxes_[i]) {
+        dmin += sqr(point[i] - maxes_[i]);
       }
     }
-    return dmin <= sqr(radius);
+    return dmin;
+  }
+
+  bool collidesWithSphere(const glm::vec3& center, float radius) const {
+    return squaredDistanceTo(center) <= sqr(radius);
   }
 
   bool collidesWithFrustum(const Frustum& frustum) const {
@@ -52,6 +57,34 @@ class BoundingBox {
     }
     return true;
   }
+
+  // The same test, but only against the planes, whose bits are set in
+  // plane_mask (bit i is planes[i]). The planes, that the whole box is
+  // inside of, are removed from the mask, so the boxes inside this one don't
+  // have to be tested against them.
+  bool collidesWithFrustum(const Frustum& frustum,
+                           unsigned* plane_mask) const {
+    glm::vec3 center = this->center();
+    glm::vec3 extent = this->extent();
+
+    for (int i = 0; i < 6; ++i) {
+      if (!(*plane_mask & (1 << i))) {
+        continue;
+      }
+      const Plane& plane = frustum.planes[i];
+
+      float d = glm::dot(center, plane.normal);
+      float r = glm::dot(extent, glm::abs(plane.normal));
+
+      if (d + r < -plane.dist) {
+        return false;
+      }
+      if (d - r >= -plane.dist) {
+        *plane_mask &= ~(1 << i);
+      }
+    }
+    return true;
+  }
 };
 
 }
@@ -0,0 +1,404 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <cmath>
+#include <stdexcept>
+#include "./cull_batch.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || \
+    defined(__i386__) || defined(_M_IX86)
+  #define ENGINE_CULL_BATCH_X86 1
+  #include <immintrin.h>
+  #ifdef _MSC_VER
+    #include <intrin.h>
+    #define ENGINE_CULL_BATCH_TARGET(isa)
+  #else
+    // The kernels are compiled for their instruction sets, without requiring
+    // them for the rest of the engine
+    #define ENGINE_CULL_BATCH_TARGET(isa) __attribute__((target(isa)))
+  #endif
+#else
+  #define ENGINE_CULL_BATCH_X86 0
+#endif
+
+namespace engine {
+
+namespace {
+
+// The values of a prepared plane
+enum PlaneValue {
+  kNormalX, kNormalY, kNormalZ, kAbsNormalX, kAbsNormalY, kAbsNormalZ,
+  kLength, kNegDist
+};
+
+using Planes = float[6][8][4];
+
+// The kernels have the same operations in the same order as
+// BoundingBox::collidesWithFrustum (and glm::dot), so the results are the
+// same. They cull the volumes in [begin, end), where begin is divisible by
+// 32, and only write the words of their own range.
+using Kernel = void (*)(const Planes& planes,
+                        const CullBatch::Volumes& volumes,
+                        size_t begin, size_t end, uint32_t* visible);
+
+template<bool kExtent, bool kRadius>
+bool ScalarVisible(const Planes& planes, const CullBatch::Volumes& v,
+                   size_t i) {
+  for (int p = 0; p < 6; ++p) {
+    auto plane = [&planes, p](PlaneValue value) {
+      return planes[p][value][0];
+    };
+    float d = v.center_x[i]*plane(kNormalX) + v.center_y[i]*plane(kNormalY)
+            + v.center_z[i]*plane(kNormalZ);
+    float r = 0;
+    if (kExtent) {
+      r = v.extent_x[i]*plane(kAbsNormalX) + v.extent_y[i]*plane(kAbsNormalY)
+        + v.extent_z[i]*plane(kAbsNormalZ);
+    }
+    if (kRadius) {
+      r += v.radius[i] * plane(kLength);
+    }
+    if (d + r < plane(kNegDist)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void SetVisible(size_t i, uint32_t mask, uint32_t* visible) {
+  if (i % 32 == 0) {
+    visible[i / 32] = 0;
+  }
+  visible[i / 32] |= mask << (i % 32);
+}
+
+template<bool kExtent, bool kRadius>
+void ScalarKernel(const Planes& planes, const CullBatch::Volumes& v,
+                  size_t begin, size_t end, uint32_t* visible) {
+  for (size_t i = begin; i < end; ++i) {
+    SetVisible(i, ScalarVisible<kExtent, kRadius>(planes, v, i), visible);
+  }
+}
+
+#if ENGINE_CULL_BATCH_X86
+
+// Returns the visibility of the volumes i ... i+3
+template<bool kExtent, bool kRadius>
+ENGINE_CULL_BATCH_TARGET("sse2")
+inline uint32_t Sse2Visible(const Planes& planes,
+                            const CullBatch::Volumes& v, size_t i) {
+  __m128 cx = _mm_loadu_ps(v.center_x + i);
+  __m128 cy = _mm_loadu_ps(v.center_y + i);
+  __m128 cz = _mm_loadu_ps(v.center_z + i);
+  __m128 ex, ey, ez, radius;
+  if (kExtent) {
+    ex = _mm_loadu_ps(v.extent_x + i);
+    ey = _mm_loadu_ps(v.extent_y + i);
+    ez = _mm_loadu_ps(v.extent_z + i);
+  }
+  if (kRadius) {
+    radius = _mm_loadu_ps(v.radius + i);
+  }
+
+  __m128 outside = _mm_setzero_ps();
+  for (int p = 0; p < 6; ++p) {
+    const float (*plane)[4] = planes[p];
+    __m128 nx = _mm_load_ps(plane[kNormalX]);
+    __m128 ny = _mm_load_ps(plane[kNormalY]);
+    __m128 nz = _mm_load_ps(plane[kNormalZ]);
+    __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, nx), _mm_mul_ps(cy, ny)),
+                          _mm_mul_ps(cz, nz));
+    __m128 r = _mm_setzero_ps();
+    if (kExtent) {
+      __m128 ax = _mm_load_ps(plane[kAbsNormalX]);
+      __m128 ay = _mm_load_ps(plane[kAbsNormalY]);
+      __m128 az = _mm_load_ps(plane[kAbsNormalZ]);
+      r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ax), _mm_mul_ps(ey, ay)),
+                     _mm_mul_ps(ez, az));
+    }
+    if (kRadius) {
+      r = _mm_add_ps(r, _mm_mul_ps(radius, _mm_load_ps(plane[kLength])));
+    }
+    __m128 neg_dist = _mm_load_ps(plane[kNegDist]);
+    outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), neg_dist));
+  }
+
+  return ~_mm_movemask_ps(outside) & 0xF;
+}
+
+template<bool kExtent, bool kRadius>
+ENGINE_CULL_BATCH_TARGET("sse2")
+void Sse2Kernel(const Planes& planes, const CullBatch::Volumes& v,
+                size_t begin, size_t end, uint32_t* visible) {
+  size_t i = begin;
+  for (; i + 4 <= end; i += 4) {
+    SetVisible(i, Sse2Visible<kExtent, kRadius>(planes, v, i), visible);
+  }
+  ScalarKernel<kExtent, kRadius>(planes, v, i, end, visible);
+}
+
+template<bool kExtent, bool kRadius>
+ENGINE_CULL_BATCH_TARGET("avx2")
+void Avx2Kernel(const Planes& planes, const CullBatch::Volumes& v,
+                size_t begin, size_t end, uint32_t* visible) {
+  size_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    __m256 cx = _mm256_loadu_ps(v.center_x + i);
+    __m256 cy = _mm256_loadu_ps(v.center_y + i);
+    __m256 cz = _mm256_loadu_ps(v.center_z + i);
+    __m256 ex, ey, ez, radius;
+    if (kExtent) {
+      ex = _mm256_loadu_ps(v.extent_x + i);
+      ey = _mm256_loadu_ps(v.extent_y + i);
+      ez = _mm256_loadu_ps(v.extent_z + i);
+    }
+    if (kRadius) {
+      radius = _mm256_loadu_ps(v.radius + i);
+    }
+
+    // No FMAs, they would round differently than the scalar code
+    __m256 outside = _mm256_setzero_ps();
+    for (int p = 0; p < 6; ++p) {
+      const float (*plane)[4] = planes[p];
+      __m256 nx = _mm256_broadcast_ss(plane[kNormalX]);
+      __m256 ny = _mm256_broadcast_ss(plane[kNormalY]);
+      __m256 nz = _mm256_broadcast_ss(plane[kNormalZ]);
+      __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, nx),
+                                             _mm256_mul_ps(cy, ny)),
+                               _mm256_mul_ps(cz, nz));
+      __m256 r = _mm256_setzero_ps();
+      if (kExtent) {
+        __m256 ax = _mm256_broadcast_ss(plane[kAbsNormalX]);
+        __m256 ay = _mm256_broadcast_ss(plane[kAbsNormalY]);
+        __m256 az = _mm256_broadcast_ss(plane[kAbsNormalZ]);
+        r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, ax),
+                                        _mm256_mul_ps(ey, ay)),
+                          _mm256_mul_ps(ez, az));
+      }
+      if (kRadius) {
+        __m256 length = _mm256_broadcast_ss(plane[kLength]);
+        r = _mm256_add_ps(r, _mm256_mul_ps(radius, length));
+      }
+      __m256 neg_dist = _mm256_broadcast_ss(plane[kNegDist]);
+      outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(d, r),
+                                                    neg_dist, _CMP_LT_OQ));
+    }
+
+    SetVisible(i, ~_mm256_movemask_ps(outside) & 0xFF, visible);
+  }
+
+  // The small batches (like the children of a quadtree node) still use SSE
+  for (; i + 4 <= end; i += 4) {
+    SetVisible(i, Sse2Visible<kExtent, kRadius>(planes, v, i), visible);
+  }
+  ScalarKernel<kExtent, kRadius>(planes, v, i, end, visible);
+}
+
+bool CpuSupports(CullBatch::InstructionSet instruction_set) {
+  #ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+    __cpuid(info, 1);
+    if (instruction_set == CullBatch::InstructionSet::kSse2) {
+      return info[3] & (1 << 26);
+    }
+    // AVX2 also needs the OS to save the ymm registers
+    bool osxsave = info[2] & (1 << 27), avx = info[2] & (1 << 28);
+    if (!osxsave || !avx || max_leaf < 7 || (_xgetbv(0) & 6) != 6) {
+      return false;
+    }
+    __cpuidex(info, 7, 0);
+    return info[1] & (1 << 5);
+  #else
+    __builtin_cpu_init();
+    if (instruction_set == CullBatch::InstructionSet::kSse2) {
+      return __builtin_cpu_supports("sse2");
+    }
+    return __builtin_cpu_supports("avx2");
+  #endif
+}
+
+#endif  // ENGINE_CULL_BATCH_X86
+
+// The kernels of an instruction set, indexed by kExtent*2 + kRadius
+template<template<bool, bool> class KernelOf>
+struct KernelTable {
+  static constexpr Kernel kernels[4] = {
+    &KernelOf<false, false>::run, &KernelOf<false, true>::run,
+    &KernelOf<true, false>::run, &KernelOf<true, true>::run
+  };
+};
+
+template<template<bool, bool> class KernelOf>
+constexpr Kernel KernelTable<KernelOf>::kernels[4];
+
+template<bool kExtent, bool kRadius>
+struct ScalarKernelOf {
+  static void run(const Planes& planes, const CullBatch::Volumes& v,
+                  size_t begin, size_t end, uint32_t* visible) {
+    ScalarKernel<kExtent, kRadius>(planes, v, begin, end, visible);
+  }
+};
+
+#if ENGINE_CULL_BATCH_X86
+template<bool kExtent, bool kRadius>
+struct Sse2KernelOf {
+  static void run(const Planes& planes, const CullBatch::Volumes& v,
+                  size_t begin, size_t end, uint32_t* visible) {
+    Sse2Kernel<kExtent, kRadius>(planes, v, begin, end, visible);
+  }
+};
+
+template<bool kExtent, bool kRadius>
+struct Avx2KernelOf {
+  static void run(const Planes& planes, const CullBatch::Volumes& v,
+                  size_t begin, size_t end, uint32_t* visible) {
+    Avx2Kernel<kExtent, kRadius>(planes, v, begin, end, visible);
+  }
+};
+#endif
+
+CullBatch::InstructionSet BestInstructionSet() {
+  for (auto instruction_set : {CullBatch::InstructionSet::kAvx2,
+                               CullBatch::InstructionSet::kSse2}) {
+    if (CullBatch::Supports(instruction_set)) {
+      return instruction_set;
+    }
+  }
+  return CullBatch::InstructionSet::kScalar;
+}
+
+CullBatch::InstructionSet& CurrentInstructionSet() {
+  static CullBatch::InstructionSet instruction_set = BestInstructionSet();
+  return instruction_set;
+}
+
+const Kernel* Kernels(CullBatch::InstructionSet instruction_set) {
+  switch (instruction_set) {
+  #if ENGINE_CULL_BATCH_X86
+    case CullBatch::InstructionSet::kAvx2:
+      return KernelTable<Avx2KernelOf>::kernels;
+    case CullBatch::InstructionSet::kSse2:
+      return KernelTable<Sse2KernelOf>::kernels;
+  #endif
+    default:
+      return KernelTable<ScalarKernelOf>::kernels;
+  }
+}
+
+}  // namespace
+
+bool CullBatch::Supports(InstructionSet instruction_set) {
+  if (instruction_set == InstructionSet::kScalar) {
+    return true;
+  }
+  #if ENGINE_CULL_BATCH_X86
+    static const bool sse2 = CpuSupports(InstructionSet::kSse2);
+    static const bool avx2 = CpuSupports(InstructionSet::kAvx2);
+    return instruction_set == InstructionSet::kSse2 ? sse2 : avx2;
+  #else
+    return false;
+  #endif
+}
+
+CullBatch::InstructionSet CullBatch::instruction_set() {
+  return CurrentInstructionSet();
+}
+
+void CullBatch::set_instruction_set(InstructionSet instruction_set) {
+  if (!Supports(instruction_set)) {
+    throw std::invalid_argument("engine::CullBatch: the instruction set "
+                                "isn't supported by the CPU");
+  }
+  CurrentInstructionSet() = instruction_set;
+}
+
+CullBatch::PreparedFrustum::PreparedFrustum(const Frustum& frustum) {
+  for (int p = 0; p < 6; ++p) {
+    const Plane& plane = frustum.planes[p];
+    glm::vec3 abs_normal = glm::abs(plane.normal);
+    float values[] = {
+      plane.normal.x, plane.normal.y, plane.normal.z,
+      abs_normal.x, abs_normal.y, abs_normal.z,
+      glm::length(plane.normal), -plane.dist
+    };
+    for (int value = 0; value < 8; ++value) {
+      for (int i = 0; i < 4; ++i) {
+        planes_[p][value][i] = values[value];
+      }
+    }
+  }
+}
+
+void CullBatch::Cull(const Frustum& frustum, const Volumes& volumes,
+                     size_t count, uint32_t* visible) {
+  Cull(PreparedFrustum{frustum}, volumes, count, visible);
+}
+
+void CullBatch::Cull(const PreparedFrustum& frustum, const Volumes& volumes,
+                     size_t count, uint32_t* visible) {
+  bool has_extent = volumes.extent_x != nullptr;
+  bool has_radius = volumes.radius != nullptr;
+  Kernel kernel = Kernels(CurrentInstructionSet())[has_extent*2 + has_radius];
+  kernel(frustum.planes_, volumes, 0, count, visible);
+}
+
+void CullBatch::clear() {
+  for (auto array : arrays()) {
+    array->clear();
+  }
+}
+
+void CullBatch::reserve(size_t size) {
+  for (auto array : arrays()) {
+    array->reserve(size);
+  }
+}
+
+size_t CullBatch::addBox(const BoundingBox& bbox) {
+  size_t index = size();
+  for (auto array : arrays()) {
+    array->push_back(0);
+  }
+  setBox(index, bbox);
+  return index;
+}
+
+size_t CullBatch::addSphere(const glm::vec3& center, float radius) {
+  size_t index = addBox(BoundingBox{center, center});
+  setSphere(index, center, radius);
+  return index;
+}
+
+void CullBatch::setBox(size_t i, const BoundingBox& bbox) {
+  glm::vec3 center = bbox.center(), extent = bbox.extent();
+  center_x_[i] = center.x;
+  center_y_[i] = center.y;
+  center_z_[i] = center.z;
+  extent_x_[i] = extent.x;
+  extent_y_[i] = extent.y;
+  extent_z_[i] = extent.z;
+  radius_[i] = 0;
+}
+
+void CullBatch::setSphere(size_t i, const glm::vec3& center, float radius) {
+  center_x_[i] = center.x;
+  center_y_[i] = center.y;
+  center_z_[i] = center.z;
+  extent_x_[i] = extent_y_[i] = extent_z_[i] = 0;
+  radius_[i] = radius;
+}
+
+CullBatch::Volumes CullBatch::volumes() const {
+  return Volumes{center_x_.data(), center_y_.data(), center_z_.data(),
+                 extent_x_.data(), extent_y_.data(), extent_z_.data(),
+                 radius_.data()};
+}
+
+void CullBatch::cull(const Frustum& frustum,
+                     std::vector<uint32_t>* visible) const {
+  visible->resize((size() + 31) / 32);
+  Cull(frustum, volumes(), size(), visible->data());
+}
+
+}  // namespace engine
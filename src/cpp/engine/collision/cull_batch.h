@@ -0,0 +1,111 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_COLLISION_CULL_BATCH_H_
+#define ENGINE_COLLISION_CULL_BATCH_H_
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include "./frustum.h"
+#include "./bounding_box.h"
+
+namespace engine {
+
+// Frustum culling of many bounding volumes at once. The volumes are stored
+// in structure of arrays layout, so a plane is tested against 4 (SSE2) or 8
+// (AVX2) of them with single instructions. The instruction set is chosen at
+// runtime, with a scalar fallback on the other CPUs.
+//
+// A volume is a box (a center and an extent, like BoundingBox::center() and
+// BoundingBox::extent()), a sphere (a center and a radius), or the sum of
+// the two. A box is visible exactly if BoundingBox::collidesWithFrustum
+// would say so. The result is a bitmask: bit i%32 of the word i/32 is set,
+// if the i-th volume is visible.
+class CullBatch {
+ public:
+  enum class InstructionSet { kScalar, kSse2, kAvx2 };
+
+  // The arrays of count volumes. The extents or the radii can be nullptr,
+  // if all of them are zero.
+  struct Volumes {
+    const float *center_x, *center_y, *center_z;
+    const float *extent_x, *extent_y, *extent_z;
+    const float *radius;
+  };
+
+  // The planes of a frustum, prepared for the kernels. It's worth to keep
+  // it, if the same frustum culls a lot of small batches.
+  class PreparedFrustum {
+   public:
+    explicit PreparedFrustum(const Frustum& frustum);
+
+   private:
+    friend class CullBatch;
+    // For every plane: its normal, the absolute value of the normal, the
+    // length of the normal and the negated distance. They are repeated 4
+    // times, so that SSE can load them without shuffles.
+    alignas(16) float planes_[6][8][4];
+  };
+
+  // Culls the volumes, and writes (count+31)/32 words to visible.
+  static void Cull(const Frustum& frustum, const Volumes& volumes,
+                   size_t count, uint32_t* visible);
+  static void Cull(const PreparedFrustum& frustum, const Volumes& volumes,
+                   size_t count, uint32_t* visible);
+
+  static bool IsVisible(const uint32_t* visible, size_t i) {
+    return (visible[i / 32] >> (i % 32)) & 1;
+  }
+
+  static bool IsVisible(const std::vector<uint32_t>& visible, size_t i) {
+    return IsVisible(visible.data(), i);
+  }
+
+  // The best instruction set of the CPU is used by default. It can be
+  // lowered (for comparisons), but this isn't thread-safe, it should be done
+  // before the culling starts.
+  static bool Supports(InstructionSet instruction_set);
+  static InstructionSet instruction_set();
+  static void set_instruction_set(InstructionSet instruction_set);
+
+  // A batch of volumes, that owns the arrays. The volumes keep their
+  // indices, the order they were added in.
+  size_t size() const { return center_x_.size(); }
+  bool empty() const { return center_x_.empty(); }
+
+  void clear();
+  void reserve(size_t size);
+
+  // Returns the index of the new volume
+  size_t addBox(const BoundingBox& bbox);
+  size_t addSphere(const glm::vec3& center, float radius);
+
+  void setBox(size_t i, const BoundingBox& bbox);
+  void setSphere(size_t i, const glm::vec3& center, float radius);
+
+  Volumes volumes() const;
+
+  // Resizes visible, and fills it for the volumes of this batch
+  void cull(const Frustum& frustum, std::vector<uint32_t>* visible) const;
+
+ private:
+  std::vector<float> center_x_, center_y_, center_z_;
+  std::vector<float> extent_x_, extent_y_, extent_z_;
+  std::vector<float> radius_;
+
+  std::array<std::vector<float>*, 7> arrays() {
+    return {{&center_x_, &center_y_, &center_z_,
+             &extent_x_, &extent_y_, &extent_z_, &radius_}};
+  }
+
+  std::array<const std::vector<float>*, 7> arrays() const {
+    return {{&center_x_, &center_y_, &center_z_,
+             &extent_x_, &extent_y_, &extent_z_, &radius_}};
+  }
+};
+
+}  // namespace engine
+
+#endif
@@ -7,6 +7,50 @@
 
 struct Frustum {
   Plane planes[6]; // left, right, top, down, near, far
+
+  // Extracts the planes from a projection * camera matrix
+  static Frustum FromMatrix(const glm::mat4& m) {
+    // REMEMBER: m[i][j] is j-th row, i-th column!!!
+    // Note: there's no need to normalize the plane parameters
+
+    return Frustum{{
+      // left
+     {m[0][3] + m[0][0],
+      m[1][3] + m[1][0],
+      m[2][3] + m[2][0],
+      m[3][3] + m[3][0]},
+
+      // right
+     {m[0][3] - m[0][0],
+      m[1][3] - m[1][0],
+      m[2][3] - m[2][0],
+      m[3][3] - m[3][0]},
+
+      // top
+     {m[0][3] - m[0][1],
+      m[1][3] - m[1][1],
+      m[2][3] - m[2][1],
+      m[3][3] - m[3][1]},
+
+      // bottom
+     {m[0][3] + m[0][1],
+      m[1][3] + m[1][1],
+      m[2][3] + m[2][1],
+      m[3][3] + m[3][1]},
+
+      // near
+     {m[0][2],
+      m[1][2],
+      m[2][2],
+      m[3][2]},
+
+      // far
+     {m[0][3] - m[0][2],
+      m[1][3] - m[1][2],
+      m[2][3] - m[2][2],
+      m[3][3] - m[3][2]}
+    }};
+  }
 };
 
 #endif
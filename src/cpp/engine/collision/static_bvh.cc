@@ -0,0 +1,327 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <limits>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include "./static_bvh.h"
+
+namespace engine {
+
+namespace {
+
+// The maximal number of boxes in a leaf
+const uint32_t kMaxLeafSize = 4;
+
+const unsigned kAllPlanes = (1 << 6) - 1;
+
+// The frustum queries don't traverse the partly visible subtrees with at
+// most this many boxes, their boxes are culled in a batch instead, which is
+// cheaper than testing their nodes one by one
+const uint32_t kMaxCullBatchSize = 64;
+
+bool ContainedBySphere(const BoundingBox& bbox, const glm::vec3& center,
+                       float radius) {
+  glm::vec3 farthest = glm::max(glm::abs(bbox.mins() - center),
+                                glm::abs(bbox.maxes() - center));
+  return glm::dot(farthest, farthest) <= sqr(radius);
+}
+
+}  // namespace
+
+// A run of boxes, that are next to each other in bboxes_, and have to be
+// tested against the frustum one by one
+struct StaticBvh::BoxRange {
+  uint32_t begin, end;
+  bool in_sphere;  // all of them are inside the sphere of the query
+};
+
+struct StaticBvh::Query {
+  const Frustum* frustum;
+  glm::vec3 center;
+  float radius;
+
+  glm::vec3 origin, inv_direction;
+  float max_distance;
+
+  // The boxes, that the frustum queries have to cull in batches
+  std::vector<BoxRange>* partial_boxes;
+
+  // Returns the distance where the ray enters the box, or a negative value
+  // if it misses it.
+  float rayHits(const BoundingBox& bbox) const {
+    glm::vec3 t1 = (bbox.mins() - origin) * inv_direction;
+    glm::vec3 t2 = (bbox.maxes() - origin) * inv_direction;
+    glm::vec3 tmin = glm::min(t1, t2), tmax = glm::max(t1, t2);
+    float enter = std::max(std::max(tmin.x, tmin.y), std::max(tmin.z, 0.0f));
+    float exit = std::min(std::min(tmax.x, tmax.y),
+                          std::min(tmax.z, max_distance));
+    return enter <= exit ? enter : -1.0f;
+  }
+};
+
+StaticBvh::StaticBvh(const std::vector<BoundingBox>& bboxes) {
+  if (bboxes.empty()) {
+    return;
+  }
+  if (std::numeric_limits<uint32_t>::max() / 2 < bboxes.size()) {
+    throw std::invalid_argument("engine::StaticBvh: too many boxes");
+  }
+
+  std::vector<glm::vec3> centers;
+  centers.reserve(bboxes.size());
+  for (const BoundingBox& bbox : bboxes) {
+    centers.push_back(bbox.center());
+  }
+
+  indices_.resize(bboxes.size());
+  std::iota(indices_.begin(), indices_.end(), 0);
+  nodes_.reserve(2 * bboxes.size() / kMaxLeafSize + 1);
+  build(bboxes, centers, 0, bboxes.size());
+
+  bboxes_.reserve(bboxes.size());
+  batch_.reserve(bboxes.size());
+  for (uint32_t index : indices_) {
+    bboxes_.push_back(bboxes[index]);
+    batch_.addBox(bboxes[index]);
+  }
+}
+
+// Splits the boxes in half by their centers, along the longest axis
+uint32_t StaticBvh::build(const std::vector<BoundingBox>& bboxes,
+                          const std::vector<glm::vec3>& centers,
+                          uint32_t begin, uint32_t end) {
+  glm::vec3 mins = bboxes[indices_[begin]].mins();
+  glm::vec3 maxes = bboxes[indices_[begin]].maxes();
+  glm::vec3 center_mins = centers[indices_[begin]];
+  glm::vec3 center_maxes = center_mins;
+  for (uint32_t i = begin + 1; i < end; ++i) {
+    const BoundingBox& bbox = bboxes[indices_[i]];
+    mins = glm::min(mins, bbox.mins());
+    maxes = glm::max(maxes, bbox.maxes());
+    center_mins = glm::min(center_mins, centers[indices_[i]]);
+    center_maxes = glm::max(center_maxes, centers[indices_[i]]);
+  }
+
+  uint32_t node = nodes_.size();
+  nodes_.push_back(Node{BoundingBox{mins, maxes}, begin, end, 0});
+  if (end - begin <= kMaxLeafSize) {
+    return node;
+  }
+
+  glm::vec3 size = center_maxes - center_mins;
+  int axis = size.x < size.y ? (size.y < size.z ? 2 : 1)
+                             : (size.x < size.z ? 2 : 0);
+  uint32_t middle = begin + (end - begin) / 2;
+  std::nth_element(indices_.begin() + begin, indices_.begin() + middle,
+                   indices_.begin() + end,
+                   [&centers, axis](uint32_t a, uint32_t b) {
+    return centers[a][axis] < centers[b][axis];
+  });
+
+  build(bboxes, centers, begin, middle);
+  uint32_t right_child = build(bboxes, centers, middle, end);
+  nodes_[node].right_child = right_child;
+  return node;
+}
+
+void StaticBvh::addSubtree(uint32_t node, std::vector<size_t>* result) const {
+  result->insert(result->end(), indices_.begin() + nodes_[node].begin,
+                 indices_.begin() + nodes_[node].end);
+}
+
+void StaticBvh::queryFrustum(const Frustum& frustum,
+                             std::vector<size_t>* result) const {
+  result->clear();
+  if (!empty()) {
+    std::vector<BoxRange> partial_boxes;
+    Query query{&frustum, glm::vec3{}, 0, glm::vec3{}, glm::vec3{}, 0,
+                &partial_boxes};
+    queryFrustum(0, kAllPlanes, true, query, result);
+    cullPartialBoxes(query, result);
+  }
+}
+
+void StaticBvh::queryFrustum(const Frustum& frustum, const glm::vec3& center,
+                             float radius, std::vector<size_t>* result) const {
+  result->clear();
+  if (!empty()) {
+    std::vector<BoxRange> partial_boxes;
+    Query query{&frustum, center, radius, glm::vec3{}, glm::vec3{}, 0,
+                &partial_boxes};
+    queryFrustum(0, kAllPlanes, false, query, result);
+    cullPartialBoxes(query, result);
+  }
+}
+
+void StaticBvh::queryFrustum(uint32_t node, unsigned plane_mask,
+                             bool in_sphere, const Query& query,
+                             std::vector<size_t>* result) const {
+  const Node& n = nodes_[node];
+  if (!n.bbox.collidesWithFrustum(*query.frustum, &plane_mask)) {
+    return;
+  }
+  if (!in_sphere) {
+    if (!n.bbox.collidesWithSphere(query.center, query.radius)) {
+      return;
+    }
+    in_sphere = ContainedBySphere(n.bbox, query.center, query.radius);
+  }
+
+  if (plane_mask == 0 && in_sphere) {
+    addSubtree(node, result);
+  } else if (n.end - n.begin <= kMaxCullBatchSize) {
+    // The neighbouring subtrees are merged into a single batch
+    std::vector<BoxRange>& ranges = *query.partial_boxes;
+    if (!ranges.empty() && ranges.back().end == n.begin &&
+        ranges.back().in_sphere == in_sphere) {
+      ranges.back().end = n.end;
+    } else {
+      ranges.push_back(BoxRange{n.begin, n.end, in_sphere});
+    }
+  } else {
+    queryFrustum(node + 1, plane_mask, in_sphere, query, result);
+    queryFrustum(n.right_child, plane_mask, in_sphere, query, result);
+  }
+}
+
+void StaticBvh::cullPartialBoxes(const Query& query,
+                                 std::vector<size_t>* result) const {
+  CullBatch::PreparedFrustum frustum{*query.frustum};
+  CullBatch::Volumes boxes = batch_.volumes();
+  std::vector<uint32_t> visible;
+  for (const BoxRange& range : *query.partial_boxes) {
+    size_t count = range.end - range.begin;
+    CullBatch::Volumes volumes{
+      boxes.center_x + range.begin, boxes.center_y + range.begin,
+      boxes.center_z + range.begin, boxes.extent_x + range.begin,
+      boxes.extent_y + range.begin, boxes.extent_z + range.begin, nullptr};
+    visible.resize((count + 31) / 32);
+    CullBatch::Cull(frustum, volumes, count, visible.data());
+
+    for (size_t i = 0; i < count; ++i) {
+      uint32_t box = range.begin + i;
+      if (CullBatch::IsVisible(visible, i) && (range.in_sphere ||
+          bboxes_[box].collidesWithSphere(query.center, query.radius))) {
+        result->push_back(indices_[box]);
+      }
+    }
+  }
+}
+
+void StaticBvh::querySphere(const glm::vec3& center, float radius,
+                            std::vector<size_t>* result) const {
+  result->clear();
+  if (!empty()) {
+    Query query{nullptr, center, radius, glm::vec3{}, glm::vec3{}, 0};
+    querySphere(0, query, result);
+  }
+}
+
+void StaticBvh::querySphere(uint32_t node, const Query& query,
+                            std::vector<size_t>* result) const {
+  const Node& n = nodes_[node];
+  if (!n.bbox.collidesWithSphere(query.center, query.radius)) {
+    return;
+  }
+
+  if (ContainedBySphere(n.bbox, query.center, query.radius)) {
+    addSubtree(node, result);
+  } else if (n.isLeaf()) {
+    for (uint32_t i = n.begin; i < n.end; ++i) {
+      if (bboxes_[i].collidesWithSphere(query.center, query.radius)) {
+        result->push_back(indices_[i]);
+      }
+    }
+  } else {
+    querySphere(node + 1, query, result);
+    querySphere(n.right_child, query, result);
+  }
+}
+
+void StaticBvh::queryRay(const glm::vec3& origin, const glm::vec3& direction,
+                         float max_distance,
+                         std::vector<size_t>* result) const {
+  result->clear();
+  if (!empty()) {
+    Query query{nullptr, glm::vec3{}, 0, origin, 1.0f / direction,
+                max_distance};
+    queryRay(0, query, result);
+  }
+}
+
+void StaticBvh::queryRay(uint32_t node, const Query& query,
+                         std::vector<size_t>* result) const {
+  const Node& n = nodes_[node];
+  if (query.rayHits(n.bbox) < 0) {
+    return;
+  }
+
+  if (n.isLeaf()) {
+    for (uint32_t i = n.begin; i < n.end; ++i) {
+      if (query.rayHits(bboxes_[i]) >= 0) {
+        result->push_back(indices_[i]);
+      }
+    }
+  } else {
+    queryRay(node + 1, query, result);
+    queryRay(n.right_child, query, result);
+  }
+}
+
+bool StaticBvh::raycast(const glm::vec3& origin, const glm::vec3& direction,
+                        float max_distance, size_t* index,
+                        float* distance) const {
+  if (empty()) {
+    return false;
+  }
+
+  Query query{nullptr, glm::vec3{}, 0, origin, 1.0f / direction,
+              max_distance};
+  uint32_t hit = indices_.size();
+  float hit_distance = max_distance;
+  raycast(0, query, &hit, &hit_distance);
+  if (hit == indices_.size()) {
+    return false;
+  }
+
+  if (index) {
+    *index = indices_[hit];
+  }
+  if (distance) {
+    *distance = hit_distance;
+  }
+  return true;
+}
+
+void StaticBvh::raycast(uint32_t node, const Query& query,
+                        uint32_t* hit, float* distance) const {
+  const Node& n = nodes_[node];
+  if (n.isLeaf()) {
+    for (uint32_t i = n.begin; i < n.end; ++i) {
+      float t = query.rayHits(bboxes_[i]);
+      if (0 <= t && (t < *distance || *hit == indices_.size())) {
+        *hit = i;
+        *distance = t;
+      }
+    }
+    return;
+  }
+
+  // The nearer child first, so the farther one can often be skipped
+  uint32_t left = node + 1, right = n.right_child;
+  float t_left = query.rayHits(nodes_[left].bbox);
+  float t_right = query.rayHits(nodes_[right].bbox);
+  if (t_right >= 0 && (t_left < 0 || t_right < t_left)) {
+    std::swap(left, right);
+    std::swap(t_left, t_right);
+  }
+  if (t_left >= 0 && (t_left <= *distance || *hit == indices_.size())) {
+    raycast(left, query, hit, distance);
+  }
+  if (t_right >= 0 && (t_right <= *distance || *hit == indices_.size())) {
+    raycast(right, query, hit, distance);
+  }
+}
+
+}  // namespace engine
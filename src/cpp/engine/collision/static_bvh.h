@@ -0,0 +1,100 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_COLLISION_STATIC_BVH_H_
+#define ENGINE_COLLISION_STATIC_BVH_H_
+
+#include <vector>
+#include <cstdint>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include "./frustum.h"
+#include "./bounding_box.h"
+#include "./cull_batch.h"
+
+namespace engine {
+
+// A bounding volume hierarchy over boxes that don't move (like the props
+// placed on the terrain). It is built once, and the cost of a query depends
+// on the number of boxes it returns, and not on the number of all boxes.
+//
+// The queries return the indices of the boxes (the order they were given to
+// the constructor in), they replace the content of result.
+//
+// The frustum queries test the bigger nodes one by one, but the boxes of the
+// small subtrees, that are partly inside the frustum, are collected, and
+// culled in batches with CullBatch.
+class StaticBvh {
+ public:
+  StaticBvh() = default;
+  explicit StaticBvh(const std::vector<BoundingBox>& bboxes);
+
+  size_t size() const { return indices_.size(); }
+  bool empty() const { return indices_.empty(); }
+
+  // The boxes, for which BoundingBox::collidesWithFrustum returns true
+  void queryFrustum(const Frustum& frustum, std::vector<size_t>* result) const;
+
+  // The boxes that are visible from the frustum, and intersect the sphere
+  void queryFrustum(const Frustum& frustum, const glm::vec3& center,
+                    float radius, std::vector<size_t>* result) const;
+
+  // The boxes that intersect the sphere
+  void querySphere(const glm::vec3& center, float radius,
+                   std::vector<size_t>* result) const;
+
+  // The boxes that the ray hits closer than max_distance. The distances are
+  // measured in the length of direction.
+  void queryRay(const glm::vec3& origin, const glm::vec3& direction,
+                float max_distance, std::vector<size_t>* result) const;
+
+  // The box that the ray enters first. Returns false if it doesn't hit any
+  // box closer than max_distance.
+  bool raycast(const glm::vec3& origin, const glm::vec3& direction,
+               float max_distance, size_t* index, float* distance) const;
+
+ private:
+  // The left child of an inner node is the next node. The boxes of the
+  // subtree of a node are the [begin, end) range of bboxes_.
+  struct Node {
+    BoundingBox bbox;
+    uint32_t begin, end;
+    uint32_t right_child;  // zero for leaves
+
+    bool isLeaf() const { return right_child == 0; }
+  };
+
+  std::vector<Node> nodes_;
+  // The boxes and their original indices, in the order of the leaves
+  std::vector<BoundingBox> bboxes_;
+  std::vector<uint32_t> indices_;
+  // The same boxes as bboxes_, for the batched culling
+  CullBatch batch_;
+
+  struct Query;
+  struct BoxRange;
+
+  uint32_t build(const std::vector<BoundingBox>& bboxes,
+                 const std::vector<glm::vec3>& centers,
+                 uint32_t begin, uint32_t end);
+
+  void addSubtree(uint32_t node, std::vector<size_t>* result) const;
+
+  void queryFrustum(uint32_t node, unsigned plane_mask, bool in_sphere,
+                    const Query& query, std::vector<size_t>* result) const;
+
+  void cullPartialBoxes(const Query& query,
+                        std::vector<size_t>* result) const;
+
+  void querySphere(uint32_t node, const Query& query,
+                   std::vector<size_t>* result) const;
+
+  void queryRay(uint32_t node, const Query& query,
+                std::vector<size_t>* result) const;
+
+  void raycast(uint32_t node, const Query& query,
+               uint32_t* hit, float* distance) const;
+};
+
+}  // namespace engine
+
+#endif
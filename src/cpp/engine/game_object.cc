@@ -3,6 +3,7 @@
 #include "./scene.h"
 #include "./game_object.h"
 #include "./game_engine.h"
+#include "./task_scheduler.h"
 
 #define _TRY_(YourCode) \
   try { \
@@ -13,6 +14,19 @@
 
 namespace engine {
 
+// True on the threads, while they update a thread-safe subtree
+static thread_local bool in_parallel_update = false;
+
+// Computes the cached matrices of the transform, and of all of its
+// descendants, so that reading them later doesn't write the caches.
+static void CacheMatrices(const Transform& transform) {
+  transform.localToWorldMatrix();
+  transform.worldToLocalMatrix();
+  for (const Transform* child : transform.children()) {
+    CacheMatrices(*child);
+  }
+}
+
 GameObject* GameObject::addComponent(std::unique_ptr<GameObject>&& component) {
   if (component == nullptr) {
     return nullptr;
@@ -77,8 +91,67 @@ void GameObject::screenResizedAll(size_t width, size_t height) {
 
 void GameObject::updateAll() {
   update();
+  if (scene_ && scene_->parallel_update()) {
+    updateComponentsInParallel();
+  } else {
+    for (size_t i = 0; i < components_.size(); ++i) {
+      components_[i]->updateAll();
+    }
+  }
+}
+
+void GameObject::updateComponentsInParallel() {
+  std::vector<GameObject*> thread_safe, others;
   for (size_t i = 0; i < components_.size(); ++i) {
-    components_[i]->updateAll();
+    GameObject* component = components_[i].get();
+    if (component->threadSafeUpdate()) {
+      thread_safe.push_back(component);
+    } else {
+      others.push_back(component);
+    }
+  }
+
+  // The thread-safe subtrees go first, and concurrently. This thread takes
+  // one of them instead of idling. If an update throws, parallelFor still
+  // waits for the others, before it rethrows the exception.
+  if (!thread_safe.empty()) {
+    // Reading a transform fills its matrix caches, so the subtrees would race
+    // when they read the same transform outside of them. Every matrix of the
+    // scene is calculated before the outermost parallel update starts. Inside
+    // of it, only the thread-safe subtree of this thread can change, so only
+    // that one can have stale matrices.
+    if (!in_parallel_update) {
+      const Transform* root = transform_.get();
+      while (root->parent()) {
+        root = root->parent();
+      }
+      CacheMatrices(*root);
+    } else {
+      CacheMatrices(*transform_);
+    }
+
+    TaskScheduler::Default().parallelFor(0, thread_safe.size(),
+        [&thread_safe](size_t begin, size_t end) {
+      // A thread can run tasks of other updates while it waits, so the
+      // previous value has to be restored
+      bool was_in_parallel_update = in_parallel_update;
+      in_parallel_update = true;
+      try {
+        for (size_t i = begin; i < end; ++i) {
+          thread_safe[i]->updateAll();
+        }
+      } catch (...) {
+        in_parallel_update = was_in_parallel_update;
+        throw;
+      }
+      in_parallel_update = was_in_parallel_update;
+    });
+  }
+
+  // The rest might read the state of the thread-safe subtrees, so they run
+  // afterwards, in their original order
+  for (GameObject* component : others) {
+    component->updateAll();
   }
 }
 
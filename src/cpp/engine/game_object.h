@@ -65,6 +65,17 @@ class GameObject {
   virtual void mouseMoved(double xpos, double ypos) {}
   virtual void collision(const GameObject* other) {}
 
+  // Should return true if the update() of this object and of all of its
+  // components only modifies the state of this subtree. If the scene's
+  // parallel update is enabled, such subtrees are updated concurrently with
+  // their siblings.
+  // The transforms outside of the subtree can be read (their matrices are
+  // cached before the parallel update starts), but they must not be copied,
+  // and nothing can be parented to them, because that modifies their list of
+  // children. The siblings, that are updated concurrently, must not be read
+  // at all.
+  virtual bool threadSafeUpdate() const { return false; }
+
   virtual void shadowRenderAll();
   virtual void renderAll();
   virtual void render2DAll();
@@ -86,6 +97,7 @@ class GameObject {
 
  private:
   void initScreenSize();
+  void updateComponentsInParallel();
 
   template<typename T>
   static T* FindComponent(const GameObject* obj);
@@ -3,10 +3,16 @@
 #ifndef ENGINE_HEIGHT_MAP_H_
 #define ENGINE_HEIGHT_MAP_H_
 
+#include <cmath>
 #include <climits>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
 #include "../oglwrap/debug/insertion.h"
 #include "./transform.h"
 #include "./height_map_interface.h"
+#include "./height_sampler.h"
+#include "./min_max_pyramid.h"
 #include "./texture_source.h"
 
 namespace engine {
@@ -14,22 +20,77 @@ namespace engine {
 template<typename T>
 class HeightMap : public HeightMapInterface {
   TextureSource<T, 1> tex_;
+  float height_scale_, height_offset_;
+  MinMaxPyramid min_max_pyramid_;
+
+  // The integer texels are normalized to [0, 1] by the textures, the float
+  // ones are used as they are
+  static double Normalization() {
+    return std::is_floating_point<T>::value
+        ? 1.0 : 1.0 / double(std::numeric_limits<T>::max());
+  }
+
+  double height(double texel) const {
+    return texel * Normalization() * height_scale_ + height_offset_;
+  }
+
+  // The inverse of height(), rounded and clamped to the range of T
+  T texel(double height) const {
+    double value = (height - height_offset_) /
+                   (Normalization() * height_scale_);
+    if (std::is_floating_point<T>::value) {
+      return T(value);
+    }
+    value = std::round(value);
+    value = std::max(value, double(std::numeric_limits<T>::lowest()));
+    value = std::min(value, double(std::numeric_limits<T>::max()));
+    return T(value);
+  }
 
  public:
+  // The default height scale maps the full range of the integer texels to
+  // [0, 255], and leaves the float texels as they are.
+  static constexpr float kDefaultHeightScale =
+      std::is_floating_point<T>::value ? 1.0f : 255.0f;
+
   // Loads in a texture from a file
   // The format string may contain any of these two flags:
-  // - 'C': a compressed image will be used.
+  // - 'C': a compressed image will be used (only for the 8 bit heightmaps).
   // - 'I': an integer image will be used.
+  // The world space heights are the normalized texels (see
+  // HeightMapInterface::height_scale) multiplied by the height_scale, plus
+  // the height_offset. A 16 bit or a float heightmap with a fitting scale
+  // and offset can hold survey data without re-quantizing it to 8 bits, the
+  // 16 bit texels stay 2 bytes, both in the memory and in the texture.
   HeightMap(const std::string& file_name,
-            const std::string& format_string = "CR")
-      : tex_(file_name, format_string) {
+            const std::string& format_string = "CR",
+            float height_scale = kDefaultHeightScale,
+            float height_offset = 0.0f)
+      : tex_(file_name, format_string)
+      , height_scale_(height_scale)
+      , height_offset_(height_offset)
+      , min_max_pyramid_(tex_.data().data()->data(), tex_.w(), tex_.h(),
+                         Normalization() * height_scale, height_offset) {
     static_assert(std::is_same<T, char>::value ||
                   std::is_same<T, unsigned char>::value ||
                   std::is_same<T, short>::value ||
-                  std::is_same<T, unsigned short>::value,
-                  "Only uchar and ushort heightmaps are supported yet");
+                  std::is_same<T, unsigned short>::value ||
+                  std::is_same<T, float>::value,
+                  "Only char, short and float heightmaps are supported yet");
   }
 
+  // Copies w*h texels from the memory (row by row), like the heights of a
+  // generated terrain. The rest is the same as for the files.
+  HeightMap(int w, int h, const T* texels,
+            const std::string& format_string = "R",
+            float height_scale = kDefaultHeightScale,
+            float height_offset = 0.0f)
+      : tex_(w, h, texels, format_string)
+      , height_scale_(height_scale)
+      , height_offset_(height_offset)
+      , min_max_pyramid_(tex_.data().data()->data(), tex_.w(), tex_.h(),
+                         Normalization() * height_scale, height_offset) {}
+
   // The width and height of the texture
   virtual int w() const override { return tex_.w(); }
   virtual int h() const override { return tex_.h(); }
@@ -47,7 +108,7 @@ class HeightMap : public HeightMapInterface {
   }
 
   virtual double heightAt(int s, int t) const override {
-    return tex_(s, t)[0] / double(std::numeric_limits<T>::max()) * 255;
+    return height(tex_(s, t)[0]);
   }
 
   virtual double heightAt(double s, double t) const override {
@@ -64,9 +125,23 @@ class HeightMap : public HeightMapInterface {
     double fh = glm::mix(double(tex_(fs, ft)[0]), double(tex_(cs, ft)[0]), s-fs);
     double ch = glm::mix(double(tex_(fs, ct)[0]), double(tex_(cs, ct)[0]), s-fs);
 
-    return glm::mix(fh, ch, t-ft) / double(std::numeric_limits<T>::max()) * 255;
+    return height(glm::mix(fh, ch, t-ft));
+  }
+
+  // The same heights, without virtual calls
+  HeightSampler<T> sampler() const {
+    return HeightSampler<T>(&tex_.data().data()->front(), w(), h(),
+                            Normalization() * height_scale_, height_offset_);
+  }
+
+  virtual void sampleHeights(const glm::vec2* points, float* heights,
+                             size_t count) const override {
+    sampler().sampleHeights(points, heights, count);
   }
 
+  virtual float height_scale() const override { return height_scale_; }
+  virtual float height_offset() const override { return height_offset_; }
+
   virtual gl::PixelDataFormat format() const override {
     return tex_.format();
   }
@@ -79,9 +154,40 @@ class HeightMap : public HeightMapInterface {
     tex_.upload(tex);
   }
 
+  virtual void uploadRect(gl::Texture2D& tex,
+                          int x0, int y0, int x1, int y1) const override {
+    tex_.subUpload(tex, x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+  }
+
+  virtual void modifyHeights(int x0, int y0, int x1, int y1,
+                             const HeightModifier& modify) override {
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, w() - 1);
+    y1 = std::min(y1, h() - 1);
+    for (int t = y0; t <= y1; ++t) {
+      for (int s = x0; s <= x1; ++s) {
+        T& value = tex_(s, t)[0];
+        value = texel(modify(s, t, height(value)));
+      }
+    }
+    min_max_pyramid_.update(tex_.data().data()->data(),
+                            Normalization() * height_scale_, height_offset_,
+                            x0, y0, x1, y1);
+  }
+
   virtual const void* data() const override {
     return tex_.data().data();
   }
+
+  // Doesn't touch the texels, uses the min/max pyramid instead
+  virtual glm::dvec2 getMinMaxOfArea(int x, int y, int w, int h) const override {
+    return glm::dvec2(min_max_pyramid_.minMaxOfArea(x, y, w, h));
+  }
+
+  virtual const MinMaxPyramid* min_max_pyramid() const override {
+    return &min_max_pyramid_;
+  }
 };
 
 }  // namespace engine
@@ -1,7 +1,27 @@
 #include "height_map_interface.h"
+#include <stdexcept>
 
 namespace engine {
 
+void HeightMapInterface::sampleHeights(const glm::vec2* points,
+                                       float* heights, size_t count) const {
+  for (size_t i = 0; i < count; ++i) {
+    heights[i] = heightAt(double(points[i].x), double(points[i].y));
+  }
+}
+
+void HeightMapInterface::uploadRect(gl::Texture2D& tex,
+                                    int x0, int y0, int x1, int y1) const {
+  throw std::logic_error("engine::HeightMapInterface: this heightmap doesn't "
+                         "support partial uploads");
+}
+
+void HeightMapInterface::modifyHeights(int x0, int y0, int x1, int y1,
+                                       const HeightModifier& modify) {
+  throw std::logic_error("engine::HeightMapInterface: this heightmap is "
+                         "read-only");
+}
+
 glm::dvec2 HeightMapInterface::getMinMaxOfArea(int x, int y, int w, int h) const {
   double zero = 0.0;
   double infinity = 1.0 / zero;
@@ -3,11 +3,15 @@
 #ifndef ENGINE_HEIGHT_MAP_INTERFACE_H_
 #define ENGINE_HEIGHT_MAP_INTERFACE_H_
 
+#include <cstddef>
+#include <functional>
 #include "./oglwrap_config.h"
 #include "../oglwrap/textures/texture_2D.h"
 
 namespace engine {
 
+class MinMaxPyramid;
+
 // An interface to get data from a heightmap
 class HeightMapInterface {
  public:
@@ -29,6 +33,20 @@ class HeightMapInterface {
   // Texture space fetch with interpolation
   virtual double heightAt(double s, double t) const = 0;
 
+  // Samples the heights at count texture space points, with interpolation.
+  // It's one virtual call for all the points, the implementations, that
+  // have the texels in the memory, use a HeightSampler for it.
+  virtual void sampleHeights(const glm::vec2* points, float* heights,
+                             size_t count) const;
+
+  // The world space height of a texel is height_scale() * value +
+  // height_offset(), where the value is what a shader samples from the
+  // uploaded texture (normalized to [0, 1] for the integer texels). The
+  // heights returned by the functions above already include these. The
+  // default maps the 8 bit range to [0, 255].
+  virtual float height_scale() const { return 255.0f; }
+  virtual float height_offset() const { return 0.0f; }
+
   // Returns the format of the height data
   virtual gl::PixelDataFormat format() const = 0;
 
@@ -38,12 +56,33 @@ class HeightMapInterface {
   // Uploads the heightmap to a texture object
   virtual void upload(gl::Texture2D& tex) const = 0;
 
+  // Uploads the inclusive texel rectangle between (x0, y0) and (x1, y1) to a
+  // bound texture, that already has the whole heightmap (see upload). The
+  // default throws std::logic_error.
+  virtual void uploadRect(gl::Texture2D& tex,
+                          int x0, int y0, int x1, int y1) const;
+
+  // Gets the texture space coordinates and the world space height of a
+  // texel, and returns its new height
+  using HeightModifier = std::function<double(int s, int t, double height)>;
+
+  // Changes the heights of the inclusive texel rectangle between (x0, y0)
+  // and (x1, y1) (clamped to the heightmap), and updates the min/max
+  // pyramid. The new heights are rounded to the precision of the texels.
+  // The default throws std::logic_error, for the read-only heightmaps.
+  virtual void modifyHeights(int x0, int y0, int x1, int y1,
+                             const HeightModifier& modify);
+
   // Returns a pointer to the heightfield data
   virtual const void* data() const = 0;
 
   // Returns dvec2{min, max} of area between (x-w/2, y-h/2) and (x+w/2, y+h/2)
   // it returns {0, 0} if the area requested doesn't contain a single valid value
   virtual glm::dvec2 getMinMaxOfArea(int x, int y, int w, int h) const;
+
+  // Returns the min/max pyramid of the heights (see MinMaxPyramid), or
+  // nullptr if the implementation doesn't have one
+  virtual const MinMaxPyramid* min_max_pyramid() const { return nullptr; }
 };
 
 }  // namespace engine
@@ -0,0 +1,60 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_HEIGHT_SAMPLER_INL_H_
+#define ENGINE_HEIGHT_SAMPLER_INL_H_
+
+#include <algorithm>
+#include <stdexcept>
+#include "./height_sampler.h"
+
+namespace engine {
+
+template<typename T>
+HeightSampler<T>::HeightSampler(const T* data, int w, int h, float scale,
+                                float offset)
+    : data_(data), w_(w), h_(h), scale_(scale), offset_(offset) {
+  if (!data || w <= 0 || h <= 0) {
+    throw std::invalid_argument("engine::HeightSampler: invalid texels");
+  }
+}
+
+template<typename T>
+inline float HeightSampler<T>::heightAt(int s, int t) const {
+  s = std::min(std::max(s, 0), w_-1);
+  t = std::min(std::max(t, 0), h_-1);
+  return float(data_[size_t(t)*w_ + s]) * scale_ + offset_;
+}
+
+// The SIMD kernels in height_sampler.cc do the same operations, in the same
+// order, so their results are exactly the same.
+template<typename T>
+inline float HeightSampler<T>::heightAt(float s, float t) const {
+  // NaN goes to zero, like with the max instructions of the kernels
+  s = !(s > 0.0f) ? 0.0f : std::min(s, float(w_-1));
+  t = !(t > 0.0f) ? 0.0f : std::min(t, float(h_-1));
+
+  // They aren't negative, so the truncation is the floor
+  int s0 = int(s), t0 = int(t);
+  float fs = s - float(s0), ft = t - float(t0);
+  int s1 = s0 + (s0 < w_-1), t1 = t0 + (t0 < h_-1);
+
+  const T* row0 = data_ + size_t(t0)*w_;
+  const T* row1 = data_ + size_t(t1)*w_;
+  float h00 = float(row0[s0]), h10 = float(row0[s1]);
+  float h01 = float(row1[s0]), h11 = float(row1[s1]);
+
+  float h0 = h00 + (h10 - h00) * fs;
+  float h1 = h01 + (h11 - h01) * fs;
+  return (h0 + (h1 - h0) * ft) * scale_ + offset_;
+}
+
+template<typename T>
+void HeightSampler<T>::sampleHeights(const std::vector<glm::vec2>& points,
+                                     std::vector<float>* heights) const {
+  heights->resize(points.size());
+  sampleHeights(points.data(), heights->data(), points.size());
+}
+
+}  // namespace engine
+
+#endif
@@ -0,0 +1,218 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <limits>
+#include <type_traits>
+#include "./height_sampler.h"
+#include "./collision/cull_batch.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || \
+    defined(__i386__) || defined(_M_IX86)
+  #define ENGINE_HEIGHT_SAMPLER_X86 1
+  #include <immintrin.h>
+  #ifdef _MSC_VER
+    #define ENGINE_HEIGHT_SAMPLER_TARGET(isa)
+  #else
+    #define ENGINE_HEIGHT_SAMPLER_TARGET(isa) __attribute__((target(isa)))
+  #endif
+#else
+  #define ENGINE_HEIGHT_SAMPLER_X86 0
+#endif
+
+namespace engine {
+
+namespace {
+
+// The sampler is copied, so its members don't have to be reloaded after
+// every store to heights (which could alias the scale)
+template<typename T>
+void ScalarKernel(HeightSampler<T> sampler, const glm::vec2* points,
+                  float* heights, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; ++i) {
+    heights[i] = sampler.heightAt(points[i].x, points[i].y);
+  }
+}
+
+#if ENGINE_HEIGHT_SAMPLER_X86
+
+// The SSE2 kernel doesn't have gathers (nor 32 bit multiplication), so it
+// only computes the coordinates and the interpolation with vectors, and
+// fetches the 16 texels one by one.
+template<typename T>
+ENGINE_HEIGHT_SAMPLER_TARGET("sse2")
+void Sse2Kernel(const HeightSampler<T>& sampler, const glm::vec2* points,
+                float* heights, size_t begin, size_t end) {
+  const T* data = sampler.data();
+  const int w = sampler.w(), h = sampler.h();
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 max_s = _mm_set1_ps(float(w-1));
+  const __m128 max_t = _mm_set1_ps(float(h-1));
+  const __m128i max_si = _mm_set1_epi32(w-1);
+  const __m128i max_ti = _mm_set1_epi32(h-1);
+  const __m128 scale = _mm_set1_ps(sampler.scale());
+  const __m128 offset = _mm_set1_ps(sampler.offset());
+
+  alignas(16) int32_t s0[4], s1[4], t0[4], t1[4];
+  alignas(16) float h00[4], h10[4], h01[4], h11[4];
+
+  size_t i = begin;
+  for (; i + 4 <= end; i += 4) {
+    const float* p = &points[i].x;
+    __m128 a = _mm_loadu_ps(p), b = _mm_loadu_ps(p + 4);
+    __m128 s = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 t = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+    s = _mm_min_ps(_mm_max_ps(s, zero), max_s);
+    t = _mm_min_ps(_mm_max_ps(t, zero), max_t);
+
+    __m128i si = _mm_cvttps_epi32(s), ti = _mm_cvttps_epi32(t);
+    __m128 fs = _mm_sub_ps(s, _mm_cvtepi32_ps(si));
+    __m128 ft = _mm_sub_ps(t, _mm_cvtepi32_ps(ti));
+    // The comparison gives -1 for true
+    _mm_store_si128(reinterpret_cast<__m128i*>(s0), si);
+    _mm_store_si128(reinterpret_cast<__m128i*>(t0), ti);
+    _mm_store_si128(reinterpret_cast<__m128i*>(s1),
+                    _mm_sub_epi32(si, _mm_cmplt_epi32(si, max_si)));
+    _mm_store_si128(reinterpret_cast<__m128i*>(t1),
+                    _mm_sub_epi32(ti, _mm_cmplt_epi32(ti, max_ti)));
+
+    for (int j = 0; j < 4; ++j) {
+      const T* row0 = data + size_t(t0[j])*w;
+      const T* row1 = data + size_t(t1[j])*w;
+      h00[j] = float(row0[s0[j]]);
+      h10[j] = float(row0[s1[j]]);
+      h01[j] = float(row1[s0[j]]);
+      h11[j] = float(row1[s1[j]]);
+    }
+
+    __m128 v00 = _mm_load_ps(h00), v10 = _mm_load_ps(h10);
+    __m128 v01 = _mm_load_ps(h01), v11 = _mm_load_ps(h11);
+    __m128 h0 = _mm_add_ps(v00, _mm_mul_ps(_mm_sub_ps(v10, v00), fs));
+    __m128 h1 = _mm_add_ps(v01, _mm_mul_ps(_mm_sub_ps(v11, v01), fs));
+    __m128 height = _mm_add_ps(h0, _mm_mul_ps(_mm_sub_ps(h1, h0), ft));
+    _mm_storeu_ps(heights + i,
+                  _mm_add_ps(_mm_mul_ps(height, scale), offset));
+  }
+  ScalarKernel(sampler, points, heights, i, end);
+}
+
+// Fetches the texels at the indices. The integer texels are gathered as
+// 32 bit words, that end at the texel (or begin at it, for the first few
+// bytes of the data), so the gathers never read outside of the data.
+template<typename T>
+ENGINE_HEIGHT_SAMPLER_TARGET("avx2")
+inline __m256 Avx2Fetch(const T* data, __m256i index) {
+  const int kPadding = 4 - sizeof(T);
+  const char* bytes = reinterpret_cast<const char*>(data);
+  __m256i offset = _mm256_mullo_epi32(index, _mm256_set1_epi32(sizeof(T)));
+  if (kPadding == 0) {
+    if (std::is_floating_point<T>::value) {
+      return _mm256_i32gather_ps(reinterpret_cast<const float*>(bytes),
+                                 offset, 1);
+    }
+    return _mm256_cvtepi32_ps(_mm256_i32gather_epi32(
+        reinterpret_cast<const int*>(bytes), offset, 1));
+  }
+
+  // The words, that begin at the texel, are shifted left, so that the texel
+  // is in the highest bytes of all of the words
+  __m256i padding = _mm256_set1_epi32(kPadding);
+  __m256i at_begin = _mm256_cmpgt_epi32(padding, offset);
+  __m256i word_offset = _mm256_sub_epi32(offset,
+                                         _mm256_andnot_si256(at_begin, padding));
+  __m256i word = _mm256_i32gather_epi32(reinterpret_cast<const int*>(bytes),
+                                        word_offset, 1);
+  word = _mm256_sllv_epi32(word, _mm256_and_si256(
+      at_begin, _mm256_set1_epi32(8*kPadding)));
+  word = std::is_signed<T>::value ? _mm256_srai_epi32(word, 8*kPadding)
+                                  : _mm256_srli_epi32(word, 8*kPadding);
+  return _mm256_cvtepi32_ps(word);
+}
+
+template<typename T>
+ENGINE_HEIGHT_SAMPLER_TARGET("avx2")
+void Avx2Kernel(const HeightSampler<T>& sampler, const glm::vec2* points,
+                float* heights, size_t begin, size_t end) {
+  const T* data = sampler.data();
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 max_s = _mm256_set1_ps(float(sampler.w()-1));
+  const __m256 max_t = _mm256_set1_ps(float(sampler.h()-1));
+  const __m256i max_si = _mm256_set1_epi32(sampler.w()-1);
+  const __m256i max_ti = _mm256_set1_epi32(sampler.h()-1);
+  const __m256i w = _mm256_set1_epi32(sampler.w());
+  const __m256 scale = _mm256_set1_ps(sampler.scale());
+  const __m256 offset = _mm256_set1_ps(sampler.offset());
+
+  size_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    // The shuffles work within the 128 bit lanes, so the 64 bit blocks have
+    // to be reordered after them
+    const float* p = &points[i].x;
+    __m256 a = _mm256_loadu_ps(p), b = _mm256_loadu_ps(p + 8);
+    __m256 s = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(
+        _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))),
+        _MM_SHUFFLE(3, 1, 2, 0)));
+    __m256 t = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(
+        _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))),
+        _MM_SHUFFLE(3, 1, 2, 0)));
+    s = _mm256_min_ps(_mm256_max_ps(s, zero), max_s);
+    t = _mm256_min_ps(_mm256_max_ps(t, zero), max_t);
+
+    __m256i s0 = _mm256_cvttps_epi32(s), t0 = _mm256_cvttps_epi32(t);
+    __m256 fs = _mm256_sub_ps(s, _mm256_cvtepi32_ps(s0));
+    __m256 ft = _mm256_sub_ps(t, _mm256_cvtepi32_ps(t0));
+    __m256i s1 = _mm256_sub_epi32(s0, _mm256_cmpgt_epi32(max_si, s0));
+    __m256i t1 = _mm256_sub_epi32(t0, _mm256_cmpgt_epi32(max_ti, t0));
+
+    __m256i row0 = _mm256_mullo_epi32(t0, w);
+    __m256i row1 = _mm256_mullo_epi32(t1, w);
+    __m256 h00 = Avx2Fetch(data, _mm256_add_epi32(row0, s0));
+    __m256 h10 = Avx2Fetch(data, _mm256_add_epi32(row0, s1));
+    __m256 h01 = Avx2Fetch(data, _mm256_add_epi32(row1, s0));
+    __m256 h11 = Avx2Fetch(data, _mm256_add_epi32(row1, s1));
+
+    // No FMAs, they would round differently than the scalar code
+    __m256 h0 = _mm256_add_ps(h00, _mm256_mul_ps(_mm256_sub_ps(h10, h00), fs));
+    __m256 h1 = _mm256_add_ps(h01, _mm256_mul_ps(_mm256_sub_ps(h11, h01), fs));
+    __m256 height = _mm256_add_ps(h0, _mm256_mul_ps(_mm256_sub_ps(h1, h0), ft));
+    _mm256_storeu_ps(heights + i,
+                     _mm256_add_ps(_mm256_mul_ps(height, scale), offset));
+  }
+  Sse2Kernel(sampler, points, heights, i, end);
+}
+
+#endif  // ENGINE_HEIGHT_SAMPLER_X86
+
+}  // namespace
+
+template<typename T>
+void HeightSampler<T>::sampleHeights(const glm::vec2* points, float* heights,
+                                     size_t count) const {
+#if ENGINE_HEIGHT_SAMPLER_X86
+  // The gathers use 32 bit byte offsets, and read 4 bytes
+  size_t size = size_t(w_) * h_ * sizeof(T);
+  bool gatherable = 4 <= size &&
+                    size <= size_t(std::numeric_limits<int32_t>::max());
+  switch (CullBatch::instruction_set()) {
+    case CullBatch::InstructionSet::kAvx2:
+      if (gatherable) {
+        Avx2Kernel(*this, points, heights, 0, count);
+        return;
+      }
+      // fallthrough
+    case CullBatch::InstructionSet::kSse2:
+      Sse2Kernel(*this, points, heights, 0, count);
+      return;
+    default:
+      break;
+  }
+#endif
+  ScalarKernel(*this, points, heights, 0, count);
+}
+
+template class HeightSampler<unsigned char>;
+template class HeightSampler<char>;
+template class HeightSampler<signed char>;
+template class HeightSampler<unsigned short>;
+template class HeightSampler<short>;
+template class HeightSampler<float>;
+
+}  // namespace engine
@@ -0,0 +1,61 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_HEIGHT_SAMPLER_H_
+#define ENGINE_HEIGHT_SAMPLER_H_
+
+#include <vector>
+#include <cstddef>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+namespace engine {
+
+// A non-virtual view of the texels of a heightmap, that is in the memory,
+// for the code, that samples a lot of heights. The heights are the texels
+// multiplied by the scale, plus the offset. The coordinates are in texture
+// space (like at HeightMapInterface), and are clamped to the edges of the
+// heightmap.
+//
+// The sampling functions are inlined, except the batched one, which is
+// explicitly instantiated in height_sampler.cc for 8 and 16 bit integer and
+// float texels.
+template<typename T>
+class HeightSampler {
+ public:
+  HeightSampler(const T* data, int w, int h, float scale = 1.0f,
+                float offset = 0.0f);
+
+  int w() const { return w_; }
+  int h() const { return h_; }
+  const T* data() const { return data_; }
+  float scale() const { return scale_; }
+  float offset() const { return offset_; }
+
+  // Texture space fetch
+  float heightAt(int s, int t) const;
+
+  // Texture space fetch with bilinear interpolation
+  float heightAt(float s, float t) const;
+  float heightAt(const glm::vec2& pos) const { return heightAt(pos.x, pos.y); }
+
+  // Samples the heights at count points. It uses SSE2 or AVX2 (with
+  // gathers) if the cpu has them, the instruction set is chosen like at
+  // CullBatch. The results are the same as heightAt's.
+  void sampleHeights(const glm::vec2* points, float* heights,
+                     size_t count) const;
+
+  // Resizes heights to the number of points
+  void sampleHeights(const std::vector<glm::vec2>& points,
+                     std::vector<float>* heights) const;
+
+ private:
+  const T* data_;
+  int w_, h_;
+  float scale_, offset_;
+};
+
+}  // namespace engine
+
+#include "./height_sampler-inl.h"
+
+#endif
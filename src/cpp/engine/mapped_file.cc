@@ -0,0 +1,98 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <stdexcept>
+#include "./mapped_file.h"
+
+#ifdef _WIN32
+  #define WIN32_LEAN_AND_MEAN
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+#endif
+
+namespace engine {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& filename) {
+  file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file_ == INVALID_HANDLE_VALUE) {
+    file_ = nullptr;
+    throw std::runtime_error("MappedFile: can't open '" + filename + "'");
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0) {
+    CloseHandle(file_);
+    throw std::runtime_error("MappedFile: '" + filename + "' is empty");
+  }
+  size_ = size.QuadPart;
+
+  mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping_) {
+    data_ = static_cast<const unsigned char*>(
+      MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  }
+  if (!data_) {
+    if (mapping_) {
+      CloseHandle(mapping_);
+    }
+    CloseHandle(file_);
+    throw std::runtime_error("MappedFile: can't map '" + filename + "'");
+  }
+}
+
+MappedFile::~MappedFile() {
+  UnmapViewOfFile(data_);
+  CloseHandle(mapping_);
+  CloseHandle(file_);
+}
+
+void MappedFile::prefetch(size_t offset, size_t size) const {
+  // PrefetchVirtualMemory isn't available before Windows 8, the pages are
+  // loaded at the first touch instead.
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    throw std::runtime_error("MappedFile: can't open '" + filename + "'");
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) == -1 || file_stat.st_size == 0) {
+    close(fd);
+    throw std::runtime_error("MappedFile: '" + filename + "' is empty");
+  }
+  size_ = file_stat.st_size;
+
+  void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps the file alive, the descriptor isn't needed anymore
+  close(fd);
+  if (data == MAP_FAILED) {
+    throw std::runtime_error("MappedFile: can't map '" + filename + "'");
+  }
+  data_ = static_cast<const unsigned char*>(data);
+}
+
+MappedFile::~MappedFile() {
+  munmap(const_cast<unsigned char*>(data_), size_);
+}
+
+void MappedFile::prefetch(size_t offset, size_t size) const {
+  // madvise needs a page aligned address
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t begin = offset / page_size * page_size;
+  madvise(const_cast<unsigned char*>(data_) + begin,
+          offset + size - begin, MADV_WILLNEED);
+}
+
+#endif
+
+}  // namespace engine
@@ -0,0 +1,42 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_MAPPED_FILE_H_
+#define ENGINE_MAPPED_FILE_H_
+
+#include <string>
+#include <cstddef>
+
+namespace engine {
+
+// A read-only memory mapping of a whole file. Nothing is read at creation,
+// the pages are loaded by the OS when they are first touched, and they can
+// be dropped again under memory pressure, so files much bigger than the RAM
+// can be mapped. Reading the mapping from several threads is safe.
+class MappedFile {
+ public:
+  // Throws std::runtime_error if the file can't be opened or mapped.
+  explicit MappedFile(const std::string& filename);
+  ~MappedFile();
+
+  const unsigned char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+  // Hints the OS that a range will be read soon, so it can start loading it.
+  void prefetch(size_t offset, size_t size) const;
+
+ private:
+  const unsigned char* data_ = nullptr;
+  size_t size_ = 0;
+
+#ifdef _WIN32
+  void* file_ = nullptr;
+  void* mapping_ = nullptr;
+#endif
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+};
+
+}  // namespace engine
+
+#endif
@@ -9,6 +9,7 @@
 #include "../oglwrap_config.h"
 
 #include "anim_state.h"
+#include "animation_clip.h"
 #include "../assimp.h"
 
 namespace engine {
@@ -23,6 +24,14 @@ struct AnimInfo {
   /// Handle for the animations
   const aiScene* handle;
 
+  /// The animation baked for fast sampling. Shared between the animations
+  /// that use the same file.
+  std::shared_ptr<const AnimationClip> clip;
+
+  /// The track of the clip for every node of the mesh's skeleton
+  /// (-1 for the nodes that aren't animated).
+  std::vector<int> track_of_node;
+
   /// The name of the animation.
   std::string name;
 
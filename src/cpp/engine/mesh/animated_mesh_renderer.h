@@ -4,6 +4,7 @@
 #define ENGINE_MESH_ANIMATED_MESH_RENDERER_H_
 
 #include <string>
+#include <vector>
 #include <functional>
 
 #include "../oglwrap_config.h"
@@ -14,6 +15,9 @@
 #include "./anim_state.h"
 #include "./skinning_data.h"
 #include "./anim_info.h"
+#include "./skeleton.h"
+#include "./pose.h"
+#include "./blend_tree.h"
 
 namespace engine {
 
@@ -27,6 +31,15 @@ class AnimatedMeshRenderer : public MeshRenderer {
   /// The animations.
   AnimData anims_;
 
+  /// The node hierarchy in a flat form, for the pose updates.
+  Skeleton skeleton_;
+
+  /// The model space transformations of the nodes, used during the pose update.
+  std::vector<glm::mat4> global_transforms_;
+
+  /// The skinning matrices, used during the pose update.
+  std::vector<glm::mat4> bone_transforms_;
+
  public:
   /**
    * @brief Loads in the mesh and the skeleton for an asset, and prepares it
@@ -38,9 +51,16 @@ class AnimatedMeshRenderer : public MeshRenderer {
   AnimatedMeshRenderer(const std::string& filename,
                        gl::Bitfield<aiPostProcessSteps> flags);
 
+  /// Prepares a mesh, that was already loaded in by MeshRenderer::Import.
+  AnimatedMeshRenderer(const std::string& filename,
+                       std::unique_ptr<Assimp::Importer> importer);
+
   /// Returns a reference to the animation resources
   const AnimData& getAnimData() const { return anims_; }
 
+  /// Returns the node hierarchy, that the BlendTrees should be built for.
+  const Skeleton& skeleton() const { return skeleton_; }
+
   // ---------------------------- Skin definition ------------------------------
 
   /**
@@ -93,6 +113,33 @@ class AnimatedMeshRenderer : public MeshRenderer {
   void updateBoneInfo(Animation& animation,
                       float time_in_seconds);
 
+  /**
+   * @brief Updates the bones' transformations from a blend tree.
+   *
+   * @param blend_tree       A tree built for this renderer's skeleton().
+   * @param time_in_seconds  The current time.
+   */
+  void updateBoneInfo(BlendTree& blend_tree, float time_in_seconds);
+
+  /**
+   * @brief Updates the bones of many instances at once.
+   *
+   * The animations are advanced on the calling thread (so the animation ended
+   * callbacks are called there), but the poses are evaluated in parallel on
+   * the TaskScheduler. The results aren't stored in the renderer, and the
+   * external bones are ignored.
+   *
+   * @param animations       The animations of the instances. Each should
+   *                         be in the batch only once.
+   * @param time_in_seconds  The current time.
+   * @param bones            Receives the skinning matrices of the instances,
+   *                         getNumBones() of them per instance, in the order
+   *                         of the animations.
+   */
+  void updateBoneInfos(const std::vector<Animation*>& animations,
+                       float time_in_seconds,
+                       std::vector<glm::mat4>& bones);
+
   /**
    * @brief Uploads the bones' transformations into the given uniform array.
    *
@@ -100,6 +147,17 @@ class AnimatedMeshRenderer : public MeshRenderer {
    */
   void uploadBoneInfo(gl::LazyUniform<glm::mat4>& bones);
 
+  /**
+   * @brief Uploads the bones of one instance of a batch update.
+   *
+   * @param bones     The uniform naming the bones array.
+   * @param batch     The matrices written by updateBoneInfos.
+   * @param instance  The index of the instance in the batch.
+   */
+  void uploadBoneInfo(gl::LazyUniform<glm::mat4>& bones,
+                      const std::vector<glm::mat4>& batch,
+                      size_t instance);
+
   /**
    * @brief Updates the bones transformation and uploads them into the given
    *        uniforms.
@@ -138,6 +196,32 @@ class AnimatedMeshRenderer : public MeshRenderer {
                     gl::Bitfield<AnimFlag> flags = AnimFlag::None,
                     float speed = 1.0f);
 
+  /// The parameters of one addAnimation call.
+  struct AnimParams {
+    std::string filename;
+    std::string anim_name;
+    gl::Bitfield<AnimFlag> flags;
+    float speed;
+
+    AnimParams(const std::string& filename,
+               const std::string& anim_name,
+               gl::Bitfield<AnimFlag> flags = AnimFlag::None,
+               float speed = 1.0f)
+        : filename(filename), anim_name(anim_name)
+        , flags(flags), speed(speed) { }
+  };
+
+  /**
+   * @brief Adds more external animations at once.
+   *
+   * Works like calling addAnimation for every element, but the files are
+   * parsed in parallel, and a file that is used by more animations is only
+   * parsed once. If any of them fails, none of them is added.
+   *
+   * @param anims   The parameters of the addAnimation calls.
+   */
+  void addAnimations(const std::vector<AnimParams>& anims);
+
  private:
   /// It shouldn't be copyable.
   AnimatedMeshRenderer(const AnimatedMeshRenderer& src) = delete;
@@ -226,72 +310,6 @@ class AnimatedMeshRenderer : public MeshRenderer {
 
   // -------------------------------- Animation --------------------------------
 
-  /**
-   * @brief Returns the index of the currently active translation keyframe for
-   *        the given animation and time.
-   *
-   * @param anim_time   The time elapsed since the start of this animation.
-   * @param node_anim   The animation node, in which the function should search
-   *                    for a keyframe.
-   */
-  unsigned findPosition(float anim_time, const aiNodeAnim* node_anim);
-
-  /**
-   * @brief Returns the index of the currently active rotation keyframe for
-   *        the given animation and time.
-   *
-   * @param anim_time   The time elapsed since the start of this animation.
-   * @param node_anim   The animation node, in which the function should search
-   *                    for a keyframe.
-   */
-  unsigned findRotation(float anim_time, const aiNodeAnim* node_anim);
-
-  /**
-   * @brief Returns the index of the currently active scaling keyframe for
-   *        the given animation and time.
-   *
-   * @param anim_time   The time elapsed since the start of this animation.
-   * @param node_anim   The animation node, in which the function should search
-   *                    for a keyframe.
-   */
-  unsigned findScaling(float anim_time, const aiNodeAnim* node_anim);
-
-  /**
-   * @brief Returns a linearly interpolated value between the previous and next
-   *        translation keyframes.
-   *
-   * @param out         Returns the result here.
-   * @param anim_time   The time elapsed since the start of this animation.
-   * @param node_anim   The animation node, in which the function should search
-   *                    for the keyframes.
-   */
-  void calcInterpolatedPosition(aiVector3D& out, float anim_time,
-                                const aiNodeAnim* node_anim);
-
-  /**
-   * @brief Returns a spherically interpolated value (always choosing the shorter
-   * path) between the previous and next rotation keyframes.
-   *
-   * @param out         Returns the result here.
-   * @param anim_time   The time elapsed since the start of this animation.
-   * @param node_anim   The animation node, in which the function should search
-   *                    for the keyframes.
-   */
-  void calcInterpolatedRotation(aiQuaternion& out, float anim_time,
-                                const aiNodeAnim* node_anim);
-
-  /**
-   * @brief Returns a linearly interpolated value between the previous and next
-   *        scaling keyframes.
-   *
-   * @param out         Returns the result here.
-   * @param anim_time   The time elapsed since the start of this animation.
-   * @param node_anim   The animation node, in which the function should search
-   *                    for the keyframes.
-   */
-  void calcInterpolatedScaling(aiVector3D& out, float anim_time,
-                               const aiNodeAnim* node_anim);
-
   /**
    * @brief Returns the animation node in the given animation, referenced by
    *        its name.
@@ -305,51 +323,39 @@ class AnimatedMeshRenderer : public MeshRenderer {
   const aiNodeAnim* findNodeAnim(const aiAnimation* animation,
                                  const std::string node_name);
 
+  /// The state of an animation update between its steps.
+  struct PoseUpdate {
+    PoseInput input;
+    float time_in_ticks;
+  };
+
   /**
-   * @brief Recursive function that travels through the entire node hierarchy,
-   *        and creates transformation values in world space.
+   * @brief Advances the animation to the given time, and returns what should
+   *        be sampled for the pose.
    *
-   * Bone transformations are stored relative to their parents. That's why it is
-   * needed. Also note, that the translation of the root node on the XZ plane is
-   * treated differently, that offset isn't baked into the animation, you can get
-   * the offset with the offsetSinceLastFrame() function, and you have to
-   * externally do the object's movement, as normally it will stay right where
-   * it was at the start of the animation.
+   * If the current animation ended, it changes to the next one (calling the
+   * animation ended callback). Also note, that the translation of the root
+   * bone on the XZ plane is treated differently, that offset isn't baked into
+   * the animation, you can get the offset with the offsetSinceLastFrame()
+   * function, and you have to externally do the object's movement, as
+   * normally it will stay right where it was at the start of the animation.
    *
-   * @param animation          The animation to update.
-   * @param anim_time          The current animation time.
-   * @param node               The node (bone) whose, and whose child's
-   *                           transformation should be updated. You should call
-   *                           this function with the root node.
-   * @param parent_transform   The transformation of the parent node. You should
-   *                           call it with an identity matrix.
+   * @param animation   The animation to update.
+   * @param time        The current time in seconds.
    */
-  void updateBoneTree(Animation& animation,
-                      float anim_time,
-                      const aiNode* node,
-                      const glm::mat4& parent_transform = glm::mat4());
+  PoseUpdate startUpdate(Animation& animation, float time);
+
+  /// Copies the result of a pose evaluation into the skinning data,
+  /// except for the external bones.
+  void storeBoneInfo();
 
   /**
-   * @brief Does the same thing as readNodeHierarchy, but it is used to create
-   *        transitions between animations, so it interpolates between four
-   *        keyframes not two.
+   * @brief Handles the start of a new loop, after the pose is evaluated.
    *
-   * @param animation             The animation to update.
-   * @param prev_animation_time   The animation time of when, the last animation
-   *                              was interrupted.
-   * @param next_animation_time   The current animation time.
-   * @param node                  The node (bone) whose, and whose child's
-   *                              transformation should be updated. You should
-   *                              call this function with the root node.
-   * @param parent_transform      The transformation of the parent node. You
-   *                              should call it with an identity matrix.
+   * @param animation   The animation to update.
+   * @param update      The value returned by startUpdate.
    */
-  void updateBoneTreeInTransition(Animation& animation,
-                                  float prev_animation_time,
-                                  float next_animation_time,
-                                  float factor,
-                                  const aiNode* node,
-                                  const glm::mat4& parent_transform = glm::mat4());
+  void finishUpdate(Animation& animation, const PoseUpdate& update);
 
 };  // AnimatedMeshRenderer
 }  // namespace engine
@@ -1,51 +1,127 @@
 // Copyright (c) 2014, Tamas Csala
 
+#include <map>
+#include <utility>
 #include "animated_mesh_renderer.h"
+#include "../task_scheduler.h"
 
 namespace engine {
 
 AnimatedMeshRenderer::AnimatedMeshRenderer(
                                   const std::string& filename,
                                   gl::Bitfield<aiPostProcessSteps> flags)
-  : MeshRenderer(filename, flags)
+  : AnimatedMeshRenderer(filename, Import(filename, flags)) {}
+
+AnimatedMeshRenderer::AnimatedMeshRenderer(
+                                  const std::string& filename,
+                                  std::unique_ptr<Assimp::Importer> importer)
+  : MeshRenderer(filename, std::move(importer))
   , skinning_data_(scene_->mNumMeshes) {
+  mapBones();
+  std::vector<glm::mat4> bone_offsets;
+  for (const SkinningData::BoneInfo& bone_info : skinning_data_.bone_info) {
+    bone_offsets.push_back(bone_info.bone_offset);
+  }
+  skeleton_ = Skeleton(scene_->mRootNode, skinning_data_.bone_mapping,
+                       bone_offsets);
+  global_transforms_.resize(skeleton_.node_count());
+  bone_transforms_.resize(skeleton_.bone_count());
 }
 
 void AnimatedMeshRenderer::addAnimation(const std::string& filename,
                                         const std::string& anim_name,
                                         gl::Bitfield<AnimFlag> flags,
                                         float speed) {
-  if (anims_.canFind(anim_name)) {
-    throw std::runtime_error(
-      "Animation name '" + anim_name + "' isn't unique for '" + filename + "'"
-    );
-  }
-  size_t idx = anims_.data.size();
-  anims_.names[anim_name] = idx;
-  anims_.data.push_back(AnimInfo());
-  anims_[idx].name = anim_name;
-  anims_[idx].handle = anims_[idx].importer->ReadFile(filename, aiProcess_Debone);
-  if (!anims_[idx].handle) {
-    throw std::runtime_error("Error parsing " + filename
-                              + " : " + anims_[idx].importer->GetErrorString());
-  }
+  addAnimations({AnimParams{filename, anim_name, flags, speed}});
+}
+
+void AnimatedMeshRenderer::addAnimations(const std::vector<AnimParams>& anims) {
+  std::vector<AnimInfo> infos(anims.size());
 
-  auto node = getRootBone(scene_->mRootNode, anims_[idx].handle);
-  if (!node) {
-    throw std::runtime_error(
-      "Animation error: The mesh's skeleton, and the animated skeleton '"
-      + anim_name + "' doesn't have a single bone in common."
-    );
+  // Check the names first, and find out which files have to be parsed
+  std::map<std::string, size_t> first_use_of_file;
+  std::vector<size_t> files_to_parse;
+  std::vector<size_t> parsed_by(anims.size());
+  for (size_t i = 0; i < anims.size(); ++i) {
+    const AnimParams& params = anims[i];
+    bool name_is_used = anims_.canFind(params.anim_name);
+    for (size_t j = 0; j < i && !name_is_used; ++j) {
+      name_is_used = anims[j].anim_name == params.anim_name;
+    }
+    if (name_is_used) {
+      throw std::runtime_error(
+        "Animation name '" + params.anim_name + "' isn't unique for '"
+        + params.filename + "'"
+      );
+    }
+
+    auto file = first_use_of_file.find(params.filename);
+    if (file == first_use_of_file.end()) {
+      first_use_of_file[params.filename] = i;
+      files_to_parse.push_back(i);
+      parsed_by[i] = i;
+    } else {
+      // Share the importer, it will be filled by the first user
+      infos[i].importer = infos[file->second].importer;
+      parsed_by[i] = file->second;
+    }
   }
 
-  aiVector3D v = node->mPositionKeys[0].mValue;
-  anims_[idx].start_offset = glm::vec3(v.x, v.y, v.z);
+  // Parsing and baking are the slow parts. Every file has its own importer,
+  // so they can be processed in parallel.
+  TaskScheduler::Default().parallelFor(0, files_to_parse.size(),
+      [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      AnimInfo& info = infos[files_to_parse[i]];
+      info.handle = info.importer->ReadFile(anims[files_to_parse[i]].filename,
+                                            aiProcess_Debone);
+      if (info.handle && info.handle->mNumAnimations > 0) {
+        info.clip = std::make_shared<AnimationClip>(
+          info.handle->mAnimations[info.handle->mNumAnimations - 1]);
+      }
+    }
+  });
+
+  for (size_t i = 0; i < anims.size(); ++i) {
+    const AnimParams& params = anims[i];
+    AnimInfo& info = infos[i];
+    info.name = params.anim_name;
+    info.handle = info.importer->GetScene();
+    info.clip = infos[parsed_by[i]].clip;
+    if (!info.handle) {
+      throw std::runtime_error("Error parsing " + params.filename
+                                + " : " + info.importer->GetErrorString());
+    }
+    if (!info.clip) {
+      throw std::runtime_error("'" + params.filename + "' doesn't contain "
+                                "any animation");
+    }
+
+    auto node = getRootBone(scene_->mRootNode, info.handle);
+    if (!node) {
+      throw std::runtime_error(
+        "Animation error: The mesh's skeleton, and the animated skeleton '"
+        + params.anim_name + "' doesn't have a single bone in common."
+      );
+    }
+
+    skeleton_.set_root_bone_node(skeleton_.findNode(skinning_data_.root_bone));
+    info.track_of_node = skeleton_.bindClip(*info.clip);
 
-  v = node->mPositionKeys[node->mNumPositionKeys - 1].mValue;
-  anims_[idx].end_offset =  glm::vec3(v.x, v.y, v.z);
+    aiVector3D v = node->mPositionKeys[0].mValue;
+    info.start_offset = glm::vec3(v.x, v.y, v.z);
 
-  anims_[idx].flags = flags;
-  anims_[idx].speed = speed;
+    v = node->mPositionKeys[node->mNumPositionKeys - 1].mValue;
+    info.end_offset =  glm::vec3(v.x, v.y, v.z);
+
+    info.flags = params.flags;
+    info.speed = params.speed;
+  }
+
+  for (AnimInfo& info : infos) {
+    anims_.names[info.name] = anims_.data.size();
+    anims_.data.push_back(std::move(info));
+  }
 }
 
 } // namespace engine
@@ -0,0 +1,327 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <cmath>
+#include <limits>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include "./animation_clip.h"
+
+namespace engine {
+
+constexpr float AnimationClip::kDefaultSampleRate;
+
+glm::mat4 BoneTransform::toMatrix() const {
+  glm::mat4 m = glm::mat4_cast(rot);
+  m[0] *= scale.x;
+  m[1] *= scale.y;
+  m[2] *= scale.z;
+  m[3] = glm::vec4(pos, 1);
+  return m;
+}
+
+BoneTransform BoneTransform::Mix(const BoneTransform& a,
+                                 const BoneTransform& b,
+                                 float factor) {
+  BoneTransform out;
+  out.pos = glm::mix(a.pos, b.pos, factor);
+  out.scale = glm::mix(a.scale, b.scale, factor);
+  // The keys are close to each other, so nlerp is as good as slerp
+  float sign = glm::dot(a.rot, b.rot) < 0 ? -1.0f : 1.0f;
+  out.rot = glm::normalize(a.rot * (1 - factor) + b.rot * (sign * factor));
+  return out;
+}
+
+// Returns the index of the key that is before (or at) time, clamped so that
+// there is always a next key.
+template<typename Key>
+static size_t FindKey(const Key* keys, unsigned num_keys, double time) {
+  const Key* next = std::upper_bound(keys, keys + num_keys, time,
+      [](double t, const Key& key) { return t < key.mTime; });
+  size_t idx = next - keys;
+  return glm::clamp<size_t>(idx, 1, num_keys - 1) - 1;
+}
+
+template<typename Key>
+static float KeyFactor(const Key* keys, size_t i, double time) {
+  double delta_time = keys[i + 1].mTime - keys[i].mTime;
+  if (delta_time <= 0) {
+    return 0.0f;
+  }
+  return glm::clamp(float((time - keys[i].mTime) / delta_time), 0.0f, 1.0f);
+}
+
+static glm::vec3 InterpolateKeys(const aiVectorKey* keys, unsigned num_keys,
+                                 double time, glm::vec3 default_value) {
+  if (num_keys == 0) {
+    return default_value;
+  } else if (num_keys == 1) {
+    return glm::vec3(keys[0].mValue.x, keys[0].mValue.y, keys[0].mValue.z);
+  }
+  size_t i = FindKey(keys, num_keys, time);
+  const aiVector3D& start = keys[i].mValue;
+  const aiVector3D& end = keys[i + 1].mValue;
+  return glm::mix(glm::vec3(start.x, start.y, start.z),
+                  glm::vec3(end.x, end.y, end.z),
+                  KeyFactor(keys, i, time));
+}
+
+static glm::quat InterpolateKeys(const aiQuatKey* keys, unsigned num_keys,
+                                 double time) {
+  if (num_keys == 0) {
+    return glm::quat();
+  } else if (num_keys == 1) {
+    const aiQuaternion& q = keys[0].mValue;
+    return glm::normalize(glm::quat(q.w, q.x, q.y, q.z));
+  }
+  size_t i = FindKey(keys, num_keys, time);
+  const aiQuaternion& start = keys[i].mValue;
+  const aiQuaternion& end = keys[i + 1].mValue;
+  // Spherical linear interpolation, that chooses the shorter path
+  return glm::normalize(glm::slerp(glm::quat(start.w, start.x, start.y, start.z),
+                                   glm::quat(end.w, end.x, end.y, end.z),
+                                   KeyFactor(keys, i, time)));
+}
+
+AnimationClip::AnimationClip(const aiAnimation* animation,
+                             float sample_rate,
+                             bool quantize_rotations)
+    : duration_(animation->mDuration) {
+  if (animation->mTicksPerSecond > 1e-10) {  // != 0
+    ticks_per_second_ = animation->mTicksPerSecond;
+  }
+
+  // Place the frames so that the last one is exactly at the end
+  frame_count_ = std::ceil(duration_ / ticks_per_second_ * sample_rate) + 1;
+  frames_per_tick_ = duration_ > 0 ? (frame_count_ - 1) / duration_ : 0.0f;
+
+  size_t track_count = animation->mNumChannels;
+  size_t key_count = frame_count_ * track_count;
+  positions_.resize(key_count);
+  scales_.resize(key_count);
+  std::vector<glm::quat> rotations(key_count);
+
+  for (size_t track = 0; track < track_count; ++track) {
+    const aiNodeAnim* node_anim = animation->mChannels[track];
+    track_names_.push_back(node_anim->mNodeName.data);
+
+    for (size_t frame = 0; frame < frame_count_; ++frame) {
+      double time = frame + 1 == frame_count_ ? duration_
+                                              : frame / frames_per_tick_;
+      size_t idx = frame * track_count + track;
+      positions_[idx] = InterpolateKeys(node_anim->mPositionKeys,
+                                        node_anim->mNumPositionKeys,
+                                        time, glm::vec3(0));
+      rotations[idx] = InterpolateKeys(node_anim->mRotationKeys,
+                                       node_anim->mNumRotationKeys, time);
+      scales_[idx] = InterpolateKeys(node_anim->mScalingKeys,
+                                     node_anim->mNumScalingKeys,
+                                     time, glm::vec3(1));
+    }
+  }
+
+  if (quantize_rotations) {
+    packed_rotations_.resize(key_count);
+    for (size_t i = 0; i < key_count; ++i) {
+      const glm::quat& q = rotations[i];
+      packed_rotations_[i] = PackedQuat{
+        int16_t(std::round(q.x * 32767)), int16_t(std::round(q.y * 32767)),
+        int16_t(std::round(q.z * 32767)), int16_t(std::round(q.w * 32767))
+      };
+    }
+  } else {
+    rotations_.swap(rotations);
+  }
+
+  mapTracks();
+}
+
+void AnimationClip::mapTracks() {
+  track_indices_.clear();
+  for (size_t i = 0; i < track_names_.size(); ++i) {
+    track_indices_[track_names_[i]] = i;
+  }
+}
+
+int AnimationClip::findTrack(const std::string& node_name) const {
+  auto iter = track_indices_.find(node_name);
+  return iter == track_indices_.end() ? -1 : iter->second;
+}
+
+BoneTransform AnimationClip::sample(size_t track, const Cursor& cursor) const {
+  size_t idx = cursor.frame * track_count() + track;
+  BoneTransform a{positions_[idx], rotation(idx), scales_[idx]};
+  if (cursor.factor == 0.0f) {
+    a.rot = glm::normalize(a.rot);
+    return a;
+  }
+  size_t next = idx + track_count();
+  BoneTransform b{positions_[next], rotation(next), scales_[next]};
+  return BoneTransform::Mix(a, b, cursor.factor);
+}
+
+// ------------------------------ Serialization --------------------------------
+
+// The file starts with this, followed by the version number. Everything is
+// stored in the native byte order.
+static const char kMagic[4] = {'L', 'C', 'L', 'P'};
+static const uint32_t kVersion = 1;
+
+template<typename T>
+static void Write(std::ostream& os, const T& value) {
+  os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+static void WriteArray(std::ostream& os, const std::vector<T>& values) {
+  os.write(reinterpret_cast<const char*>(values.data()),
+           values.size() * sizeof(T));
+}
+
+template<typename T>
+static T Read(std::istream& is) {
+  T value{};
+  is.read(reinterpret_cast<char*>(&value), sizeof(T));
+  if (!is) {
+    throw std::runtime_error("AnimationClip::Load: truncated data");
+  }
+  return value;
+}
+
+// Reads the array in chunks, so if a corrupt size gets past the checks
+// (because the stream's size is unknown), the read fails when it runs out of
+// data, instead of trying to allocate the whole array first.
+template<typename Array>
+static void ReadArray(std::istream& is, Array& values, size_t size) {
+  const size_t kChunkSize = 1 << 16;
+  values.clear();
+  while (values.size() < size) {
+    size_t begin = values.size();
+    values.resize(begin + std::min(kChunkSize, size - begin));
+    is.read(reinterpret_cast<char*>(&values[begin]),
+            (values.size() - begin) * sizeof(values[0]));
+    if (!is) {
+      throw std::runtime_error("AnimationClip::Load: truncated data");
+    }
+  }
+}
+
+// The number of bytes left in the stream, or the maximal size_t, if the
+// stream can't seek.
+static size_t RemainingBytes(std::istream& is) {
+  std::streampos pos = is.tellg();
+  if (pos == std::streampos(-1)) {
+    return std::numeric_limits<size_t>::max();
+  }
+  is.seekg(0, std::ios::end);
+  std::streampos end = is.tellg();
+  is.seekg(pos);
+  if (!is || end == std::streampos(-1)) {
+    throw std::runtime_error("AnimationClip::Load: can't seek in the stream");
+  }
+  return size_t(end - pos);
+}
+
+void AnimationClip::save(std::ostream& os) const {
+  os.write(kMagic, sizeof(kMagic));
+  Write(os, kVersion);
+  Write(os, duration_);
+  Write(os, ticks_per_second_);
+  Write(os, frames_per_tick_);
+  Write(os, uint32_t(frame_count_));
+  Write(os, uint32_t(track_count()));
+  Write(os, uint8_t(quantized()));
+  for (const std::string& name : track_names_) {
+    Write(os, uint32_t(name.size()));
+    os.write(name.data(), name.size());
+  }
+  WriteArray(os, positions_);
+  WriteArray(os, scales_);
+  if (quantized()) {
+    WriteArray(os, packed_rotations_);
+  } else {
+    WriteArray(os, rotations_);
+  }
+}
+
+void AnimationClip::save(const std::string& filename) const {
+  std::ofstream file(filename, std::ios::binary);
+  save(file);
+  if (!file) {
+    throw std::runtime_error("Error writing animation clip '" + filename + "'");
+  }
+}
+
+AnimationClip AnimationClip::Load(std::istream& is) {
+  char magic[sizeof(kMagic)];
+  is.read(magic, sizeof(magic));
+  if (!is || !std::equal(magic, magic + sizeof(magic), kMagic)) {
+    throw std::runtime_error("AnimationClip::Load: not an animation clip");
+  }
+  if (Read<uint32_t>(is) != kVersion) {
+    throw std::runtime_error("AnimationClip::Load: unsupported version");
+  }
+
+  AnimationClip clip;
+  clip.duration_ = Read<float>(is);
+  clip.ticks_per_second_ = Read<float>(is);
+  clip.frames_per_tick_ = Read<float>(is);
+  clip.frame_count_ = Read<uint32_t>(is);
+  size_t track_count = Read<uint32_t>(is);
+  bool quantized = Read<uint8_t>(is);
+
+  // sample() and cursor() expect finite times, and at least one frame
+  if (!std::isfinite(clip.duration_) || clip.duration_ < 0 ||
+      !std::isfinite(clip.ticks_per_second_) || clip.ticks_per_second_ <= 0 ||
+      !std::isfinite(clip.frames_per_tick_) || clip.frames_per_tick_ < 0) {
+    throw std::runtime_error("AnimationClip::Load: invalid timing");
+  }
+  if (track_count != 0 && clip.frame_count_ < 1) {
+    throw std::runtime_error("AnimationClip::Load: invalid frame count");
+  }
+
+  // The sizes are checked against the data, that is actually there, before
+  // anything is allocated for them
+  size_t remaining = RemainingBytes(is);
+  if (track_count > remaining / sizeof(uint32_t)) {
+    throw std::runtime_error("AnimationClip::Load: invalid track count");
+  }
+  clip.track_names_.resize(track_count);
+  for (std::string& name : clip.track_names_) {
+    size_t name_length = Read<uint32_t>(is);
+    remaining -= sizeof(uint32_t);
+    if (name_length > remaining) {
+      throw std::runtime_error("AnimationClip::Load: invalid track name");
+    }
+    ReadArray(is, name, name_length);
+    remaining -= name_length;
+  }
+
+  size_t key_size = 2*sizeof(glm::vec3) +
+      (quantized ? sizeof(PackedQuat) : sizeof(glm::quat));
+  if (track_count != 0 &&
+      clip.frame_count_ > remaining / key_size / track_count) {
+    throw std::runtime_error("AnimationClip::Load: invalid frame count");
+  }
+  size_t key_count = clip.frame_count_ * track_count;
+  ReadArray(is, clip.positions_, key_count);
+  ReadArray(is, clip.scales_, key_count);
+  if (quantized) {
+    ReadArray(is, clip.packed_rotations_, key_count);
+  } else {
+    ReadArray(is, clip.rotations_, key_count);
+  }
+
+  clip.mapTracks();
+  return clip;
+}
+
+AnimationClip AnimationClip::Load(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("Can't open animation clip '" + filename + "'");
+  }
+  return Load(file);
+}
+
+}  // namespace engine
@@ -0,0 +1,154 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_MESH_ANIMATION_CLIP_H_
+#define ENGINE_MESH_ANIMATION_CLIP_H_
+
+#include <map>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <iosfwd>
+#include <cstdint>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "../assimp.h"
+
+namespace engine {
+
+/// The local transformation of a bone, in a form that can be blended.
+struct BoneTransform {
+  glm::vec3 pos;
+  glm::quat rot;
+  glm::vec3 scale;
+
+  BoneTransform() : scale(1) {}
+  BoneTransform(const glm::vec3& pos, const glm::quat& rot,
+                const glm::vec3& scale)
+      : pos(pos), rot(rot), scale(scale) {}
+
+  /// Returns translate * rotate * scale.
+  glm::mat4 toMatrix() const;
+
+  /// Linear interpolation for the position and the scale, and a normalized
+  /// linear interpolation on the shorter path for the rotation.
+  static BoneTransform Mix(const BoneTransform& a, const BoneTransform& b,
+                           float factor);
+};
+
+/**
+ * @brief An animation baked into a compact, uniformly resampled form.
+ *
+ * Every track (an animated node) has a key in every frame, and the keys of a
+ * frame are stored next to each other, so finding the keys for a time is a
+ * single multiplication instead of a search through the assimp key arrays,
+ * and sampling all the tracks of a frame reads contiguous memory.
+ *
+ * The rotations can optionally be quantized to 16 bit per component, which
+ * halves the size of the clip.
+ */
+class AnimationClip {
+ public:
+  /// The default resampling rate, in samples per second.
+  static constexpr float kDefaultSampleRate = 30.0f;
+
+  AnimationClip() = default;
+
+  /**
+   * @brief Bakes an assimp animation.
+   *
+   * @param animation           The animation to bake.
+   * @param sample_rate         The number of samples per second.
+   * @param quantize_rotations  Store the rotations in 16 bit integers.
+   */
+  explicit AnimationClip(const aiAnimation* animation,
+                         float sample_rate = kDefaultSampleRate,
+                         bool quantize_rotations = false);
+
+  /// Writes the clip in a binary format, that can be loaded back with Load.
+  void save(std::ostream& os) const;
+  void save(const std::string& filename) const;
+
+  /// Loads a clip written by save. Throws std::runtime_error on failure.
+  static AnimationClip Load(std::istream& is);
+  static AnimationClip Load(const std::string& filename);
+
+  /// The length of the clip, in ticks.
+  float duration() const { return duration_; }
+  float ticks_per_second() const { return ticks_per_second_; }
+
+  size_t frame_count() const { return frame_count_; }
+  size_t track_count() const { return track_names_.size(); }
+  bool quantized() const { return !packed_rotations_.empty(); }
+
+  /// The name of the node that the track animates.
+  const std::string& track_name(size_t track) const {
+    return track_names_[track];
+  }
+
+  /// Returns the index of the track that animates the node called
+  /// node_name, or -1 if there isn't such a track.
+  int findTrack(const std::string& node_name) const;
+
+  /// The pair of frames (and the factor between them) for a time.
+  struct Cursor {
+    size_t frame;
+    float factor;
+  };
+
+  /// Returns where to sample the clip at anim_time (in ticks).
+  Cursor cursor(float anim_time) const {
+    if (frame_count_ < 2) {
+      return Cursor{0, 0.0f};
+    }
+    float f = glm::clamp(anim_time * frames_per_tick_,
+                         0.0f, float(frame_count_ - 1));
+    size_t frame = std::min(size_t(f), frame_count_ - 2);
+    return Cursor{frame, f - frame};
+  }
+
+  /// Samples a track at a cursor. This is O(1).
+  BoneTransform sample(size_t track, const Cursor& cursor) const;
+
+  /// Samples a track at anim_time (in ticks).
+  BoneTransform sample(size_t track, float anim_time) const {
+    return sample(track, cursor(anim_time));
+  }
+
+ private:
+  /// A quaternion quantized to [-32767, 32767] per component.
+  struct PackedQuat {
+    int16_t x, y, z, w;
+  };
+
+  float duration_ = 0.0f;
+  float ticks_per_second_ = 24.0f;
+  float frames_per_tick_ = 0.0f;
+  size_t frame_count_ = 0;
+
+  std::vector<std::string> track_names_;
+  std::map<std::string, int> track_indices_;
+
+  // All of these are indexed with [frame * track_count() + track]
+  std::vector<glm::vec3> positions_;
+  std::vector<glm::vec3> scales_;
+  std::vector<glm::quat> rotations_;  // Used if the clip isn't quantized
+  std::vector<PackedQuat> packed_rotations_;  // Used if it is
+
+  glm::quat rotation(size_t idx) const {
+    if (packed_rotations_.empty()) {
+      return rotations_[idx];
+    } else {
+      const PackedQuat& q = packed_rotations_[idx];
+      return glm::quat(q.w, q.x, q.y, q.z) * (1.0f / 32767.0f);
+    }
+  }
+
+  void mapTracks();
+};
+
+}  // namespace engine
+
+#endif  // ENGINE_MESH_ANIMATION_CLIP_H_
@@ -0,0 +1,358 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "./blend_tree.h"
+
+namespace engine {
+
+BlendTree::BoneMask BlendTree::MaskFromBone(const Skeleton& skeleton,
+                                            const std::string& bone_name) {
+  int bone_node = skeleton.findNode(bone_name);
+  if (bone_node == -1) {
+    throw std::invalid_argument(
+      "BlendTree::MaskFromBone: the skeleton doesn't have a bone named '"
+      + bone_name + "'");
+  }
+  BoneMask mask(skeleton.node_count(), 0.0f);
+  std::fill(mask.begin() + bone_node,
+            mask.begin() + skeleton.subtree_end(bone_node), 1.0f);
+  return mask;
+}
+
+int BlendTree::addParameter(const std::string& name, float value) {
+  if (parameter_names_.find(name) != parameter_names_.end()) {
+    throw std::invalid_argument(
+      "BlendTree::addParameter: '" + name + "' is already a parameter");
+  }
+  parameter_names_[name] = parameters_.size();
+  parameters_.push_back(value);
+  return parameters_.size() - 1;
+}
+
+int BlendTree::addClip(const AnimationClip& clip, float speed) {
+  Node node;
+  node.type = Node::Type::Clip;
+  node.clip = &clip;
+  node.track_of_node = skeleton_.bindClip(clip);
+  node.speed = speed;
+  nodes_.push_back(std::move(node));
+  return nodes_.size() - 1;
+}
+
+int BlendTree::addBlend1D(int parameter,
+                          std::vector<std::pair<float, int>> children) {
+  if (children.empty()) {
+    throw std::invalid_argument("BlendTree::addBlend1D: no children");
+  }
+  std::sort(children.begin(), children.end());
+
+  Node node;
+  node.type = Node::Type::Blend1D;
+  node.parameter_x = parameter;
+  for (const auto& child : children) {
+    node.positions.push_back(glm::vec2(child.first, 0));
+    node.children.push_back(child.second);
+  }
+  nodes_.push_back(std::move(node));
+  return nodes_.size() - 1;
+}
+
+int BlendTree::addBlend2D(
+    int parameter_x, int parameter_y,
+    const std::vector<std::pair<glm::vec2, int>>& children) {
+  if (children.empty()) {
+    throw std::invalid_argument("BlendTree::addBlend2D: no children");
+  }
+
+  Node node;
+  node.type = Node::Type::Blend2D;
+  node.parameter_x = parameter_x;
+  node.parameter_y = parameter_y;
+  for (const auto& child : children) {
+    // The gradient bands divide by the distance of the positions
+    if (std::find(node.positions.begin(), node.positions.end(),
+                  child.first) != node.positions.end()) {
+      throw std::invalid_argument(
+        "BlendTree::addBlend2D: two children have the same position");
+    }
+    node.positions.push_back(child.first);
+    node.children.push_back(child.second);
+  }
+  nodes_.push_back(std::move(node));
+  return nodes_.size() - 1;
+}
+
+int BlendTree::addLayer(int root, LayerMode mode,
+                        float weight, const BoneMask& mask) {
+  if (!mask.empty() && mask.size() != skeleton_.node_count()) {
+    throw std::invalid_argument(
+      "BlendTree::addLayer: the mask doesn't match the skeleton");
+  }
+  Layer layer;
+  layer.root = root;
+  layer.mode = mode;
+  layer.weight = weight;
+  layer.mask = mask;
+  layers_.push_back(layer);
+  return layers_.size() - 1;
+}
+
+// The gradient band weight of the i-th child (not normalized)
+static float GradientBandWeight(const std::vector<glm::vec2>& positions,
+                                size_t i, glm::vec2 p) {
+  float weight = 1.0f;
+  for (size_t j = 0; j < positions.size(); ++j) {
+    if (i != j) {
+      glm::vec2 d = positions[j] - positions[i];
+      float h = 1 - glm::dot(p - positions[i], d) / glm::dot(d, d);
+      weight = std::min(weight, std::max(h, 0.0f));
+    }
+  }
+  return weight;
+}
+
+void BlendTree::collectClips(int node_idx, float weight) {
+  if (weight < 1e-4f) {
+    return;
+  }
+
+  const Node& node = nodes_[node_idx];
+  switch (node.type) {
+    case Node::Type::Clip: {
+      active_clips_.push_back(ActiveClip{&node, weight, {0, 0.0f}});
+    } break;
+    case Node::Type::Blend1D: {
+      const auto& pos = node.positions;
+      float p = parameters_[node.parameter_x];
+      // NaN isn't between any two children, it plays the first one
+      if (!(p > pos.front().x)) {
+        collectClips(node.children.front(), weight);
+      } else if (p >= pos.back().x) {
+        collectClips(node.children.back(), weight);
+      } else {
+        size_t i = 0;
+        while (pos[i + 1].x < p) {
+          ++i;
+        }
+        float factor = (p - pos[i].x) / (pos[i + 1].x - pos[i].x);
+        collectClips(node.children[i], weight * (1 - factor));
+        collectClips(node.children[i + 1], weight * factor);
+      }
+    } break;
+    case Node::Type::Blend2D: {
+      glm::vec2 p{parameters_[node.parameter_x], parameters_[node.parameter_y]};
+      float sum = 0.0f;
+      for (size_t i = 0; i < node.children.size(); ++i) {
+        sum += GradientBandWeight(node.positions, i, p);
+      }
+      // With different positions, at least one of the weights is positive,
+      // but if they still can't be normalized, the nearest child plays alone
+      if (!(sum > 0.0f)) {
+        size_t nearest = 0;
+        for (size_t i = 1; i < node.children.size(); ++i) {
+          if (glm::distance(p, node.positions[i]) <
+              glm::distance(p, node.positions[nearest])) {
+            nearest = i;
+          }
+        }
+        collectClips(node.children[nearest], weight);
+        break;
+      }
+      for (size_t i = 0; i < node.children.size(); ++i) {
+        collectClips(node.children[i],
+                     weight * GradientBandWeight(node.positions, i, p) / sum);
+      }
+    } break;
+  }
+}
+
+void BlendTree::advanceLayers(float time_in_seconds) {
+  float dt = first_evaluation_ ? 0.0f : time_in_seconds - last_time_;
+  last_time_ = time_in_seconds;
+
+  active_clips_.clear();
+  layer_ends_.clear();
+  for (Layer& layer : layers_) {
+    size_t begin = active_clips_.size();
+    collectClips(layer.root, 1.0f);
+
+    // The clips are synchronized, the length of the loop is their weighted
+    // length, in seconds
+    float length = 0.0f;
+    for (size_t i = begin; i < active_clips_.size(); ++i) {
+      const Node& node = *active_clips_[i].node;
+      length += active_clips_[i].weight * node.clip->duration()
+                / node.clip->ticks_per_second() / node.speed;
+    }
+    if (length > 0) {
+      layer.phase += dt / length;
+    }
+    layer.wrapped = layer.phase >= 1.0f;
+    layer.phase -= std::floor(layer.phase);
+
+    for (size_t i = begin; i < active_clips_.size(); ++i) {
+      const AnimationClip* clip = active_clips_[i].node->clip;
+      active_clips_[i].cursor = clip->cursor(layer.phase * clip->duration());
+    }
+    layer_ends_.push_back(active_clips_.size());
+  }
+}
+
+bool BlendTree::blendLayer(size_t layer, size_t node,
+                           BoneTransform& out) const {
+  size_t begin = layer == 0 ? 0 : layer_ends_[layer - 1];
+  bool additive = layers_[layer].mode == LayerMode::Additive;
+
+  glm::vec3 pos, scale;
+  glm::quat first_rot, rot(0, 0, 0, 0);
+  float weight_sum = 0.0f;
+  for (size_t i = begin; i < layer_ends_[layer]; ++i) {
+    const ActiveClip& active = active_clips_[i];
+    int track = active.node->track_of_node[node];
+    if (track == -1) {
+      continue;
+    }
+
+    BoneTransform sample = active.node->clip->sample(track, active.cursor);
+    if (additive) {
+      // The difference from the first frame
+      BoneTransform reference =
+        active.node->clip->sample(track, AnimationClip::Cursor{0, 0.0f});
+      sample.pos -= reference.pos;
+      sample.rot = glm::inverse(reference.rot) * sample.rot;
+      sample.scale /= reference.scale;
+    }
+
+    if (weight_sum == 0.0f) {
+      first_rot = sample.rot;
+    }
+    float w = active.weight;
+    pos += sample.pos * w;
+    scale += sample.scale * w;
+    // Keep every rotation on the same side as the first, so they don't
+    // cancel each other out
+    rot += sample.rot * (glm::dot(first_rot, sample.rot) < 0 ? -w : w);
+    weight_sum += w;
+  }
+
+  if (weight_sum == 0.0f) {
+    return false;
+  }
+  out.pos = pos / weight_sum;
+  out.scale = scale / weight_sum;
+  out.rot = glm::normalize(rot);
+  return true;
+}
+
+glm::vec3 BlendTree::blendedRootPosition(size_t begin, size_t end,
+                                         float phase) const {
+  glm::vec3 pos;
+  float weight_sum = 0.0f;
+  for (size_t i = begin; i < end; ++i) {
+    const ActiveClip& active = active_clips_[i];
+    int track = active.node->track_of_node[skeleton_.root_bone_node()];
+    if (track != -1) {
+      const AnimationClip* clip = active.node->clip;
+      pos += clip->sample(track, phase * clip->duration()).pos * active.weight;
+      weight_sum += active.weight;
+    }
+  }
+  if (weight_sum > 0) {
+    pos /= weight_sum;
+  }
+  return glm::vec3(pos.x, 0, pos.z);
+}
+
+void BlendTree::evaluate(float time_in_seconds,
+                         glm::mat4* global_transforms,
+                         glm::mat4* bones) {
+  if (layers_.empty()) {
+    throw std::logic_error("BlendTree::evaluate: the tree doesn't have a layer");
+  }
+  advanceLayers(time_in_seconds);
+
+  int root_bone_node = skeleton_.root_bone_node();
+  bool root_animated = false;
+  BoneTransform layer_pose;
+
+  for (size_t node = 0; node < skeleton_.node_count(); ++node) {
+    BoneTransform pose = skeleton_.default_pose(node);
+    bool animated = false;
+
+    for (size_t layer = 0; layer < layers_.size(); ++layer) {
+      if (!blendLayer(layer, node, layer_pose)) {
+        continue;
+      }
+
+      if (layer == 0) {
+        pose = layer_pose;
+        // Only the base layer moves the character
+        if (int(node) == root_bone_node) {
+          root_offset_ = glm::vec3(pose.pos.x, 0, pose.pos.z);
+          root_animated = true;
+        }
+      } else {
+        const Layer& l = layers_[layer];
+        float w = l.weight * (l.mask.empty() ? 1.0f : l.mask[node]);
+        if (w <= 0.0f) {
+          continue;
+        }
+        if (l.mode == LayerMode::Override) {
+          pose = BoneTransform::Mix(pose, layer_pose, w);
+        } else {
+          pose.pos += layer_pose.pos * w;
+          pose.rot = glm::normalize(
+            pose.rot * glm::slerp(glm::quat(), layer_pose.rot, w));
+          pose.scale *= glm::mix(glm::vec3(1), layer_pose.scale, w);
+        }
+      }
+      animated = true;
+    }
+
+    glm::mat4 local_transform;
+    if (animated) {
+      if (int(node) == root_bone_node) {
+        pose.pos = glm::vec3(0, pose.pos.y, 0);
+      }
+      local_transform = pose.toMatrix();
+    } else {
+      local_transform = skeleton_.default_transform(node);
+    }
+
+    int parent = skeleton_.parent(node);
+    if (parent == -1) {
+      global_transforms[node] = local_transform;
+    } else {
+      global_transforms[node] = global_transforms[parent] * local_transform;
+    }
+
+    int bone = skeleton_.bone_index(node);
+    if (bone != -1) {
+      bones[bone] = global_transforms[node] * skeleton_.bone_offset(bone);
+    }
+  }
+
+  if (root_animated) {
+    if (!first_evaluation_) {
+      glm::vec3 delta = root_offset_ - last_root_offset_;
+      if (layers_[0].wrapped) {
+        // The root jumped back to the start of the loop
+        delta += blendedRootPosition(0, layer_ends_[0], 1.0f)
+                 - blendedRootPosition(0, layer_ends_[0], 0.0f);
+      }
+      root_motion_ += glm::vec2(delta.x, delta.z);
+    }
+    last_root_offset_ = root_offset_;
+  }
+  first_evaluation_ = false;
+}
+
+glm::vec2 BlendTree::offsetSinceLastFrame() {
+  glm::vec2 ret = root_motion_;
+  root_motion_ = glm::vec2();
+  return ret;
+}
+
+}  // namespace engine
@@ -0,0 +1,205 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_MESH_BLEND_TREE_H_
+#define ENGINE_MESH_BLEND_TREE_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <utility>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "./skeleton.h"
+#include "./animation_clip.h"
+
+namespace engine {
+
+/**
+ * @brief Blends any number of clips into one pose.
+ *
+ * The tree consists of clips, and 1D and 2D blend spaces above them, which
+ * weight their children by one or two parameters (like speed and direction).
+ * The clips under a layer are synchronized: they are played at the same
+ * phase, and the length of the loop is the weighted length of the clips.
+ *
+ * On top of the base layer, more layers can be added, that either override
+ * the pose, or add their difference from their first frame to it. Each layer
+ * can be restricted to a part of the skeleton with a per-node mask.
+ *
+ * The tree is only walked to find the weights of the clips (this is cheap,
+ * it doesn't depend on the number of bones), and then the whole pose is
+ * evaluated in a single loop over the skeleton, no matter how many clips
+ * are blended.
+ */
+class BlendTree {
+ public:
+  /// How a layer is combined with the layers below it.
+  enum class LayerMode {
+    /// Blends the pose towards the layer's pose by the weight.
+    Override,
+    /// Adds the layer's difference from its first frame, scaled by the weight.
+    Additive
+  };
+
+  /// The weight of each node of a skeleton in a layer.
+  using BoneMask = std::vector<float>;
+
+  /// Returns a mask that contains the bone called bone_name and its
+  /// descendants. Throws std::invalid_argument if there's no such bone.
+  static BoneMask MaskFromBone(const Skeleton& skeleton,
+                               const std::string& bone_name);
+
+  /// The tree keeps a reference to the skeleton.
+  explicit BlendTree(const Skeleton& skeleton) : skeleton_(skeleton) {}
+
+  // ------------------------------ Parameters ---------------------------------
+
+  /// Adds a parameter, and returns its index.
+  int addParameter(const std::string& name, float value = 0.0f);
+
+  void set_parameter(int idx, float value) { parameters_[idx] = value; }
+  void set_parameter(const std::string& name, float value) {
+    parameters_[parameter_names_.at(name)] = value;
+  }
+  float parameter(int idx) const { return parameters_[idx]; }
+
+  // --------------------------------- Nodes -----------------------------------
+
+  /**
+   * @brief Adds a clip node, and returns its index.
+   *
+   * @param clip    The clip. It must outlive the tree.
+   * @param speed   The playback speed.
+   */
+  int addClip(const AnimationClip& clip, float speed = 1.0f);
+
+  /**
+   * @brief Adds a 1D blend space, and returns its index.
+   *
+   * The two children around the parameter's value are blended linearly.
+   * Outside of the range, the nearest child plays alone, and if the parameter
+   * is NaN, the first one.
+   *
+   * @param parameter  The index of the parameter.
+   * @param children   Pairs of a parameter value and a node index.
+   */
+  int addBlend1D(int parameter,
+                 std::vector<std::pair<float, int>> children);
+
+  /**
+   * @brief Adds a 2D blend space, and returns its index.
+   *
+   * The children are weighted with gradient band interpolation, so the
+   * weight of a child is 1 at its position, and 0 at the other ones. The
+   * positions must be different.
+   *
+   * @param parameter_x  The index of the parameter for the X axis.
+   * @param parameter_y  The index of the parameter for the Y axis.
+   * @param children     Pairs of a position and a node index.
+   */
+  int addBlend2D(int parameter_x, int parameter_y,
+                 const std::vector<std::pair<glm::vec2, int>>& children);
+
+  // -------------------------------- Layers -----------------------------------
+
+  /**
+   * @brief Adds a layer, and returns its index.
+   *
+   * The first layer is the base layer, its mode, weight and mask are ignored.
+   *
+   * @param root    The root node of the layer.
+   * @param mode    How the layer is combined with the ones below it.
+   * @param weight  The weight of the layer.
+   * @param mask    The per node weights. Empty means every node.
+   */
+  int addLayer(int root, LayerMode mode = LayerMode::Override,
+               float weight = 1.0f, const BoneMask& mask = BoneMask{});
+
+  void set_layer_weight(int layer, float weight) {
+    layers_[layer].weight = weight;
+  }
+  float layer_weight(int layer) const { return layers_[layer].weight; }
+
+  // ------------------------------- Evaluation --------------------------------
+
+  /**
+   * @brief Advances the layers to the given time, and evaluates the pose.
+   *
+   * Doesn't allocate after the first call.
+   *
+   * @param time_in_seconds    The current time.
+   * @param global_transforms  Receives the model space transformation of every
+   *                           node. Must have skeleton.node_count() elements.
+   * @param bones              Receives the skinning matrix of every bone. Must
+   *                           have skeleton.bone_count() elements.
+   */
+  void evaluate(float time_in_seconds,
+                glm::mat4* global_transforms,
+                glm::mat4* bones);
+
+  /**
+   * @brief Returns the XZ movement of the root bone since it was last queried,
+   *        like Animation::offsetSinceLastFrame().
+   */
+  glm::vec2 offsetSinceLastFrame();
+
+ private:
+  struct Node {
+    enum class Type { Clip, Blend1D, Blend2D } type;
+
+    // For clips
+    const AnimationClip* clip = nullptr;
+    std::vector<int> track_of_node;
+    float speed = 1.0f;
+
+    // For blend spaces
+    int parameter_x = -1, parameter_y = -1;
+    std::vector<int> children;
+    std::vector<glm::vec2> positions;  // Only x is used in 1D
+  };
+
+  struct Layer {
+    int root;
+    LayerMode mode;
+    float weight;
+    BoneMask mask;
+
+    // The synchronized playback position, in [0, 1)
+    float phase = 0.0f;
+    bool wrapped = false;
+  };
+
+  /// A clip that takes part in the current pose.
+  struct ActiveClip {
+    const Node* node;
+    float weight;
+    AnimationClip::Cursor cursor;
+  };
+
+  const Skeleton& skeleton_;
+  std::vector<Node> nodes_;
+  std::vector<Layer> layers_;
+  std::vector<float> parameters_;
+  std::map<std::string, int> parameter_names_;
+
+  float last_time_ = 0.0f;
+  bool first_evaluation_ = true;
+
+  // The active clips of each layer, layer after layer.
+  std::vector<ActiveClip> active_clips_;
+  std::vector<size_t> layer_ends_;
+
+  glm::vec3 root_offset_, last_root_offset_;
+  glm::vec2 root_motion_;
+
+  void collectClips(int node, float weight);
+  void advanceLayers(float time_in_seconds);
+  glm::vec3 blendedRootPosition(size_t begin, size_t end, float phase) const;
+  bool blendLayer(size_t layer, size_t node, BoneTransform& out) const;
+};
+
+}  // namespace engine
+
+#endif  // ENGINE_MESH_BLEND_TREE_H_
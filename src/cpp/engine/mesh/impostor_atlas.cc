@@ -0,0 +1,102 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <cmath>
+#include <stdexcept>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "./impostor_atlas.h"
+#include "../game_engine.h"
+#include "../shader_manager.h"
+#include "../../oglwrap/context.h"
+#include "../../oglwrap/framebuffer.h"
+#include "../../oglwrap/smart_enums.h"
+
+namespace engine {
+
+ImpostorAtlas::ImpostorAtlas(const std::vector<MeshRenderer*>& meshes,
+                             int view_count, int cell_size)
+    : view_count_(view_count), mesh_count_(meshes.size())
+    , cell_size_(cell_size) {
+  if (meshes.empty() || view_count <= 0 || cell_size <= 0) {
+    throw std::invalid_argument("engine::ImpostorAtlas: invalid arguments");
+  }
+
+  for (gl::Texture2D* tex : {&colors_, &normals_}) {
+    gl::Bind(*tex);
+    tex->upload(gl::kRgba8, view_count_*cell_size_, mesh_count_*cell_size_,
+                gl::kRgba, gl::kUnsignedByte, nullptr);
+    tex->minFilter(gl::kLinearMipmapLinear);
+    tex->magFilter(gl::kLinear);
+    tex->wrapS(gl::kClampToEdge);
+    tex->wrapT(gl::kClampToEdge);
+    gl::Unbind(*tex);
+  }
+
+  bake(meshes, colors_, false);
+  bake(meshes, normals_, true);
+
+  for (gl::Texture2D* tex : {&colors_, &normals_}) {
+    gl::Bind(*tex);
+    tex->generateMipmap();
+    gl::Unbind(*tex);
+  }
+}
+
+void ImpostorAtlas::bake(const std::vector<MeshRenderer*>& meshes,
+                         gl::Texture2D& target, bool normals) {
+  ShaderManager* shader_manager = GameEngine::shader_manager();
+  ShaderProgram prog(shader_manager->get("engine/impostor_bake.vert"),
+                     shader_manager->get("engine/impostor_bake.frag"));
+  gl::Use(prog);
+  gl::UniformSampler(prog, "uDiffuseTexture").set(0);
+  gl::Uniform<int>(prog, "uBakeNormals").set(normals);
+  gl::Uniform<glm::mat4> uProjectionMatrix(prog, "uProjectionMatrix");
+  gl::Uniform<glm::mat4> uCameraMatrix(prog, "uCameraMatrix");
+
+  gl::Texture2D depth;
+  gl::Bind(depth);
+  depth.upload(gl::kDepthComponent, view_count_*cell_size_,
+               mesh_count_*cell_size_, gl::kDepthComponent, gl::kFloat,
+               nullptr);
+  gl::Unbind(depth);
+
+  gl::Framebuffer fbo;
+  gl::Bind(fbo);
+  fbo.attachTexture(gl::kColorAttachment0, target, 0);
+  fbo.attachTexture(gl::kDepthAttachment, depth, 0);
+  fbo.validate();
+
+  gl::TemporarySet capabilities{{{gl::kDepthTest, true},
+                                 {gl::kBlend, false},
+                                 {gl::kCullFace, false}}};
+  // The uncovered texels have to be transparent
+  GLfloat clear_color[4];
+  glGetFloatv(GL_COLOR_CLEAR_VALUE, clear_color);
+  glClearColor(0, 0, 0, 0);
+  gl::Clear().Color().Depth();
+
+  for (int mesh = 0; mesh < mesh_count_; ++mesh) {
+    glm::vec4 bsphere = meshes[mesh]->bSphere();
+    glm::vec3 center = glm::vec3(bsphere);
+    float radius = bsphere.w;
+    uProjectionMatrix = glm::ortho(-radius, radius, -radius, radius,
+                                   0.0f, 4*radius);
+
+    for (int view = 0; view < view_count_; ++view) {
+      float angle = 2*M_PI * view / view_count_;
+      glm::vec3 dir{cos(angle), 0, sin(angle)};
+      uCameraMatrix = glm::lookAt(center + 2*radius*dir, center,
+                                  glm::vec3(0, 1, 0));
+
+      gl::Viewport(view*cell_size_, mesh*cell_size_, cell_size_, cell_size_);
+      meshes[mesh]->render();
+    }
+  }
+
+  glClearColor(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
+  gl::Unbind(fbo);
+  glm::vec2 window_size = GameEngine::window_size();
+  gl::Viewport(window_size.x, window_size.y);
+}
+
+}  // namespace engine
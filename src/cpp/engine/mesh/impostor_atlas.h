@@ -0,0 +1,50 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_MESH_IMPOSTOR_ATLAS_H_
+#define ENGINE_MESH_IMPOSTOR_ATLAS_H_
+
+#include <vector>
+#include "../oglwrap_config.h"
+#include "../../oglwrap/textures/texture_2D.h"
+#include "./mesh_renderer.h"
+
+namespace engine {
+
+// Pre-rendered views of meshes, to draw them far away as camera facing
+// quads (impostors). Every mesh gets a row of the atlas, with view_count
+// views from evenly spaced directions around the vertical axis. The i-th
+// view looks at the center of the mesh's bounding sphere from the direction
+// (cos(a), 0, sin(a)), where a = 2*pi*i/view_count, and shows the whole
+// bounding sphere.
+//
+// The color texture has the diffuse colors, with the coverage in alpha, the
+// normal texture has the model space normals (mapped to [0, 1]).
+//
+// The meshes are drawn with MeshRenderer::render, so they have to be baked
+// before their instance matrices are set up, and their attributes have to be
+// set up to the locations of impostor_bake.vert (0: position, 1: texture
+// coordinates, 2: normal), with the diffuse textures on the unit 0. The
+// baking works offscreen, with any OpenGL 3.3+ implementation (llvmpipe
+// included).
+class ImpostorAtlas {
+ public:
+  ImpostorAtlas(const std::vector<MeshRenderer*>& meshes, int view_count,
+                int cell_size);
+
+  int view_count() const { return view_count_; }
+  int mesh_count() const { return mesh_count_; }
+
+  const gl::Texture2D& colors() const { return colors_; }
+  const gl::Texture2D& normals() const { return normals_; }
+
+ private:
+  int view_count_, mesh_count_, cell_size_;
+  gl::Texture2D colors_, normals_;
+
+  void bake(const std::vector<MeshRenderer*>& meshes, gl::Texture2D& target,
+            bool normals);
+};
+
+}  // namespace engine
+
+#endif
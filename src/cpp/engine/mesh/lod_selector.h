@@ -0,0 +1,71 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_MESH_LOD_SELECTOR_H_
+#define ENGINE_MESH_LOD_SELECTOR_H_
+
+#include <limits>
+#include <algorithm>
+#include <vector>
+#include <stdexcept>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+namespace engine {
+
+// Chooses the level of detail of a mesh instance by the size of its bounding
+// sphere on the screen. The level i+1 is used below the i-th threshold. An
+// instance only switches to a coarser level, if it's smaller than the
+// threshold by the hysteresis ratio, and only switches back, if it's bigger
+// by it, so the instances at the thresholds don't flicker.
+class LodSelector {
+  std::vector<float> thresholds_;
+  float hysteresis_;
+
+ public:
+  // The thresholds are in pixels, in decreasing order
+  explicit LodSelector(const std::vector<float>& thresholds,
+                       float hysteresis = 0.1f)
+      : thresholds_(thresholds), hysteresis_(hysteresis) {
+    for (size_t i = 1; i < thresholds_.size(); ++i) {
+      if (thresholds_[i-1] <= thresholds_[i]) {
+        throw std::invalid_argument("engine::LodSelector: the thresholds "
+                                    "have to be decreasing");
+      }
+    }
+    if (!(0 <= hysteresis && hysteresis < 1)) {
+      throw std::invalid_argument("engine::LodSelector: invalid hysteresis");
+    }
+  }
+
+  size_t lod_count() const { return thresholds_.size() + 1; }
+
+  // The diameter of the bounding sphere (xyz: center, w: radius) on the
+  // screen, in pixels
+  static float ProjectedSize(const glm::mat4& projection, float screen_height,
+                             const glm::vec3& cam_pos,
+                             const glm::vec4& bsphere) {
+    float distance = glm::length(glm::vec3(bsphere) - cam_pos);
+    if (distance <= bsphere.w) {
+      return std::numeric_limits<float>::infinity();
+    }
+    // projection[1][1] is cot(fovy/2), the half of the screen's height
+    return bsphere.w / distance * projection[1][1] * screen_height;
+  }
+
+  // The level for an instance, that used current_lod in the last frame
+  size_t select(float projected_size, size_t current_lod) const {
+    size_t lod = std::min(current_lod, lod_count() - 1);
+    while (lod + 1 < lod_count() &&
+           projected_size < thresholds_[lod] * (1 - hysteresis_)) {
+      ++lod;
+    }
+    while (lod > 0 && projected_size > thresholds_[lod-1] * (1 + hysteresis_)) {
+      --lod;
+    }
+    return lod;
+  }
+};
+
+}  // namespace engine
+
+#endif
@@ -1,7 +1,12 @@
 // Copyright (c) 2014, Tamas Csala
 
 #include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
 #include "./mesh_renderer.h"
+#include "./mesh_simplifier.h"
+#include "../misc.h"
 #include "../../oglwrap/context.h"
 #include "../../oglwrap/smart_enums.h"
 
@@ -12,18 +17,21 @@ namespace engine {
   * @param flags - The assimp post-process flags. */
 MeshRenderer::MeshRenderer(const std::string& filename,
                            gl::Bitfield<aiPostProcessSteps> flags)
-    : scene_(importer_.ReadFile(filename.c_str(), flags|aiProcess_Triangulate))
+    : MeshRenderer(filename, Import(filename, flags)) {}
+
+MeshRenderer::MeshRenderer(const std::string& filename,
+                           std::unique_ptr<Assimp::Importer> importer)
+    : importer_(std::move(importer))
+    , scene_(importer_->GetScene())
     , filename_(filename)
     , entries_(scene_->mNumMeshes)
+    , instance_matrix_location_(0)
     , is_setup_positions_(false)
     , is_setup_normals_(false)
     , is_setup_tex_coords_(false)
-    , textures_enabled_(true) {
-  if (!scene_) {
-    throw std::runtime_error("Error parsing " + filename_ + " : " +
-                             importer_.GetErrorString());
-  }
-
+    , textures_enabled_(true)
+    , lod_count_(1)
+    , lod_reduction_(0.5f) {
   // The world transform is the transform that takes the root node to it's
   // parent's space, which is the OpenGL style world space. The inverse of this
   // is stored as an attribute of the scene's root node.
@@ -31,6 +39,16 @@ MeshRenderer::MeshRenderer(const std::string& filename,
     glm::inverse(engine::convertMatrix(scene_->mRootNode->mTransformation));
 }
 
+std::unique_ptr<Assimp::Importer> MeshRenderer::Import(
+    const std::string& filename, gl::Bitfield<aiPostProcessSteps> flags) {
+  auto importer = engine::make_unique<Assimp::Importer>();
+  if (!importer->ReadFile(filename.c_str(), flags|aiProcess_Triangulate)) {
+    throw std::runtime_error("Error parsing " + filename + " : " +
+                             importer->GetErrorString());
+  }
+  return importer;
+}
+
 std::vector<int> MeshRenderer::btTriangles(btTriangleIndexVertexArray* triangles) {
   std::vector<int> indices_vector;
 
@@ -104,9 +122,52 @@ void MeshRenderer::setIndices(size_t index) {
                  "This might result in rendering artifacts." << std::endl;
   }
 
-  gl::Bind(entries_[index].indices);
-  entries_[index].indices.data(indices_vector);
-  entries_[index].idx_count = indices_vector.size();
+  MeshEntry& entry = entries_[index];
+  entry.idx_count = indices_vector.size();
+  entry.lods.clear();
+  entry.lods.push_back(MeshEntry::Lod{0, entry.idx_count});
+
+  if (lod_count_ > 1) {
+    std::vector<glm::vec3> positions;
+    positions.reserve(mesh->mNumVertices);
+    for (size_t i = 0; i < mesh->mNumVertices; i++) {
+      const aiVector3D& v = mesh->mVertices[i];
+      positions.push_back(glm::vec3(v.x, v.y, v.z));
+    }
+    MeshSimplifier simplifier{positions, std::vector<uint32_t>(
+        indices_vector.begin(), indices_vector.end())};
+
+    float target = simplifier.triangle_count();
+    for (size_t lod = 1; lod < lod_count_; ++lod) {
+      target *= lod_reduction_;
+      std::vector<uint32_t> lod_indices = simplifier.simplify(target);
+      if (lod_indices.size() >= entry.lods.back().idx_count) {
+        break;  // it can't be simplified more, the last level is used
+      }
+      entry.lods.push_back(MeshEntry::Lod{
+          indices_vector.size() * sizeof(IdxType),
+          static_cast<unsigned>(lod_indices.size())});
+      indices_vector.insert(indices_vector.end(), lod_indices.begin(),
+                            lod_indices.end());
+    }
+  }
+
+  gl::Bind(entry.indices);
+  entry.indices.data(indices_vector);
+}
+
+/// Makes setupPositions generate simplified versions of the mesh.
+void MeshRenderer::generateLods(size_t lod_count, float reduction) {
+  if (is_setup_positions_) {
+    throw std::logic_error("MeshRenderer::generateLods has to be called "
+                           "before setupPositions");
+  }
+  if (lod_count == 0 || !(0 < reduction && reduction < 1)) {
+    throw std::invalid_argument("MeshRenderer::generateLods: invalid "
+                                "arguments");
+  }
+  lod_count_ = lod_count;
+  lod_reduction_ = reduction;
 }
 
 /// Loads in vertex positions and indices, and uploads the former into an attribute array.
@@ -342,9 +403,61 @@ void MeshRenderer::setupSpecularTextures(unsigned short texture_unit) {
                 AI_MATKEY_COLOR_SPECULAR, false);
 }
 
+/// Sets up a mat4 per instance attribute for the instanced rendering.
+/** Calling this function changes the currently active VAO and ArrayBuffer.
+  * @param location - The location of the first column of the matrix. */
+void MeshRenderer::setupInstanceMatrices(GLuint location) {
+#ifdef glVertexAttribDivisor
+  if (glVertexAttribDivisor) {
+    // The pointers are set up before every draw call
+    for (size_t i = 0; i < entries_.size(); i++) {
+      gl::Bind(entries_[i].vao);
+      for (GLuint column = 0; column < 4; ++column) {
+        gl::VertexAttrib attrib(location + column);
+        attrib.enable();
+        attrib.divisor(1);
+      }
+    }
+    gl::Unbind(gl::kVertexArray);
+    instance_matrices_ = engine::make_unique<StreamBuffer>();
+    instance_matrix_location_ = location;
+  }
+#endif
+}
+
 /// Renders the mesh.
 /** Changes the currently active VAO and may change the Texture2D binding */
 void MeshRenderer::render() {
+  renderEntries(0, 0);
+}
+
+/// Renders an instance of the mesh for every matrix, with one draw call per mesh entry.
+/** Changes the currently active VAO and ArrayBuffer, and may change the Texture2D binding */
+void MeshRenderer::renderInstanced(const std::vector<glm::mat4>& matrices,
+                                   size_t lod) {
+  if (matrices.empty() || !instance_matrices_) {
+    return;
+  }
+  size_t offset = instance_matrices_->write(matrices);
+
+  glBindBuffer(GL_ARRAY_BUFFER, instance_matrices_->expose());
+  for (size_t i = 0; i < entries_.size(); i++) {
+    gl::Bind(entries_[i].vao);
+    for (GLuint column = 0; column < 4; ++column) {
+      gl::VertexAttrib attrib(instance_matrix_location_ + column);
+      attrib.pointer(4, gl::DataType::kFloat, false, sizeof(glm::mat4),
+                     reinterpret_cast<const void*>(
+                         offset + column*sizeof(glm::vec4)));
+    }
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  renderEntries(matrices.size(), lod);
+  instance_matrices_->fence();
+}
+
+/// Draws a level of detail of every mesh entry, instance_count times if it isn't zero.
+void MeshRenderer::renderEntries(size_t instance_count, size_t lod) {
   if (!is_setup_positions_) {
     return;  // we can't render the mesh, if we don't have any vertex.
   }
@@ -363,7 +476,19 @@ void MeshRenderer::render() {
       }
     }
 
-    gl::DrawElements(gl::kTriangles, entries_[i].idx_count, entries_[i].idx_type);
+    // The entries that couldn't be simplified enough use their last level
+    const auto& lods = entries_[i].lods;
+    const MeshEntry::Lod& range = lods[std::min(lod, lods.size() - 1)];
+    const void* offset = reinterpret_cast<const void*>(range.offset);
+    if (instance_count == 0) {
+      gl::DrawElements(gl::kTriangles, range.idx_count, entries_[i].idx_type,
+                       offset);
+    } else {
+#ifdef glDrawElementsInstanced
+      gl::DrawElementsInstanced(gl::kTriangles, range.idx_count,
+                                entries_[i].idx_type, instance_count, offset);
+#endif
+    }
 
     if (textures_enabled_) {
       for (auto iter = materials_.begin(); iter != materials_.end(); iter++) {
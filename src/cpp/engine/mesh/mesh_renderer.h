@@ -15,6 +15,7 @@
 #include "../../oglwrap/textures/texture_2D.h"
 
 #include "../assimp.h"
+#include "../stream_buffer.h"
 #include "../collision/bounding_box.h"
 
 namespace engine {
@@ -34,11 +35,19 @@ class MeshRenderer {
     static const unsigned kInvalidMaterial = unsigned(-1);
     gl::IndexType idx_type;
 
+    /// The index range of a level of detail.
+    struct Lod {
+      size_t offset;  // in bytes
+      unsigned idx_count;
+    };
+    /// The levels of detail, after each other in the index buffer (the first one is the full mesh).
+    std::vector<Lod> lods;
+
     MeshEntry() : material_index(kInvalidMaterial) {}
   };
 
   /// The assimp importer. The scene actually belongs to this.
-  Assimp::Importer importer_;
+  std::unique_ptr<Assimp::Importer> importer_;
 
   /// A pointer to the scene stored by the importer. But this is the working interface for it.
   const aiScene* scene_;
@@ -64,6 +73,13 @@ class MeshRenderer {
   /// The materials.
   std::map<aiTextureType, MaterialInfo> materials_;
 
+  /// The per instance model matrices, shared by every mesh entry. Every
+  /// instanced draw writes the next part of the ring, and the attributes are
+  /// pointed there before the draw. Only created by setupInstanceMatrices.
+  std::unique_ptr<StreamBuffer> instance_matrices_;
+  /// The location of the first column of the per instance matrix.
+  GLuint instance_matrix_location_;
+
   /// Stores if the setupPositions function is called (they shouldn't be called more than once).
   bool is_setup_positions_;
   /// Stores if the setupNormals function is called (they shouldn't be called more than once).
@@ -73,6 +89,11 @@ class MeshRenderer {
   /// Textures can be disabled, and not used for rendering
   bool textures_enabled_;
 
+  /// The number of levels of detail to generate.
+  size_t lod_count_;
+  /// The ratio of the triangle counts of two consecutive levels of detail.
+  float lod_reduction_;
+
   /// It shouldn't be copyable.
   MeshRenderer(const MeshRenderer& src) = delete;
   /// It shouldn't be copyable.
@@ -85,6 +106,20 @@ public:
   MeshRenderer(const std::string& filename,
                gl::Bitfield<aiPostProcessSteps> flags);
 
+  /// Creates the renderer for a scene that was already loaded in by Import.
+  /** @param filename - The name of the loaded file (for the error messages).
+    * @param importer - The importer returned by Import. */
+  MeshRenderer(const std::string& filename,
+               std::unique_ptr<Assimp::Importer> importer);
+
+  /// Loads in a file with assimp, and does some post-processing on it.
+  /** It doesn't make any OpenGL call, so it can run on any thread, while the
+    * MeshRenderer has to be created on the one with the context.
+    * @param filename - The name of the file to load in.
+    * @param flags - The assimp post-process flags. */
+  static std::unique_ptr<Assimp::Importer> Import(
+      const std::string& filename, gl::Bitfield<aiPostProcessSteps> flags);
+
   template <typename IdxType>
   /// Returns a vector of the indices
   std::vector<IdxType> indices();
@@ -97,6 +132,9 @@ public:
   std::vector<int> btTriangles(btTriangleIndexVertexArray* triangles);
 
 private:
+  /// Draws a level of detail of every mesh entry, instance_count times if it isn't zero.
+  void renderEntries(size_t instance_count, size_t lod);
+
   template <typename IdxType>
   /// A template for setting different types (byte/short/int) of indices.
   /** This expects the correct vao to be already bound!
@@ -104,6 +142,18 @@ private:
   void setIndices(size_t index);
 
 public:
+  /// Makes setupPositions generate simplified versions of the mesh.
+  /** The levels are generated with quadric error edge collapses (see MeshSimplifier),
+    * every level has about reduction times the triangles of the previous one. They
+    * share the vertices, and are stored after each other in the index buffers.
+    * Has to be called before setupPositions.
+    * @param lod_count - The number of levels, including the full mesh.
+    * @param reduction - The ratio of the triangle counts of two consecutive levels. */
+  void generateLods(size_t lod_count, float reduction = 0.5f);
+
+  /// Returns the number of levels of detail.
+  size_t lodCount() const { return lod_count_; }
+
   /// Loads in vertex positions and indices, and uploads the former into an attribute array.
   /** Uploads the vertex positions data to an attribute array, and sets it up for use.
     * Calling this function changes the currently active VAO, ArrayBuffer and IndexBuffer.
@@ -165,10 +215,23 @@ public:
     * @param texture_unit - Specifies the texture unit to use for the specular textures. */
   void setupSpecularTextures(unsigned short texture_unit);
 
+  /// Sets up a mat4 per instance attribute for the instanced rendering.
+  /** The matrix takes 4 attribute locations, starting with location, so it
+    * should be specified explicitly in the shaders (with a layout qualifier).
+    * Calling this function changes the currently active VAO and ArrayBuffer.
+    * @param location - The location of the first column of the matrix. */
+  void setupInstanceMatrices(GLuint location);
+
   /// Renders the mesh.
   /** Changes the currently active VAO and may change the Texture2D binding */
   void render();
 
+  /// Renders an instance of the mesh for every matrix, with one draw call per mesh entry.
+  /** Needs setupInstanceMatrices to be called first.
+    * Changes the currently active VAO and ArrayBuffer, and may change the Texture2D binding
+    * @param lod - The level of detail to draw (see generateLods). */
+  void renderInstanced(const std::vector<glm::mat4>& matrices, size_t lod = 0);
+
   /// Gives information about the mesh's bounding cuboid.
   BoundingBox boundingBox(const glm::mat4& matrix = glm::mat4{}) const;
 
@@ -0,0 +1,264 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <map>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include "./mesh_simplifier.h"
+
+namespace engine {
+
+namespace {
+
+// The border planes are weighted heavier than the faces, so the borders
+// only move, if there's nothing else to collapse.
+const double kBorderWeight = 1000.0;
+
+// A collapse is rejected, if it would turn a triangle by more than ~80°
+const double kMinNormalCos = 0.2;
+
+}  // namespace
+
+MeshSimplifier::Quadric::Quadric() {
+  std::fill(a_, a_ + 10, 0.0);
+}
+
+MeshSimplifier::Quadric::Quadric(const glm::dvec3& n, double d, double w) {
+  a_[0] = w*n.x*n.x; a_[1] = w*n.x*n.y; a_[2] = w*n.x*n.z; a_[3] = w*n.x*d;
+  a_[4] = w*n.y*n.y; a_[5] = w*n.y*n.z; a_[6] = w*n.y*d;
+  a_[7] = w*n.z*n.z; a_[8] = w*n.z*d;
+  a_[9] = w*d*d;
+}
+
+MeshSimplifier::Quadric& MeshSimplifier::Quadric::operator+=(
+    const Quadric& rhs) {
+  for (int i = 0; i < 10; ++i) {
+    a_[i] += rhs.a_[i];
+  }
+  return *this;
+}
+
+double MeshSimplifier::Quadric::error(const glm::dvec3& p) const {
+  return a_[0]*p.x*p.x + 2*a_[1]*p.x*p.y + 2*a_[2]*p.x*p.z + 2*a_[3]*p.x
+       + a_[4]*p.y*p.y + 2*a_[5]*p.y*p.z + 2*a_[6]*p.y
+       + a_[7]*p.z*p.z + 2*a_[8]*p.z
+       + a_[9];
+}
+
+MeshSimplifier::MeshSimplifier(const std::vector<glm::vec3>& positions,
+                               const std::vector<uint32_t>& indices)
+    : positions_(positions.begin(), positions.end())
+    , quadrics_(positions.size())
+    , triangle_count_(0)
+    , vertex_triangles_(positions.size())
+    , live_vertices_(positions.size(), true)
+    , versions_(positions.size(), 0) {
+  if (indices.size() % 3 != 0) {
+    throw std::invalid_argument("engine::MeshSimplifier: the index count "
+                                "isn't divisible by three");
+  }
+
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    std::array<uint32_t, 3> triangle{{indices[i], indices[i+1], indices[i+2]}};
+    for (uint32_t vertex : triangle) {
+      if (positions.size() <= vertex) {
+        throw std::out_of_range("engine::MeshSimplifier: invalid index");
+      }
+    }
+    if (triangle[0] == triangle[1] || triangle[1] == triangle[2] ||
+        triangle[2] == triangle[0]) {
+      continue;
+    }
+
+    uint32_t t = triangles_.size();
+    triangles_.push_back(triangle);
+    for (uint32_t vertex : triangle) {
+      vertex_triangles_[vertex].push_back(t);
+    }
+
+    // The plane of the triangle, weighted by its area
+    const glm::dvec3& p0 = positions_[triangle[0]];
+    glm::dvec3 normal = glm::cross(positions_[triangle[1]] - p0,
+                                   positions_[triangle[2]] - p0);
+    double length = glm::length(normal);
+    if (length > 0) {
+      normal /= length;
+      Quadric quadric{normal, -glm::dot(normal, p0), length / 2};
+      for (uint32_t vertex : triangle) {
+        quadrics_[vertex] += quadric;
+      }
+    }
+  }
+  live_triangles_.assign(triangles_.size(), true);
+  triangle_count_ = triangles_.size();
+
+  // The number of triangles of every edge
+  EdgeMap edges;
+  for (const auto& triangle : triangles_) {
+    for (int i = 0; i < 3; ++i) {
+      uint32_t a = triangle[i], b = triangle[(i+1) % 3];
+      edges[std::make_pair(std::min(a, b), std::max(a, b))]++;
+    }
+  }
+
+  addBorderQuadrics(edges);
+  for (const auto& edge : edges) {
+    pushCollapses(edge.first.first, edge.first.second);
+  }
+}
+
+// The edges that only have one triangle get a plane, that is perpendicular
+// to the triangle, and goes through the edge.
+void MeshSimplifier::addBorderQuadrics(const EdgeMap& edges) {
+  for (const auto& triangle : triangles_) {
+    const glm::dvec3& p0 = positions_[triangle[0]];
+    glm::dvec3 normal = glm::cross(positions_[triangle[1]] - p0,
+                                   positions_[triangle[2]] - p0);
+    if (glm::length(normal) == 0) {
+      continue;
+    }
+    normal = glm::normalize(normal);
+
+    for (int i = 0; i < 3; ++i) {
+      uint32_t a = triangle[i], b = triangle[(i+1) % 3];
+      if (edges.at(std::make_pair(std::min(a, b), std::max(a, b))) != 1) {
+        continue;
+      }
+      glm::dvec3 edge = positions_[b] - positions_[a];
+      glm::dvec3 border_normal = glm::cross(edge, normal);
+      double length = glm::length(border_normal);
+      if (length == 0) {
+        continue;
+      }
+      border_normal /= length;
+      Quadric quadric{border_normal,
+                      -glm::dot(border_normal, positions_[a]),
+                      kBorderWeight * glm::dot(edge, edge)};
+      quadrics_[a] += quadric;
+      quadrics_[b] += quadric;
+    }
+  }
+}
+
+void MeshSimplifier::pushCollapses(uint32_t a, uint32_t b) {
+  Quadric quadric = quadrics_[a];
+  quadric += quadrics_[b];
+
+  heap_.push_back(Collapse{quadric.error(positions_[b]), a, b,
+                           versions_[a], versions_[b]});
+  std::push_heap(heap_.begin(), heap_.end());
+  heap_.push_back(Collapse{quadric.error(positions_[a]), b, a,
+                           versions_[b], versions_[a]});
+  std::push_heap(heap_.begin(), heap_.end());
+}
+
+bool MeshSimplifier::flips(uint32_t from, uint32_t to) const {
+  for (uint32_t t : vertex_triangles_[from]) {
+    if (!live_triangles_[t]) {
+      continue;
+    }
+    const auto& triangle = triangles_[t];
+    if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+      continue;  // it will be removed
+    }
+
+    glm::dvec3 p[3], moved[3];
+    for (int i = 0; i < 3; ++i) {
+      p[i] = positions_[triangle[i]];
+      moved[i] = triangle[i] == from ? positions_[to] : p[i];
+    }
+    glm::dvec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+    glm::dvec3 new_normal = glm::cross(moved[1] - moved[0],
+                                       moved[2] - moved[0]);
+    double lengths = glm::length(normal) * glm::length(new_normal);
+    if (lengths == 0 ||
+        glm::dot(normal, new_normal) < kMinNormalCos * lengths) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void MeshSimplifier::collapse(uint32_t from, uint32_t to) {
+  live_vertices_[from] = false;
+  quadrics_[to] += quadrics_[from];
+  versions_[to]++;
+
+  for (uint32_t t : vertex_triangles_[from]) {
+    if (!live_triangles_[t]) {
+      continue;
+    }
+    auto& triangle = triangles_[t];
+    if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+      live_triangles_[t] = false;
+      triangle_count_--;
+    } else {
+      for (uint32_t& vertex : triangle) {
+        if (vertex == from) {
+          vertex = to;
+        }
+      }
+      vertex_triangles_[to].push_back(t);
+    }
+  }
+  vertex_triangles_[from].clear();
+
+  // Drop the dead triangles of the new vertex, so the lists don't grow
+  auto& triangles = vertex_triangles_[to];
+  triangles.erase(std::remove_if(triangles.begin(), triangles.end(),
+                                 [this](uint32_t t) {
+                                   return !live_triangles_[t];
+                                 }), triangles.end());
+
+  for (uint32_t neighbour : neighbours(to)) {
+    pushCollapses(to, neighbour);
+  }
+}
+
+std::vector<uint32_t> MeshSimplifier::neighbours(uint32_t vertex) const {
+  std::vector<uint32_t> result;
+  for (uint32_t t : vertex_triangles_[vertex]) {
+    if (live_triangles_[t]) {
+      for (uint32_t other : triangles_[t]) {
+        if (other != vertex) {
+          result.push_back(other);
+        }
+      }
+    }
+  }
+  std::sort(result.begin(), result.end());
+  result.erase(std::unique(result.begin(), result.end()), result.end());
+  return result;
+}
+
+std::vector<uint32_t> MeshSimplifier::simplify(size_t target_triangle_count) {
+  while (target_triangle_count < triangle_count_ && !heap_.empty()) {
+    std::pop_heap(heap_.begin(), heap_.end());
+    Collapse c = heap_.back();
+    heap_.pop_back();
+
+    if (!live_vertices_[c.from] || !live_vertices_[c.to] ||
+        versions_[c.from] != c.from_version ||
+        versions_[c.to] != c.to_version) {
+      continue;  // an outdated collapse
+    }
+
+    // A rejected collapse is pushed again, when one of its vertices
+    // gets a new neighbour
+    if (!flips(c.from, c.to)) {
+      collapse(c.from, c.to);
+    }
+  }
+
+  std::vector<uint32_t> indices;
+  indices.reserve(3 * triangle_count_);
+  for (size_t t = 0; t < triangles_.size(); ++t) {
+    if (live_triangles_[t]) {
+      indices.insert(indices.end(), triangles_[t].begin(),
+                     triangles_[t].end());
+    }
+  }
+  return indices;
+}
+
+}  // namespace engine
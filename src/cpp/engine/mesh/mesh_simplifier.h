@@ -0,0 +1,83 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_MESH_MESH_SIMPLIFIER_H_
+#define ENGINE_MESH_MESH_SIMPLIFIER_H_
+
+#include <map>
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+namespace engine {
+
+// Simplifies a triangle mesh with edge collapses, ordered by the quadric
+// error metric (Garland and Heckbert). A vertex is always collapsed into one
+// of its neighbours, so the simplified meshes index the original vertices,
+// and all of the levels of detail can share a vertex buffer.
+//
+// The edges, that only have one triangle (the borders and the texture
+// seams) are kept in place with extra planes. The collapses, that would
+// flip a triangle, are rejected.
+class MeshSimplifier {
+ public:
+  MeshSimplifier(const std::vector<glm::vec3>& positions,
+                 const std::vector<uint32_t>& indices);
+
+  size_t triangle_count() const { return triangle_count_; }
+
+  // Collapses edges until at most target_triangle_count triangles remain
+  // (or no more edges can be collapsed), and returns the indices of the
+  // simplified mesh. It continues from the result of the previous call, so
+  // a chain of levels can be built with decreasing targets.
+  std::vector<uint32_t> simplify(size_t target_triangle_count);
+
+ private:
+  // A symmetric 4x4 matrix: the sum of the squared distances to planes
+  class Quadric {
+    double a_[10];
+
+   public:
+    Quadric();
+    // The plane of dot(normal, x) + dist = 0, with a unit normal
+    Quadric(const glm::dvec3& normal, double dist, double weight);
+    Quadric& operator+=(const Quadric& rhs);
+    double error(const glm::dvec3& pos) const;
+  };
+
+  struct Collapse {
+    double cost;
+    uint32_t from, to;
+    uint32_t from_version, to_version;
+
+    bool operator<(const Collapse& rhs) const { return cost > rhs.cost; }
+  };
+
+  std::vector<glm::dvec3> positions_;
+  std::vector<Quadric> quadrics_;
+  std::vector<std::array<uint32_t, 3>> triangles_;
+  std::vector<bool> live_triangles_;
+  size_t triangle_count_;
+
+  // The triangles of every vertex (some of them might be dead already)
+  std::vector<std::vector<uint32_t>> vertex_triangles_;
+  std::vector<bool> live_vertices_;
+  // Incremented when a vertex changes, to invalidate its queued collapses
+  std::vector<uint32_t> versions_;
+  std::vector<Collapse> heap_;
+
+  // The number of triangles of the edges (with the smaller index first)
+  using EdgeMap = std::map<std::pair<uint32_t, uint32_t>, int>;
+
+  void addBorderQuadrics(const EdgeMap& edges);
+  void pushCollapses(uint32_t a, uint32_t b);
+  bool flips(uint32_t from, uint32_t to) const;
+  void collapse(uint32_t from, uint32_t to);
+  std::vector<uint32_t> neighbours(uint32_t vertex) const;
+};
+
+}  // namespace engine
+
+#endif
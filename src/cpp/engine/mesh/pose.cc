@@ -0,0 +1,77 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include "./pose.h"
+#include "../task_scheduler.h"
+
+namespace engine {
+
+void EvaluatePose(const Skeleton& skeleton,
+                  const PoseInput& input,
+                  glm::mat4* global_transforms,
+                  glm::mat4* bones,
+                  glm::vec3* root_offset) {
+  const ClipPose& last = input.last;
+  const ClipPose& current = input.current;
+  AnimationClip::Cursor last_cursor = last.clip->cursor(last.time);
+  AnimationClip::Cursor current_cursor = current.clip->cursor(current.time);
+  bool in_transition = input.factor < 1.0f;
+
+  for (size_t node = 0; node < skeleton.node_count(); ++node) {
+    int current_track = (*current.track_of_node)[node];
+    int last_track = (*last.track_of_node)[node];
+    glm::mat4 local_transform;
+
+    if (current_track != -1 && (!in_transition || last_track != -1)) {
+      BoneTransform sample = current.clip->sample(current_track, current_cursor);
+      BoneTransform transform = sample;
+      if (in_transition) {
+        transform = BoneTransform::Mix(
+          last.clip->sample(last_track, last_cursor), sample, input.factor);
+      }
+
+      if (int(node) == skeleton.root_bone_node()) {
+        *root_offset = glm::vec3(sample.pos.x, 0, sample.pos.z);
+        if (input.mirrored) {
+          *root_offset *= -1;
+        }
+        transform.pos = glm::vec3(0, transform.pos.y, 0);
+      }
+      local_transform = transform.toMatrix();
+    } else {
+      local_transform = skeleton.default_transform(node);
+    }
+
+    int parent = skeleton.parent(node);
+    if (parent == -1) {
+      global_transforms[node] = local_transform;
+    } else {
+      global_transforms[node] = global_transforms[parent] * local_transform;
+    }
+
+    int bone = skeleton.bone_index(node);
+    if (bone != -1) {
+      bones[bone] = global_transforms[node] * skeleton.bone_offset(bone);
+    }
+  }
+}
+
+void EvaluatePoses(const Skeleton& skeleton,
+                   const std::vector<PoseInput>& inputs,
+                   std::vector<glm::mat4>& bones,
+                   std::vector<glm::vec3>& root_offsets) {
+  size_t bone_count = skeleton.bone_count();
+  bones.resize(inputs.size() * bone_count);
+
+  // A few characters per chunk, so that a chunk is worth a task, but every
+  // worker still gets work with a few hundred characters.
+  TaskScheduler::Default().parallelFor(0, inputs.size(),
+      [&](size_t begin, size_t end) {
+    std::vector<glm::mat4> global_transforms(skeleton.node_count());
+    for (size_t i = begin; i < end; ++i) {
+      EvaluatePose(skeleton, inputs[i], global_transforms.data(),
+                   bones.data() + i * bone_count, &root_offsets[i]);
+    }
+  }, 8);
+}
+
+}  // namespace engine
@@ -0,0 +1,75 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_MESH_POSE_H_
+#define ENGINE_MESH_POSE_H_
+
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "./skeleton.h"
+#include "./animation_clip.h"
+
+namespace engine {
+
+/// A clip at a given time, and its binding to a skeleton.
+struct ClipPose {
+  const AnimationClip* clip = nullptr;
+  const std::vector<int>* track_of_node = nullptr;
+  float time = 0.0f;
+};
+
+/// Everything that is needed to evaluate the pose of one character: a blend
+/// between the last and the current clip.
+struct PoseInput {
+  ClipPose last;
+  ClipPose current;
+
+  /// The weight of the current clip.
+  float factor = 1.0f;
+
+  /// If the root bone's offset should be negated.
+  bool mirrored = false;
+};
+
+/**
+ * @brief Evaluates a pose in a single loop over the skeleton.
+ *
+ * Doesn't allocate, and only writes the given arrays, so it is safe to call
+ * for different characters in parallel.
+ *
+ * @param skeleton           The skeleton of the character.
+ * @param input              The clips to blend.
+ * @param global_transforms  Receives the model space transformation of every
+ *                           node. Must have skeleton.node_count() elements.
+ * @param bones              Receives the skinning matrix of every bone. Must
+ *                           have skeleton.bone_count() elements.
+ * @param root_offset        Receives the XZ offset of the root bone, if the
+ *                           root bone is animated. Left as it is otherwise.
+ */
+void EvaluatePose(const Skeleton& skeleton,
+                  const PoseInput& input,
+                  glm::mat4* global_transforms,
+                  glm::mat4* bones,
+                  glm::vec3* root_offset);
+
+/**
+ * @brief Evaluates the poses of many characters on the TaskScheduler.
+ *
+ * @param skeleton      The skeleton that all the characters share.
+ * @param inputs        The clips of each character.
+ * @param bones         Receives the skinning matrices of the characters, the
+ *                      ones of the i-th character start at
+ *                      i * skeleton.bone_count(). It is resized if needed.
+ * @param root_offsets  The root bone offsets of the characters, updated like
+ *                      in EvaluatePose. Must have inputs.size() elements.
+ */
+void EvaluatePoses(const Skeleton& skeleton,
+                   const std::vector<PoseInput>& inputs,
+                   std::vector<glm::mat4>& bones,
+                   std::vector<glm::vec3>& root_offsets);
+
+}  // namespace engine
+
+#endif  // ENGINE_MESH_POSE_H_
@@ -0,0 +1,61 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include "./skeleton.h"
+
+namespace engine {
+
+Skeleton::Skeleton(const aiNode* root,
+                   const std::map<std::string, unsigned>& bone_mapping,
+                   const std::vector<glm::mat4>& bone_offsets)
+    : bone_offsets_(bone_offsets) {
+  addNode(root, -1, bone_mapping);
+}
+
+void Skeleton::addNode(const aiNode* node, int parent,
+                       const std::map<std::string, unsigned>& bone_mapping) {
+  size_t idx = parents_.size();
+  std::string name(node->mName.data);
+  auto bone = bone_mapping.find(name);
+
+  parents_.push_back(parent);
+  subtree_ends_.push_back(0);
+  bone_indices_.push_back(bone == bone_mapping.end() ? -1 : int(bone->second));
+  glm::mat4 transform = engine::convertMatrix(node->mTransformation);
+  default_transforms_.push_back(transform);
+
+  // The node transforms don't have shear, so the columns of the upper 3x3
+  // are the scaled axes
+  glm::vec3 scale{glm::length(glm::vec3(transform[0])),
+                  glm::length(glm::vec3(transform[1])),
+                  glm::length(glm::vec3(transform[2]))};
+  glm::mat3 rotation{glm::vec3(transform[0]) / scale.x,
+                     glm::vec3(transform[1]) / scale.y,
+                     glm::vec3(transform[2]) / scale.z};
+  default_poses_.push_back(BoneTransform(glm::vec3(transform[3]),
+                                         glm::quat_cast(rotation), scale));
+  names_.push_back(name);
+
+  for (unsigned i = 0; i < node->mNumChildren; ++i) {
+    addNode(node->mChildren[i], idx, bone_mapping);
+  }
+  subtree_ends_[idx] = parents_.size();
+}
+
+int Skeleton::findNode(const std::string& name) const {
+  for (size_t i = 0; i < names_.size(); ++i) {
+    if (names_[i] == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+std::vector<int> Skeleton::bindClip(const AnimationClip& clip) const {
+  std::vector<int> tracks(node_count());
+  for (size_t i = 0; i < node_count(); ++i) {
+    tracks[i] = clip.findTrack(names_[i]);
+  }
+  return tracks;
+}
+
+}  // namespace engine
@@ -0,0 +1,97 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_MESH_SKELETON_H_
+#define ENGINE_MESH_SKELETON_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "../assimp.h"
+#include "./animation_clip.h"
+
+namespace engine {
+
+/**
+ * @brief The node hierarchy of a mesh, flattened into arrays.
+ *
+ * The nodes are in depth first pre-order, so every node comes after its
+ * parent, and the descendants of a node are right after it. This way the
+ * whole hierarchy can be updated in a single loop, and a subtree can be
+ * skipped by jumping to subtree_end().
+ */
+class Skeleton {
+ public:
+  Skeleton() = default;
+
+  /**
+   * @param root          The root node of the hierarchy.
+   * @param bone_mapping  Maps the bone names to bone indices.
+   * @param bone_offsets  The offset matrix (from the model space to the
+   *                      bone's space) of every bone.
+   */
+  Skeleton(const aiNode* root,
+           const std::map<std::string, unsigned>& bone_mapping,
+           const std::vector<glm::mat4>& bone_offsets);
+
+  size_t node_count() const { return parents_.size(); }
+  size_t bone_count() const { return bone_offsets_.size(); }
+
+  /// The index of the parent node, or -1 for the root.
+  int parent(size_t node) const { return parents_[node]; }
+
+  /// The index after the last descendant of the node.
+  size_t subtree_end(size_t node) const { return subtree_ends_[node]; }
+
+  /// The index of the bone that belongs to the node, or -1 if it isn't a bone.
+  int bone_index(size_t node) const { return bone_indices_[node]; }
+
+  /// The transformation of the node relative to its parent, when it isn't
+  /// animated.
+  const glm::mat4& default_transform(size_t node) const {
+    return default_transforms_[node];
+  }
+
+  /// The default transform decomposed, so it can be blended with animations.
+  const BoneTransform& default_pose(size_t node) const {
+    return default_poses_[node];
+  }
+
+  const std::string& node_name(size_t node) const { return names_[node]; }
+
+  const glm::mat4& bone_offset(size_t bone) const {
+    return bone_offsets_[bone];
+  }
+
+  /// The node of the root bone, whose XZ movement isn't applied to the pose,
+  /// but is given back as an offset. It is -1 if it isn't known.
+  int root_bone_node() const { return root_bone_node_; }
+  void set_root_bone_node(int node) { root_bone_node_ = node; }
+
+  /// Returns the index of the node called name, or -1 if there isn't one.
+  int findNode(const std::string& name) const;
+
+  /// Returns the track of the clip that animates each node (or -1 for the
+  /// nodes that it doesn't animate).
+  std::vector<int> bindClip(const AnimationClip& clip) const;
+
+ private:
+  std::vector<int> parents_;
+  std::vector<size_t> subtree_ends_;
+  std::vector<int> bone_indices_;
+  std::vector<glm::mat4> default_transforms_;
+  std::vector<BoneTransform> default_poses_;
+  std::vector<std::string> names_;
+  std::vector<glm::mat4> bone_offsets_;
+  int root_bone_node_ = -1;
+
+  void addNode(const aiNode* node, int parent,
+               const std::map<std::string, unsigned>& bone_mapping);
+};
+
+}  // namespace engine
+
+#endif  // ENGINE_MESH_SKELETON_H_
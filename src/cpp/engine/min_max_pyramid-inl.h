@@ -0,0 +1,113 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_MIN_MAX_PYRAMID_INL_H_
+#define ENGINE_MIN_MAX_PYRAMID_INL_H_
+
+#include <algorithm>
+#include <stdexcept>
+#include "./min_max_pyramid.h"
+#include "./task_scheduler.h"
+
+namespace engine {
+
+template<typename T>
+MinMaxPyramid::MinMaxPyramid(const T* data, int w, int h, float scale,
+                             float offset, int base_cell_size)
+    : w_(w), h_(h), base_cell_size_(base_cell_size) {
+  if (w <= 0 || h <= 0) {
+    throw std::invalid_argument("MinMaxPyramid: empty heightmap");
+  }
+  if (base_cell_size <= 0 || (base_cell_size & (base_cell_size-1)) != 0) {
+    throw std::invalid_argument(
+      "MinMaxPyramid: base_cell_size must be a power of two");
+  }
+
+  const int s = base_cell_size;
+  Level base;
+  base.w = std::max((w - 1 + s - 1) / s, 1);
+  base.h = std::max((h - 1 + s - 1) / s, 1);
+
+  // The rows of cells are independent, so they are processed in parallel.
+  base.mins.resize(base.w * base.h);
+  base.maxes.resize(base.w * base.h);
+  levels_.push_back(std::move(base));
+  TaskScheduler::Default().parallelFor(0, levels_[0].h,
+      [&](size_t cy_begin, size_t cy_end) {
+    reduceBaseCells(data, scale, offset, 0, levels_[0].w,
+                    cy_begin, cy_end);
+  });
+
+  buildUpperLevels();
+}
+
+template<typename T>
+void MinMaxPyramid::reduceBaseCells(const T* data, float scale, float offset,
+                                    int cx_begin, int cx_end,
+                                    int cy_begin, int cy_end) {
+  Level& base = levels_[0];
+  const int s = base_cell_size_;
+
+  // Reduce in T, and only convert the results to float. Every row is
+  // processed left to right, cell by cell, so the inner loop is a tight,
+  // non-virtual min/max over contiguous memory, that the compiler can
+  // vectorize.
+  std::vector<T> cell_mins(cx_end - cx_begin), cell_maxes(cx_end - cx_begin);
+  for (int cy = cy_begin; cy < cy_end; ++cy) {
+    int y_begin = cy*s, y_end = std::min(cy*s + s, h_ - 1);
+    for (int y = y_begin; y <= y_end; ++y) {
+      const T* row = data + static_cast<size_t>(y) * w_;
+      for (int cx = cx_begin; cx < cx_end; ++cx) {
+        int x_begin = cx*s, x_end = std::min(cx*s + s, w_ - 1);
+        T curr_min = row[x_begin], curr_max = row[x_begin];
+        for (int x = x_begin + 1; x <= x_end; ++x) {
+          curr_min = std::min(curr_min, row[x]);
+          curr_max = std::max(curr_max, row[x]);
+        }
+        int i = cx - cx_begin;
+        if (y == y_begin) {
+          cell_mins[i] = curr_min;
+          cell_maxes[i] = curr_max;
+        } else {
+          cell_mins[i] = std::min(cell_mins[i], curr_min);
+          cell_maxes[i] = std::max(cell_maxes[i], curr_max);
+        }
+      }
+    }
+    // A negative scale swaps the minimums and the maximums
+    std::vector<T>& mins = scale < 0 ? cell_maxes : cell_mins;
+    std::vector<T>& maxes = scale < 0 ? cell_mins : cell_maxes;
+    for (int cx = cx_begin; cx < cx_end; ++cx) {
+      base.mins[cy*base.w + cx] = mins[cx - cx_begin] * scale + offset;
+      base.maxes[cy*base.w + cx] = maxes[cx - cx_begin] * scale + offset;
+    }
+  }
+}
+
+template<typename T>
+void MinMaxPyramid::update(const T* data, float scale, float offset,
+                           int x0, int y0, int x1, int y1) {
+  x0 = std::max(x0, 0);
+  y0 = std::max(y0, 0);
+  x1 = std::min(x1, w_ - 1);
+  y1 = std::min(y1, h_ - 1);
+  if (empty() || x1 < x0 || y1 < y0) {
+    return;
+  }
+
+  // The cells share their border texels, so a texel on a border is in the
+  // previous cell too
+  const Level& base = levels_[0];
+  const int s = base_cell_size_;
+  int cx0 = std::max(x0 - 1, 0) / s, cx1 = std::min(x1 / s, base.w - 1);
+  int cy0 = std::max(y0 - 1, 0) / s, cy1 = std::min(y1 / s, base.h - 1);
+  reduceBaseCells(data, scale, offset, cx0, cx1 + 1, cy0, cy1 + 1);
+
+  for (int level = 1; level < level_count(); ++level) {
+    cx0 /= 2, cy0 /= 2, cx1 /= 2, cy1 /= 2;
+    reduceUpperCells(level, cx0, cy0, cx1, cy1);
+  }
+}
+
+}  // namespace engine
+
+#endif
@@ -0,0 +1,100 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <algorithm>
+#include <stdexcept>
+#include "./min_max_pyramid.h"
+
+namespace engine {
+
+MinMaxPyramid::MinMaxPyramid(int w, int h, int base_cell_size, Level base)
+    : w_(w), h_(h), base_cell_size_(base_cell_size) {
+  const int s = base_cell_size;
+  if (w <= 0 || h <= 0) {
+    throw std::invalid_argument("MinMaxPyramid: empty heightmap");
+  }
+  if (s <= 0 || (s & (s-1)) != 0) {
+    throw std::invalid_argument(
+      "MinMaxPyramid: base_cell_size must be a power of two");
+  }
+  if (base.w != std::max((w - 1 + s - 1) / s, 1) ||
+      base.h != std::max((h - 1 + s - 1) / s, 1) ||
+      base.mins.size() != size_t(base.w) * base.h ||
+      base.maxes.size() != size_t(base.w) * base.h) {
+    throw std::invalid_argument(
+      "MinMaxPyramid: the base level doesn't match the heightmap's size");
+  }
+  levels_.push_back(std::move(base));
+
+  buildUpperLevels();
+}
+
+void MinMaxPyramid::buildUpperLevels() {
+  while (levels_.back().w > 1 || levels_.back().h > 1) {
+    const Level& prev = levels_.back();
+    Level next;
+    next.w = (prev.w + 1) / 2;
+    next.h = (prev.h + 1) / 2;
+    next.mins.resize(next.w * next.h);
+    next.maxes.resize(next.w * next.h);
+
+    levels_.push_back(std::move(next));
+    reduceUpperCells(level_count() - 1, 0, 0, levels_.back().w - 1,
+                     levels_.back().h - 1);
+  }
+}
+
+void MinMaxPyramid::reduceUpperCells(int level, int cx0, int cy0,
+                                     int cx1, int cy1) {
+  const Level& prev = levels_[level - 1];
+  Level& next = levels_[level];
+  for (int cy = cy0; cy <= cy1; ++cy) {
+    int py0 = 2*cy, py1 = std::min(2*cy + 1, prev.h - 1);
+    for (int cx = cx0; cx <= cx1; ++cx) {
+      int px0 = 2*cx, px1 = std::min(2*cx + 1, prev.w - 1);
+      float curr_min = std::min(
+        std::min(prev.mins[py0*prev.w + px0], prev.mins[py0*prev.w + px1]),
+        std::min(prev.mins[py1*prev.w + px0], prev.mins[py1*prev.w + px1]));
+      float curr_max = std::max(
+        std::max(prev.maxes[py0*prev.w + px0], prev.maxes[py0*prev.w + px1]),
+        std::max(prev.maxes[py1*prev.w + px0], prev.maxes[py1*prev.w + px1]));
+      next.mins[cy*next.w + cx] = curr_min;
+      next.maxes[cy*next.w + cx] = curr_max;
+    }
+  }
+}
+
+glm::vec2 MinMaxPyramid::minMaxOfRect(int x0, int y0, int x1, int y1) const {
+  x0 = std::max(x0, 0);
+  y0 = std::max(y0, 0);
+  x1 = std::min(x1, w_ - 1);
+  y1 = std::min(y1, h_ - 1);
+  if (empty() || x1 < x0 || y1 < y0) {
+    return glm::vec2(0, 0);
+  }
+
+  // Use the coarsest level, whose cells are at most half as big as the
+  // rectangle, so that at most 5x5 cells have to be visited.
+  int extent = std::max(x1 - x0, y1 - y0);
+  int level = 0;
+  while (level + 1 < level_count() && cell_size(level + 1) <= extent / 2) {
+    level++;
+  }
+
+  const Level& l = levels_[level];
+  int s = cell_size(level);
+  int cx0 = std::min(x0 / s, l.w - 1), cy0 = std::min(y0 / s, l.h - 1);
+  int cx1 = std::max(cx0, std::min((x1 + s - 1) / s - 1, l.w - 1));
+  int cy1 = std::max(cy0, std::min((y1 + s - 1) / s - 1, l.h - 1));
+
+  float curr_min = l.mins[cy0*l.w + cx0], curr_max = l.maxes[cy0*l.w + cx0];
+  for (int cy = cy0; cy <= cy1; ++cy) {
+    for (int cx = cx0; cx <= cx1; ++cx) {
+      curr_min = std::min(curr_min, l.mins[cy*l.w + cx]);
+      curr_max = std::max(curr_max, l.maxes[cy*l.w + cx]);
+    }
+  }
+
+  return glm::vec2(curr_min, curr_max);
+}
+
+}  // namespace engine
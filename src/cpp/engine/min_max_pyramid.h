@@ -0,0 +1,98 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_MIN_MAX_PYRAMID_H_
+#define ENGINE_MIN_MAX_PYRAMID_H_
+
+#include <vector>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+namespace engine {
+
+// A mip chain of the minimum and maximum heights of a heightmap, built once
+// from the raw texel data. A cell of the level k covers the inclusive texel
+// range [c*s, c*s + s] where s = base_cell_size * 2^k, so neighbouring cells
+// share their border texels, and a rectangle, whose corners are aligned to
+// the cells, can be covered exactly. Used to answer the min/max queries of
+// the quadtree, and can also be used for ray casts and physics queries.
+class MinMaxPyramid {
+ public:
+  struct Level {
+    int w, h;  // the number of cells
+    std::vector<float> mins, maxes;  // row-major, w*h
+  };
+
+  MinMaxPyramid() = default;
+
+  // Builds the pyramid from w*h row-major texels. The heights are the texels
+  // multiplied by scale, plus offset. The base_cell_size must be a power of
+  // two.
+  template<typename T>
+  MinMaxPyramid(const T* data, int w, int h, float scale = 1.0f,
+                float offset = 0.0f, int base_cell_size = 8);
+
+  // Builds the upper levels above an already reduced base level (for
+  // heightmaps that don't fit into the memory, see TiledHeightMap). The base
+  // must follow the same cell conventions as if it was built from texels.
+  MinMaxPyramid(int w, int h, int base_cell_size, Level base);
+
+  int w() const { return w_; }
+  int h() const { return h_; }
+  bool empty() const { return levels_.empty(); }
+  int level_count() const { return levels_.size(); }
+  const Level& level(int level) const { return levels_[level]; }
+
+  // The number of texels a cell of a given level spans (minus one)
+  int cell_size(int level) const { return base_cell_size_ << level; }
+
+  // Returns vec2{min, max} of a cell
+  glm::vec2 cell(int level, int cx, int cy) const {
+    const Level& l = levels_[level];
+    return glm::vec2(l.mins[cy*l.w + cx], l.maxes[cy*l.w + cx]);
+  }
+
+  // Returns vec2{min, max} of the inclusive texel rectangle between (x0, y0)
+  // and (x1, y1) in O(1), using the cells of the biggest size that is at most
+  // half of the rectangle's extent. The result is exact if the corners are
+  // multiples of that cell size (like the areas of the quadtree nodes),
+  // otherwise it is a slightly bigger, conservative range.
+  // It returns {0, 0} if the area doesn't contain a single texel.
+  glm::vec2 minMaxOfRect(int x0, int y0, int x1, int y1) const;
+
+  // Same as minMaxOfRect, but with the conventions of
+  // HeightMapInterface::getMinMaxOfArea
+  glm::vec2 minMaxOfArea(int x, int y, int w, int h) const {
+    return minMaxOfRect(x - w/2, y - h/2, x + w/2, y + h/2);
+  }
+
+  // Recomputes the cells, that contain a texel of the inclusive rectangle
+  // between (x0, y0) and (x1, y1), after those texels changed. Only the
+  // changed cells are reduced again from the texels, and only their parents
+  // on the upper levels, so it costs O(area + level_count). The texels, the
+  // scale and the offset have to be the same as at the construction.
+  template<typename T>
+  void update(const T* data, float scale, float offset,
+              int x0, int y0, int x1, int y1);
+
+ private:
+  int w_ = 0, h_ = 0, base_cell_size_ = 1;
+  std::vector<Level> levels_;
+
+  // Reduces the base cells in [cx_begin, cx_end) x [cy_begin, cy_end) from
+  // the texels
+  template<typename T>
+  void reduceBaseCells(const T* data, float scale, float offset,
+                       int cx_begin, int cx_end, int cy_begin, int cy_end);
+
+  // Reduces the cells of a level above the base in the inclusive cell
+  // rectangle between (cx0, cy0) and (cx1, cy1) from the level below it
+  void reduceUpperCells(int level, int cx0, int cy0, int cx1, int cy1);
+
+  void buildUpperLevels();
+};
+
+}  // namespace engine
+
+#include "./min_max_pyramid-inl.h"
+
+#endif
@@ -0,0 +1,139 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "./normal_map.h"
+#include "./task_scheduler.h"
+
+namespace engine {
+
+NormalMap::NormalMap(const HeightMapInterface& height_map)
+    : height_map_(height_map), w_(height_map.w()), h_(height_map.h()) {
+  if (w_ <= 0 || h_ <= 0) {
+    throw std::invalid_argument("engine::NormalMap: empty heightmap");
+  }
+  texels_.resize(2 * size_t(w_) * h_);
+  compute(0, 0, w_-1, h_-1);
+}
+
+// The xz coordinates are projected to the |x| + |y| + |z| = 1 octahedron,
+// whose upper half is a diamond, that is rotated by 45 degrees to fill the
+// whole square.
+glm::vec2 NormalMap::Encode(const glm::vec3& normal) {
+  glm::vec3 n = normal / (std::abs(normal.x) + std::abs(normal.y) +
+                          std::abs(normal.z));
+  return glm::vec2(n.x + n.z, n.x - n.z) * 0.5f + 0.5f;
+}
+
+glm::vec3 NormalMap::Decode(const glm::vec2& encoded) {
+  glm::vec2 e = encoded * 2.0f - 1.0f;
+  float x = (e.x + e.y) * 0.5f, z = (e.x - e.y) * 0.5f;
+  return glm::normalize(glm::vec3(x, 1.0f - std::abs(x) - std::abs(z), z));
+}
+
+glm::vec3 NormalMap::normalAt(int s, int t) const {
+  s = std::min(std::max(s, 0), w_-1);
+  t = std::min(std::max(t, 0), h_-1);
+  size_t index = 2 * (size_t(t)*w_ + s);
+  return Decode(glm::vec2(texels_[index], texels_[index+1]) / 65535.0f);
+}
+
+// Interpolates the encoded values, like the texture filtering does
+glm::vec3 NormalMap::normalAt(float s, float t) const {
+  s = std::min(std::max(s, 0.0f), float(w_-1));
+  t = std::min(std::max(t, 0.0f), float(h_-1));
+  int s0 = int(s), t0 = int(t);
+  int s1 = std::min(s0 + 1, w_-1), t1 = std::min(t0 + 1, h_-1);
+
+  auto encoded = [this](int s, int t) {
+    size_t index = 2 * (size_t(t)*w_ + s);
+    return glm::vec2(texels_[index], texels_[index+1]) / 65535.0f;
+  };
+  glm::vec2 e0 = glm::mix(encoded(s0, t0), encoded(s1, t0), s - s0);
+  glm::vec2 e1 = glm::mix(encoded(s0, t1), encoded(s1, t1), s - s0);
+  return Decode(glm::mix(e0, e1, t - t0));
+}
+
+glm::ivec4 NormalMap::update(int x0, int y0, int x1, int y1) {
+  x0 = std::max(x0 - 1, 0);
+  y0 = std::max(y0 - 1, 0);
+  x1 = std::min(x1 + 1, w_-1);
+  y1 = std::min(y1 + 1, h_-1);
+  if (x1 < x0 || y1 < y0) {
+    return glm::ivec4(0, 0, -1, -1);
+  }
+  compute(x0, y0, x1, y1);
+  return glm::ivec4(x0, y0, x1, y1);
+}
+
+void NormalMap::compute(int x0, int y0, int x1, int y1) {
+  // The bands are independent, so they are computed in parallel. Every band
+  // fetches its heights (with a one texel border) with a single
+  // sampleHeights call, so the heightmap isn't sampled through a virtual
+  // call for every texel.
+  const int kBandHeight = 64;
+  int band_count = (y1 - y0) / kBandHeight + 1;
+  int sx0 = std::max(x0 - 1, 0), sx1 = std::min(x1 + 1, w_-1);
+  int sample_w = sx1 - sx0 + 1;
+
+  TaskScheduler::Default().parallelFor(0, band_count,
+      [&](size_t band_begin, size_t band_end) {
+    std::vector<glm::vec2> points;
+    std::vector<float> heights;
+    for (size_t band = band_begin; band < band_end; ++band) {
+      int by0 = y0 + int(band) * kBandHeight;
+      int by1 = std::min(by0 + kBandHeight - 1, y1);
+      int sy0 = std::max(by0 - 1, 0), sy1 = std::min(by1 + 1, h_-1);
+
+      points.clear();
+      for (int y = sy0; y <= sy1; ++y) {
+        for (int x = sx0; x <= sx1; ++x) {
+          points.push_back(glm::vec2(x, y));
+        }
+      }
+      heights.resize(points.size());
+      height_map_.sampleHeights(points.data(), heights.data(), points.size());
+
+      // The neighbours are clamped to the sampled area, which is the same as
+      // clamping them to the heightmap
+      auto height = [&](int x, int y) {
+        x = std::min(std::max(x, sx0), sx1);
+        y = std::min(std::max(y, sy0), sy1);
+        return heights[size_t(y - sy0)*sample_w + (x - sx0)];
+      };
+
+      for (int y = by0; y <= by1; ++y) {
+        GLushort* row = texels_.data() + 2 * size_t(y)*w_;
+        for (int x = x0; x <= x1; ++x) {
+          float dx = height(x+1, y) - height(x-1, y);
+          float dz = height(x, y+1) - height(x, y-1);
+          glm::vec2 e = Encode(glm::normalize(glm::vec3(-dx, 1.0f, -dz)));
+          row[2*x] = GLushort(e.x * 65535.0f + 0.5f);
+          row[2*x + 1] = GLushort(e.y * 65535.0f + 0.5f);
+        }
+      }
+    }
+  });
+}
+
+void NormalMap::upload(gl::Texture2D& tex) const {
+  tex.upload(gl::kRg16, w_, h_, gl::kRg, gl::kUnsignedShort, texels_.data());
+}
+
+void NormalMap::upload(gl::Texture2D& tex, const glm::ivec4& rect) const {
+  if (rect.z < rect.x || rect.w < rect.y) {
+    return;
+  }
+
+  // The rows of the rectangle are read from the whole map
+  GLint row_length;
+  glGetIntegerv(GL_UNPACK_ROW_LENGTH, &row_length);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, w_);
+  tex.subUpload(rect.x, rect.y, rect.z - rect.x + 1, rect.w - rect.y + 1,
+                gl::kRg, gl::kUnsignedShort,
+                texels_.data() + 2 * (size_t(rect.y)*w_ + rect.x));
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, row_length);
+}
+
+}  // namespace engine
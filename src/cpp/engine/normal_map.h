@@ -0,0 +1,69 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_NORMAL_MAP_H_
+#define ENGINE_NORMAL_MAP_H_
+
+#include <vector>
+#include "./oglwrap_config.h"
+#include "../oglwrap/textures/texture_2D.h"
+#include "./height_map_interface.h"
+
+namespace engine {
+
+// The normals of a heightmap, computed on the cpu, once for every texel, so
+// the terrain shader can fetch them instead of computing them from four
+// extra height fetches per vertex. The cpu copy can also be used by the
+// gameplay code, like for slope queries.
+//
+// The normals are the same central differences, that the shader used to
+// compute: normalize(-(h(s+1, t) - h(s-1, t)), 1, -(h(s, t+1) - h(s, t-1))),
+// clamped at the edges of the heightmap. They always point upwards, so they
+// are stored with hemi-octahedral encoding, in two 16 bit unsigned
+// normalized channels (GL_RG16), that can be filtered linearly.
+class NormalMap {
+ public:
+  // Computes the normals in parallel, in bands of rows. The heightmap must
+  // outlive the normal map, update() reads it again.
+  explicit NormalMap(const HeightMapInterface& height_map);
+
+  int w() const { return w_; }
+  int h() const { return h_; }
+
+  // Two values per texel, in row-major order
+  const std::vector<GLushort>& data() const { return texels_; }
+
+  // Maps an upwards pointing unit vector to [0, 1]^2, and back
+  static glm::vec2 Encode(const glm::vec3& normal);
+  static glm::vec3 Decode(const glm::vec2& encoded);
+
+  // Texture space fetch (clamped to the edges)
+  glm::vec3 normalAt(int s, int t) const;
+
+  // Texture space fetch with bilinear interpolation
+  glm::vec3 normalAt(float s, float t) const;
+
+  // Recomputes the normals after the heights of the inclusive texel
+  // rectangle between (x0, y0) and (x1, y1) changed. That affects the
+  // normals one texel further too, it returns the inclusive rectangle of
+  // the recomputed texels as {x0, y0, x1, y1}, which is empty (x1 < x0) if
+  // the rectangle doesn't intersect the heightmap.
+  glm::ivec4 update(int x0, int y0, int x1, int y1);
+
+  // Uploads the whole normal map to a bound texture
+  void upload(gl::Texture2D& tex) const;
+
+  // Uploads an inclusive rectangle of the normal map (like the one returned
+  // by update()) to a bound texture, that already has the whole map.
+  void upload(gl::Texture2D& tex, const glm::ivec4& rect) const;
+
+ private:
+  const HeightMapInterface& height_map_;
+  int w_, h_;
+  std::vector<GLushort> texels_;
+
+  void compute(int x0, int y0, int x1, int y1);
+};
+
+}  // namespace engine
+
+#endif
@@ -16,7 +16,8 @@ Scene::Scene()
         physics_finished_.set();
       }
     }}
-    , camera_(nullptr), shadow_(nullptr), window_(GameEngine::window()) {
+    , camera_(nullptr), shadow_(nullptr), window_(GameEngine::window())
+    , parallel_update_(false) {
   set_scene(this);
 }
 
@@ -65,6 +65,13 @@ class Scene : public GameObject {
   GLFWwindow* window() const { return window_; }
   void set_window(GLFWwindow* window) { window_ = window; }
 
+  // If enabled, the subtrees whose root returns true from threadSafeUpdate()
+  // are updated concurrently with their siblings, before the rest of them.
+  // Off by default, in which case everything is updated on the main thread,
+  // in a deterministic, depth-first order, which is easier to debug.
+  bool parallel_update() const { return parallel_update_; }
+  void set_parallel_update(bool value) { parallel_update_ = value; }
+
   virtual void keyAction(int key, int scancode, int action, int mods) override {
     if (action == GLFW_PRESS) {
       switch (key) {
@@ -107,6 +114,7 @@ class Scene : public GameObject {
   Shadow* shadow_;
   Timer game_time_, environment_time_, camera_time_;
   GLFWwindow* window_;
+  bool parallel_update_;
 
   virtual void updateAll() override {
     game_time_.tick();
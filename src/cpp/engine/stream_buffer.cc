@@ -0,0 +1,124 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include "./stream_buffer.h"
+
+namespace engine {
+
+StreamBuffer::StreamBuffer(GLenum target, size_t capacity)
+    : target_(target), buffer_(0), capacity_(0), mapping_(nullptr)
+    , head_(0), fenced_head_(0) {
+  if (capacity == 0) {
+    throw std::invalid_argument("engine::StreamBuffer: zero capacity");
+  }
+  allocate(capacity);
+}
+
+StreamBuffer::~StreamBuffer() {
+  release();
+}
+
+void StreamBuffer::allocate(size_t capacity) {
+  release();
+  capacity_ = capacity;
+  head_ = fenced_head_ = 0;
+
+  glGenBuffers(1, &buffer_);
+  glBindBuffer(target_, buffer_);
+#ifdef glBufferStorage
+  if (glBufferStorage) {
+    GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(target_, capacity_, nullptr, flags);
+    mapping_ = static_cast<char*>(
+        glMapBufferRange(target_, 0, capacity_, flags));
+  }
+#endif
+  if (!mapping_) {
+    glBufferData(target_, capacity_, nullptr, GL_STREAM_DRAW);
+  }
+}
+
+void StreamBuffer::release() {
+#ifdef glFenceSync
+  for (const Fence& fence : fences_) {
+    glDeleteSync(fence.sync);
+  }
+#endif
+  fences_.clear();
+
+  if (buffer_) {
+    if (mapping_) {
+      glBindBuffer(target_, buffer_);
+      glUnmapBuffer(target_);
+      mapping_ = nullptr;
+    }
+    glDeleteBuffers(1, &buffer_);
+    buffer_ = 0;
+  }
+}
+
+void StreamBuffer::waitFor(uint64_t position) {
+  while (!fences_.empty() && fences_.front().begin < position) {
+#ifdef glFenceSync
+    GLsync sync = fences_.front().sync;
+    GLenum result;
+    do {
+      result = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    } while (result == GL_TIMEOUT_EXPIRED);
+    glDeleteSync(sync);
+#endif
+    fences_.pop_front();
+  }
+}
+
+size_t StreamBuffer::write(const void* data, size_t size, size_t alignment) {
+  alignment = std::max<size_t>(alignment, 1);
+  size_t physical = head_ % capacity_;
+  size_t padding = (alignment - physical % alignment) % alignment;
+
+  uint64_t begin = head_ + padding;
+  if (physical + padding + size > capacity_) {
+    begin = head_ - physical + capacity_;  // wrap around
+  }
+
+  // The data of the commands, that haven't been fenced yet, can't be
+  // waited for, so the ring has to grow
+  if (begin + size > fenced_head_ + capacity_) {
+    allocate(std::max(2*capacity_, 2*size));
+    begin = 0;
+  }
+
+  uint64_t end = begin + size;
+  if (end > capacity_) {
+    waitFor(end - capacity_);
+  }
+
+  size_t offset = begin % capacity_;
+  if (mapping_) {
+    std::memcpy(mapping_ + offset, data, size);
+  } else {
+    glBindBuffer(target_, buffer_);
+    glBufferSubData(target_, offset, size, data);
+  }
+
+  head_ = end;
+  return offset;
+}
+
+void StreamBuffer::fence() {
+  if (fenced_head_ == head_) {
+    return;
+  }
+#ifdef glFenceSync
+  if (glFenceSync) {
+    GLsync sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    fences_.push_back(Fence{sync, fenced_head_});
+  }
+#endif
+  fenced_head_ = head_;
+}
+
+}  // namespace engine
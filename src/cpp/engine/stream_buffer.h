@@ -0,0 +1,77 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_STREAM_BUFFER_H_
+#define ENGINE_STREAM_BUFFER_H_
+
+#include <deque>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "./oglwrap_config.h"
+
+namespace engine {
+
+// A ring buffer for data, that is uploaded every frame (like instance
+// attributes). The writes go after each other, so they never overwrite the
+// data, that the previous draw calls read from, and the buffer isn't
+// re-specified, so uploading doesn't allocate, neither on the cpu, nor in
+// the driver.
+//
+// If ARB_buffer_storage is available, the buffer is persistently mapped and
+// the data is copied with memcpy, else glBufferSubData is used. The draw
+// calls, that read the data, have to be followed by a fence() call, so that
+// their part of the ring is only reused after the gpu has finished them. If
+// the data of one frame doesn't fit in the ring, its capacity is doubled.
+class StreamBuffer {
+ public:
+  explicit StreamBuffer(GLenum target = GL_ARRAY_BUFFER,
+                        size_t capacity = 1 << 16);
+  ~StreamBuffer();
+
+  StreamBuffer(const StreamBuffer&) = delete;
+  StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+  // The name of the buffer, it changes when the capacity grows
+  GLuint expose() const { return buffer_; }
+  size_t capacity() const { return capacity_; }
+  bool persistent() const { return mapping_ != nullptr; }
+
+  // Copies the data into the ring, and returns its offset in bytes, which is
+  // a multiple of alignment. The offset is only valid in the current buffer
+  // (see expose()), so it has to be used before the next write. It changes
+  // the binding of the target.
+  size_t write(const void* data, size_t size, size_t alignment);
+
+  template<typename T>
+  size_t write(const std::vector<T>& data) {
+    return write(data.data(), data.size() * sizeof(T), sizeof(T));
+  }
+
+  // Marks the data written so far as in use by the commands issued so far
+  void fence();
+
+ private:
+  GLenum target_;
+  GLuint buffer_;
+  size_t capacity_;
+  char *mapping_;
+
+  // The positions are counted from the creation of the buffer, without
+  // wrapping around, so the ranges can be compared easily.
+  uint64_t head_, fenced_head_;
+
+  struct Fence {
+    GLsync sync;
+    uint64_t begin;
+  };
+  std::deque<Fence> fences_;
+
+  void allocate(size_t capacity);
+  void release();
+  // Waits until the data before position isn't used by the gpu
+  void waitFor(uint64_t position);
+};
+
+}  // namespace engine
+
+#endif
@@ -0,0 +1,257 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <algorithm>
+#include "./task_scheduler.h"
+
+namespace engine {
+
+namespace {
+// The index of the worker running on this thread, and the scheduler it
+// belongs to. Threads not owned by a scheduler have -1.
+thread_local int tls_worker_index = -1;
+thread_local const TaskScheduler* tls_scheduler = nullptr;
+}
+
+bool TaskScheduler::Handle::done() const {
+  return !state_ || state_->done;
+}
+
+TaskScheduler::TaskScheduler(unsigned worker_count) {
+  if (worker_count == 0) {
+    worker_count = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  for (unsigned i = 0; i < worker_count; ++i) {
+    workers_.push_back(std::unique_ptr<Worker>(new Worker));
+  }
+  // Only start them when all the deques exist, as they steal from each other
+  for (unsigned i = 0; i < worker_count; ++i) {
+    workers_[i]->thread = std::thread{&TaskScheduler::workerLoop, this, i};
+  }
+}
+
+TaskScheduler::~TaskScheduler() {
+  should_quit_ = true;
+  notifyAll();
+  for (auto& worker : workers_) {
+    worker->thread.join();
+  }
+}
+
+TaskScheduler& TaskScheduler::Default() {
+  static TaskScheduler scheduler;
+  return scheduler;
+}
+
+TaskScheduler::Handle TaskScheduler::schedule(
+    Task task, const std::vector<Handle>& dependencies) {
+  auto state = std::make_shared<TaskState>();
+  state->task = std::move(task);
+
+  // pending_dependencies starts from one, so that the task can't be queued
+  // by a dependency that finishes while we are still registering the others
+  for (const Handle& dependency : dependencies) {
+    if (!dependency.valid()) { continue; }
+    TaskState& dep = *dependency.state_;
+    std::lock_guard<std::mutex> lock(dep.mutex);
+    if (!dep.done) {
+      state->pending_dependencies++;
+      dep.dependents.push_back(state);
+    }
+  }
+  if (--state->pending_dependencies == 0) {
+    enqueue(state);
+  }
+
+  return Handle{state};
+}
+
+void TaskScheduler::wait(const Handle& task) {
+  if (!task.valid()) { return; }
+
+  waiting_threads_++;
+  while (!task.done()) {
+    if (!tryRunOne()) {
+      std::unique_lock<std::mutex> lock(sleep_mutex_);
+      wake_up_.wait(lock, [this, &task]{
+        return task.done() || queued_tasks_ > 0;
+      });
+    }
+  }
+  waiting_threads_--;
+
+  if (task.state_->exception) {
+    std::rethrow_exception(task.state_->exception);
+  }
+}
+
+void TaskScheduler::wait(const std::vector<Handle>& tasks) {
+  std::exception_ptr exception;
+  for (const Handle& task : tasks) {
+    try {
+      wait(task);
+    } catch (...) {
+      if (!exception) {
+        exception = std::current_exception();
+      }
+    }
+  }
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+}
+
+void TaskScheduler::parallelFor(
+    size_t begin, size_t end, const std::function<void(size_t, size_t)>& body,
+    size_t min_chunk_size) {
+  if (end <= begin) { return; }
+
+  // A few chunks per worker, so that the stealing can balance the load
+  size_t count = end - begin;
+  size_t chunk_count = std::max<size_t>(
+    std::min<size_t>(4 * (worker_count() + 1),
+                     count / std::max<size_t>(min_chunk_size, 1)), 1);
+
+  std::vector<Handle> chunks;
+  chunks.reserve(chunk_count - 1);
+  for (size_t i = 1; i < chunk_count; ++i) {
+    size_t chunk_begin = begin + count*i/chunk_count;
+    size_t chunk_end = begin + count*(i+1)/chunk_count;
+    chunks.push_back(schedule([&body, chunk_begin, chunk_end]{
+      body(chunk_begin, chunk_end);
+    }));
+  }
+
+  // The calling thread takes the first chunk
+  std::exception_ptr exception;
+  try {
+    body(begin, begin + count/chunk_count);
+  } catch (...) {
+    exception = std::current_exception();
+  }
+
+  // Wait for everything before rethrowing, as the chunks reference body
+  try {
+    wait(chunks);
+  } catch (...) {
+    if (!exception) {
+      exception = std::current_exception();
+    }
+  }
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+}
+
+void TaskScheduler::workerLoop(unsigned index) {
+  tls_worker_index = index;
+  tls_scheduler = this;
+
+  while (!should_quit_) {
+    if (!tryRunOne()) {
+      std::unique_lock<std::mutex> lock(sleep_mutex_);
+      wake_up_.wait(lock, [this]{
+        return should_quit_ || queued_tasks_ > 0;
+      });
+    }
+  }
+}
+
+void TaskScheduler::enqueue(const std::shared_ptr<TaskState>& task) {
+  // Workers push to their own deque, other threads distribute the tasks
+  unsigned index;
+  if (tls_scheduler == this) {
+    index = tls_worker_index;
+  } else {
+    index = next_worker_++ % workers_.size();
+  }
+
+  {
+    Worker& worker = *workers_[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.tasks.push_back(task);
+  }
+  queued_tasks_++;
+
+  // Taking the lock makes sure that no one is between checking the wake up
+  // condition and going to sleep, so the notification can't get lost.
+  { std::lock_guard<std::mutex> lock(sleep_mutex_); }
+  wake_up_.notify_one();
+}
+
+std::shared_ptr<TaskScheduler::TaskState> TaskScheduler::pop(int own_index) {
+  if (queued_tasks_ == 0) {
+    return nullptr;
+  }
+
+  // Look at our own deque first (LIFO)
+  if (own_index >= 0) {
+    Worker& worker = *workers_[own_index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (!worker.tasks.empty()) {
+      auto task = std::move(worker.tasks.back());
+      worker.tasks.pop_back();
+      queued_tasks_--;
+      return task;
+    }
+  }
+
+  // Then try to steal the oldest task from someone else (FIFO)
+  unsigned worker_count = workers_.size();
+  unsigned start = own_index >= 0 ? own_index + 1 : 0;
+  for (unsigned i = 0; i < worker_count; ++i) {
+    Worker& victim = *workers_[(start + i) % worker_count];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      auto task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      queued_tasks_--;
+      return task;
+    }
+  }
+
+  return nullptr;
+}
+
+bool TaskScheduler::tryRunOne() {
+  auto task = pop(tls_scheduler == this ? tls_worker_index : -1);
+  if (task) {
+    run(task);
+    return true;
+  } else {
+    return false;
+  }
+}
+
+void TaskScheduler::run(const std::shared_ptr<TaskState>& task) {
+  try {
+    task->task();
+  } catch (...) {
+    task->exception = std::current_exception();
+  }
+  task->task = nullptr;  // release the captures early
+
+  std::vector<std::shared_ptr<TaskState>> dependents;
+  {
+    std::lock_guard<std::mutex> lock(task->mutex);
+    task->done = true;
+    dependents.swap(task->dependents);
+  }
+
+  for (const auto& dependent : dependents) {
+    if (--dependent->pending_dependencies == 0) {
+      enqueue(dependent);
+    }
+  }
+
+  // Wake up the threads waiting for this task
+  if (waiting_threads_ > 0) {
+    notifyAll();
+  }
+}
+
+void TaskScheduler::notifyAll() {
+  { std::lock_guard<std::mutex> lock(sleep_mutex_); }
+  wake_up_.notify_all();
+}
+
+}  // namespace engine
@@ -0,0 +1,108 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_TASK_SCHEDULER_H_
+#define ENGINE_TASK_SCHEDULER_H_
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+namespace engine {
+
+// An engine-wide work-stealing job system. Every worker thread has its own
+// deque: it pushes and pops its own tasks at the back (so the recently
+// spawned, cache-warm tasks run first), and steals from the front of the
+// others' deques when it runs out of work. Tasks can depend on other tasks,
+// and a task is only queued when all of its dependencies have finished.
+class TaskScheduler {
+  struct TaskState;
+
+ public:
+  using Task = std::function<void()>;
+
+  // A reference to a scheduled task. Copyable, and can be waited on.
+  class Handle {
+    std::shared_ptr<TaskState> state_;
+    friend class TaskScheduler;
+    explicit Handle(const std::shared_ptr<TaskState>& state) : state_(state) {}
+
+   public:
+    Handle() = default;
+    bool valid() const { return state_ != nullptr; }
+    bool done() const;
+  };
+
+  // Starts worker_count threads. Zero means one per hardware thread.
+  explicit TaskScheduler(unsigned worker_count = 0);
+  ~TaskScheduler();
+
+  // The scheduler shared by the whole engine
+  static TaskScheduler& Default();
+
+  unsigned worker_count() const { return workers_.size(); }
+
+  // Schedules a task, that will run after all of the dependencies finished
+  Handle schedule(Task task, const std::vector<Handle>& dependencies = {});
+
+  // Blocks until the task finishes, but executes other tasks in the meantime,
+  // so it is safe to call from inside a task. If the task threw an exception,
+  // it is rethrown here.
+  void wait(const Handle& task);
+
+  // Waits for all of the tasks, even if some of them threw. The first
+  // exception (in the order of the tasks) is rethrown.
+  void wait(const std::vector<Handle>& tasks);
+
+  // Calls body(chunk_begin, chunk_end) for disjoint subranges of
+  // [begin, end) in parallel, and blocks until all of them have finished.
+  // The chunks are at least min_chunk_size long.
+  void parallelFor(size_t begin, size_t end,
+                   const std::function<void(size_t, size_t)>& body,
+                   size_t min_chunk_size = 1);
+
+ private:
+  struct TaskState {
+    Task task;
+    std::atomic<int> pending_dependencies{1};
+    std::atomic<bool> done{false};
+    std::exception_ptr exception;
+    std::mutex mutex;  // guards dependents
+    std::vector<std::shared_ptr<TaskState>> dependents;
+  };
+
+  struct Worker {
+    std::mutex mutex;
+    std::deque<std::shared_ptr<TaskState>> tasks;
+    std::thread thread;
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<int> queued_tasks_{0};
+  std::atomic<unsigned> next_worker_{0};
+  std::atomic<bool> should_quit_{false};
+  std::atomic<int> waiting_threads_{0};  // the number of threads in wait()
+
+  // Sleeping workers and waiting threads are woken up through this
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_up_;
+
+  void workerLoop(unsigned index);
+  void enqueue(const std::shared_ptr<TaskState>& task);
+  std::shared_ptr<TaskState> pop(int own_index);
+  bool tryRunOne();
+  void run(const std::shared_ptr<TaskState>& task);
+  void notifyAll();
+
+  TaskScheduler(const TaskScheduler&) = delete;
+  TaskScheduler& operator=(const TaskScheduler&) = delete;
+};
+
+}  // namespace engine
+
+#endif
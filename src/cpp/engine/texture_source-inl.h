@@ -3,6 +3,7 @@
 #ifndef ENGINE_TEXTURE_SOURCE_INL_H_
 #define ENGINE_TEXTURE_SOURCE_INL_H_
 
+#include <algorithm>
 #include "texture_source.h"
 #include "../oglwrap/smart_enums.h"
 #include "../oglwrap/context/pixel_ops.h"
@@ -10,8 +11,8 @@
 namespace engine {
 
 template<typename T, char NUM_COMPONENTS>
-TextureSource<T, NUM_COMPONENTS>::TextureSource(const std::string& file_name,
-                                                std::string format_string) {
+void TextureSource<T, NUM_COMPONENTS>::setFormatString(
+    std::string format_string) {
   // Preprocess format_string: 'S', 'C' and 'I' have special meaning
   size_t s_pos = format_string.find('S');
   if(s_pos != std::string::npos) {
@@ -42,6 +43,12 @@ TextureSource<T, NUM_COMPONENTS>::TextureSource(const std::string& file_name,
 
   assert(NUM_COMPONENTS <= 4);
   assert(format_string.length() == NUM_COMPONENTS);
+}
+
+template<typename T, char NUM_COMPONENTS>
+TextureSource<T, NUM_COMPONENTS>::TextureSource(const std::string& file_name,
+                                                std::string format_string) {
+  setFormatString(format_string);
 
   Magick::Image image(file_name);
   w_ = image.columns();
@@ -72,6 +79,14 @@ TextureSource<T, NUM_COMPONENTS>::TextureSource(const std::string& file_name,
   image.write(0, 0, w_, h_, format_string_, type, data_.data());
 }
 
+template<typename T, char NUM_COMPONENTS>
+TextureSource<T, NUM_COMPONENTS>::TextureSource(int w, int h, const T* texels,
+                                                std::string format_string)
+    : data_(w * h), w_(w), h_(h) {
+  setFormatString(format_string);
+  std::copy(texels, texels + w*h*NUM_COMPONENTS, data_.front().data());
+}
+
 template<typename T, char NUM_COMPONENTS>
 gl::PixelDataFormat TextureSource<T, NUM_COMPONENTS>::format() const {
   if (integer_) {
@@ -241,6 +256,34 @@ void TextureSource<T, NUM_COMPONENTS>::upload(gl::Texture2D& tex,
   }
 }
 
+template<typename T, char NUM_COMPONENTS>
+void TextureSource<T, NUM_COMPONENTS>::subUpload(gl::Texture2D& tex,
+                                                 int x, int y,
+                                                 int w, int h) const {
+  int x1 = x + w, y1 = y + h;
+  if (compressed_) {
+    x &= ~3, y &= ~3;
+    x1 = (x1 + 3) & ~3, y1 = (y1 + 3) & ~3;
+  }
+  x = std::max(x, 0), y = std::max(y, 0);
+  x1 = std::min(x1, w_), y1 = std::min(y1, h_);
+  if (x1 <= x || y1 <= y) {
+    return;
+  }
+
+  // The rows of the rectangle are read from the whole image
+  GLint unpack_aligment, row_length;
+  glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpack_aligment);
+  glGetIntegerv(GL_UNPACK_ROW_LENGTH, &row_length);
+  gl::PixelStore(gl::kUnpackAlignment, 1);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, w_);
+
+  tex.subUpload(x, y, x1 - x, y1 - y, format(), type(), &data_[y*w_ + x]);
+
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, row_length);
+  gl::PixelStore(gl::kUnpackAlignment, unpack_aligment);
+}
+
 }  // namespace engine
 
 #endif
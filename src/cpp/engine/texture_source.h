@@ -20,6 +20,9 @@ class TextureSource {
   std::vector<std::array<T, NUM_COMPONENTS>> data_;
   int w_, h_;
 
+  // Sets the flags and the format from a format string
+  void setFormatString(std::string format_string);
+
  public:
   // Loads in a texture from a file
   // The format string can contain any of these flags:
@@ -29,6 +32,11 @@ class TextureSource {
   TextureSource(const std::string& file_name,
                 std::string format_string = "CSRGBA");
 
+  // Copies w*h texels from the memory, row by row, like the ones of a
+  // generated image. The format string is the same as for the files.
+  TextureSource(int w, int h, const T* texels,
+                std::string format_string = "CSRGBA");
+
   virtual ~TextureSource() {}
 
   // getters
@@ -55,18 +63,18 @@ class TextureSource {
 
   // Indexes the array, but doesn't care about over or under-indexing
   std::array<T, NUM_COMPONENTS>& operator()(int x, int y) {
-    return data_[y*h_ + x];
+    return data_[y*w_ + x];
   }
   const std::array<T, NUM_COMPONENTS>& operator()(int x, int y) const {
-    return data_[y*h_ + x];
+    return data_[y*w_ + x];
   }
 
   // Indexes the array, throws at over or under-indexing
   std::array<T, NUM_COMPONENTS>& at(int x, int y) {
-    return data_.at(y*h_ + x);
+    return data_.at(y*w_ + x);
   }
   const std::array<T, NUM_COMPONENTS>& at(int x, int y) const {
-    return data_.at(y*h_ + x);
+    return data_.at(y*w_ + x);
   }
 
   // Returns if the coordinates are valid
@@ -78,6 +86,11 @@ class TextureSource {
   virtual void upload(gl::Texture2D& tex) const;
   virtual void upload(gl::Texture2D& tex,
                       gl::PixelDataInternalFormat internal_format) const;
+
+  // Uploads a rectangle of the image to a texture, that already has the
+  // whole image. If the texture is compressed, the rectangle is extended to
+  // the 4x4 blocks of the compression.
+  virtual void subUpload(gl::Texture2D& tex, int x, int y, int w, int h) const;
 };
 
 }  // namespace engine
@@ -0,0 +1,262 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include "./tiled_height_map.h"
+#include "./task_scheduler.h"
+
+namespace engine {
+
+static const char kMagic[4] = {'L', 'T', 'H', 'M'};
+static const uint32_t kVersion = 1;
+
+// The header is padded, so that the tiles start at an aligned offset
+static const size_t kHeaderSize = 64;
+
+// The cell size of the stored min/max pyramid level. It is the half of the
+// smallest quadtree node that is worth using, so those nodes are exact.
+static const int kMinMaxCellSize = 64;
+
+// The number of tiles, that are needed to cover a side of texel_count texels
+static int TileCount(int texel_count, int tile_size, int level) {
+  int tile_extent = tile_size << level;
+  return std::max((texel_count - 1 + tile_extent - 1) / tile_extent, 1);
+}
+
+static int LevelCount(int w, int h, int tile_size) {
+  int level = 0;
+  while (TileCount(w, tile_size, level) > 1 ||
+         TileCount(h, tile_size, level) > 1) {
+    level++;
+  }
+  return level + 1;
+}
+
+template<typename T>
+static void WriteValue(std::ostream& os, const T& value) {
+  os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+static void WriteArray(std::ostream& os, const std::vector<T>& values) {
+  os.write(reinterpret_cast<const char*>(values.data()),
+           values.size() * sizeof(T));
+}
+
+template<typename T>
+static T Read(const unsigned char* data, size_t offset) {
+  T value;
+  std::memcpy(&value, data + offset, sizeof(T));
+  return value;
+}
+
+void TiledHeightMap::Write(const std::string& filename,
+                           const HeightMapInterface& source, int tile_size) {
+  if (tile_size < kMinMaxCellSize || (tile_size & (tile_size-1)) != 0) {
+    throw std::invalid_argument("TiledHeightMap::Write: the tile size must be "
+                                "a power of two, and at least 64");
+  }
+  const int w = source.w(), h = source.h();
+  if (w < 2 || h < 2) {
+    throw std::invalid_argument("TiledHeightMap::Write: the heightmap is "
+                                "smaller than 2x2");
+  }
+
+  std::ofstream os(filename, std::ios::binary);
+  if (!os) {
+    throw std::runtime_error("TiledHeightMap::Write: can't open '"
+                             + filename + "'");
+  }
+
+  const int level_count = LevelCount(w, h, tile_size);
+  const size_t texel_count = size_t(tile_size + 1) * (tile_size + 1);
+  size_t tiles_size = 0;
+  for (int level = 0; level < level_count; ++level) {
+    tiles_size += size_t(TileCount(w, tile_size, level))
+                  * TileCount(h, tile_size, level) * texel_count;
+  }
+
+  os.write(kMagic, sizeof(kMagic));
+  WriteValue(os, kVersion);
+  WriteValue(os, uint32_t(w));
+  WriteValue(os, uint32_t(h));
+  WriteValue(os, uint32_t(tile_size));
+  WriteValue(os, uint32_t(level_count));
+  WriteValue(os, uint32_t(kMinMaxCellSize));
+  WriteValue(os, uint32_t(0));
+  WriteValue(os, uint64_t(kHeaderSize + tiles_size));  // the min/max offset
+  std::vector<char> padding(kHeaderSize - static_cast<size_t>(os.tellp()));
+  WriteArray(os, padding);
+
+  const int c = kMinMaxCellSize;
+  MinMaxPyramid::Level base;
+  base.w = std::max((w - 1 + c - 1) / c, 1);
+  base.h = std::max((h - 1 + c - 1) / c, 1);
+  base.mins.resize(base.w * base.h);
+  base.maxes.resize(base.w * base.h);
+
+  std::vector<GLubyte> tile_row;
+  for (int level = 0; level < level_count; ++level) {
+    int tiles_x = TileCount(w, tile_size, level);
+    int tiles_y = TileCount(h, tile_size, level);
+    tile_row.resize(tiles_x * texel_count);
+
+    for (int ty = 0; ty < tiles_y; ++ty) {
+      TaskScheduler::Default().parallelFor(0, tiles_x,
+          [&](size_t tx_begin, size_t tx_end) {
+        for (int tx = tx_begin; tx < int(tx_end); ++tx) {
+          GLubyte* tile = &tile_row[tx * texel_count];
+          for (int j = 0; j <= tile_size; ++j) {
+            int t = std::min((ty*tile_size + j) << level, h - 1);
+            for (int i = 0; i <= tile_size; ++i) {
+              int s = std::min((tx*tile_size + i) << level, w - 1);
+              double height = std::round(source.heightAt(s, t));
+              tile[j*(tile_size+1) + i] =
+                  static_cast<GLubyte>(std::max(0.0, std::min(height, 255.0)));
+            }
+          }
+
+          if (level != 0) {
+            continue;
+          }
+
+          // Reduce the min/max cells, that start in this tile. A cell is
+          // never wider than a tile, and the tiles have the shared border
+          // texels, so every cell can be reduced from a single tile.
+          int x0 = tx*tile_size, y0 = ty*tile_size;
+          for (int cy = y0 / c; cy < std::min((y0 + tile_size) / c, base.h);
+               ++cy) {
+            int j_end = std::min(cy*c + c, h - 1) - y0;
+            for (int cx = x0 / c; cx < std::min((x0 + tile_size) / c, base.w);
+                 ++cx) {
+              int i_end = std::min(cx*c + c, w - 1) - x0;
+              GLubyte curr_min = 255, curr_max = 0;
+              for (int j = cy*c - y0; j <= j_end; ++j) {
+                for (int i = cx*c - x0; i <= i_end; ++i) {
+                  curr_min = std::min(curr_min, tile[j*(tile_size+1) + i]);
+                  curr_max = std::max(curr_max, tile[j*(tile_size+1) + i]);
+                }
+              }
+              base.mins[cy*base.w + cx] = curr_min;
+              base.maxes[cy*base.w + cx] = curr_max;
+            }
+          }
+        }
+      });
+
+      WriteArray(os, tile_row);
+    }
+  }
+
+  WriteArray(os, base.mins);
+  WriteArray(os, base.maxes);
+
+  if (!os) {
+    throw std::runtime_error("TiledHeightMap::Write: can't write '"
+                             + filename + "'");
+  }
+}
+
+TiledHeightMap::TiledHeightMap(const std::string& filename)
+    : file_(filename) {
+  const unsigned char* data = file_.data();
+  if (file_.size() < kHeaderSize ||
+      !std::equal(kMagic, kMagic + sizeof(kMagic), data)) {
+    throw std::runtime_error("TiledHeightMap: '" + filename +
+                             "' isn't a tiled heightmap");
+  }
+  if (Read<uint32_t>(data, 4) != kVersion) {
+    throw std::runtime_error("TiledHeightMap: '" + filename +
+                             "' has an unsupported version");
+  }
+
+  w_ = Read<uint32_t>(data, 8);
+  h_ = Read<uint32_t>(data, 12);
+  tile_size_ = Read<uint32_t>(data, 16);
+  level_count_ = Read<uint32_t>(data, 20);
+  int cell_size = Read<uint32_t>(data, 24);
+  uint64_t min_max_offset = Read<uint64_t>(data, 32);
+
+  if (w_ < 2 || h_ < 2 || tile_size_ < kMinMaxCellSize ||
+      (tile_size_ & (tile_size_-1)) != 0 || cell_size != kMinMaxCellSize ||
+      level_count_ != LevelCount(w_, h_, tile_size_)) {
+    throw std::runtime_error("TiledHeightMap: '" + filename +
+                             "' has an invalid header");
+  }
+
+  size_t offset = kHeaderSize;
+  for (int level = 0; level < level_count_; ++level) {
+    level_offsets_.push_back(offset);
+    offset += size_t(tiles_x(level)) * tiles_y(level) * tile_texel_count();
+  }
+
+  MinMaxPyramid::Level base;
+  base.w = std::max((w_ - 1 + cell_size - 1) / cell_size, 1);
+  base.h = std::max((h_ - 1 + cell_size - 1) / cell_size, 1);
+  size_t cell_count = size_t(base.w) * base.h;
+  if (min_max_offset != offset ||
+      file_.size() != offset + 2 * cell_count * sizeof(float)) {
+    throw std::runtime_error("TiledHeightMap: '" + filename +
+                             "' is truncated");
+  }
+
+  // The tiles have an odd size, so the floats might be unaligned
+  base.mins.resize(cell_count);
+  base.maxes.resize(cell_count);
+  std::memcpy(base.mins.data(), data + offset, cell_count * sizeof(float));
+  std::memcpy(base.maxes.data(), data + offset + cell_count * sizeof(float),
+              cell_count * sizeof(float));
+  min_max_pyramid_ = MinMaxPyramid{w_, h_, cell_size, std::move(base)};
+}
+
+int TiledHeightMap::tiles_x(int level) const {
+  return TileCount(w_, tile_size_, level);
+}
+
+int TiledHeightMap::tiles_y(int level) const {
+  return TileCount(h_, tile_size_, level);
+}
+
+size_t TiledHeightMap::tileOffset(int level, int x, int y) const {
+  return level_offsets_[level]
+         + (size_t(y) * tiles_x(level) + x) * tile_texel_count();
+}
+
+const GLubyte* TiledHeightMap::tile(int level, int x, int y) const {
+  return file_.data() + tileOffset(level, x, y);
+}
+
+void TiledHeightMap::prefetchTile(int level, int x, int y) const {
+  file_.prefetch(tileOffset(level, x, y), tile_texel_count());
+}
+
+double TiledHeightMap::heightAt(int s, int t) const {
+  s = std::max(0, std::min(s, w_ - 1));
+  t = std::max(0, std::min(t, h_ - 1));
+  int tx = std::min(s / tile_size_, tiles_x(0) - 1);
+  int ty = std::min(t / tile_size_, tiles_y(0) - 1);
+  int i = s - tx*tile_size_, j = t - ty*tile_size_;
+  return tile(0, tx, ty)[j*(tile_size_+1) + i];
+}
+
+double TiledHeightMap::heightAt(double s, double t) const {
+  double fs = std::floor(s), ft = std::floor(t);
+  int is = fs, it = ft;
+
+  double fh = glm::mix(heightAt(is, it), heightAt(is+1, it), s-fs);
+  double ch = glm::mix(heightAt(is, it+1), heightAt(is+1, it+1), s-fs);
+
+  return glm::mix(fh, ch, t-ft);
+}
+
+void TiledHeightMap::upload(gl::Texture2D& tex) const {
+  throw std::logic_error("TiledHeightMap::upload: a tiled heightmap can't be "
+                         "uploaded as a single texture, it has to be "
+                         "streamed with a cdlod::TileCache");
+}
+
+}  // namespace engine
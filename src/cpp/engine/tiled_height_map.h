@@ -0,0 +1,104 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_TILED_HEIGHT_MAP_H_
+#define ENGINE_TILED_HEIGHT_MAP_H_
+
+#include <string>
+#include <vector>
+#include "./mapped_file.h"
+#include "./min_max_pyramid.h"
+#include "./height_map_interface.h"
+
+namespace engine {
+
+// An 8 bit heightmap, that is stored on the disk in square tiles, and is
+// memory mapped instead of being loaded, so it can be much bigger than the
+// RAM, and opening it is instant. Only the min/max pyramid is kept in the
+// memory, the texels are paged in by the OS when they are accessed.
+//
+// Every tile is stored at every level of detail. A texel of the level L is
+// the height at (s << L, t << L), so a level has exactly the heights, that
+// the vertices of a CDLOD node of the same level can be placed at. A tile of
+// the level L covers tile_size << L texels of the heightmap, and has
+// (tile_size + 1)^2 samples: the last row and column are shared with the
+// neighbouring tiles, so a tile can be filtered without its neighbours. The
+// coarsest level consists of a single tile.
+//
+// The file starts with a header, then the tiles follow level by level, in
+// row-major order, then the base level of the min/max pyramid. The data is
+// in native byte order.
+class TiledHeightMap : public HeightMapInterface {
+ public:
+  // Throws std::runtime_error if the file can't be read, or isn't valid.
+  explicit TiledHeightMap(const std::string& filename);
+
+  // Converts any heightmap to the tiled format. The heights are rounded, and
+  // clamped to [0, 255]. The tile_size must be a power of two, and at least
+  // 64. The tiles are sampled in parallel, and are written a row of tiles at
+  // a time, so the source doesn't have to fit into the memory either.
+  static void Write(const std::string& filename,
+                    const HeightMapInterface& source, int tile_size = 256);
+
+  int tile_size() const { return tile_size_; }
+  int level_count() const { return level_count_; }
+
+  // The number of tiles in a row and in a column on a level
+  int tiles_x(int level) const;
+  int tiles_y(int level) const;
+
+  // The number of samples in a tile
+  size_t tile_texel_count() const {
+    return size_t(tile_size_ + 1) * (tile_size_ + 1);
+  }
+
+  // Returns the (tile_size + 1)^2 samples of a tile, in row-major order. The
+  // memory is only read from the disk when it's touched.
+  const GLubyte* tile(int level, int x, int y) const;
+
+  // Asks the OS to start reading a tile in the background.
+  void prefetchTile(int level, int x, int y) const;
+
+  virtual int w() const override { return w_; }
+  virtual int h() const override { return h_; }
+
+  virtual glm::vec2 extent() const override { return glm::vec2(w_, h_); }
+  virtual glm::vec2 center() const override { return extent() / 2.0f; }
+
+  virtual bool valid(double s, double t) const override {
+    return 0 < s && s < w_ && 0 < t && t < h_;
+  }
+
+  // Reads the finest level, which might have to be paged in from the disk
+  virtual double heightAt(int s, int t) const override;
+  virtual double heightAt(double s, double t) const override;
+
+  virtual gl::PixelDataFormat format() const override { return gl::kRed; }
+  virtual gl::PixelDataType type() const override { return gl::kUnsignedByte; }
+
+  // A tiled heightmap is meant to be bigger than what a single texture can
+  // hold, so this throws std::logic_error. Use a cdlod::TileCache instead.
+  virtual void upload(gl::Texture2D& tex) const override;
+
+  // The texels aren't contiguous, so this returns nullptr.
+  virtual const void* data() const override { return nullptr; }
+
+  virtual glm::dvec2 getMinMaxOfArea(int x, int y, int w, int h) const override {
+    return glm::dvec2(min_max_pyramid_.minMaxOfArea(x, y, w, h));
+  }
+
+  virtual const MinMaxPyramid* min_max_pyramid() const override {
+    return &min_max_pyramid_;
+  }
+
+ private:
+  MappedFile file_;
+  int w_, h_, tile_size_, level_count_;
+  std::vector<size_t> level_offsets_;  // the file offset of every level
+  MinMaxPyramid min_max_pyramid_;
+
+  size_t tileOffset(int level, int x, int y) const;
+};
+
+}  // namespace engine
+
+#endif
@@ -32,20 +32,85 @@ class Transformation {
   using quat = glm::tquat<T, P>;
 
   Transformation* parent_;
+  std::vector<Transformation*> children_;
   vec3 pos_, scale_;
   quat rot_;
 
+  // The matrices are only recalculated when they are needed after a change.
+  // A change in the local values (or in the parent) marks the whole subtree
+  // dirty. A clean transform always has clean ancestors, so the propagation
+  // can stop at an already dirty transform.
+  mutable mat4 local_to_parent_, local_to_world_, world_to_local_;
+  mutable bool local_dirty_, world_dirty_, inverse_dirty_;
+
+  // Should be called after any of pos_, rot_ or scale_ is modified
+  void localChanged() {
+    local_dirty_ = true;
+    worldChanged();
+  }
+
+  void worldChanged() {
+    if (!world_dirty_) {
+      world_dirty_ = true;
+      for (Transformation* child : children_) {
+        child->worldChanged();
+      }
+    }
+  }
+
  public:
   Transformation(Transformation* parent = nullptr)
-      : parent_(parent)
-      , scale_(1, 1, 1) {
+      : parent_(nullptr)
+      , scale_(1, 1, 1)
+      , local_dirty_(true), world_dirty_(true), inverse_dirty_(true) {
     assert(parent != this);
+    set_parent(parent);
+  }
+
+  // A copy gets the same parent, but not the children
+  Transformation(const Transformation& other)
+      : parent_(nullptr)
+      , pos_(other.pos_), scale_(other.scale_), rot_(other.rot_)
+      , local_dirty_(true), world_dirty_(true), inverse_dirty_(true) {
+    set_parent(other.parent_);
   }
 
-  virtual ~Transformation() {}
+  Transformation& operator=(const Transformation& other) {
+    if (this != &other) {
+      pos_ = other.pos_;
+      scale_ = other.scale_;
+      rot_ = other.rot_;
+      localChanged();
+      set_parent(other.parent_);
+    }
+    return *this;
+  }
+
+  virtual ~Transformation() {
+    set_parent(nullptr);
+    for (Transformation* child : children_) {
+      child->parent_ = nullptr;
+      child->worldChanged();
+    }
+  }
+
+  void set_parent(Transformation* parent) {
+    assert(parent != this);
+    if (parent == parent_) { return; }
+
+    if (parent_) {
+      auto& siblings = parent_->children_;
+      siblings.erase(std::find(siblings.begin(), siblings.end(), this));
+    }
+    parent_ = parent;
+    if (parent_) {
+      parent_->children_.push_back(this);
+    }
+    worldChanged();
+  }
 
-  void set_parent(Transformation* parent) { parent_ = parent; }
   Transformation* parent() const { return parent_; }
+  const std::vector<Transformation*>& children() const { return children_; }
 
   virtual const vec3 pos() const {
     if (parent_) {
@@ -62,6 +127,7 @@ class Transformation {
     } else {
       pos_ = new_pos;
     }
+    localChanged();
   }
 
   const vec3& local_pos() const {
@@ -70,6 +136,7 @@ class Transformation {
 
   virtual void set_local_pos(const vec3& new_pos) {
     pos_ = new_pos;
+    localChanged();
   }
 
   virtual const vec3 scale() const {
@@ -86,6 +153,7 @@ class Transformation {
     } else {
       scale_ = new_scale;
     }
+    localChanged();
   }
 
   const vec3& local_scale() const {
@@ -94,6 +162,7 @@ class Transformation {
 
   virtual void set_local_scale(const vec3& new_scale) {
     scale_ = new_scale;
+    localChanged();
   }
 
   virtual const quat rot() const {
@@ -110,6 +179,7 @@ class Transformation {
     } else {
       rot_ = new_rot;
     }
+    localChanged();
   }
 
   const quat& local_rot() const {
@@ -118,6 +188,7 @@ class Transformation {
 
   virtual void set_local_rot(const quat& new_rot) {
     rot_ = new_rot;
+    localChanged();
   }
 
   // Sets the rotation, so that 'local_space_vec' in local space will be
@@ -194,18 +265,33 @@ class Transformation {
   }
 
   mat4 worldToLocalMatrix() const {
-    return glm::inverse(localToWorldMatrix());
+    if (world_dirty_ || inverse_dirty_) {
+      world_to_local_ = glm::inverse(localToWorldMatrix());
+      inverse_dirty_ = false;
+    }
+    return world_to_local_;
   }
 
-  virtual mat4 localToWorldMatrix() const {
-    mat4 local_transf = glm::scale(glm::mat4_cast(rot_), scale_);
-    local_transf[3] = vec4(pos_, 1);
+  mat4 localToParentMatrix() const {
+    if (local_dirty_) {
+      local_to_parent_ = glm::scale(glm::mat4_cast(rot_), scale_);
+      local_to_parent_[3] = vec4(pos_, 1);
+      local_dirty_ = false;
+    }
+    return local_to_parent_;
+  }
 
-    if (parent_) {
-      return parent_->localToWorldMatrix() * local_transf;
-    } else {
-      return local_transf;
+  virtual mat4 localToWorldMatrix() const {
+    if (world_dirty_) {
+      if (parent_) {
+        local_to_world_ = parent_->localToWorldMatrix() * localToParentMatrix();
+      } else {
+        local_to_world_ = localToParentMatrix();
+      }
+      world_dirty_ = false;
+      inverse_dirty_ = true;
     }
+    return local_to_world_;
   }
 
   // To help the users to decide which matrix they need, in case of confusion
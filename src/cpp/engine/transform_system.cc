@@ -0,0 +1,293 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <stdexcept>
+#include "./transform_system.h"
+
+namespace engine {
+
+constexpr uint32_t TransformSystem::kInvalidIndex;
+
+// Calculates the top three rows of the local matrices (column by column)
+// from the positions, the rotations and the scales. The iterations are
+// independent, every input and output is a separate float array, and the
+// restrict parameters tell the compiler, that they don't overlap, so it
+// vectorizes this loop.
+static void CalculateLocalMatrices(
+    int count, const float* __restrict px, const float* __restrict py,
+    const float* __restrict pz, const float* __restrict rx,
+    const float* __restrict ry, const float* __restrict rz,
+    const float* __restrict rw, const float* __restrict sx,
+    const float* __restrict sy, const float* __restrict sz,
+    float* __restrict m00, float* __restrict m01, float* __restrict m02,
+    float* __restrict m10, float* __restrict m11, float* __restrict m12,
+    float* __restrict m20, float* __restrict m21, float* __restrict m22,
+    float* __restrict m30, float* __restrict m31, float* __restrict m32) {
+  for (int i = 0; i < count; ++i) {
+    float x = rx[i], y = ry[i], z = rz[i], w = rw[i];
+    float xx = x*x, yy = y*y, zz = z*z;
+    float xy = x*y, xz = x*z, yz = y*z;
+    float wx = w*x, wy = w*y, wz = w*z;
+    m00[i] = (1 - 2*(yy + zz)) * sx[i];
+    m01[i] = 2*(xy + wz) * sx[i];
+    m02[i] = 2*(xz - wy) * sx[i];
+    m10[i] = 2*(xy - wz) * sy[i];
+    m11[i] = (1 - 2*(xx + zz)) * sy[i];
+    m12[i] = 2*(yz + wx) * sy[i];
+    m20[i] = 2*(xz + wy) * sz[i];
+    m21[i] = 2*(yz - wx) * sz[i];
+    m22[i] = (1 - 2*(xx + yy)) * sz[i];
+    m30[i] = px[i];
+    m31[i] = py[i];
+    m32[i] = pz[i];
+  }
+}
+
+TransformSystem::Handle TransformSystem::create(Handle parent) {
+  uint32_t id;
+  if (free_ids_.empty()) {
+    id = id_to_index_.size();
+    id_to_index_.push_back(kInvalidIndex);
+    generations_.push_back(0);
+    first_child_.push_back(kInvalidIndex);
+    next_sibling_.push_back(kInvalidIndex);
+    prev_sibling_.push_back(kInvalidIndex);
+  } else {
+    id = free_ids_.back();
+    free_ids_.pop_back();
+  }
+
+  // Appending keeps the order, as the parent is already in the arrays
+  size_t idx = size();
+  id_to_index_[id] = idx;
+  pushBack();
+  index_to_id_[idx] = id;
+  link(id, valid(parent) ? index(parent) : -1);
+
+  return Handle{id, generations_[id]};
+}
+
+void TransformSystem::destroy(Handle handle) {
+  if (!valid(handle)) { return; }
+
+  uint32_t removed = index(handle);
+  uint32_t last = size() - 1;
+
+  // The children become roots
+  while (first_child_[handle.id] != kInvalidIndex) {
+    uint32_t child = first_child_[handle.id];
+    unlink(child);
+    parents_[id_to_index_[child]] = -1;
+  }
+  unlink(handle.id);
+
+  // Move the last one into the gap. It might get in front of its parent.
+  if (removed != last) {
+    copyElement(last, removed);
+    uint32_t moved = index_to_id_[removed];
+    id_to_index_[moved] = removed;
+    for (uint32_t child = first_child_[moved]; child != kInvalidIndex;
+         child = next_sibling_[child]) {
+      parents_[id_to_index_[child]] = removed;
+    }
+    order_dirty_ = true;
+  }
+  popBack();
+
+  id_to_index_[handle.id] = kInvalidIndex;
+  generations_[handle.id]++;
+  free_ids_.push_back(handle.id);
+}
+
+void TransformSystem::set_parent(Handle handle, Handle parent) {
+  int32_t idx = index(handle);
+  int32_t parent_idx = valid(parent) ? index(parent) : -1;
+
+  for (int32_t i = parent_idx; i != -1; i = parents_[i]) {
+    if (i == idx) {
+      throw std::invalid_argument(
+        "TransformSystem::set_parent: a transform can't be its own ancestor");
+    }
+  }
+
+  unlink(handle.id);
+  link(handle.id, parent_idx);
+  if (parent_idx > idx) {
+    order_dirty_ = true;
+  }
+}
+
+TransformSystem::Handle TransformSystem::parent(Handle handle) const {
+  int32_t parent_idx = parents_[index(handle)];
+  if (parent_idx == -1) {
+    return Handle{};
+  }
+  uint32_t id = index_to_id_[parent_idx];
+  return Handle{id, generations_[id]};
+}
+
+void TransformSystem::link(uint32_t id, int32_t parent_idx) {
+  parents_[id_to_index_[id]] = parent_idx;
+  if (parent_idx != -1) {
+    uint32_t parent = index_to_id_[parent_idx];
+    uint32_t next = first_child_[parent];
+    next_sibling_[id] = next;
+    if (next != kInvalidIndex) {
+      prev_sibling_[next] = id;
+    }
+    first_child_[parent] = id;
+  }
+}
+
+void TransformSystem::unlink(uint32_t id) {
+  int32_t parent_idx = parents_[id_to_index_[id]];
+  if (parent_idx == -1) { return; }
+
+  uint32_t prev = prev_sibling_[id], next = next_sibling_[id];
+  if (prev != kInvalidIndex) {
+    next_sibling_[prev] = next;
+  } else {
+    first_child_[index_to_id_[parent_idx]] = next;
+  }
+  if (next != kInvalidIndex) {
+    prev_sibling_[next] = prev;
+  }
+  prev_sibling_[id] = next_sibling_[id] = kInvalidIndex;
+  parents_[id_to_index_[id]] = -1;
+}
+
+void TransformSystem::pushBack() {
+  for (auto& position : positions_) { position.push_back(0); }
+  for (auto& rotation : rotations_) { rotation.push_back(0); }
+  rotations_[3].back() = 1;
+  for (auto& scale : scales_) { scale.push_back(1); }
+  for (auto& element : local_matrices_) { element.push_back(0); }
+  parents_.push_back(-1);
+  index_to_id_.push_back(kInvalidIndex);
+  world_matrices_.push_back(glm::mat4());
+}
+
+void TransformSystem::popBack() {
+  for (auto& position : positions_) { position.pop_back(); }
+  for (auto& rotation : rotations_) { rotation.pop_back(); }
+  for (auto& scale : scales_) { scale.pop_back(); }
+  for (auto& element : local_matrices_) { element.pop_back(); }
+  parents_.pop_back();
+  index_to_id_.pop_back();
+  world_matrices_.pop_back();
+}
+
+void TransformSystem::copyElement(size_t from, size_t to) {
+  for (auto& position : positions_) { position[to] = position[from]; }
+  for (auto& rotation : rotations_) { rotation[to] = rotation[from]; }
+  for (auto& scale : scales_) { scale[to] = scale[from]; }
+  parents_[to] = parents_[from];
+  index_to_id_[to] = index_to_id_[from];
+}
+
+void TransformSystem::update() {
+  if (order_dirty_) {
+    restoreOrder();
+  }
+
+  const int count = size();
+
+  // The local matrices first
+  CalculateLocalMatrices(
+      count, positions_[0].data(), positions_[1].data(), positions_[2].data(),
+      rotations_[0].data(), rotations_[1].data(), rotations_[2].data(),
+      rotations_[3].data(), scales_[0].data(), scales_[1].data(),
+      scales_[2].data(), local_matrices_[0].data(), local_matrices_[1].data(),
+      local_matrices_[2].data(), local_matrices_[3].data(),
+      local_matrices_[4].data(), local_matrices_[5].data(),
+      local_matrices_[6].data(), local_matrices_[7].data(),
+      local_matrices_[8].data(), local_matrices_[9].data(),
+      local_matrices_[10].data(), local_matrices_[11].data());
+
+  const float* m00 = local_matrices_[0].data();
+  const float* m01 = local_matrices_[1].data();
+  const float* m02 = local_matrices_[2].data();
+  const float* m10 = local_matrices_[3].data();
+  const float* m11 = local_matrices_[4].data();
+  const float* m12 = local_matrices_[5].data();
+  const float* m20 = local_matrices_[6].data();
+  const float* m21 = local_matrices_[7].data();
+  const float* m22 = local_matrices_[8].data();
+  const float* m30 = local_matrices_[9].data();
+  const float* m31 = local_matrices_[10].data();
+  const float* m32 = local_matrices_[11].data();
+
+  // Then the hierarchy. Every parent is before its children, so its world
+  // matrix is already final when a child needs it. The local matrices are
+  // affine, so the multiplication skips their bottom row.
+  for (int i = 0; i < count; ++i) {
+    glm::vec3 c0(m00[i], m01[i], m02[i]), c1(m10[i], m11[i], m12[i]);
+    glm::vec3 c2(m20[i], m21[i], m22[i]), c3(m30[i], m31[i], m32[i]);
+    glm::mat4& world = world_matrices_[i];
+    int32_t parent = parents_[i];
+    if (parent == -1) {
+      world[0] = glm::vec4(c0, 0);
+      world[1] = glm::vec4(c1, 0);
+      world[2] = glm::vec4(c2, 0);
+      world[3] = glm::vec4(c3, 1);
+    } else {
+      const glm::mat4& p = world_matrices_[parent];
+      world[0] = p[0]*c0.x + p[1]*c0.y + p[2]*c0.z;
+      world[1] = p[0]*c1.x + p[1]*c1.y + p[2]*c1.z;
+      world[2] = p[0]*c2.x + p[1]*c2.y + p[2]*c2.z;
+      world[3] = p[0]*c3.x + p[1]*c3.y + p[2]*c3.z + p[3];
+    }
+  }
+}
+
+void TransformSystem::restoreOrder() {
+  size_t count = size();
+
+  // A depth first walk from the roots (in their current order) puts every
+  // parent before its children, and the subtrees after each other.
+  std::vector<uint32_t> order;
+  order.reserve(count);
+  std::vector<uint32_t> stack;
+  for (size_t i = 0; i < count; ++i) {
+    if (parents_[i] != -1) { continue; }
+    stack.push_back(index_to_id_[i]);
+    while (!stack.empty()) {
+      uint32_t id = stack.back();
+      stack.pop_back();
+      order.push_back(id_to_index_[id]);
+      for (uint32_t child = first_child_[id]; child != kInvalidIndex;
+           child = next_sibling_[child]) {
+        stack.push_back(child);
+      }
+    }
+  }
+
+  std::vector<int32_t> new_index(count);
+  for (size_t i = 0; i < count; ++i) {
+    new_index[order[i]] = i;
+  }
+
+  auto reorder = [&order, count](std::vector<float>& array) {
+    std::vector<float> reordered(count);
+    for (size_t i = 0; i < count; ++i) {
+      reordered[i] = array[order[i]];
+    }
+    array.swap(reordered);
+  };
+  for (auto& position : positions_) { reorder(position); }
+  for (auto& rotation : rotations_) { reorder(rotation); }
+  for (auto& scale : scales_) { reorder(scale); }
+
+  std::vector<int32_t> parents(count);
+  std::vector<uint32_t> index_to_id(count);
+  for (size_t i = 0; i < count; ++i) {
+    uint32_t old = order[i];
+    parents[i] = parents_[old] == -1 ? -1 : new_index[parents_[old]];
+    index_to_id[i] = index_to_id_[old];
+    id_to_index_[index_to_id[i]] = i;
+  }
+  parents_.swap(parents);
+  index_to_id_.swap(index_to_id);
+  order_dirty_ = false;
+}
+
+}  // namespace engine
@@ -0,0 +1,148 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_TRANSFORM_SYSTEM_H_
+#define ENGINE_TRANSFORM_SYSTEM_H_
+
+#include <vector>
+#include <cstdint>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+namespace engine {
+
+// Stores a lot of transforms in separate float arrays per component (x, y, z
+// of the positions and so on), sorted so that every parent is before its
+// children. The world matrices are calculated in two linear passes: a
+// vectorized one for the local matrices, and one for the hierarchy.
+//
+// Unlike Transform, it doesn't calculate anything lazily: the world matrices
+// are only valid after update() was called. It is meant for big amounts of
+// dynamic objects, whose matrices are needed in every frame anyway.
+class TransformSystem {
+ public:
+  // A reference to a transform, that stays valid while the system reorders
+  // its arrays. A handle of a destroyed transform is detected as invalid.
+  struct Handle {
+    uint32_t id;
+    uint32_t generation;
+
+    Handle() : id(UINT32_MAX), generation(0) {}
+    Handle(uint32_t id, uint32_t generation) : id(id), generation(generation) {}
+  };
+
+  TransformSystem() = default;
+
+  // Creates a new identity transform
+  Handle create(Handle parent = Handle{});
+
+  // Destroys a transform. Its children become roots, with their local values
+  // kept as they are.
+  void destroy(Handle handle);
+
+  bool valid(Handle handle) const {
+    return handle.id < generations_.size() &&
+           generations_[handle.id] == handle.generation &&
+           id_to_index_[handle.id] != kInvalidIndex;
+  }
+
+  size_t size() const { return parents_.size(); }
+
+  // Throws std::invalid_argument if it would create a cycle
+  void set_parent(Handle handle, Handle parent);
+  Handle parent(Handle handle) const;
+
+  glm::vec3 local_pos(Handle handle) const {
+    size_t i = index(handle);
+    return glm::vec3(positions_[0][i], positions_[1][i], positions_[2][i]);
+  }
+  void set_local_pos(Handle handle, const glm::vec3& pos) {
+    size_t i = index(handle);
+    for (int c = 0; c < 3; ++c) {
+      positions_[c][i] = pos[c];
+    }
+  }
+
+  glm::quat local_rot(Handle handle) const {
+    size_t i = index(handle);
+    return glm::quat(rotations_[3][i], rotations_[0][i], rotations_[1][i],
+                     rotations_[2][i]);
+  }
+  void set_local_rot(Handle handle, const glm::quat& rot) {
+    size_t i = index(handle);
+    rotations_[0][i] = rot.x;
+    rotations_[1][i] = rot.y;
+    rotations_[2][i] = rot.z;
+    rotations_[3][i] = rot.w;
+  }
+
+  glm::vec3 local_scale(Handle handle) const {
+    size_t i = index(handle);
+    return glm::vec3(scales_[0][i], scales_[1][i], scales_[2][i]);
+  }
+  void set_local_scale(Handle handle, const glm::vec3& scale) {
+    size_t i = index(handle);
+    for (int c = 0; c < 3; ++c) {
+      scales_[c][i] = scale[c];
+    }
+  }
+
+  // Only valid after update(), and until the next modification
+  const glm::mat4& world_matrix(Handle handle) const {
+    return world_matrices_[index(handle)];
+  }
+
+  // Recalculates all the world matrices (and restores the parent before
+  // child order first, if the hierarchy changed)
+  void update();
+
+  // The position of a transform in the arrays. It changes when the
+  // hierarchy changes, so it can't be stored.
+  size_t index(Handle handle) const { return id_to_index_[handle.id]; }
+
+  // Direct access to the arrays, for batch processing. The parent index of
+  // a root is -1.
+  const std::vector<glm::mat4>& world_matrices() const {
+    return world_matrices_;
+  }
+  const std::vector<int32_t>& parent_indices() const { return parents_; }
+
+ private:
+  static constexpr uint32_t kInvalidIndex = UINT32_MAX;
+
+  // Indexed by the array index. Every component has its own array (x, y, z
+  // and w for the rotations), so the local matrices can be calculated with
+  // SIMD, four or eight transforms at once.
+  std::vector<float> positions_[3], rotations_[4], scales_[3];
+  // The top three rows of the local matrices, column by column (element
+  // 3*column + row), in the same layout. The bottom row is always 0, 0, 0, 1.
+  std::vector<float> local_matrices_[12];
+  std::vector<int32_t> parents_;
+  std::vector<uint32_t> index_to_id_;
+  std::vector<glm::mat4> world_matrices_;
+
+  // Indexed by the handle id
+  std::vector<uint32_t> id_to_index_;
+  std::vector<uint32_t> generations_;
+  std::vector<uint32_t> free_ids_;
+  // The children of every transform, as a doubly linked list of ids, so
+  // destroying or reparenting a transform doesn't have to search for them.
+  std::vector<uint32_t> first_child_, next_sibling_, prev_sibling_;
+
+  // Set if a parent might have got behind one of its children
+  bool order_dirty_ = false;
+
+  void link(uint32_t id, int32_t parent_idx);
+  void unlink(uint32_t id);
+  // Appends / removes an element at the end of every array
+  void pushBack();
+  void popBack();
+  // Copies the element at index from to index to in every array
+  void copyElement(size_t from, size_t to);
+  void restoreOrder();
+};
+
+}  // namespace engine
+
+#endif
@@ -0,0 +1,102 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <iostream>
+
+#include "../mesh/pose.h"
+#include "../task_scheduler.h"
+#include "./synthetic_animation.h"
+
+// Evaluates the poses of 1000 characters with a 64 bone skeleton, blending
+// two clips, and reports the time per frame on one thread and on the
+// TaskScheduler.
+
+using Clock = std::chrono::high_resolution_clock;
+using Millis = std::chrono::duration<double, std::milli>;
+
+constexpr int kBoneNum = 64, kCharacterNum = 1000, kFrames = 100;
+
+int main() {
+  // Chains of 8 bones, every chain starts from the first bone of the last one
+  aiNode* root = CreateNode("root", nullptr);
+  std::vector<aiNode*> bones;
+  std::map<std::string, unsigned> bone_mapping;
+  std::vector<glm::mat4> bone_offsets;
+  for (int i = 0; i < kBoneNum; ++i) {
+    aiNode* parent = i == 0 ? root : i % 8 == 0 ? bones[i - 8] : bones[i - 1];
+    bones.push_back(CreateNode("bone" + std::to_string(i), parent));
+    bone_mapping["bone" + std::to_string(i)] = i;
+    bone_offsets.push_back(glm::translate(glm::mat4(), glm::vec3(0, -i, 0)));
+  }
+
+  engine::Skeleton skeleton(root, bone_mapping, bone_offsets);
+  skeleton.set_root_bone_node(skeleton.findNode("bone0"));
+
+  aiAnimation* walk_anim = CreateAnimation(kBoneNum, 10, 30);
+  aiAnimation* run_anim = CreateAnimation(kBoneNum, 10, 20);
+  engine::AnimationClip walk(walk_anim), run(run_anim);
+  std::vector<int> walk_tracks = skeleton.bindClip(walk);
+  std::vector<int> run_tracks = skeleton.bindClip(run);
+
+  std::vector<engine::PoseInput> inputs(kCharacterNum);
+  std::vector<float> phases(kCharacterNum);
+  for (int i = 0; i < kCharacterNum; ++i) {
+    inputs[i].last.clip = &walk;
+    inputs[i].last.track_of_node = &walk_tracks;
+    inputs[i].current.clip = &run;
+    inputs[i].current.track_of_node = &run_tracks;
+    // Half of them are in a transition
+    inputs[i].factor = i % 2 ? 1.0f : (Random() + 1) / 2;
+    phases[i] = (Random() + 1) * 10;
+  }
+
+  std::vector<glm::mat4> serial_bones(kCharacterNum * skeleton.bone_count());
+  std::vector<glm::mat4> parallel_bones;
+  std::vector<glm::mat4> global_transforms(skeleton.node_count());
+  std::vector<glm::vec3> root_offsets(kCharacterNum);
+
+  double serial_time = 0, parallel_time = 0;
+  size_t mismatches = 0;
+  for (int frame = 0; frame < kFrames; ++frame) {
+    for (int i = 0; i < kCharacterNum; ++i) {
+      inputs[i].last.time = fmod(phases[i] + frame, walk.duration());
+      inputs[i].current.time = fmod(phases[i] + frame * 1.5f, run.duration());
+    }
+
+    auto start = Clock::now();
+    for (int i = 0; i < kCharacterNum; ++i) {
+      engine::EvaluatePose(skeleton, inputs[i], global_transforms.data(),
+                           &serial_bones[i * skeleton.bone_count()],
+                           &root_offsets[i]);
+    }
+    serial_time += Millis(Clock::now() - start).count();
+
+    start = Clock::now();
+    engine::EvaluatePoses(skeleton, inputs, parallel_bones, root_offsets);
+    parallel_time += Millis(Clock::now() - start).count();
+
+    for (size_t i = 0; i < serial_bones.size(); ++i) {
+      if (serial_bones[i] != parallel_bones[i]) {
+        mismatches++;
+      }
+    }
+  }
+
+  std::cout << kCharacterNum << " characters, " << kBoneNum
+            << " bones, per frame:" << std::endl;
+  std::cout << "One thread:    " << serial_time / kFrames << " ms" << std::endl;
+  std::cout << "TaskScheduler: " << parallel_time / kFrames << " ms ("
+            << engine::TaskScheduler::Default().worker_count()
+            << " workers)" << std::endl;
+
+  delete walk_anim;
+  delete run_anim;
+
+  if (mismatches) {
+    std::cout << "Failed: " << mismatches << " matrices differ" << std::endl;
+  }
+  return mismatches != 0;
+}
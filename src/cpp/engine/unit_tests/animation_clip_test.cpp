@@ -0,0 +1,207 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <cstdlib>
+#include <iostream>
+
+#include "../mesh/animation_clip.h"
+#include "./synthetic_animation.h"
+
+// Bakes a random animation with irregular key times, and compares the clip
+// with sampling the assimp keys directly.
+
+size_t fail_num = 0;
+
+void AssertNear(const glm::vec3& a, const glm::vec3& b, float epsilon,
+                const std::string& msg) {
+  if (glm::length(a - b) > epsilon) {
+    std::cout << "Failed: " << msg << std::endl;
+    fail_num++;
+  }
+}
+
+void AssertNear(const glm::quat& a, const glm::quat& b, float epsilon,
+                const std::string& msg) {
+  // q and -q are the same rotation
+  if (1 - fabs(glm::dot(a, b)) > epsilon) {
+    std::cout << "Failed: " << msg << std::endl;
+    fail_num++;
+  }
+}
+
+// An animation with keys at irregular times, and a different number of them
+// in every channel. The last channel is constant.
+aiAnimation* CreateIrregularAnimation(int channel_num, double duration) {
+  std::vector<unsigned> key_nums(channel_num, 1);
+  for (int c = 0; c + 1 < channel_num; ++c) {
+    key_nums[c] = 2 + rand() % 20;
+  }
+  return CreateAnimation(key_nums, duration, 0.4);
+}
+
+// Samples a channel directly, with a linear search, like the renderer
+// used to.
+engine::BoneTransform Reference(const aiNodeAnim* channel, double time) {
+  unsigned key_num = channel->mNumPositionKeys, i = 0;
+  float factor = 0;
+  if (key_num > 1) {
+    while (i + 2 < key_num && channel->mPositionKeys[i + 1].mTime < time) {
+      i++;
+    }
+    double t0 = channel->mPositionKeys[i].mTime;
+    double t1 = channel->mPositionKeys[i + 1].mTime;
+    factor = glm::clamp(float((time - t0) / (t1 - t0)), 0.0f, 1.0f);
+  }
+  unsigned j = key_num > 1 ? i + 1 : i;
+
+  auto vec = [](const aiVector3D& v) { return glm::vec3(v.x, v.y, v.z); };
+  auto quat = [](const aiQuaternion& q) { return glm::quat(q.w, q.x, q.y, q.z); };
+  return engine::BoneTransform(
+    glm::mix(vec(channel->mPositionKeys[i].mValue),
+             vec(channel->mPositionKeys[j].mValue), factor),
+    glm::slerp(quat(channel->mRotationKeys[i].mValue),
+               quat(channel->mRotationKeys[j].mValue), factor),
+    glm::mix(vec(channel->mScalingKeys[i].mValue),
+             vec(channel->mScalingKeys[j].mValue), factor));
+}
+
+void CompareWithReference(const engine::AnimationClip& clip,
+                          const aiAnimation* anim, float epsilon,
+                          const std::string& msg) {
+  for (int i = 0; i < 1000; ++i) {
+    float time = (Random() + 1) / 2 * anim->mDuration;
+    for (unsigned c = 0; c < anim->mNumChannels; ++c) {
+      int track = clip.findTrack(anim->mChannels[c]->mNodeName.data);
+      engine::BoneTransform expected = Reference(anim->mChannels[c], time);
+      engine::BoneTransform actual = clip.sample(track, time);
+      AssertNear(actual.pos, expected.pos, epsilon, msg + " position");
+      AssertNear(actual.rot, expected.rot, epsilon, msg + " rotation");
+      AssertNear(actual.scale, expected.scale, epsilon, msg + " scale");
+    }
+  }
+}
+
+int main() {
+  aiAnimation* anim = CreateIrregularAnimation(8, 60);
+
+  // At its own frames, the clip is exact
+  engine::AnimationClip dense(anim, 1000);
+  CompareWithReference(dense, anim, 0.05f, "Densely sampled clip");
+
+  engine::AnimationClip clip(anim, 120);
+  engine::AnimationClip quantized(anim, 120, true);
+  for (size_t frame = 0; frame < clip.frame_count(); ++frame) {
+    float time = clip.duration() * frame / (clip.frame_count() - 1);
+    for (unsigned c = 0; c < anim->mNumChannels; ++c) {
+      engine::BoneTransform expected = Reference(anim->mChannels[c], time);
+      AssertNear(clip.sample(c, time).pos, expected.pos, 1e-4f, "Key position");
+      AssertNear(clip.sample(c, time).rot, expected.rot, 1e-5f, "Key rotation");
+      AssertNear(quantized.sample(c, time).rot, expected.rot, 1e-4f,
+                 "Quantized key rotation");
+    }
+  }
+
+  if (clip.findTrack("bone3") != 3 || clip.findTrack("no such bone") != -1) {
+    std::cout << "Failed: findTrack" << std::endl;
+    fail_num++;
+  }
+
+  // Out of range times are clamped
+  AssertNear(clip.sample(0, -10).pos, clip.sample(0, 0).pos, 1e-6f, "Clamping");
+  AssertNear(clip.sample(0, 1000).pos, clip.sample(0, 60).pos, 1e-6f, "Clamping");
+
+  // Save and load
+  for (const engine::AnimationClip* original : {&clip, &quantized}) {
+    std::stringstream stream;
+    original->save(stream);
+    engine::AnimationClip loaded = engine::AnimationClip::Load(stream);
+    if (loaded.frame_count() != original->frame_count() ||
+        loaded.track_count() != original->track_count() ||
+        loaded.quantized() != original->quantized()) {
+      std::cout << "Failed: loaded clip's header" << std::endl;
+      fail_num++;
+    }
+    for (int i = 0; i < 100; ++i) {
+      float time = (Random() + 1) / 2 * anim->mDuration;
+      size_t track = rand() % original->track_count();
+      AssertNear(loaded.sample(track, time).pos,
+                 original->sample(track, time).pos, 0, "Loaded position");
+      AssertNear(loaded.sample(track, time).rot,
+                 original->sample(track, time).rot, 1e-6f, "Loaded rotation");
+    }
+  }
+
+  try {
+    std::stringstream garbage("not a clip");
+    engine::AnimationClip::Load(garbage);
+    std::cout << "Failed: loading garbage should throw" << std::endl;
+    fail_num++;
+  } catch (const std::runtime_error&) {}
+
+  // Truncated and corrupted files. The header is the magic, the version,
+  // the duration, the ticks per second and the frames per tick at bytes 8,
+  // 12 and 16, then the frame count at byte 20 and the track count at 24.
+  {
+    std::stringstream stream;
+    clip.save(stream);
+    const std::string data = stream.str();
+    auto corrupt = [&data](size_t offset, uint32_t value) {
+      std::string corrupted = data;
+      corrupted.replace(offset, sizeof(value),
+                        reinterpret_cast<const char*>(&value), sizeof(value));
+      return corrupted;
+    };
+    const std::string invalid_files[] = {
+      data.substr(0, 10), data.substr(0, 26), data.substr(0, 40),
+      data.substr(0, data.size() - 1),
+      corrupt(20, 0xFFFFFFFF), corrupt(24, 0xFFFFFFFF),
+      corrupt(29, 0x7FFFFFFF),  // the first track name's length
+      corrupt(20, 0),  // no frames, but there are tracks
+      // NaN, infinite and negative times
+      corrupt(8, 0x7FC00000), corrupt(8, 0xBF800000),
+      corrupt(12, 0x7F800000), corrupt(12, 0),
+      corrupt(16, 0x7FC00000), corrupt(16, 0xBF800000)
+    };
+    for (const std::string& invalid_file : invalid_files) {
+      try {
+        std::stringstream invalid(invalid_file);
+        engine::AnimationClip::Load(invalid);
+        std::cout << "Failed: loading an invalid clip should throw"
+                  << std::endl;
+        fail_num++;
+      } catch (const std::runtime_error&) {}
+    }
+  }
+
+  // Sampling speed: 100 characters with 60 bones
+  {
+    using Clock = std::chrono::high_resolution_clock;
+    aiAnimation* big_anim = CreateIrregularAnimation(60, 120);
+    engine::AnimationClip big_clip(big_anim);
+    auto start = Clock::now();
+    glm::vec3 sink;
+    for (int character = 0; character < 100; ++character) {
+      auto cursor = big_clip.cursor(character * 1.1f);
+      for (size_t track = 0; track < big_clip.track_count(); ++track) {
+        sink += big_clip.sample(track, cursor).pos;
+      }
+    }
+    std::chrono::duration<double, std::micro> time = Clock::now() - start;
+    std::cout << "Sampling 100 x 60 bones: " << time.count()
+              << " us (" << sink.x << ")" << std::endl;
+    delete big_anim;
+  }
+
+  delete anim;
+
+  if (fail_num) {
+    std::cout << fail_num << " checks failed" << std::endl;
+  } else {
+    std::cout << "All tests passed" << std::endl;
+  }
+  return fail_num != 0;
+}
@@ -0,0 +1,212 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <iostream>
+
+#include "../mesh/pose.h"
+#include "../mesh/blend_tree.h"
+#include "./synthetic_animation.h"
+
+constexpr int kBoneNum = 6;
+size_t fail_num = 0;
+
+void AssertNear(const glm::mat4& a, const glm::mat4& b, const std::string& msg) {
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      if (!(fabs(a[i][j] - b[i][j]) <= 1e-3f)) {  // catches NaN too
+        std::cout << "Failed: " << msg << std::endl;
+        fail_num++;
+        return;
+      }
+    }
+  }
+}
+
+struct Fixture {
+  engine::Skeleton skeleton;
+  std::vector<glm::mat4> globals, bones;
+
+  Fixture() {
+    std::map<std::string, unsigned> bone_mapping;
+    for (int i = 0; i < kBoneNum; ++i) {
+      bone_mapping["bone" + std::to_string(i)] = i;
+    }
+    skeleton = engine::Skeleton(CreateChain(kBoneNum), bone_mapping,
+                                std::vector<glm::mat4>(kBoneNum));
+    skeleton.set_root_bone_node(skeleton.findNode("bone0"));
+    globals.resize(skeleton.node_count());
+    bones.resize(skeleton.bone_count());
+  }
+
+  // The bones of a single clip, at a time in ticks
+  std::vector<glm::mat4> clipBones(const engine::AnimationClip& clip,
+                                   float time) {
+    std::vector<int> tracks = skeleton.bindClip(clip);
+    engine::PoseInput input;
+    input.last.clip = input.current.clip = &clip;
+    input.last.track_of_node = input.current.track_of_node = &tracks;
+    input.last.time = input.current.time = time;
+    std::vector<glm::mat4> result(skeleton.bone_count());
+    glm::vec3 root_offset;
+    engine::EvaluatePose(skeleton, input, globals.data(), result.data(),
+                         &root_offset);
+    return result;
+  }
+
+  void compare(const std::vector<glm::mat4>& expected, const std::string& msg) {
+    for (size_t i = 0; i < bones.size(); ++i) {
+      AssertNear(bones[i], expected[i], msg + ", bone " + std::to_string(i));
+    }
+  }
+};
+
+void Blend1DTest() {
+  Fixture f;
+  engine::AnimationClip walk(CreateAnimation(kBoneNum, 10, 60));
+  engine::AnimationClip run(CreateAnimation(kBoneNum, 10, 30));
+
+  engine::BlendTree tree(f.skeleton);
+  int speed = tree.addParameter("speed");
+  int walk_node = tree.addClip(walk), run_node = tree.addClip(run);
+  tree.addLayer(tree.addBlend1D(speed, {{4.0f, run_node}, {1.0f, walk_node}}));
+
+  // At a threshold, only that clip plays. The length of the loop is the
+  // length of the clip: 2 seconds.
+  tree.set_parameter(speed, 0.0f);
+  tree.evaluate(0.0f, f.globals.data(), f.bones.data());
+  tree.evaluate(0.5f, f.globals.data(), f.bones.data());
+  f.compare(f.clipBones(walk, 0.25f * walk.duration()), "1D blend below range");
+
+  tree.set_parameter("speed", 4.0f);
+  tree.evaluate(1.0f, f.globals.data(), f.bones.data());
+  // The run loop is 1 second long, and the phase advanced by 0.5
+  f.compare(f.clipBones(run, 0.75f * run.duration()), "1D blend at threshold");
+
+  // A quarter of the way between two constant poses
+  engine::AnimationClip a(CreateAnimation(kBoneNum, 1, 30));
+  engine::AnimationClip b(CreateAnimation(kBoneNum, 1, 30));
+  engine::BlendTree const_tree(f.skeleton);
+  int param = const_tree.addParameter("param", 0.25f);
+  const_tree.addLayer(const_tree.addBlend1D(
+    param, {{0.0f, const_tree.addClip(a)}, {1.0f, const_tree.addClip(b)}}));
+  const_tree.evaluate(0.0f, f.globals.data(), f.bones.data());
+  glm::vec3 local_pos{(glm::inverse(f.bones[0]) * f.bones[1])[3]};
+  glm::vec3 expected = glm::mix(a.sample(a.findTrack("bone1"), 0.0f).pos,
+                                b.sample(b.findTrack("bone1"), 0.0f).pos, 0.25f);
+  if (glm::length(local_pos - expected) > 1e-4f) {
+    std::cout << "Failed: 1D blend between two children" << std::endl;
+    fail_num++;
+  }
+
+  // A NaN parameter doesn't give NaN weights, the first child plays
+  const_tree.set_parameter(param, std::numeric_limits<float>::quiet_NaN());
+  const_tree.evaluate(1.0f, f.globals.data(), f.bones.data());
+  f.compare(f.clipBones(a, 0.0f), "1D blend with a NaN parameter");
+}
+
+void Blend2DTest() {
+  Fixture f;
+  std::vector<engine::AnimationClip> clips;
+  for (int i = 0; i < 4; ++i) {
+    clips.emplace_back(CreateAnimation(kBoneNum, 1, 30));
+  }
+
+  engine::BlendTree tree(f.skeleton);
+  int x = tree.addParameter("x"), y = tree.addParameter("y");
+  std::vector<std::pair<glm::vec2, int>> children;
+  glm::vec2 positions[] = {{0, 0}, {1, 0}, {0, 1}, {-1, -1}};
+  for (int i = 0; i < 4; ++i) {
+    children.push_back({positions[i], tree.addClip(clips[i])});
+  }
+  tree.addLayer(tree.addBlend2D(x, y, children));
+
+  for (int i = 0; i < 4; ++i) {
+    tree.set_parameter(x, positions[i].x);
+    tree.set_parameter(y, positions[i].y);
+    tree.evaluate(i, f.globals.data(), f.bones.data());
+    f.compare(f.clipBones(clips[i], 0), "2D blend at child " + std::to_string(i));
+  }
+
+  // A non-finite parameter doesn't make the bones NaN
+  tree.set_parameter(x, INFINITY);
+  tree.set_parameter(y, 0.0f);
+  tree.evaluate(4, f.globals.data(), f.bones.data());
+  bool finite = true;
+  for (const glm::mat4& bone : f.bones) {
+    for (int i = 0; i < 16; ++i) {
+      finite &= std::isfinite(bone[i / 4][i % 4]);
+    }
+  }
+  if (!finite) {
+    std::cout << "Failed: 2D blend with an infinite parameter" << std::endl;
+    fail_num++;
+  }
+
+  try {
+    children.push_back({positions[1], children[0].second});
+    tree.addBlend2D(x, y, children);
+    std::cout << "Failed: duplicate 2D blend positions should throw"
+              << std::endl;
+    fail_num++;
+  } catch (const std::invalid_argument&) {}
+}
+
+void LayerTest() {
+  Fixture f;
+  engine::AnimationClip base(CreateAnimation(kBoneNum, 10, 30));
+  engine::AnimationClip upper(CreateAnimation(kBoneNum, 1, 30));
+  engine::AnimationClip breathe(CreateAnimation(kBoneNum, 10, 30));
+
+  engine::BlendTree tree(f.skeleton);
+  tree.addLayer(tree.addClip(base));
+  engine::BlendTree::BoneMask mask =
+    engine::BlendTree::MaskFromBone(f.skeleton, "bone3");
+  int override_layer = tree.addLayer(
+    tree.addClip(upper), engine::BlendTree::LayerMode::Override, 1.0f, mask);
+  int additive_layer = tree.addLayer(
+    tree.addClip(breathe), engine::BlendTree::LayerMode::Additive, 1.0f);
+
+  // The additive layer is at its first frame, so it doesn't change anything.
+  // Above bone3 the base plays, below it the masked override layer.
+  tree.evaluate(0.0f, f.globals.data(), f.bones.data());
+  std::vector<glm::mat4> expected = f.clipBones(base, 0);
+  std::vector<glm::mat4> upper_bones = f.clipBones(upper, 0);
+  for (int i = 0; i < kBoneNum; ++i) {
+    // The model space matrices of the masked bones depend on the parents,
+    // so compare the local transforms
+    glm::mat4 local = i == 0 ? f.bones[0] : glm::inverse(f.bones[i-1]) * f.bones[i];
+    const auto& source = i < 3 ? expected : upper_bones;
+    glm::mat4 expected_local = i == 0 ? source[0]
+                                      : glm::inverse(source[i-1]) * source[i];
+    AssertNear(local, expected_local, "Masked layer, bone " + std::to_string(i));
+  }
+
+  // With zero weights, only the base is left
+  tree.set_layer_weight(override_layer, 0.0f);
+  tree.set_layer_weight(additive_layer, 0.0f);
+  tree.evaluate(0.5f, f.globals.data(), f.bones.data());
+  f.compare(f.clipBones(base, 0.5f * base.duration()), "Zero weight layers");
+
+  try {
+    engine::BlendTree::MaskFromBone(f.skeleton, "no such bone");
+    std::cout << "Failed: MaskFromBone should throw" << std::endl;
+    fail_num++;
+  } catch (const std::invalid_argument&) {}
+}
+
+int main() {
+  Blend1DTest();
+  Blend2DTest();
+  LayerTest();
+
+  if (fail_num) {
+    std::cout << fail_num << " checks failed" << std::endl;
+  } else {
+    std::cout << "All tests passed" << std::endl;
+  }
+  return fail_num != 0;
+}
@@ -0,0 +1,125 @@
+// Copyright (c) 2014, Tamas Csala
+
+// Culls 100k boxes and 100k spheres with every instruction set, that the CPU
+// supports, and compares them with BoundingBox::collidesWithFrustum, one box
+// at a time. All of them have to give the same results.
+
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <iostream>
+
+#define GLM_FORCE_RADIANS
+#include <glm/gtc/matrix_transform.hpp>
+#include "../collision/cull_batch.h"
+
+using Clock = std::chrono::high_resolution_clock;
+using engine::CullBatch;
+
+const char* Name(CullBatch::InstructionSet instruction_set) {
+  switch (instruction_set) {
+    case CullBatch::InstructionSet::kScalar: return "scalar";
+    case CullBatch::InstructionSet::kSse2: return "SSE2";
+    case CullBatch::InstructionSet::kAvx2: return "AVX2";
+  }
+  return "";
+}
+
+int main() {
+  const int kVolumeCount = 100000, kFrameCount = 200;
+  const float kWorldSize = 8192;
+
+  // Boxes and spheres of various sizes, all around the world
+  std::mt19937 random{42};
+  std::uniform_real_distribution<float> coord{0, kWorldSize};
+  std::uniform_real_distribution<float> size{1, 64};
+  std::vector<engine::BoundingBox> bboxes;
+  CullBatch boxes, spheres;
+  for (int i = 0; i < kVolumeCount; ++i) {
+    glm::vec3 center{coord(random), coord(random) / 16, coord(random)};
+    glm::vec3 extent{size(random), size(random), size(random)};
+    bboxes.push_back(engine::BoundingBox{center - extent/2.0f,
+                                         center + extent/2.0f});
+    boxes.addBox(bboxes.back());
+    spheres.addSphere(center, size(random));
+  }
+
+  // Looks around from the center of the world
+  glm::mat4 proj = glm::perspectiveFov<float>(M_PI/3, 1920, 1080, 0.5, 30000);
+  std::vector<Frustum> frustums;
+  for (int i = 0; i < kFrameCount; ++i) {
+    float angle = 2*M_PI * i / kFrameCount;
+    glm::vec3 pos{kWorldSize/2, 300, kWorldSize/2};
+    glm::vec3 forward{cos(angle), -0.2f, sin(angle)};
+    glm::mat4 cam = glm::lookAt(pos, pos + forward, glm::vec3(0, 1, 0));
+    frustums.push_back(Frustum::FromMatrix(proj * cam));
+  }
+
+  using Nanos = std::chrono::duration<double, std::nano>;
+  const double kTestCount = double(kVolumeCount) * kFrameCount;
+
+  std::vector<std::vector<uint32_t>> reference(kFrameCount);
+  size_t visible_count = 0;
+  auto start = Clock::now();
+  for (int f = 0; f < kFrameCount; ++f) {
+    reference[f].assign((kVolumeCount + 31) / 32, 0);
+    for (int i = 0; i < kVolumeCount; ++i) {
+      if (bboxes[i].collidesWithFrustum(frustums[f])) {
+        reference[f][i / 32] |= uint32_t(1) << (i % 32);
+      }
+    }
+  }
+  double reference_time = Nanos(Clock::now() - start).count() / kTestCount;
+  for (int i = 0; i < kVolumeCount; ++i) {
+    visible_count += CullBatch::IsVisible(reference[0], i);
+  }
+  std::cout << "BoundingBox::collidesWithFrustum: " << reference_time
+            << " ns/box (" << visible_count << " of " << kVolumeCount
+            << " visible)" << std::endl;
+
+  // The spheres are checked against the scalar kernel
+  std::vector<std::vector<uint32_t>> sphere_reference(kFrameCount);
+  CullBatch::set_instruction_set(CullBatch::InstructionSet::kScalar);
+  for (int f = 0; f < kFrameCount; ++f) {
+    spheres.cull(frustums[f], &sphere_reference[f]);
+  }
+
+  for (auto instruction_set : {CullBatch::InstructionSet::kScalar,
+                               CullBatch::InstructionSet::kSse2,
+                               CullBatch::InstructionSet::kAvx2}) {
+    if (!CullBatch::Supports(instruction_set)) {
+      std::cout << Name(instruction_set) << ": not supported" << std::endl;
+      continue;
+    }
+    CullBatch::set_instruction_set(instruction_set);
+
+    std::vector<uint32_t> visible;
+    auto start = Clock::now();
+    for (int f = 0; f < kFrameCount; ++f) {
+      boxes.cull(frustums[f], &visible);
+      if (visible != reference[f]) {
+        std::cout << "Failed: " << Name(instruction_set) << " culled the "
+                  << "boxes differently in frame " << f << std::endl;
+        return 1;
+      }
+    }
+    auto boxes_end = Clock::now();
+    for (int f = 0; f < kFrameCount; ++f) {
+      spheres.cull(frustums[f], &visible);
+      if (visible != sphere_reference[f]) {
+        std::cout << "Failed: " << Name(instruction_set) << " culled the "
+                  << "spheres differently in frame " << f << std::endl;
+        return 1;
+      }
+    }
+    auto spheres_end = Clock::now();
+
+    std::cout << Name(instruction_set) << ": "
+              << Nanos(boxes_end - start).count() / kTestCount
+              << " ns/box, "
+              << Nanos(spheres_end - boxes_end).count() / kTestCount
+              << " ns/sphere" << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,282 @@
+// Copyright (c) 2014, Tamas Csala
+
+// Samples the heights of random points through the virtual
+// HeightMapInterface::heightAt, with the inlined HeightSampler::heightAt,
+// and with the batched HeightSampler::sampleHeights with every instruction
+// set, that the CPU supports. The batches have to give exactly the same
+// heights as the inlined sampling, for every texel type, at the edges of the
+// heightmaps too, and the virtual path has to agree with them within
+// rounding.
+// It doesn't need an OpenGL context.
+
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <limits>
+#include <vector>
+#include <iostream>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include "../height_map_interface.h"
+#include "../height_sampler.h"
+#include "../collision/cull_batch.h"
+
+using Clock = std::chrono::high_resolution_clock;
+using engine::CullBatch;
+using engine::HeightSampler;
+
+int fail_num = 0;
+
+void Check(bool condition, const char* message) {
+  if (!condition) {
+    std::cerr << "Check failed: " << message << std::endl;
+    fail_num++;
+  }
+}
+
+const char* Name(CullBatch::InstructionSet instruction_set) {
+  switch (instruction_set) {
+    case CullBatch::InstructionSet::kScalar: return "scalar";
+    case CullBatch::InstructionSet::kSse2: return "SSE2";
+    case CullBatch::InstructionSet::kAvx2: return "AVX2";
+  }
+  return "";
+}
+
+const CullBatch::InstructionSet kInstructionSets[] = {
+  CullBatch::InstructionSet::kScalar,
+  CullBatch::InstructionSet::kSse2,
+  CullBatch::InstructionSet::kAvx2
+};
+
+// An 8 bit heightmap in the memory, that samples the heights the same way
+// as engine::HeightMap<unsigned char> (which would need an image file)
+class ByteHeightMap : public engine::HeightMapInterface {
+  int size_;
+  std::vector<std::array<unsigned char, 1>> texels_;
+
+  double texel(int s, int t) const { return texels_[t*size_ + s][0]; }
+
+ public:
+  explicit ByteHeightMap(int size) : size_(size), texels_(size*size) {
+    for (int t = 0; t < size; ++t) {
+      for (int s = 0; s < size; ++s) {
+        texels_[t*size + s][0] = 128 + 64*sin(s / 97.0) * cos(t / 131.0)
+                                     + 32*sin((s+t) / 23.0);
+      }
+    }
+  }
+
+  HeightSampler<unsigned char> sampler() const {
+    return HeightSampler<unsigned char>(&texels_.data()->front(),
+                                        size_, size_, 1.0f);
+  }
+
+  virtual int w() const override { return size_; }
+  virtual int h() const override { return size_; }
+
+  virtual glm::vec2 extent() const override { return glm::vec2(size_); }
+  virtual glm::vec2 center() const override { return glm::vec2(size_/2); }
+
+  virtual bool valid(double x, double z) const override {
+    return 0 <= x && x < size_ && 0 <= z && z < size_;
+  }
+
+  virtual double heightAt(int s, int t) const override { return texel(s, t); }
+
+  virtual double heightAt(double s, double t) const override {
+    double fs = floor(s), cs = fs + 1;
+    double ft = floor(t), ct = ft + 1;
+
+    double fh = glm::mix(texel(fs, ft), texel(cs, ft), s-fs);
+    double ch = glm::mix(texel(fs, ct), texel(cs, ct), s-fs);
+
+    return glm::mix(fh, ch, t-ft);
+  }
+
+  virtual gl::PixelDataFormat format() const override {
+    return gl::PixelDataFormat::kRed;
+  }
+
+  virtual gl::PixelDataType type() const override {
+    return gl::PixelDataType::kUnsignedByte;
+  }
+
+  virtual void upload(gl::Texture2D& tex) const override {}
+
+  virtual const void* data() const override { return texels_.data(); }
+
+  virtual void sampleHeights(const glm::vec2* points, float* heights,
+                             size_t count) const override {
+    sampler().sampleHeights(points, heights, count);
+  }
+};
+
+// Random texels of the full range of T, sampled at random points, that
+// are partly outside of the heightmap, and at the corners of the texels.
+template<typename T>
+void CheckType(const char* name, int w, int h, std::mt19937& random) {
+  std::vector<T> texels(w*h);
+  std::uniform_real_distribution<double> unit{0, 1};
+  for (T& texel : texels) {
+    double min = std::numeric_limits<T>::lowest();
+    double max = std::numeric_limits<T>::max();
+    if (std::is_floating_point<T>::value) {
+      min = -1000, max = 1000;
+    }
+    texel = T(min + (max - min) * unit(random));
+  }
+  HeightSampler<T> sampler(texels.data(), w, h, 0.5f, 3.25f);
+
+  std::uniform_real_distribution<float> s{-2.0f, w + 2.0f}, t{-2.0f, h + 2.0f};
+  std::vector<glm::vec2> points;
+  for (int i = 0; i < 1000; ++i) {
+    points.push_back(glm::vec2(s(random), t(random)));
+  }
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      points.push_back(glm::vec2(x, y));
+    }
+  }
+  // NaN is clamped to zero, the infinities to the edges
+  const float kNaN = std::numeric_limits<float>::quiet_NaN();
+  const float kInf = std::numeric_limits<float>::infinity();
+  for (glm::vec2 point : {glm::vec2(kNaN, 0.5f), glm::vec2(0.5f, kNaN),
+                          glm::vec2(kNaN, kNaN), glm::vec2(kInf, -kInf),
+                          glm::vec2(-kInf, kInf)}) {
+    points.push_back(point);
+  }
+  Check(sampler.heightAt(kNaN, kNaN) == sampler.heightAt(0, 0),
+        "NaN isn't clamped to zero");
+
+  std::vector<float> reference(points.size()), heights;
+  for (size_t i = 0; i < points.size(); ++i) {
+    reference[i] = sampler.heightAt(points[i]);
+  }
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      Check(sampler.heightAt(x, y) == sampler.heightAt(float(x), float(y)),
+            "The texel fetch differs from the interpolation at a texel");
+    }
+  }
+
+  for (auto instruction_set : kInstructionSets) {
+    if (!CullBatch::Supports(instruction_set)) {
+      continue;
+    }
+    CullBatch::set_instruction_set(instruction_set);
+    sampler.sampleHeights(points, &heights);
+    bool same = heights == reference;
+    if (!same) {
+      std::cerr << name << " " << w << "x" << h << " "
+                << Name(instruction_set) << ": ";
+    }
+    Check(same, "The batch differs from heightAt");
+  }
+}
+
+int main() {
+  const int kMapSize = 4096, kPointCount = 4096, kFrameCount = 500;
+
+  std::mt19937 random{42};
+  for (auto instruction_set : kInstructionSets) {
+    if (!CullBatch::Supports(instruction_set)) {
+      std::cout << Name(instruction_set) << ": not supported" << std::endl;
+    }
+  }
+
+  // The texel types, with sizes, where the gathers are at the ends of the
+  // data, and where the data is too small for them
+  for (glm::ivec2 size : {glm::ivec2(1, 1), glm::ivec2(2, 1),
+                          glm::ivec2(3, 2), glm::ivec2(17, 9),
+                          glm::ivec2(256, 256)}) {
+    CheckType<unsigned char>("uchar", size.x, size.y, random);
+    CheckType<signed char>("schar", size.x, size.y, random);
+    CheckType<char>("char", size.x, size.y, random);
+    CheckType<unsigned short>("ushort", size.x, size.y, random);
+    CheckType<short>("short", size.x, size.y, random);
+    CheckType<float>("float", size.x, size.y, random);
+  }
+
+  ByteHeightMap hmap{kMapSize};
+  const engine::HeightMapInterface& interface = hmap;
+  HeightSampler<unsigned char> sampler = hmap.sampler();
+
+  // Every frame samples a different set of points, like the objects
+  // that move around
+  std::uniform_real_distribution<float> coord{0, kMapSize - 1};
+  std::vector<std::vector<glm::vec2>> frames(kFrameCount);
+  for (auto& points : frames) {
+    for (int i = 0; i < kPointCount; ++i) {
+      points.push_back(glm::vec2(coord(random), coord(random)));
+    }
+  }
+
+  std::vector<float> heights(kPointCount), reference(kPointCount);
+  double max_error = 0, checksum = 0;
+
+  auto begin = Clock::now();
+  for (const auto& points : frames) {
+    for (int i = 0; i < kPointCount; ++i) {
+      heights[i] = interface.heightAt(double(points[i].x),
+                                      double(points[i].y));
+    }
+    checksum += heights[0];
+  }
+  auto end = Clock::now();
+  double virtual_time =
+      std::chrono::duration<double, std::micro>(end - begin).count();
+  std::cout << "virtual heightAt: " << virtual_time / kFrameCount
+            << " us / " << kPointCount << " points" << std::endl;
+
+  begin = Clock::now();
+  for (const auto& points : frames) {
+    for (int i = 0; i < kPointCount; ++i) {
+      reference[i] = sampler.heightAt(points[i]);
+    }
+    checksum += reference[0];
+  }
+  end = Clock::now();
+  double inline_time =
+      std::chrono::duration<double, std::micro>(end - begin).count();
+  std::cout << "inlined heightAt: " << inline_time / kFrameCount
+            << " us / " << kPointCount << " points" << std::endl;
+
+  for (int i = 0; i < kPointCount; ++i) {
+    const glm::vec2& point = frames.back()[i];
+    double error = std::abs(reference[i] - interface.heightAt(
+        double(point.x), double(point.y)));
+    max_error = std::max(max_error, error);
+  }
+  Check(max_error < 1e-3, "The sampler differs from the virtual heightAt");
+
+  for (auto instruction_set : kInstructionSets) {
+    if (!CullBatch::Supports(instruction_set)) {
+      continue;
+    }
+    CullBatch::set_instruction_set(instruction_set);
+
+    begin = Clock::now();
+    for (const auto& points : frames) {
+      interface.sampleHeights(points.data(), heights.data(), kPointCount);
+      checksum += heights[0];
+    }
+    end = Clock::now();
+    double time = std::chrono::duration<double, std::micro>(end - begin).count();
+    std::cout << "sampleHeights (" << Name(instruction_set) << "): "
+              << time / kFrameCount << " us / " << kPointCount << " points, "
+              << virtual_time / time << "x faster than virtual" << std::endl;
+    Check(heights == reference, "The batch differs from heightAt");
+  }
+
+  std::cout << "(max error of the virtual path: " << max_error
+            << ", checksum: " << checksum << ")" << std::endl;
+
+  if (fail_num) {
+    std::cerr << fail_num << " checks failed" << std::endl;
+  } else {
+    std::cout << "All checks passed" << std::endl;
+  }
+  return fail_num != 0;
+}
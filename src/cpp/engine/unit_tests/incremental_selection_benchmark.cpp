@@ -0,0 +1,189 @@
+// Copyright (c) 2014, Tamas Csala
+
+// Replays a camera path, and compares the full traversal of the quadtree
+// with the incremental selection. The two have to select the same nodes in
+// every frame. It doesn't need an OpenGL context, the selected nodes are
+// only counted, not rendered.
+//
+// The path can be given as a file of "x y z forward_x forward_y forward_z"
+// lines (one per frame), otherwise paths with a few different speeds are
+// generated, with a few jumps as camera cuts. The incremental selection pays
+// off the most for slow cameras, for fast ones it falls back to the full
+// traversal, so it is also measured without the fallback.
+
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+
+#include <GL/glew.h>
+#define GLM_FORCE_RADIANS
+#include <glm/gtc/matrix_transform.hpp>
+#include "../cdlod/flat_quad_tree.h"
+#include "../cdlod/incremental_selection.h"
+#include "./synthetic_height_map.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+// Takes the place of the QuadGridMesh. The order of the nodes differs
+// between the two selections, so it only keeps an order independent
+// checksum of them.
+struct CountingRenderList {
+  size_t nodes = 0, subquads = 0;
+  unsigned long long checksum = 0;
+
+  void addToRenderList(GLint x, GLint z, int scale, int level) {
+    addToRenderList(x, z, scale, level, true, true, true, true);
+  }
+
+  void addToRenderList(GLint x, GLint z, int scale, int level,
+                       bool tl, bool tr, bool bl, bool br) {
+    nodes++;
+    subquads += tl + tr + bl + br;
+    unsigned long long hash = (unsigned long long)(x) * 73856093u
+                            ^ (unsigned long long)(z) * 19349663u
+                            ^ (unsigned long long)(level) * 83492791u
+                            ^ (tl | tr << 1 | bl << 2 | br << 3) << 28;
+    checksum += hash * 0x9E3779B97F4A7C15ull;
+  }
+
+  bool operator==(const CountingRenderList& other) const {
+    return nodes == other.nodes && subquads == other.subquads &&
+           checksum == other.checksum;
+  }
+};
+
+struct CameraPose {
+  glm::vec3 pos, forward;
+};
+
+std::vector<CameraPose> LoadPath(const std::string& filename) {
+  std::ifstream file{filename};
+  if (!file) {
+    throw std::runtime_error("Couldn't open " + filename);
+  }
+  std::vector<CameraPose> path;
+  CameraPose pose;
+  while (file >> pose.pos.x >> pose.pos.y >> pose.pos.z
+              >> pose.forward.x >> pose.forward.y >> pose.forward.z) {
+    path.push_back(pose);
+  }
+  return path;
+}
+
+// Moves with the given speed (in units per frame) on a wavy line, while
+// looking around, and jumps to a new place every 1000 frames.
+std::vector<CameraPose> GeneratePath(int map_size, int frame_count,
+                                     float speed) {
+  std::vector<CameraPose> path;
+  glm::vec2 pos;
+  float heading = 0;
+  for (int i = 0; i < frame_count; ++i) {
+    int leg = i / 1000, frame = i % 1000;
+    if (frame == 0) {
+      pos = glm::vec2(map_size/4 + (leg * 1237) % (map_size/2),
+                      map_size/4 + (leg * 2591) % (map_size/2));
+      heading = leg * 2.1f;
+    }
+    float t = frame / 60.0f;
+    float direction = heading + 0.3f*sin(t);
+    pos += speed * glm::vec2(cos(direction), sin(direction));
+
+    float look = heading + 0.8f*sin(0.5f*t);
+    CameraPose pose;
+    pose.pos = glm::vec3(pos.x, 300 + 50*sin(0.2f*t), pos.y);
+    pose.forward = glm::vec3(cos(look), -0.2f, sin(look));
+    path.push_back(pose);
+  }
+  return path;
+}
+
+// Runs both selections on the path, and returns false if they differ.
+bool Replay(const engine::cdlod::FlatQuadTree& tree,
+            const std::vector<CameraPose>& path, const std::string& name) {
+  glm::mat4 proj = glm::perspectiveFov<float>(M_PI/3, 1920, 1080, 0.5, 30000);
+  std::vector<Frustum> frustums;
+  for (const CameraPose& pose : path) {
+    glm::mat4 cam = glm::lookAt(pose.pos, pose.pos + pose.forward,
+                                glm::vec3(0, 1, 0));
+    frustums.push_back(Frustum::FromMatrix(proj * cam));
+  }
+
+  std::vector<CountingRenderList> full_lists(path.size());
+  auto start = Clock::now();
+  for (size_t i = 0; i < path.size(); ++i) {
+    tree.selectNodes(path[i].pos, frustums[i], full_lists[i]);
+  }
+  auto full_end = Clock::now();
+
+  engine::cdlod::IncrementalSelection incremental{tree};
+  std::vector<CountingRenderList> incremental_lists(path.size());
+  size_t fallback_frames = 0;
+  for (size_t i = 0; i < path.size(); ++i) {
+    incremental.selectNodes(path[i].pos, frustums[i], incremental_lists[i]);
+    fallback_frames += incremental.fell_back();
+  }
+  auto incremental_end = Clock::now();
+
+  engine::cdlod::IncrementalSelection always_incremental{tree};
+  always_incremental.set_max_speed(INFINITY);
+  std::vector<CountingRenderList> always_incremental_lists(path.size());
+  size_t updated_nodes = 0, cut_size = 0;
+  for (size_t i = 0; i < path.size(); ++i) {
+    always_incremental.selectNodes(path[i].pos, frustums[i],
+                                   always_incremental_lists[i]);
+    updated_nodes += always_incremental.updated_node_count();
+    cut_size += always_incremental.cut_size();
+  }
+  auto always_incremental_end = Clock::now();
+
+  size_t nodes = 0;
+  for (size_t i = 0; i < path.size(); ++i) {
+    nodes += full_lists[i].nodes;
+    if (!(full_lists[i] == incremental_lists[i]) ||
+        !(full_lists[i] == always_incremental_lists[i])) {
+      std::cout << "Failed: the selections differ in frame " << i
+                << " of the " << name << " path" << std::endl;
+      return false;
+    }
+  }
+
+  using Micros = std::chrono::duration<double, std::micro>;
+  size_t n = path.size();
+  std::cout << name << " (" << n << " frames, " << nodes / n
+            << " nodes/frame):" << std::endl;
+  std::cout << "  Full selection:        "
+            << Micros(full_end - start).count() / n << " us/frame"
+            << std::endl;
+  std::cout << "  Incremental selection: "
+            << Micros(incremental_end - full_end).count() / n << " us/frame, "
+            << fallback_frames << " frames fell back" << std::endl;
+  std::cout << "  Without the fallback:  "
+            << Micros(always_incremental_end - incremental_end).count() / n
+            << " us/frame, " << updated_nodes / n << " of " << cut_size / n
+            << " cut nodes updated/frame" << std::endl;
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  const int kMapSize = 8192, kNodeDimension = 16, kFrameCount = 5000;
+  SyntheticHeightMap<float> hmap{kMapSize};
+  engine::cdlod::FlatQuadTree tree{hmap, kNodeDimension};
+
+  if (argc > 1) {
+    return !Replay(tree, LoadPath(argv[1]), argv[1]);
+  }
+
+  // At 60 fps: 15, 60 and 240 units per second
+  const float kSpeeds[] = {0.25f, 1.0f, 4.0f};
+  const char* kNames[] = {"Walking", "Driving", "Flying"};
+  for (int i = 0; i < 3; ++i) {
+    if (!Replay(tree, GeneratePath(kMapSize, kFrameCount, kSpeeds[i]),
+                kNames[i])) {
+      return 1;
+    }
+  }
+  return 0;
+}
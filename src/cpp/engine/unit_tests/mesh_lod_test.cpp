@@ -0,0 +1,199 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+
+#include "../mesh/lod_selector.h"
+#include "../mesh/mesh_simplifier.h"
+
+size_t fail_num = 0;
+
+void Check(bool condition, const std::string& msg) {
+  if (!condition) {
+    std::cout << "Failed: " << msg << std::endl;
+    fail_num++;
+  }
+}
+
+struct Mesh {
+  std::vector<glm::vec3> positions;
+  std::vector<uint32_t> indices;
+};
+
+// A dimension x dimension grid of quads on the y = 0 plane, [0, 1]^2 large
+Mesh Grid(int dimension) {
+  Mesh mesh;
+  for (int z = 0; z <= dimension; ++z) {
+    for (int x = 0; x <= dimension; ++x) {
+      mesh.positions.push_back(glm::vec3(x, 0, z) / float(dimension));
+    }
+  }
+  for (int z = 0; z < dimension; ++z) {
+    for (int x = 0; x < dimension; ++x) {
+      uint32_t i = z * (dimension+1) + x, j = i + dimension + 1;
+      mesh.indices.insert(mesh.indices.end(), {i, j, i+1, i+1, j, j+1});
+    }
+  }
+  return mesh;
+}
+
+// A unit sphere, with a seam at the first and last meridians (like the
+// texture seams of the models)
+Mesh Sphere(int rings, int segments) {
+  Mesh mesh;
+  for (int r = 0; r <= rings; ++r) {
+    float theta = M_PI * r / rings;
+    for (int s = 0; s <= segments; ++s) {
+      float phi = 2*M_PI * s / segments;
+      mesh.positions.push_back(glm::vec3(sin(theta)*cos(phi), cos(theta),
+                                         sin(theta)*sin(phi)));
+    }
+  }
+  for (int r = 0; r < rings; ++r) {
+    for (int s = 0; s < segments; ++s) {
+      uint32_t i = r * (segments+1) + s, j = i + segments + 1;
+      if (r != 0) {
+        mesh.indices.insert(mesh.indices.end(), {i, i+1, j});
+      }
+      if (r != rings-1) {
+        mesh.indices.insert(mesh.indices.end(), {i+1, j+1, j});
+      }
+    }
+  }
+  return mesh;
+}
+
+glm::vec3 Normal(const Mesh& mesh, const std::vector<uint32_t>& indices,
+                 size_t i) {
+  const glm::vec3& p0 = mesh.positions[indices[i]];
+  return glm::cross(mesh.positions[indices[i+1]] - p0,
+                    mesh.positions[indices[i+2]] - p0);
+}
+
+void CheckValid(const Mesh& mesh, const std::vector<uint32_t>& indices,
+                const std::string& name) {
+  Check(indices.size() % 3 == 0, name + ": the index count is invalid");
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    bool valid = indices[i] < mesh.positions.size() &&
+                 indices[i+1] < mesh.positions.size() &&
+                 indices[i+2] < mesh.positions.size();
+    Check(valid, name + ": invalid index");
+    if (!valid) {
+      return;
+    }
+    Check(indices[i] != indices[i+1] && indices[i+1] != indices[i+2] &&
+          indices[i+2] != indices[i], name + ": degenerate triangle");
+  }
+}
+
+// The grid can be simplified without any error, and its borders have to
+// stay in place
+void GridTest() {
+  Mesh grid = Grid(32);
+  engine::MeshSimplifier simplifier{grid.positions, grid.indices};
+  Check(simplifier.triangle_count() == 2*32*32, "Grid: triangle count");
+
+  std::vector<uint32_t> indices = simplifier.simplify(64);
+  CheckValid(grid, indices, "Grid");
+  Check(indices.size() / 3 <= 64, "Grid: the target wasn't reached");
+
+  float area = 0;
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    glm::vec3 normal = Normal(grid, indices, i);
+    Check(normal.y > 0 && normal.x == 0 && normal.z == 0,
+          "Grid: a triangle is flipped");
+    area += glm::length(normal) / 2;
+  }
+  Check(std::abs(area - 1) < 1e-4, "Grid: the area changed");
+}
+
+// The chain of levels of a sphere
+void SphereTest() {
+  Mesh sphere = Sphere(48, 96);
+  engine::MeshSimplifier simplifier{sphere.positions, sphere.indices};
+  size_t triangle_count = simplifier.triangle_count();
+
+  for (int level = 1; level <= 4; ++level) {
+    std::string name = "Sphere level " + std::to_string(level);
+    size_t target = triangle_count >> level;
+    std::vector<uint32_t> indices = simplifier.simplify(target);
+    CheckValid(sphere, indices, name);
+    Check(indices.size() / 3 <= target, name + ": the target wasn't reached");
+    Check(indices.size() / 3 > target * 0.9, name + ": too many collapses");
+
+    // The volume (by the divergence theorem) shouldn't shrink a lot
+    float volume = 0;
+    for (size_t i = 0; i < indices.size(); i += 3) {
+      volume += glm::dot(sphere.positions[indices[i]],
+                         Normal(sphere, indices, i)) / 6;
+    }
+    Check(volume > 0.9 * (4*M_PI/3), name + ": the volume shrunk");
+  }
+}
+
+void InvalidInputTest() {
+  Mesh grid = Grid(2);
+  grid.indices.push_back(0);
+  bool thrown = false;
+  try {
+    engine::MeshSimplifier{grid.positions, grid.indices};
+  } catch (const std::invalid_argument&) {
+    thrown = true;
+  }
+  Check(thrown, "InvalidInput: the index count isn't checked");
+
+  grid.indices.push_back(1);
+  grid.indices.push_back(100);
+  thrown = false;
+  try {
+    engine::MeshSimplifier{grid.positions, grid.indices};
+  } catch (const std::out_of_range&) {
+    thrown = true;
+  }
+  Check(thrown, "InvalidInput: the indices aren't checked");
+}
+
+void LodSelectorTest() {
+  engine::LodSelector selector{{400, 200, 100}, 0.1f};
+  Check(selector.lod_count() == 4, "LodSelector: lod count");
+
+  Check(selector.select(1000, 0) == 0, "LodSelector: near");
+  Check(selector.select(150, 0) == 2, "LodSelector: middle");
+  Check(selector.select(10, 0) == 3, "LodSelector: far");
+  Check(selector.select(1000, 3) == 0, "LodSelector: coming closer");
+
+  // Around the threshold, the level doesn't change
+  Check(selector.select(195, 1) == 1, "LodSelector: hysteresis (finer)");
+  Check(selector.select(205, 2) == 2, "LodSelector: hysteresis (coarser)");
+  Check(selector.select(175, 1) == 2, "LodSelector: below the hysteresis");
+  Check(selector.select(225, 2) == 1, "LodSelector: above the hysteresis");
+
+  // A 10 unit sphere, 100 units away, with 90° fov on a 1000 px screen
+  glm::mat4 projection{1.0f};
+  float size = engine::LodSelector::ProjectedSize(
+      projection, 1000, glm::vec3(0), glm::vec4(0, 0, 100, 10));
+  Check(std::abs(size - 100) < 1e-3, "LodSelector: projected size");
+
+  bool thrown = false;
+  try {
+    engine::LodSelector{{100, 200}};
+  } catch (const std::invalid_argument&) {
+    thrown = true;
+  }
+  Check(thrown, "LodSelector: the order of the thresholds isn't checked");
+}
+
+int main() {
+  GridTest();
+  SphereTest();
+  InvalidInputTest();
+  LodSelectorTest();
+
+  if (fail_num == 0) {
+    std::cout << "All tests passed" << std::endl;
+  }
+  return fail_num != 0;
+}
@@ -0,0 +1,128 @@
+// Copyright (c) 2014, Tamas Csala
+
+// Checks the encoding of engine::NormalMap, that its normals are the ones,
+// that the terrain shader used to compute from the heights, and that the
+// incremental updates give the same texels as a full rebuild.
+// It doesn't need an OpenGL context.
+
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include "../normal_map.h"
+#include "./synthetic_height_map.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+size_t fail_num = 0;
+
+void Check(bool condition, const std::string& msg) {
+  if (!condition) {
+    std::cout << "Failed: " << msg << std::endl;
+    fail_num++;
+  }
+}
+
+// A texel, clamped to the edges like the texture fetches of the shader
+double ClampedHeight(const engine::HeightMapInterface& hmap, int s, int t) {
+  return hmap.heightAt(std::min(std::max(s, 0), hmap.w()-1),
+                       std::min(std::max(t, 0), hmap.h()-1));
+}
+
+// The normal, that cdlod_terrain.vert computed before the normal map
+glm::vec3 ShaderNormal(const engine::HeightMapInterface& hmap, int s, int t) {
+  glm::vec3 u = glm::vec3(1.0f, ClampedHeight(hmap, s+1, t) -
+                                ClampedHeight(hmap, s-1, t), 0.0f);
+  glm::vec3 v = glm::vec3(0.0f, ClampedHeight(hmap, s, t+1) -
+                                ClampedHeight(hmap, s, t-1), 1.0f);
+  return glm::normalize(glm::cross(u, -v));
+}
+
+// acos would be imprecise for the small angles
+float Angle(const glm::vec3& a, const glm::vec3& b) {
+  return std::atan2(glm::length(glm::cross(a, b)), glm::dot(a, b));
+}
+
+void EncodingTest() {
+  std::mt19937 random{42};
+  std::uniform_real_distribution<float> coord{-1, 1}, up{0, 1};
+  float max_error = 0;
+  for (int i = 0; i < 100000; ++i) {
+    glm::vec3 normal = glm::normalize(glm::vec3(coord(random), up(random),
+                                                coord(random)));
+    glm::vec2 e = engine::NormalMap::Encode(normal);
+    Check(0 <= e.x && e.x <= 1 && 0 <= e.y && e.y <= 1,
+          "The encoded normal is outside of [0, 1]^2");
+    // Quantized like the texels
+    e = glm::round(e * 65535.0f) / 65535.0f;
+    max_error = std::max(max_error,
+                         Angle(normal, engine::NormalMap::Decode(e)));
+  }
+  Check(max_error < 1e-4f, "The 16 bit encoding isn't precise enough");
+  std::cout << "max error of the encoding: " << max_error << " radians"
+            << std::endl;
+}
+
+void ShaderNormalTest(const SyntheticHeightMap<float>& hmap) {
+  engine::NormalMap normal_map{hmap};
+  float max_error = 0;
+  for (int t = 0; t < hmap.h(); ++t) {
+    for (int s = 0; s < hmap.w(); ++s) {
+      max_error = std::max(max_error, Angle(normal_map.normalAt(s, t),
+                                            ShaderNormal(hmap, s, t)));
+    }
+  }
+  Check(max_error < 1e-4f, "The normals differ from the shader's");
+
+  glm::vec3 n = normal_map.normalAt(10.5f, 20.25f);
+  Check(std::abs(glm::length(n) - 1) < 1e-5f,
+        "The interpolated normal isn't normalized");
+  Check(normal_map.normalAt(-5, -5) == normal_map.normalAt(0, 0),
+        "The fetches aren't clamped");
+}
+
+void UpdateTest(SyntheticHeightMap<float>& hmap) {
+  engine::NormalMap normal_map{hmap};
+
+  // A crater, that overlaps the edge of the heightmap
+  int x0 = hmap.w() - 40, y0 = 100, x1 = hmap.w() - 1, y1 = 170;
+  hmap.modifyHeights(x0, y0, x1, y1, [x0](int s, int t, double height) {
+    return height - 5 - 0.1 * (s - x0);
+  });
+  glm::ivec4 rect = normal_map.update(x0, y0, x1 + 10, y1);
+  Check(rect == glm::ivec4(x0 - 1, y0 - 1, x1, y1 + 1),
+        "The recomputed rectangle is wrong");
+  Check(normal_map.data() == engine::NormalMap{hmap}.data(),
+        "The update differs from a full rebuild");
+
+  rect = normal_map.update(-10, -10, -5, -5);
+  Check(rect.z < rect.x, "The rectangle outside of the map isn't empty");
+}
+
+int main() {
+  const int kSize = 1025;
+  SyntheticHeightMap<float> hmap{kSize, kSize + 200};
+
+  EncodingTest();
+  ShaderNormalTest(hmap);
+  UpdateTest(hmap);
+
+  auto begin = Clock::now();
+  engine::NormalMap normal_map{hmap};
+  auto end = Clock::now();
+  std::cout << "building a " << hmap.w() << "x" << hmap.h()
+            << " normal map: "
+            << std::chrono::duration<double, std::milli>(end - begin).count()
+            << " ms" << std::endl;
+
+  if (fail_num) {
+    std::cout << fail_num << " checks failed" << std::endl;
+  } else {
+    std::cout << "All checks passed" << std::endl;
+  }
+  return fail_num != 0;
+}
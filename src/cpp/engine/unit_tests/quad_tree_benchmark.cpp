@@ -0,0 +1,278 @@
+// Copyright (c) 2014, Tamas Csala
+
+// Compares the node selection speed of the pointer based and the flat
+// quadtree layouts, checks that the selection in a world, that is too big
+// for 16 bit coordinates, is correct, and isn't slower far from the origin,
+// and shows how the allowed screen-space error changes the triangle count.
+// It doesn't need an OpenGL context, the selected nodes are only counted,
+// not rendered.
+
+#include <cmath>
+#include <chrono>
+#include <climits>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include <GL/glew.h>
+#define GLM_FORCE_RADIANS
+#include <glm/gtc/matrix_transform.hpp>
+#include "../cdlod/flat_quad_tree.h"
+#include "../cdlod/pointer_quad_tree.h"
+#include "../min_max_pyramid.h"
+#include "./synthetic_height_map.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+// A procedural heightmap for a world, whose texels wouldn't fit into the
+// memory. Only the min/max pyramid is stored, like in a TiledHeightMap.
+class LargeHeightMap : public engine::HeightMapInterface {
+  int size_;
+  engine::MinMaxPyramid min_max_pyramid_;
+
+  static double Height(double s, double t) {
+    return 128 + 64*sin(s / 797.0) * cos(t / 1031.0) + 32*sin((s+t) / 223.0);
+  }
+
+ public:
+  explicit LargeHeightMap(int size) : size_(size) {
+    // The cells are approximated from their corners, that's enough here
+    const int kCellSize = 64;
+    engine::MinMaxPyramid::Level base;
+    base.w = base.h = (size - 1 + kCellSize - 1) / kCellSize;
+    for (int cy = 0; cy < base.h; ++cy) {
+      for (int cx = 0; cx < base.w; ++cx) {
+        double corners[] = {
+          Height(cx*kCellSize, cy*kCellSize),
+          Height((cx+1)*kCellSize, cy*kCellSize),
+          Height(cx*kCellSize, (cy+1)*kCellSize),
+          Height((cx+1)*kCellSize, (cy+1)*kCellSize)
+        };
+        base.mins.push_back(*std::min_element(corners, corners + 4));
+        base.maxes.push_back(*std::max_element(corners, corners + 4));
+      }
+    }
+    min_max_pyramid_ = engine::MinMaxPyramid{size, size, kCellSize, base};
+  }
+
+  virtual int w() const override { return size_; }
+  virtual int h() const override { return size_; }
+
+  virtual glm::vec2 extent() const override { return glm::vec2(size_); }
+  virtual glm::vec2 center() const override { return glm::vec2(size_/2); }
+
+  virtual bool valid(double x, double z) const override {
+    return 0 <= x && x < size_ && 0 <= z && z < size_;
+  }
+
+  virtual double heightAt(int s, int t) const override { return Height(s, t); }
+
+  virtual double heightAt(double s, double t) const override {
+    return Height(s, t);
+  }
+
+  virtual gl::PixelDataFormat format() const override {
+    return gl::PixelDataFormat::kRed;
+  }
+
+  virtual gl::PixelDataType type() const override {
+    return gl::PixelDataType::kFloat;
+  }
+
+  virtual void upload(gl::Texture2D& tex) const override {}
+
+  virtual const void* data() const override { return nullptr; }
+
+  virtual glm::dvec2 getMinMaxOfArea(int x, int y, int w, int h) const override {
+    return glm::dvec2(min_max_pyramid_.minMaxOfArea(x, y, w, h));
+  }
+
+  virtual const engine::MinMaxPyramid* min_max_pyramid() const override {
+    return &min_max_pyramid_;
+  }
+};
+
+// Takes the place of the QuadGridMesh, and only counts the render calls
+struct CountingRenderList {
+  size_t nodes = 0, subquads = 0;
+  GLint min_coord = INT_MAX, max_coord = INT_MIN;
+
+  void addToRenderList(GLint x, GLint z, int scale, int level) {
+    addToRenderList(x, z, scale, level, true, true, true, true);
+  }
+
+  void addToRenderList(GLint x, GLint z, int scale, int level,
+                       bool tl, bool tr, bool bl, bool br) {
+    nodes++;
+    subquads += tl + tr + bl + br;
+    min_coord = std::min({min_coord, x, z});
+    max_coord = std::max({max_coord, x, z});
+  }
+};
+
+// In a real frame, the rendering evicts the quadtree from the caches between
+// two selections. This simulates that by walking through a big buffer.
+void FlushCaches() {
+  static std::vector<char> garbage(64 << 20);
+  for (size_t i = 0; i < garbage.size(); i += 64) {
+    garbage[i]++;
+  }
+}
+
+// Flies the camera around on a circle over the terrain, and returns the
+// average selection time in microseconds. By default, the circle is around
+// the center of the map.
+template<typename Tree>
+double Benchmark(const Tree& tree, int map_size, int frame_count,
+                 bool flush_caches, CountingRenderList* render_list,
+                 glm::vec2 center = glm::vec2(-1),
+                 const engine::cdlod::LodSettings& lod =
+                     engine::cdlod::LodSettings{}) {
+  glm::mat4 proj = glm::perspectiveFov<float>(M_PI/3, 1920, 1080, 0.5, 30000);
+  if (center.x < 0) {
+    center = glm::vec2(map_size/2);
+  }
+
+  Clock::duration time{0};
+  for (int i = 0; i < frame_count; ++i) {
+    if (flush_caches) {
+      FlushCaches();
+    }
+
+    float angle = 2*M_PI * i / frame_count;
+    glm::vec3 pos = glm::vec3(center.x + 2048 * cos(angle), 300,
+                              center.y + 2048 * sin(angle));
+    glm::vec3 forward = glm::vec3(-sin(angle), -0.2f, cos(angle));
+    glm::mat4 cam = glm::lookAt(pos, pos + forward, glm::vec3(0, 1, 0));
+    Frustum frustum = Frustum::FromMatrix(proj * cam);
+
+    auto start = Clock::now();
+    tree.selectNodes(pos, frustum, *render_list, lod);
+    time += Clock::now() - start;
+  }
+
+  return std::chrono::duration<double, std::micro>(time).count() / frame_count;
+}
+
+// Flies around near the origin, and near the far corner of a world, that is
+// too big for 16 bit coordinates. The selection has to be correct, and it
+// shouldn't be slower far from the origin.
+int LargeWorldBenchmark() {
+  // With 16 texel nodes, the tree itself wouldn't fit into the memory
+  const int kMapSize = 65536, kNodeDimension = 64, kFrameCount = 1000;
+  LargeHeightMap hmap{kMapSize};
+  engine::cdlod::FlatQuadTree tree{hmap, kNodeDimension};
+
+  double times[2];
+  for (int far : {0, 1}) {
+    glm::vec2 center = glm::vec2(far ? kMapSize - 4096 : 4096);
+    CountingRenderList render_list;
+    Benchmark(tree, kMapSize, kFrameCount/10, false, &render_list, center);
+    render_list = CountingRenderList{};
+    times[far] = Benchmark(tree, kMapSize, kFrameCount, false, &render_list,
+                           center);
+
+    std::cout << "Selection in a " << kMapSize << "x" << kMapSize << " world, "
+              << (far ? "far from" : "near") << " the origin: " << times[far]
+              << " us/frame, " << render_list.nodes / kFrameCount
+              << " nodes/frame" << std::endl;
+
+    if (render_list.min_coord < 0 || kMapSize < render_list.max_coord) {
+      std::cout << "Failed: node coordinates overflowed" << std::endl;
+      return 1;
+    }
+  }
+
+  // Leave some room for the noise of the measurement
+  if (times[1] > 1.5 * times[0]) {
+    std::cout << "Failed: the selection is slower far from the origin"
+              << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+// Selects with the ranges of decreasing screen-space errors. The smaller the
+// allowed error, the more triangles have to be drawn.
+int LodSettingsBenchmark(const engine::cdlod::FlatQuadTree& tree,
+                         int map_size, int node_dimension) {
+  const int kFrameCount = 100;
+  // A subquad is a grid of node_dimension/2 x node_dimension/2 quads
+  size_t triangles_per_subquad = 2 * (node_dimension/2) * (node_dimension/2);
+
+  size_t last_subquads = 0;
+  for (float max_pixel_error : {8.0f, 4.0f, 2.0f, 1.0f}) {
+    auto lod = engine::cdlod::LodSettings::FromScreenSpaceError(
+        max_pixel_error, M_PI/3, 1080, node_dimension);
+    CountingRenderList render_list;
+    double time = Benchmark(tree, map_size, kFrameCount, false, &render_list,
+                            glm::vec2(-1), lod);
+    size_t subquads = render_list.subquads / kFrameCount;
+
+    std::cout << "Selection with " << max_pixel_error << " px error: "
+              << time << " us/frame, " << subquads << " instances/frame, "
+              << subquads * triangles_per_subquad << " triangles/frame"
+              << std::endl;
+
+    if (subquads <= last_subquads) {
+      std::cout << "Failed: a smaller error didn't select more instances"
+                << std::endl;
+      return 1;
+    }
+    last_subquads = subquads;
+  }
+  return 0;
+}
+
+int main() {
+  const int kMapSize = 8192, kNodeDimension = 16, kFrameCount = 1000;
+  SyntheticHeightMap<float> hmap{kMapSize};
+
+  auto start = Clock::now();
+  engine::cdlod::PointerQuadTree pointer_tree{hmap, kNodeDimension};
+  auto pointer_built = Clock::now();
+  engine::cdlod::FlatQuadTree flat_tree{hmap, kNodeDimension};
+  auto flat_built = Clock::now();
+
+  using Millis = std::chrono::duration<double, std::milli>;
+  std::cout << "Build time (pointer): "
+            << Millis(pointer_built - start).count() << " ms" << std::endl;
+  std::cout << "Build time (flat):    "
+            << Millis(flat_built - pointer_built).count() << " ms" << std::endl;
+
+  for (bool flush_caches : {false, true}) {
+    CountingRenderList pointer_list, flat_list;
+    // Warm up
+    Benchmark(pointer_tree, kMapSize, kFrameCount/10, flush_caches,
+              &pointer_list);
+    Benchmark(flat_tree, kMapSize, kFrameCount/10, flush_caches, &flat_list);
+
+    pointer_list = flat_list = CountingRenderList{};
+    double pointer_time = Benchmark(pointer_tree, kMapSize, kFrameCount,
+                                    flush_caches, &pointer_list);
+    double flat_time = Benchmark(flat_tree, kMapSize, kFrameCount,
+                                 flush_caches, &flat_list);
+
+    std::string caches = flush_caches ? "cold" : "warm";
+    std::cout << "Selection with " << caches << " caches (pointer): "
+              << pointer_time << " us/frame, "
+              << pointer_list.nodes / kFrameCount << " nodes/frame" << std::endl;
+    std::cout << "Selection with " << caches << " caches (flat):    "
+              << flat_time << " us/frame, "
+              << flat_list.nodes / kFrameCount << " nodes/frame" << std::endl;
+
+    if (pointer_list.nodes != flat_list.nodes ||
+        pointer_list.subquads != flat_list.subquads) {
+      std::cout << "Failed: the two layouts selected different nodes"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  if (LodSettingsBenchmark(flat_tree, kMapSize, kNodeDimension)) {
+    return 1;
+  }
+
+  return LargeWorldBenchmark();
+}
@@ -0,0 +1,184 @@
+// Copyright (c) 2014, Tamas Csala
+
+// Places trees on a 65536 x 65536 world, like Tree does (one per 150 x 150
+// units), and compares the queries of StaticBvh with the linear scans over
+// all of the boxes. The results have to be the same.
+
+#include <cmath>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#define GLM_FORCE_RADIANS
+#include <glm/gtc/matrix_transform.hpp>
+#include "../collision/static_bvh.h"
+
+using Clock = std::chrono::high_resolution_clock;
+using Micros = std::chrono::duration<double, std::micro>;
+
+const float kWorldSize = 65536, kTreeDist = 150;
+const int kFrameCount = 200;
+
+bool Same(std::vector<size_t> result, const std::vector<size_t>& reference) {
+  std::sort(result.begin(), result.end());
+  return result == reference;
+}
+
+int main() {
+  std::mt19937 random{42};
+  std::uniform_real_distribution<float> offset{-kTreeDist/4, kTreeDist/4};
+  std::uniform_real_distribution<float> size{10, 40};
+  std::uniform_real_distribution<float> height{0, 200};
+  std::vector<engine::BoundingBox> bboxes;
+  for (float x = kTreeDist; x + kTreeDist < kWorldSize; x += kTreeDist) {
+    for (float z = kTreeDist; z + kTreeDist < kWorldSize; z += kTreeDist) {
+      glm::vec3 pos{x + offset(random), height(random), z + offset(random)};
+      float r = size(random), h = 2*size(random);
+      bboxes.push_back(engine::BoundingBox{pos - glm::vec3(r, 0, r),
+                                           pos + glm::vec3(r, h, r)});
+    }
+  }
+
+  auto build_start = Clock::now();
+  engine::StaticBvh bvh{bboxes};
+  std::cout << bboxes.size() << " trees, built in "
+            << Micros(Clock::now() - build_start).count() / 1000 << " ms"
+            << std::endl;
+
+  // Walks through the world, looking around
+  glm::mat4 proj = glm::perspectiveFov<float>(M_PI/3, 1920, 1080, 0.5, 30000);
+  std::vector<glm::vec3> positions;
+  std::vector<Frustum> frustums;
+  for (int i = 0; i < kFrameCount; ++i) {
+    float angle = 2*M_PI * i / kFrameCount;
+    glm::vec3 pos{kWorldSize/4 + i * 100, 250, kWorldSize/2 + i * 50};
+    glm::vec3 forward{cos(angle), -0.2f, sin(angle)};
+    glm::mat4 cam = glm::lookAt(pos, pos + forward, glm::vec3(0, 1, 0));
+    positions.push_back(pos);
+    frustums.push_back(Frustum::FromMatrix(proj * cam));
+  }
+
+  struct Scenario {
+    const char* name;
+    std::function<bool(const engine::BoundingBox&, int)> reference;
+    std::function<void(int, std::vector<size_t>*)> query;
+  };
+
+  std::vector<Scenario> scenarios{
+    {"Frustum",
+     [&](const engine::BoundingBox& bbox, int f) {
+       return bbox.collidesWithFrustum(frustums[f]);
+     },
+     [&](int f, std::vector<size_t>* result) {
+       bvh.queryFrustum(frustums[f], result);
+     }},
+    {"Frustum and 1500 units",
+     [&](const engine::BoundingBox& bbox, int f) {
+       return bbox.collidesWithFrustum(frustums[f]) &&
+              bbox.collidesWithSphere(positions[f], 1500);
+     },
+     [&](int f, std::vector<size_t>* result) {
+       bvh.queryFrustum(frustums[f], positions[f], 1500, result);
+     }},
+    {"Sphere of 150 units",
+     [&](const engine::BoundingBox& bbox, int f) {
+       return bbox.collidesWithSphere(positions[f], 150);
+     },
+     [&](int f, std::vector<size_t>* result) {
+       bvh.querySphere(positions[f], 150, result);
+     }}
+  };
+
+  std::vector<size_t> reference, result;
+  for (const Scenario& scenario : scenarios) {
+    double linear_time = 0, bvh_time = 0;
+    size_t count = 0;
+    for (int f = 0; f < kFrameCount; ++f) {
+      auto start = Clock::now();
+      reference.clear();
+      for (size_t i = 0; i < bboxes.size(); ++i) {
+        if (scenario.reference(bboxes[i], f)) {
+          reference.push_back(i);
+        }
+      }
+      auto middle = Clock::now();
+      scenario.query(f, &result);
+      auto end = Clock::now();
+
+      linear_time += Micros(middle - start).count();
+      bvh_time += Micros(end - middle).count();
+      count += result.size();
+
+      if (!Same(result, reference)) {
+        std::cout << "Failed: " << scenario.name << " query gave "
+                  << result.size() << " instead of " << reference.size()
+                  << " boxes in frame " << f << std::endl;
+        return 1;
+      }
+    }
+    std::cout << scenario.name << " (" << count / kFrameCount
+              << " boxes/frame): linear " << linear_time / kFrameCount
+              << " us/frame, BVH " << bvh_time / kFrameCount
+              << " us/frame" << std::endl;
+  }
+
+  // Rays from the camera, slightly downwards
+  double linear_time = 0, bvh_time = 0;
+  int hit_count = 0;
+  for (int f = 0; f < kFrameCount; ++f) {
+    for (int r = 0; r < 16; ++r) {
+      float angle = 2*M_PI * (f * 16 + r) / (kFrameCount * 16);
+      glm::vec3 origin = positions[f] - glm::vec3(0, 100, 0);
+      glm::vec3 direction{cos(angle), -0.05f, sin(angle)};
+      glm::vec3 inv_direction = 1.0f / direction;
+
+      auto start = Clock::now();
+      reference.clear();
+      size_t nearest = bboxes.size();
+      float nearest_distance = 5000;
+      for (size_t i = 0; i < bboxes.size(); ++i) {
+        // The same slab test as the BVH's
+        glm::vec3 t1 = (bboxes[i].mins() - origin) * inv_direction;
+        glm::vec3 t2 = (bboxes[i].maxes() - origin) * inv_direction;
+        glm::vec3 tmin = glm::min(t1, t2), tmax = glm::max(t1, t2);
+        float enter = std::max(std::max(tmin.x, tmin.y),
+                               std::max(tmin.z, 0.0f));
+        float exit = std::min(std::min(tmax.x, tmax.y),
+                              std::min(tmax.z, 5000.0f));
+        if (enter <= exit) {
+          reference.push_back(i);
+          if (enter < nearest_distance || nearest == bboxes.size()) {
+            nearest = i;
+            nearest_distance = enter;
+          }
+        }
+      }
+      auto middle = Clock::now();
+      size_t hit;
+      float distance;
+      bool hits = bvh.raycast(origin, direction, 5000, &hit, &distance);
+      auto end = Clock::now();
+      bvh.queryRay(origin, direction, 5000, &result);
+
+      linear_time += Micros(middle - start).count();
+      bvh_time += Micros(end - middle).count();
+      hit_count += hits;
+
+      if (!Same(result, reference) ||
+          hits != (nearest != bboxes.size()) ||
+          (hits && distance != nearest_distance)) {
+        std::cout << "Failed: ray " << r << " in frame " << f << std::endl;
+        return 1;
+      }
+    }
+  }
+  std::cout << "Raycast (" << hit_count << " of " << kFrameCount * 16
+            << " hit): linear " << linear_time / (kFrameCount * 16)
+            << " us/ray, BVH " << bvh_time / (kFrameCount * 16) << " us/ray"
+            << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,104 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_UNIT_TESTS_SYNTHETIC_ANIMATION_H_
+#define ENGINE_UNIT_TESTS_SYNTHETIC_ANIMATION_H_
+
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include "../assimp.h"
+#include <glm/gtc/quaternion.hpp>
+
+// Random skeletons and animations for the tests and the benchmarks, built
+// the same way, as assimp would import them, so they don't depend on any file.
+
+// A random number in [-1, 1]
+inline float Random() {
+  return rand() / float(RAND_MAX) * 2 - 1;
+}
+
+// A node one unit above its parent, with room for four children. The parent
+// owns it, like in a scene imported by assimp.
+inline aiNode* CreateNode(const std::string& name, aiNode* parent) {
+  aiNode* node = new aiNode;
+  node->mName.Set(name);
+  node->mTransformation = engine::convertMatrix(
+    glm::translate(glm::mat4(), glm::vec3(0, 1, 0)));
+  node->mParent = parent;
+  node->mNumChildren = 0;
+  node->mChildren = new aiNode*[4];
+  node->mNumMeshes = 0;
+  node->mMeshes = nullptr;
+  if (parent) {
+    parent->mChildren[parent->mNumChildren++] = node;
+  }
+  return node;
+}
+
+// A chain: root -> bone0 -> bone1 -> ...
+inline aiNode* CreateChain(int bone_num) {
+  aiNode* root = CreateNode("root", nullptr);
+  aiNode* parent = root;
+  for (int i = 0; i < bone_num; ++i) {
+    parent = CreateNode("bone" + std::to_string(i), parent);
+  }
+  return root;
+}
+
+// Random keys for a channel, evenly spaced in [0, duration], but the inner
+// ones are moved by up to jitter times the spacing. The rotation only changes
+// a little from key to key, like in a real animation. If key_num is 1, the
+// channel is constant.
+inline aiNodeAnim* CreateChannel(const std::string& name, unsigned key_num,
+                                 double duration, double jitter = 0) {
+  aiNodeAnim* channel = new aiNodeAnim;
+  channel->mNodeName.Set(name);
+  channel->mNumPositionKeys = channel->mNumRotationKeys =
+    channel->mNumScalingKeys = key_num;
+  channel->mPositionKeys = new aiVectorKey[key_num];
+  channel->mRotationKeys = new aiQuatKey[key_num];
+  channel->mScalingKeys = new aiVectorKey[key_num];
+  glm::quat rot = glm::normalize(glm::quat(Random(), Random(),
+                                           Random(), Random()));
+  for (unsigned k = 0; k < key_num; ++k) {
+    double time = key_num == 1 ? 0 : duration * k / (key_num - 1);
+    if (0 < k && k + 1 < key_num) {
+      time += duration / (key_num - 1) * Random() * jitter;
+    }
+    rot = glm::normalize(rot * glm::quat(1, Random()*0.1f, Random()*0.1f,
+                                         Random()*0.1f));
+    channel->mPositionKeys[k].mTime = time;
+    channel->mPositionKeys[k].mValue = aiVector3D(Random(), Random(), Random());
+    channel->mRotationKeys[k].mTime = time;
+    channel->mRotationKeys[k].mValue = aiQuaternion(rot.w, rot.x, rot.y, rot.z);
+    channel->mScalingKeys[k].mTime = time;
+    channel->mScalingKeys[k].mValue = aiVector3D(1 + Random()*0.1f, 1, 1);
+  }
+  return channel;
+}
+
+// An animation of the "bone0", "bone1", ... nodes, with key_nums[c] keys in
+// the c-th channel. It owns the arrays, like the ones created by assimp.
+inline aiAnimation* CreateAnimation(const std::vector<unsigned>& key_nums,
+                                    double duration, double jitter = 0) {
+  aiAnimation* anim = new aiAnimation;
+  anim->mDuration = duration;
+  anim->mTicksPerSecond = 30;
+  anim->mNumChannels = key_nums.size();
+  anim->mChannels = new aiNodeAnim*[key_nums.size()];
+  for (size_t c = 0; c < key_nums.size(); ++c) {
+    anim->mChannels[c] = CreateChannel("bone" + std::to_string(c),
+                                       key_nums[c], duration, jitter);
+  }
+  return anim;
+}
+
+// The same number of evenly spaced keys in every channel.
+inline aiAnimation* CreateAnimation(int channel_num, unsigned key_num,
+                                    double duration) {
+  return CreateAnimation(std::vector<unsigned>(channel_num, key_num),
+                         duration);
+}
+
+#endif
@@ -0,0 +1,121 @@
+// Copyright (c) 2014, Tamas Csala
+
+#ifndef ENGINE_UNIT_TESTS_SYNTHETIC_HEIGHT_MAP_H_
+#define ENGINE_UNIT_TESTS_SYNTHETIC_HEIGHT_MAP_H_
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+#include "../height_map_interface.h"
+#include "../min_max_pyramid.h"
+
+// The heights of a procedural terrain, in [32, 224]
+inline double SyntheticHeight(int s, int t) {
+  return 128 + 64*sin(s / 97.0) * cos(t / 131.0) + 32*sin((s+t) / 23.0);
+}
+
+// The synthetic heights as texels of an engine::HeightMap<T>, whose texels
+// are multiplied by scale (the normalization times the height scale), plus
+// the offset. They are rounded and clamped like HeightMap::modifyHeights does.
+template<typename T>
+std::vector<T> SyntheticTexels(int w, int h, double scale, double offset) {
+  static_assert(std::is_integral<T>::value, "Only integer texels are rounded");
+  std::vector<T> texels(w*h);
+  for (int t = 0; t < h; ++t) {
+    for (int s = 0; s < w; ++s) {
+      double value = std::round((SyntheticHeight(s, t) - offset) / scale);
+      value = std::max(value, double(std::numeric_limits<T>::lowest()));
+      value = std::min(value, double(std::numeric_limits<T>::max()));
+      texels[t*w + s] = value;
+    }
+  }
+  return texels;
+}
+
+// A procedural heightmap for the tests and the benchmarks, so they don't
+// depend on any file. The heights are in [32, 224], so they fit into 8 bit
+// texels too. The texels are used as they are (without normalization).
+template<typename T>
+class SyntheticHeightMap : public engine::HeightMapInterface {
+  static_assert(std::is_same<T, float>::value ||
+                std::is_same<T, GLubyte>::value,
+                "Only float and 8 bit synthetic heightmaps are supported");
+
+  int w_, h_;
+  std::vector<T> heights_;
+  engine::MinMaxPyramid min_max_pyramid_;
+
+ public:
+  SyntheticHeightMap(int w, int h) : w_(w), h_(h), heights_(w*h) {
+    for (int t = 0; t < h; ++t) {
+      for (int s = 0; s < w; ++s) {
+        heights_[t*w + s] = SyntheticHeight(s, t);
+      }
+    }
+    min_max_pyramid_ = engine::MinMaxPyramid{heights_.data(), w, h};
+  }
+
+  explicit SyntheticHeightMap(int size) : SyntheticHeightMap(size, size) {}
+
+  virtual int w() const override { return w_; }
+  virtual int h() const override { return h_; }
+
+  virtual glm::vec2 extent() const override { return glm::vec2(w_, h_); }
+  virtual glm::vec2 center() const override { return extent() / 2.0f; }
+
+  virtual bool valid(double s, double t) const override {
+    return 0 <= s && s < w_ && 0 <= t && t < h_;
+  }
+
+  virtual double heightAt(int s, int t) const override {
+    return heights_[t*w_ + s];
+  }
+
+  virtual double heightAt(double s, double t) const override {
+    return heightAt(static_cast<int>(s), static_cast<int>(t));
+  }
+
+  virtual gl::PixelDataFormat format() const override {
+    return gl::PixelDataFormat::kRed;
+  }
+
+  virtual gl::PixelDataType type() const override {
+    return std::is_same<T, float>::value ? gl::PixelDataType::kFloat
+                                         : gl::PixelDataType::kUnsignedByte;
+  }
+
+  virtual void upload(gl::Texture2D& tex) const override {}
+
+  virtual const void* data() const override { return heights_.data(); }
+
+  // Rounds and clamps the 8 bit texels, like engine::HeightMap
+  virtual void modifyHeights(int x0, int y0, int x1, int y1,
+                             const HeightModifier& modify) override {
+    x0 = std::max(x0, 0), y0 = std::max(y0, 0);
+    x1 = std::min(x1, w_-1), y1 = std::min(y1, h_-1);
+    for (int t = y0; t <= y1; ++t) {
+      for (int s = x0; s <= x1; ++s) {
+        double height = modify(s, t, heightAt(s, t));
+        if (!std::is_floating_point<T>::value) {
+          height = std::max(std::min(std::round(height), 255.0), 0.0);
+        }
+        heights_[t*w_ + s] = height;
+      }
+    }
+    min_max_pyramid_.update(heights_.data(), 1.0f, 0.0f, x0, y0, x1, y1);
+  }
+
+  virtual glm::dvec2 getMinMaxOfArea(int x, int y,
+                                     int w, int h) const override {
+    return glm::dvec2(min_max_pyramid_.minMaxOfArea(x, y, w, h));
+  }
+
+  virtual const engine::MinMaxPyramid* min_max_pyramid() const override {
+    return &min_max_pyramid_;
+  }
+};
+
+#endif
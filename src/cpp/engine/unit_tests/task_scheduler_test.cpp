@@ -0,0 +1,127 @@
+// Copyright (c) 2014, Tamas Csala
+
+// Checks that the TaskScheduler runs every task, and that when a task
+// throws, the waits still let every other task finish before they rethrow
+// the exception (GameObject::updateComponentsInParallel relies on this, its
+// tasks reference the components).
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+
+#include "../task_scheduler.h"
+
+size_t fail_num = 0;
+
+void Check(bool condition, const std::string& msg) {
+  if (!condition) {
+    std::cout << "Failed: " << msg << std::endl;
+    fail_num++;
+  }
+}
+
+void Sleep() {
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+}
+
+void ParallelForTest(engine::TaskScheduler& scheduler) {
+  const size_t kCount = 1000;
+  std::vector<std::atomic<int>> visits(kCount);
+  for (auto& visit : visits) {
+    visit = 0;
+  }
+  scheduler.parallelFor(0, kCount, [&visits](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      visits[i]++;
+    }
+  });
+  bool once = true;
+  for (auto& visit : visits) {
+    once &= visit == 1;
+  }
+  Check(once, "parallelFor didn't visit every index exactly once");
+}
+
+// The calling thread runs the first chunk, like the first component in
+// updateComponentsInParallel. It throws, while the others are still running.
+void CallingThreadThrowsTest(engine::TaskScheduler& scheduler) {
+  const size_t kCount = 8;
+  std::atomic<size_t> finished{0}, first_end{0};
+  bool thrown = false;
+  try {
+    scheduler.parallelFor(0, kCount, [&](size_t begin, size_t end) {
+      if (begin == 0) {
+        first_end = end;
+        throw std::runtime_error("update failed");
+      }
+      Sleep();
+      finished += end - begin;
+    });
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  Check(thrown, "The exception of the calling thread's chunk was lost");
+  Check(finished == kCount - first_end,
+        "parallelFor rethrew before the other chunks finished");
+}
+
+void WorkerThrowsTest(engine::TaskScheduler& scheduler) {
+  const size_t kCount = 8;
+  std::atomic<size_t> finished{0};
+  bool thrown = false;
+  try {
+    scheduler.parallelFor(0, kCount, [&](size_t begin, size_t end) {
+      if (begin != 0 && begin <= kCount/2 && kCount/2 < end) {
+        throw std::runtime_error("update failed");
+      }
+      Sleep();
+      finished += end - begin;
+    });
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  Check(thrown, "The exception of a worker's chunk was lost");
+  Check(finished < kCount, "No chunk has thrown");
+}
+
+void WaitAllTest(engine::TaskScheduler& scheduler) {
+  std::atomic<bool> slow_task_finished{false};
+  std::vector<engine::TaskScheduler::Handle> tasks;
+  tasks.push_back(scheduler.schedule([]{
+    throw std::runtime_error("task failed");
+  }));
+  tasks.push_back(scheduler.schedule([&slow_task_finished]{
+    Sleep();
+    slow_task_finished = true;
+  }));
+
+  bool thrown = false;
+  try {
+    scheduler.wait(tasks);
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  Check(thrown, "wait didn't rethrow the exception of the task");
+  Check(slow_task_finished, "wait rethrew before every task finished");
+}
+
+int main() {
+  engine::TaskScheduler scheduler{4};
+  ParallelForTest(scheduler);
+  for (int i = 0; i < 20; ++i) {
+    CallingThreadThrowsTest(scheduler);
+    WorkerThrowsTest(scheduler);
+    WaitAllTest(scheduler);
+  }
+
+  if (fail_num) {
+    std::cout << fail_num << " checks failed" << std::endl;
+  } else {
+    std::cout << "All checks passed" << std::endl;
+  }
+  return fail_num != 0;
+}
@@ -0,0 +1,185 @@
+// Copyright (c) 2014, Tamas Csala
+
+// Digs craters into a 16 bit engine::HeightMap, and checks that the
+// incremental updates of the min/max pyramid and of the quadtrees give the
+// same results as rebuilding them, and compares their costs.
+// It doesn't need an OpenGL context.
+
+#include <cmath>
+#include <array>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include <GL/glew.h>
+#define GLM_FORCE_RADIANS
+#include <glm/gtc/matrix_transform.hpp>
+#include "../cdlod/flat_quad_tree.h"
+#include "../cdlod/pointer_quad_tree.h"
+#include "../height_map.h"
+#include "../min_max_pyramid.h"
+#include "./synthetic_height_map.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+size_t fail_num = 0;
+
+void Check(bool condition, const std::string& msg) {
+  if (!condition) {
+    std::cout << "Failed: " << msg << std::endl;
+    fail_num++;
+  }
+}
+
+using HeightMap = engine::HeightMap<unsigned short>;
+
+// 16 bit texels with 1 cm steps, from 400 m below zero, so the craters can
+// go deeper than the synthetic terrain, and the offset matters too
+constexpr float kHeightScale = 655.35f, kHeightOffset = -400.0f;
+
+// A min/max pyramid built from scratch, from the current texels, with the
+// same scale and offset as the HeightMap's own one
+engine::MinMaxPyramid RebuiltPyramid(const HeightMap& hmap) {
+  return engine::MinMaxPyramid{
+      static_cast<const unsigned short*>(hmap.data()), hmap.w(), hmap.h(),
+      float(1.0 / 65535 * hmap.height_scale()), hmap.height_offset()};
+}
+
+// Remembers every selected node
+struct RecordingRenderList {
+  std::vector<std::array<int, 8>> nodes;
+
+  void addToRenderList(GLint x, GLint z, int scale, int level) {
+    addToRenderList(x, z, scale, level, true, true, true, true);
+  }
+
+  void addToRenderList(GLint x, GLint z, int scale, int level,
+                       bool tl, bool tr, bool bl, bool br) {
+    nodes.push_back({{x, z, scale, level, tl, tr, bl, br}});
+  }
+};
+
+// Looks at the crater from a few directions, from near, so that the LOD
+// decisions depend on the bounding boxes of the modified nodes too
+template<typename Tree>
+std::vector<RecordingRenderList> Select(const Tree& tree, glm::vec2 crater) {
+  glm::mat4 proj = glm::perspectiveFov<float>(M_PI/3, 1920, 1080, 0.5, 30000);
+  std::vector<RecordingRenderList> lists;
+  for (int i = 0; i < 8; ++i) {
+    float angle = 2*M_PI * i / 8;
+    glm::vec3 target = glm::vec3(crater.x, 200, crater.y);
+    glm::vec3 pos = target + glm::vec3(cos(angle), 0.5f, sin(angle)) * 300.0f;
+    glm::mat4 cam = glm::lookAt(pos, target, glm::vec3(0, 1, 0));
+    lists.emplace_back();
+    tree.selectNodes(pos, Frustum::FromMatrix(proj * cam), lists.back());
+  }
+  return lists;
+}
+
+template<typename Tree>
+bool SameSelection(const Tree& a, const Tree& b, glm::vec2 crater) {
+  auto lists_a = Select(a, crater), lists_b = Select(b, crater);
+  for (size_t i = 0; i < lists_a.size(); ++i) {
+    if (lists_a[i].nodes != lists_b[i].nodes) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SamePyramid(const engine::MinMaxPyramid& a,
+                 const engine::MinMaxPyramid& b) {
+  if (a.level_count() != b.level_count()) {
+    return false;
+  }
+  for (int level = 0; level < a.level_count(); ++level) {
+    if (a.level(level).mins != b.level(level).mins ||
+        a.level(level).maxes != b.level(level).maxes) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main() {
+  const int kMapSize = 4096, kNodeDimension = 16, kCraterCount = 50;
+  std::vector<unsigned short> texels = SyntheticTexels<unsigned short>(
+      kMapSize, kMapSize, 1.0 / 65535 * kHeightScale, kHeightOffset);
+  HeightMap hmap{kMapSize, kMapSize, texels.data(), "R",
+                 kHeightScale, kHeightOffset};
+  engine::cdlod::FlatQuadTree flat_tree{hmap, kNodeDimension};
+  engine::cdlod::PointerQuadTree pointer_tree{hmap, kNodeDimension};
+
+  std::mt19937 random{42};
+  std::uniform_int_distribution<int> coord{-32, kMapSize + 32};
+  std::uniform_int_distribution<int> radius{1, 48};
+  Clock::duration update_time{0};
+  for (int i = 0; i < kCraterCount; ++i) {
+    // Some of the craters are at the edges, and they are deeper than the
+    // lowest point of the terrain, so the bounding boxes have to grow
+    glm::ivec2 center{coord(random), coord(random)};
+    int r = radius(random);
+    if (i % 10 == 0) {
+      center = glm::ivec2(0, kMapSize - 1);
+    }
+    glm::ivec4 rect{center.x - r, center.y - r, center.x + r, center.y + r};
+    auto dig = [center, r](int s, int t, double height) {
+      double d = glm::length(glm::vec2(s - center.x, t - center.y)) / r;
+      return d < 1 ? height - 200 * (1 - d*d) : height;
+    };
+
+    bool inside = 0 <= center.x && center.x < kMapSize &&
+                  0 <= center.y && center.y < kMapSize;
+    double old_height = inside ? hmap.heightAt(center.x, center.y) : 0;
+
+    auto start = Clock::now();
+    hmap.modifyHeights(rect.x, rect.y, rect.z, rect.w, dig);
+    flat_tree.updateHeights(hmap, rect.x, rect.y, rect.z, rect.w);
+    pointer_tree.updateHeights(hmap, rect.x, rect.y, rect.z, rect.w);
+    update_time += Clock::now() - start;
+
+    // The new height is quantized to the nearest texel, and clamped to the
+    // range of them
+    if (inside) {
+      double expected = std::max(old_height - 200, double(kHeightOffset));
+      Check(std::abs(hmap.heightAt(center.x, center.y) - expected) < 0.0051,
+            "The modified height isn't the nearest texel");
+    }
+
+    if (i % 10 == 9 || i == kCraterCount - 1) {
+      Check(SamePyramid(*hmap.min_max_pyramid(), RebuiltPyramid(hmap)),
+            "The updated min/max pyramid differs from a rebuilt one");
+
+      glm::vec2 crater = glm::clamp(glm::vec2(center), glm::vec2(0),
+                                    glm::vec2(kMapSize - 1));
+      Check(SameSelection(flat_tree, engine::cdlod::FlatQuadTree{
+                              hmap, kNodeDimension}, crater),
+            "The updated flat quadtree differs from a rebuilt one");
+      Check(SameSelection(pointer_tree, engine::cdlod::PointerQuadTree{
+                              hmap, kNodeDimension}, crater),
+            "The updated pointer quadtree differs from a rebuilt one");
+    }
+  }
+
+  auto start = Clock::now();
+  engine::MinMaxPyramid rebuilt_pyramid = RebuiltPyramid(hmap);
+  engine::cdlod::FlatQuadTree rebuilt_flat_tree{hmap, kNodeDimension};
+  engine::cdlod::PointerQuadTree rebuilt_pointer_tree{hmap, kNodeDimension};
+  auto end = Clock::now();
+
+  using Micros = std::chrono::duration<double, std::micro>;
+  std::cout << "Updating after a crater: "
+            << Micros(update_time).count() / kCraterCount << " us" << std::endl;
+  std::cout << "Rebuilding after a crater: " << Micros(end - start).count()
+            << " us" << std::endl;
+
+  if (fail_num) {
+    std::cout << fail_num << " checks failed" << std::endl;
+  } else {
+    std::cout << "All checks passed" << std::endl;
+  }
+  return fail_num != 0;
+}
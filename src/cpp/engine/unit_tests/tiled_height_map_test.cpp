@@ -0,0 +1,211 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#include "../tiled_height_map.h"
+#include "../cdlod/tile_cache.h"
+#include "./synthetic_height_map.h"
+
+size_t fail_num = 0;
+
+void Check(bool condition, const std::string& msg) {
+  if (!condition) {
+    std::cout << "Failed: " << msg << std::endl;
+    fail_num++;
+  }
+}
+
+const char* kFileName = "tiled_height_map_test.lthm";
+
+void FormatTest(const SyntheticHeightMap<GLubyte>& source) {
+  engine::TiledHeightMap hmap{kFileName};
+  Check(hmap.w() == source.w() && hmap.h() == source.h(), "Size");
+  Check(hmap.level_count() == 5, "Level count");
+  Check(hmap.tiles_x(hmap.level_count() - 1) == 1 &&
+        hmap.tiles_y(hmap.level_count() - 1) == 1, "Single coarsest tile");
+
+  bool heights_match = true;
+  for (int t = 0; t < source.h(); ++t) {
+    for (int s = 0; s < source.w(); ++s) {
+      heights_match &= hmap.heightAt(s, t) == source.heightAt(s, t);
+    }
+  }
+  Check(heights_match, "Heights of the finest level");
+
+  // A level's texels are the heights at every 2^level-th texel
+  int ts = hmap.tile_size();
+  bool tiles_match = true;
+  for (int level = 0; level < hmap.level_count(); ++level) {
+    for (int ty = 0; ty < hmap.tiles_y(level); ++ty) {
+      for (int tx = 0; tx < hmap.tiles_x(level); ++tx) {
+        const GLubyte* tile = hmap.tile(level, tx, ty);
+        for (int j = 0; j <= ts; ++j) {
+          int t = std::min((ty*ts + j) << level, source.h() - 1);
+          for (int i = 0; i <= ts; ++i) {
+            int s = std::min((tx*ts + i) << level, source.w() - 1);
+            tiles_match &= tile[j*(ts+1) + i] == source.heightAt(s, t);
+          }
+        }
+      }
+    }
+  }
+  Check(tiles_match, "Texels of the tiles");
+
+  // The areas of the quadtree nodes are aligned, so they are exact
+  for (int size = 128; size <= 1024; size *= 2) {
+    for (int z = size/2; z < source.h(); z += size) {
+      for (int x = size/2; x < source.w(); x += size) {
+        double min = 255, max = 0;
+        for (int t = z - size/2; t <= std::min(z + size/2, source.h()-1); ++t) {
+          for (int s = x - size/2; s <= std::min(x + size/2, source.w()-1); ++s) {
+            min = std::min(min, source.heightAt(s, t));
+            max = std::max(max, source.heightAt(s, t));
+          }
+        }
+        glm::dvec2 min_max = hmap.getMinMaxOfArea(x, z, size, size);
+        Check(min_max.x == min && min_max.y == max,
+              "Min/max of a node of size " + std::to_string(size));
+      }
+    }
+  }
+
+  {
+    std::ofstream os{"not_a_tiled_height_map.lthm", std::ios::binary};
+    os << "This isn't a tiled heightmap, but it's long enough for a header.";
+  }
+  try {
+    engine::TiledHeightMap invalid{"not_a_tiled_height_map.lthm"};
+    Check(false, "Loading an invalid file should throw");
+  } catch (const std::runtime_error&) {}
+  std::remove("not_a_tiled_height_map.lthm");
+}
+
+// Runs update() until every requested tile is uploaded (or can't be, for the
+// lack of slots), requesting the same nodes every frame. Stores the uploads
+// in slots.
+void Stream(engine::cdlod::TileCache& cache,
+            const std::vector<glm::vec4>& nodes,
+            std::vector<std::vector<GLubyte>>& slots) {
+  auto upload = [&](int slot, const GLubyte* texels) {
+    slots[slot].assign(texels, texels + cache.height_map().tile_texel_count());
+  };
+  // The decodes run on the workers, so the frames can't be counted. The
+  // cache is stable, when an update doesn't change anything, and doesn't
+  // leave (or start) any decode behind.
+  const auto kTimeout = std::chrono::seconds(10);
+  auto start = std::chrono::steady_clock::now();
+  while (true) {
+    for (const glm::vec4& node : nodes) {
+      cache.request(node.x, node.y, node.z, node.w);
+    }
+    bool changed = cache.update(upload);
+    if (!changed && cache.pending_count() == 0) {
+      return;
+    }
+    if (std::chrono::steady_clock::now() - start > kTimeout) {
+      Check(false, "The streaming doesn't settle");
+      return;
+    }
+    std::this_thread::yield();
+  }
+}
+
+// Checks that the page table entry of the tile at (s, t) is on the expected
+// level, and points to an uploaded tile, that has the height of the texel
+// at (s, t) (which is rounded down to that level's texel spacing)
+bool CheckPageTable(const engine::cdlod::TileCache& cache,
+                    const std::vector<std::vector<GLubyte>>& slots,
+                    int s, int t, int expected_level) {
+  const engine::TiledHeightMap& hmap = cache.height_map();
+  int ts = hmap.tile_size();
+  int px = s / ts, py = t / ts;
+  int slot = cache.page_table()[2*(py*cache.page_table_w() + px)];
+  int level = cache.page_table()[2*(py*cache.page_table_w() + px) + 1];
+  int i = (s - (px >> level) * (ts << level)) >> level;
+  int j = (t - (py >> level) * (ts << level)) >> level;
+  return level == expected_level &&
+         slots[slot][j*(ts+1) + i] == hmap.heightAt(s >> level << level,
+                                                     t >> level << level);
+}
+
+void StreamingTest() {
+  engine::TiledHeightMap hmap{kFileName};
+  int ts = hmap.tile_size();
+  std::vector<std::vector<GLubyte>> slots(8);
+  engine::cdlod::TileCache cache{hmap, 8, 2};
+
+  // The first update always loads the coarsest level
+  cache.update([&](int slot, const GLubyte* texels) {
+    slots[slot].assign(texels, texels + hmap.tile_texel_count());
+  });
+  int top = hmap.level_count() - 1;
+  Check(cache.isResident(top, 0, 0), "The coarsest tile is loaded at start");
+  Check(CheckPageTable(cache, slots, 300, 300, top),
+        "Everything falls back to the coarsest level");
+
+  // A level 0 node, that has the size of a tile, only needs that tile
+  Stream(cache, {glm::vec4(ts + ts/2, ts + ts/2, ts, 0)}, slots);
+  Check(cache.isResident(0, 1, 1), "Requested tile is loaded");
+  Check(!cache.isResident(0, 0, 0) && !cache.isResident(0, 2, 1),
+        "Neighbouring tiles aren't loaded");
+  Check(CheckPageTable(cache, slots, ts + 10, ts + 50, 0),
+        "Page table points to the finest tile");
+  Check(CheckPageTable(cache, slots, 2*ts + 10, 10, top),
+        "Page table falls back around the finest tile");
+
+  // A level 1 node, that spans the tiles (0..1, 0..1) of level 1
+  Stream(cache, {glm::vec4(2*ts, 2*ts, 256, 1)}, slots);
+  for (int y = 0; y < 2; ++y) {
+    for (int x = 0; x < 2; ++x) {
+      Check(cache.isResident(1, x, y), "Level 1 tiles are loaded");
+    }
+  }
+  Check(CheckPageTable(cache, slots, ts + 10, ts + 50, 0),
+        "Finer tiles are kept while there's room");
+  Check(CheckPageTable(cache, slots, 10, 10, 1),
+        "Page table points to the level 1 tile");
+
+  // More tiles than slots: the least recently used ones are evicted, but
+  // never the coarsest, and never the ones that are used.
+  std::vector<glm::vec4> nodes;
+  for (int y = 0; y < 2; ++y) {
+    for (int x = 0; x < 3; ++x) {
+      nodes.push_back(glm::vec4(x*ts + ts/2, y*ts + ts/2, ts, 0));
+    }
+  }
+  Stream(cache, nodes, slots);
+  Check(cache.resident_count() == 8, "Every slot is used");
+  Check(cache.isResident(top, 0, 0), "The coarsest tile is never evicted");
+  for (int y = 0; y < 2; ++y) {
+    for (int x = 0; x < 3; ++x) {
+      Check(cache.isResident(0, x, y), "Used tiles are loaded");
+      Check(CheckPageTable(cache, slots, x*ts + 5, y*ts + 5, 0),
+            "Page table of used tiles");
+    }
+  }
+}
+
+int main() {
+  // The size isn't a multiple of the tile size
+  SyntheticHeightMap<GLubyte> source{1000, 700};
+  engine::TiledHeightMap::Write(kFileName, source, 64);
+
+  FormatTest(source);
+  StreamingTest();
+  std::remove(kFileName);
+
+  if (fail_num) {
+    std::cout << fail_num << " checks failed" << std::endl;
+  } else {
+    std::cout << "All tests passed" << std::endl;
+  }
+  return fail_num != 0;
+}
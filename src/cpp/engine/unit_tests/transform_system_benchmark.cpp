@@ -0,0 +1,177 @@
+// Copyright (c) 2014, Tamas Csala
+
+#include <chrono>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+
+#include <GL/glew.h>
+#include "../../oglwrap/debug/insertion.h"
+#include "../misc.h"
+#include "../transform.h"
+#include "../transform_system.h"
+
+// Moves 10000 objects (1000 roots with 9 descendants each) in every frame,
+// and compares the world matrix calculation of the TransformSystem with
+// the one of the individually allocated Transforms.
+
+using Clock = std::chrono::high_resolution_clock;
+using Micros = std::chrono::duration<double, std::micro>;
+using Handle = engine::TransformSystem::Handle;
+
+constexpr int kRootNum = 1000, kDescendantNum = 9, kFrames = 1000;
+size_t fail_num = 0;
+
+float Random() {
+  return rand() / float(RAND_MAX) * 2 - 1;
+}
+
+void CheckMatrices(const glm::mat4& a, const glm::mat4& b,
+                   const std::string& msg) {
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      if (fabs(a[i][j] - b[i][j]) > 1e-3f) {
+        std::cout << "Failed: " << msg << std::endl;
+        fail_num++;
+        return;
+      }
+    }
+  }
+}
+
+// Parent of the i-th descendant of a root (-1 means the root itself)
+int ParentOf(int i) {
+  return i % 3 == 0 ? -1 : i - 1;
+}
+
+// Destroys every other one of many siblings. A destroy only visits the
+// children of the destroyed and of the moved transform, so this is linear.
+void DestroyTest() {
+  const int kChildNum = 20000;
+  engine::TransformSystem system;
+  Handle root = system.create();
+  std::vector<Handle> children;
+  for (int i = 0; i < kChildNum; ++i) {
+    children.push_back(system.create(root));
+  }
+
+  auto start = Clock::now();
+  for (int i = 0; i < kChildNum; i += 2) {
+    system.destroy(children[i]);
+  }
+  double destroy_time = Micros(Clock::now() - start).count();
+
+  bool ok = system.size() == kChildNum/2 + 1;
+  for (int i = 0; i < kChildNum; ++i) {
+    ok &= system.valid(children[i]) == (i % 2 == 1);
+    if (i % 2 == 1) {
+      ok &= system.parent(children[i]).id == root.id;
+    }
+  }
+  system.destroy(root);
+  for (int i = 1; i < kChildNum; i += 2) {
+    ok &= !system.valid(system.parent(children[i]));
+  }
+  if (!ok) {
+    std::cout << "Failed: destroying siblings" << std::endl;
+    fail_num++;
+  }
+  std::cout << "Destroying " << kChildNum/2 << " siblings: " << destroy_time
+            << " us" << std::endl;
+}
+
+int main() {
+  DestroyTest();
+
+  engine::TransformSystem system;
+  std::vector<Handle> handles;
+  std::vector<std::unique_ptr<engine::Transform>> transforms;
+
+  for (int r = 0; r < kRootNum; ++r) {
+    int root = handles.size();
+    handles.push_back(system.create());
+    transforms.push_back(engine::make_unique<engine::Transform>());
+    for (int i = 0; i < kDescendantNum; ++i) {
+      int parent = ParentOf(i) == -1 ? root : root + 1 + ParentOf(i);
+      handles.push_back(system.create(handles[parent]));
+      transforms.push_back(engine::make_unique<engine::Transform>());
+      transforms.back()->set_parent(transforms[parent].get());
+
+      glm::vec3 pos{Random(), Random(), Random()};
+      glm::quat rot = glm::normalize(glm::quat(Random(), Random(),
+                                               Random(), Random()));
+      system.set_local_pos(handles.back(), pos);
+      system.set_local_rot(handles.back(), rot);
+      transforms.back()->set_local_pos(pos);
+      transforms.back()->set_local_rot(rot);
+    }
+  }
+
+  // Reparent some objects to later created ones, which has to reorder
+  // the arrays of the system
+  for (int r = 0; r + 1 < kRootNum; r += 7) {
+    int child = r * (kDescendantNum + 1), parent = child + kDescendantNum + 1;
+    system.set_parent(handles[child], handles[parent]);
+    transforms[child]->set_parent(transforms[parent].get());
+  }
+
+  // Destroying an object makes its children roots
+  {
+    auto extra = system.create();
+    system.set_parent(handles[1], extra);
+    system.destroy(extra);
+    if (system.parent(handles[1]).id != Handle{}.id || system.valid(extra)) {
+      std::cout << "Failed: destroying a parent" << std::endl;
+      fail_num++;
+    }
+    system.set_parent(handles[1], handles[0]);
+  }
+
+  double system_time = 0, transform_time = 0;
+  glm::mat4 sink;
+  for (int frame = 0; frame < kFrames; ++frame) {
+    glm::quat rot = glm::angleAxis(frame * 0.01f, glm::vec3(0, 1, 0));
+    glm::vec3 pos{frame * 0.1f, 0, 0};
+
+    auto start = Clock::now();
+    for (int r = 0; r < kRootNum; ++r) {
+      Handle root = handles[r * (kDescendantNum + 1)];
+      system.set_local_pos(root, pos);
+      system.set_local_rot(root, rot);
+    }
+    system.update();
+    for (size_t i = 0; i < handles.size(); ++i) {
+      sink += system.world_matrix(handles[i]);
+    }
+    system_time += Micros(Clock::now() - start).count();
+
+    start = Clock::now();
+    for (int r = 0; r < kRootNum; ++r) {
+      engine::Transform& root = *transforms[r * (kDescendantNum + 1)];
+      root.set_local_pos(pos);
+      root.set_local_rot(rot);
+    }
+    for (size_t i = 0; i < transforms.size(); ++i) {
+      sink += transforms[i]->localToWorldMatrix();
+    }
+    transform_time += Micros(Clock::now() - start).count();
+
+    if (frame % 100 == 0) {
+      for (size_t i = 0; i < handles.size(); ++i) {
+        CheckMatrices(system.world_matrix(handles[i]),
+                      transforms[i]->localToWorldMatrix(),
+                      "World matrix of object " + std::to_string(i));
+      }
+    }
+  }
+
+  std::cout << handles.size() << " objects, per frame:" << std::endl;
+  std::cout << "TransformSystem: " << system_time / kFrames << " us" << std::endl;
+  std::cout << "Transform:       " << transform_time / kFrames << " us" << std::endl;
+  std::cout << "(" << sink[0][0] << ")" << std::endl;
+
+  if (fail_num) {
+    std::cout << fail_num << " checks failed" << std::endl;
+  }
+  return fail_num != 0;
+}
@@ -1,6 +1,8 @@
 // Copyright (c) 2014, Tamas Csala
 
 #include <ctime>
+#include <chrono>
+#include <vector>
 #include <cstdlib>
 #include <iostream>
 
@@ -59,8 +61,21 @@ void AssertEquals(const glm::dquat& a, const glm::dquat& b, const std::string& m
   }
 }
 
+void AssertEquals(const glm::dmat4& a, const glm::dmat4& b, const std::string& msg) {
+  bool failure = false;
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      failure |= CheckDouble(a[i][j], b[i][j]);
+    }
+  }
+  if (failure) {
+    std::cout << "Failed: " + msg << std::endl;
+    fail_num++;
+  }
+}
+
 void AssertEquals(const Transform& a, const Transform& b, const std::string& msg) {
-  AssertEquals(a.getParent(), b.getParent(), msg);
+  AssertEquals(a.parent(), b.parent(), msg);
   AssertEquals(a.local_pos(), b.local_pos(), msg);
   AssertEquals(a.local_rot(), b.local_rot(), msg);
   AssertEquals(a.local_scale(), b.local_scale(), msg);
@@ -86,8 +101,8 @@ glm::dquat RandomQuat() {
 void TestParentChild(Transform& parent,
                      Transform& child,
                      Transform& grand_child) {
-  AssertEquals(&parent, child.getParent(), "Setting up parent relation");
-  AssertEquals(&child, parent.getChildren()[0], "Setting up child relation");
+  AssertEquals(&parent, child.parent(), "Setting up parent relation");
+  AssertEquals(&child, parent.children()[0], "Setting up child relation");
   AssertEquals(parent.pos(), child.pos(), "Location inheriting");
   AssertEquals(child.pos(), grand_child.pos(), "Two levels Location inheriting");
 }
@@ -187,7 +202,7 @@ void DirectionTest() {
 
 
 int GetParentsNum(Transform* t) {
-  Transform* parent = t->getParent();
+  Transform* parent = t->parent();
   if (parent) {
     return GetParentsNum(parent) + 1;
   } else {
@@ -235,13 +250,130 @@ void GlobalSettings(Transform& t) {
   AssertEquals(t.rot()*v, -v, "Setting rot with 'v', '-v'" + prnts);
 }
 
+// Calculates the matrix from the local values through the whole parent
+// chain, without touching the caches, like the transforms used to.
+glm::dmat4 UncachedLocalToWorld(const Transform& t) {
+  glm::dmat4 local = glm::scale(glm::mat4_cast(t.local_rot()), t.local_scale());
+  local[3] = glm::dvec4(t.local_pos(), 1);
+  if (t.parent()) {
+    return UncachedLocalToWorld(*t.parent()) * local;
+  } else {
+    return local;
+  }
+}
+
+void CheckCaches(const std::vector<Transform*>& transforms,
+                 const std::string& msg) {
+  for (Transform* t : transforms) {
+    glm::dmat4 expected = UncachedLocalToWorld(*t);
+    AssertEquals(t->localToWorldMatrix(), expected, "World matrix " + msg);
+    AssertEquals(t->worldToLocalMatrix(), glm::inverse(expected),
+                 "Inverse matrix " + msg);
+  }
+}
+
+// Modifies random nodes of a tree in every possible way, and checks after
+// every modification that the cached matrices of all of them are up-to-date.
+void CacheEquivalenceTest() {
+  const int kNodeNum = 32;
+  std::vector<Transform> nodes(kNodeNum);
+  std::vector<Transform*> all;
+  for (int i = 0; i < kNodeNum; ++i) {
+    all.push_back(&nodes[i]);
+    // Mostly a deep chain, with some branches
+    if (i > 0) {
+      nodes[i].set_parent(&nodes[i % 5 == 0 ? rand() % i : i-1]);
+    }
+    nodes[i].set_local_pos(RandomVec() / 100.0);
+    nodes[i].set_local_scale(glm::dvec3(1) + RandomVec() / 1000.0);
+  }
+  CheckCaches(all, "after construction");
+
+  for (int i = 0; i < 1000; ++i) {
+    int idx = rand() % kNodeNum;
+    Transform& t = nodes[idx];
+    switch (rand() % 8) {
+      case 0: t.set_local_pos(RandomVec() / 100.0); break;
+      case 1: t.set_local_rot(glm::normalize(RandomQuat())); break;
+      case 2: t.set_local_scale(glm::dvec3(1) + RandomVec() / 1000.0); break;
+      case 3: t.set_pos(RandomVec()); break;
+      case 4: t.set_rot(glm::normalize(RandomQuat())); break;
+      case 5: t.set_scale(glm::dvec3(1) + RandomVec() / 1000.0); break;
+      case 6: t.set_forward(RandomVec()); break;
+      case 7: {
+        // Reparent to a node with smaller index, so there's no cycle
+        t.set_parent(idx > 0 ? &nodes[rand() % idx] : nullptr);
+      } break;
+    }
+    CheckCaches(all, "after modification " + std::to_string(i));
+  }
+
+  // A copy has the same matrices, but doesn't take the children
+  Transform copy = nodes[kNodeNum/2];
+  AssertEquals(copy.localToWorldMatrix(), nodes[kNodeNum/2].localToWorldMatrix(),
+               "Copy's world matrix");
+  AssertEquals(copy.children().size(), size_t(0), "Copy's children");
+
+  // Destroying a parent detaches its children
+  {
+    Transform parent;
+    parent.set_pos(RandomVec());
+    nodes[0].set_parent(&parent);
+  }
+  AssertEquals(nodes[0].parent(), (Transform*)nullptr, "Destroyed parent");
+  CheckCaches(all, "after the parent is destroyed");
+}
+
+// Compares the cached and the uncached matrix calculation on a deep chain,
+// where only the root moves, but the leaf is queried many times per "frame".
+void DeepChainBenchmark() {
+  using Clock = std::chrono::high_resolution_clock;
+  const int kDepth = 64, kFrames = 1000, kQueriesPerFrame = 16;
+
+  std::vector<Transform> chain(kDepth);
+  for (int i = 1; i < kDepth; ++i) {
+    chain[i].set_parent(&chain[i-1]);
+    chain[i].set_local_pos(glm::dvec3(0, 1, 0));
+    chain[i].set_local_rot(glm::normalize(glm::dquat(1, 0.01, 0, 0)));
+  }
+  Transform& leaf = chain.back();
+
+  double sum = 0;  // so the calculations can't be optimized out
+  auto start = Clock::now();
+  for (int frame = 0; frame < kFrames; ++frame) {
+    chain.front().set_local_pos(glm::dvec3(frame, 0, 0));
+    for (int i = 0; i < kQueriesPerFrame; ++i) {
+      sum += leaf.pos().x + leaf.worldToLocalMatrix()[3][0];
+    }
+  }
+  auto cached_end = Clock::now();
+  for (int frame = 0; frame < kFrames; ++frame) {
+    for (int i = 0; i < kQueriesPerFrame; ++i) {
+      glm::dmat4 m = UncachedLocalToWorld(leaf);
+      sum += m[3][0] + glm::inverse(m)[3][0];
+    }
+  }
+  auto uncached_end = Clock::now();
+
+  using Micros = std::chrono::duration<double, std::micro>;
+  std::cout << "Depth " << kDepth << " chain, " << kQueriesPerFrame
+            << " queries per frame:" << std::endl;
+  std::cout << "  cached:   "
+            << Micros(cached_end - start).count() / kFrames
+            << " us/frame" << std::endl;
+  std::cout << "  uncached: "
+            << Micros(uncached_end - cached_end).count() / kFrames
+            << " us/frame" << std::endl;
+  if (std::isnan(sum)) { std::cout << std::endl; }
+}
+
 int main() {
   srand(time(nullptr));
 
   Transform parent, child, grand_child;
   parent.set_pos(RandomVec());
-  parent.addChild(child);
-  child.addChild(grand_child);
+  child.set_parent(&parent);
+  grand_child.set_parent(&child);
   TestParentChild(parent, child, grand_child);
 
   // Test with a thousand random transformations
@@ -255,6 +387,9 @@ int main() {
   GlobalSettings(child);
   GlobalSettings(grand_child);
 
+  CacheEquivalenceTest();
+  DeepChainBenchmark();
+
   if (fail_num) {
     std::cout << "Number of failures: " << fail_num << std::endl;
   } else {
@@ -2,12 +2,16 @@
 
 #include "./main_scene.h"
 
-#include <iostream>
+#include <memory>
 #include <string>
+#include <vector>
+#include <utility>
+#include <iostream>
 
 #include "../engine/rigid_body.h"
 #include "../engine/game_engine.h"
 #include "../engine/shader_manager.h"
+#include "../engine/task_scheduler.h"
 
 #include "../charmove.h"
 #include "../skybox.h"
@@ -47,6 +51,26 @@ MainScene::MainScene() {
     glfwSwapBuffers(window);
   PrintDebugTime();
 
+  // The meshes are loaded in on the scheduler, while the skybox, the shadow
+  // maps and the terrain are initialized. Only their OpenGL setup has to wait
+  // for Ayumi's and the trees' constructors. The tasks share the results, so
+  // these stay alive, even if an initialization throws before the wait.
+  struct MeshImports {
+    std::unique_ptr<Assimp::Importer> ayumi;
+    Tree::MeshImports trees;
+  };
+  auto meshes = std::make_shared<MeshImports>();
+  engine::TaskScheduler& scheduler = engine::TaskScheduler::Default();
+  std::vector<engine::TaskScheduler::Handle> mesh_imports;
+  mesh_imports.push_back(scheduler.schedule([meshes] {
+    meshes->ayumi = Ayumi::ImportMesh();
+  }));
+  for (size_t i = 0; i < meshes->trees.size(); ++i) {
+    mesh_imports.push_back(scheduler.schedule([meshes, i] {
+      meshes->trees[i] = Tree::ImportMesh(i);
+    }));
+  }
+
   PrintDebugText("Initializing the skybox");
     Skybox *skybox = addComponent<Skybox>();
   PrintDebugTime();
@@ -61,8 +85,12 @@ MainScene::MainScene() {
   PrintDebugTime();
   const engine::HeightMapInterface& height_map = terrain->height_map();
 
+  PrintDebugText("Waiting for the meshes");
+    scheduler.wait(mesh_imports);
+  PrintDebugTime();
+
   PrintDebugText("Initializing Ayumi");
-    Ayumi *ayumi = addComponent<Ayumi>();
+    Ayumi *ayumi = addComponent<Ayumi>(std::move(meshes->ayumi));
     ayumi->addComponent<engine::RigidBody>(ayumi->transform(), height_map, 0);
 
     CharacterMovement *charmove = ayumi->addComponent<CharacterMovement>();
@@ -90,7 +118,7 @@ MainScene::MainScene() {
   PrintDebugTime();
 
   PrintDebugText("Initializing the trees");
-    addComponent<Tree>(height_map);
+    addComponent<Tree>(height_map, std::move(meshes->trees));
   PrintDebugTime();
 
   PrintDebugText("Initializing the resources for the after effects");
@@ -47,6 +47,10 @@ glm::mat4 Shadow::projMat(float size) const {
   return glm::ortho<float>(-size, size, -size, size, 0, 2*size);
 }
 
+glm::vec3 Shadow::getLightSourcePos() const {
+  return skybox_->getLightSourcePos();
+}
+
 glm::mat4 Shadow::camMat(glm::vec3 lightSrcPos,
                          glm::vec4 targetBSphere) const {
   return glm::lookAt(
@@ -55,9 +59,7 @@ glm::mat4 Shadow::camMat(glm::vec3 lightSrcPos,
     glm::vec3(0, 1, 0));
 }
 
-glm::mat4 Shadow::modelCamProjMat(glm::vec4 targetBSphere,
-                                  glm::mat4 modelMatrix,
-                                  glm::mat4 worldTransform) {
+glm::mat4 Shadow::camProjMat(glm::vec4 targetBSphere, glm::mat4 modelMatrix) {
   // [-1, 1] -> [0, 1] convert
   glm::mat4 biasMatrix(
     0.5, 0.0, 0.0, 0.0,
@@ -75,6 +77,13 @@ glm::mat4 Shadow::modelCamProjMat(glm::vec4 targetBSphere,
 
   cp_matrices_[curr_depth_] = biasMatrix * pc;
 
+  return pc;
+}
+
+glm::mat4 Shadow::modelCamProjMat(glm::vec4 targetBSphere,
+                                  glm::mat4 modelMatrix,
+                                  glm::mat4 worldTransform) {
+  glm::mat4 pc = camProjMat(targetBSphere, modelMatrix);
   return static_cast<glm::mat4>(pc * modelMatrix * worldTransform);
 }
 
@@ -102,6 +111,10 @@ void Shadow::setViewPort() {
   gl::Viewport(x*size_, y*size_, size_, size_);
 }
 
+void Shadow::setAtlasViewPort() {
+  gl::Viewport(0, 0, xsize_*size_, ysize_*size_);
+}
+
 void Shadow::push() {
   if (curr_depth_ < max_depth_) {
     ++curr_depth_;
@@ -18,7 +18,11 @@ class Shadow : public engine::GameObject {
          int atlas_x_size, int atlas_y_size);
   virtual void screenResized(size_t width, size_t height) override;
   glm::mat4 projMat(float size) const;
+  glm::vec3 getLightSourcePos() const;
   glm::mat4 camMat(glm::vec3 lightSrcPos, glm::vec4 targetBSphere) const;
+  // The projection * camera matrix of the current shadow map, that is
+  // targeted at the bounding sphere (in model space)
+  glm::mat4 camProjMat(glm::vec4 targetBSphere, glm::mat4 modelMatrix);
   glm::mat4 modelCamProjMat(glm::vec4 targetBSphere,
                             glm::mat4 modelMatrix,
                             glm::mat4 worldTransform = glm::mat4());
@@ -30,6 +34,8 @@ class Shadow : public engine::GameObject {
   }
 
   void setViewPort();
+  // The whole atlas, for drawing into more shadow maps at once
+  void setAtlasViewPort();
   void begin();
   void push();
   size_t getDepth() const;
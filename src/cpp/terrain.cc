@@ -2,23 +2,40 @@
 
 #include "./terrain.h"
 #include <string>
+#include <fstream>
 
 #include "engine/scene.h"
 
+// The tiled heightmap can be created from the png with
+// engine::TiledHeightMap::Write
+static std::unique_ptr<engine::HeightMapInterface> LoadHeightMap() {
+  const char* tiled_file = "src/resources/terrain/terrain.lthm";
+  if (std::ifstream{tiled_file}) {
+    return engine::make_unique<engine::TiledHeightMap>(tiled_file);
+  } else {
+    return engine::make_unique<engine::HeightMap<GLubyte>>(
+        "src/resources/terrain/terrain.png");
+  }
+}
+
 Terrain::Terrain(engine::GameObject* parent)
     : engine::GameObject(parent)
-    , height_map_("src/resources/terrain/terrain.png")
-    , mesh_(scene_->shader_manager(), height_map_)
+    , height_map_(LoadHeightMap())
+    , mesh_(scene_->shader_manager(), *height_map_)
     , prog_(scene_->shader_manager()->get("terrain.vert"),
             scene_->shader_manager()->get("terrain.frag"))
     , uProjectionMatrix_(prog_, "uProjectionMatrix")
     , uCameraMatrix_(prog_, "uCameraMatrix")
+    , uRebasedCameraMatrix_(prog_, "uRebasedCameraMatrix")
     , uModelMatrix_(prog_, "uModelMatrix")
     , uShadowCP_(prog_, "uShadowCP")
     , uNumUsedShadowMaps_(prog_, "uNumUsedShadowMaps")
     , uShadowAtlasSize_(prog_, "uShadowAtlasSize") {
   gl::Use(prog_);
-  mesh_.setup(prog_, 1);
+  mesh_.setup(prog_, 1, 6, 7);
+  // The camera usually follows a walking character. When it moves fast, the
+  // selection falls back to the full traversal.
+  mesh_.set_incremental_selection(true);
   gl::UniformSampler(prog_, "uGrassMap0").set(2);
   gl::UniformSampler(prog_, "uGrassMap1").set(3);
   for (int i = 0; i < 2; ++i) {
@@ -58,6 +75,7 @@ void Terrain::render() {
   gl::Use(prog_);
   prog_.update();
   uCameraMatrix_ = cam.cameraMatrix();
+  uRebasedCameraMatrix_ = mesh_.rebasedCameraMatrix(cam);
   uProjectionMatrix_ = cam.projectionMatrix();
   uModelMatrix_ = transform()->matrix();
   if (shadow) {
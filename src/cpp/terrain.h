@@ -8,6 +8,7 @@
 #include "engine/oglwrap_config.h"
 
 #include "engine/height_map.h"
+#include "engine/tiled_height_map.h"
 #include "engine/game_object.h"
 #include "engine/shader_manager.h"
 #include "engine/cdlod/terrain_mesh.h"
@@ -17,16 +18,18 @@ class Terrain : public engine::GameObject {
   explicit Terrain(engine::GameObject* parent);
   virtual ~Terrain() {}
 
-  const engine::HeightMapInterface& height_map() { return height_map_; }
+  const engine::HeightMapInterface& height_map() { return *height_map_; }
 
  private:
-  engine::HeightMap<GLubyte> height_map_;
+  // A TiledHeightMap if terrain.lthm exists (that is streamed), otherwise
+  // the whole terrain.png
+  std::unique_ptr<engine::HeightMapInterface> height_map_;
   engine::cdlod::TerrainMesh mesh_;
   engine::ShaderProgram prog_;  // has to be inited after mesh_
 
   gl::Texture2D grassMaps_[2], grassNormalMap_;
   gl::LazyUniform<glm::mat4> uProjectionMatrix_, uCameraMatrix_,
-                             uModelMatrix_, uShadowCP_;
+                             uRebasedCameraMatrix_, uModelMatrix_, uShadowCP_;
   gl::LazyUniform<int> uNumUsedShadowMaps_;
   gl::LazyUniform<glm::ivec2> uShadowAtlasSize_;
 
@@ -1,77 +1,179 @@
 // Copyright (c) 2014, Tamas Csala
 
 #include "./tree.h"
+
+#include <utility>
 #include "engine/scene.h"
 #include "oglwrap/debug/insertion.h"
 
-Tree::Tree(GameObject *parent, const engine::HeightMapInterface& height_map)
+// The per instance model matrix in the shaders
+static const GLuint kModelMatrixLocation = 12;
+// The size of uCamProjMatrices in tree_shadow.vert
+static const size_t kMaxShadowMaps = 16;
+// The number of baked views of every tree type, and their size in pixels
+static const int kImpostorViewCount = 8;
+static const int kImpostorSize = 256;
+// The meshes of the tree types
+static const char* kMeshFiles[] = {
+  "src/resources/models/trees/massive_swamptree_01_a.obj",
+  "src/resources/models/trees/massive_swamptree_01_b.obj",
+  "src/resources/models/trees/cedar_01_a_source.obj"
+};
+
+std::unique_ptr<Assimp::Importer> Tree::ImportMesh(size_t type) {
+  return engine::MeshRenderer::Import(kMeshFiles[type],
+    aiProcessPreset_TargetRealtime_Quality | aiProcess_FlipUVs |
+    aiProcess_PreTransformVertices);
+}
+
+Tree::Tree(GameObject *parent, const engine::HeightMapInterface& height_map,
+           MeshImports meshes)
     : GameObject(parent)
     , prog_(scene_->shader_manager()->get("tree.vert"),
             scene_->shader_manager()->get("tree.frag"))
     , shadow_prog_(scene_->shader_manager()->get("tree_shadow.vert"),
                    scene_->shader_manager()->get("tree_shadow.frag"))
     , uProjectionMatrix_(prog_, "uProjectionMatrix")
-    , uModelCameraMatrix_(prog_, "uModelCameraMatrix")
-    , uNormalMatrix_(prog_, "uNormalMatrix")
-    , shadow_uMCP_(shadow_prog_, "uMCP") {
+    , uCameraMatrix_(prog_, "uCameraMatrix")
+    , shadow_uCamProjMatrices_(shadow_prog_, "uCamProjMatrices")
+    , shadow_uFirstShadowMap_(shadow_prog_, "uFirstShadowMap")
+    , shadow_uShadowAtlasSize_(shadow_prog_, "uShadowAtlasSize")
+    , lod_selector_({300, 150, 60, 30})
+    , screen_height_(1)
+    , impostor_prog_(scene_->shader_manager()->get("tree_impostor.vert"),
+                     scene_->shader_manager()->get("tree_impostor.frag"))
+    , impostor_uProjectionMatrix_(impostor_prog_, "uProjectionMatrix")
+    , impostor_uCameraMatrix_(impostor_prog_, "uCameraMatrix")
+    , impostor_uCamPos_(impostor_prog_, "uCamPos") {
   gl::Use(shadow_prog_);
   gl::UniformSampler(shadow_prog_, "uDiffuseTexture").set(0);
   shadow_prog_.validate();
 
   gl::Use(prog_);
 
-  meshes_[0] = engine::make_unique<engine::MeshRenderer>(
-    "src/resources/models/trees/massive_swamptree_01_a.obj",
-    aiProcessPreset_TargetRealtime_Quality | aiProcess_FlipUVs |
-    aiProcess_PreTransformVertices);
-  meshes_[1] = engine::make_unique<engine::MeshRenderer>(
-    "src/resources/models/trees/massive_swamptree_01_b.obj",
-    aiProcessPreset_TargetRealtime_Quality | aiProcess_FlipUVs |
-    aiProcess_PreTransformVertices);
-  meshes_[2] = engine::make_unique<engine::MeshRenderer>(
-    "src/resources/models/trees/cedar_01_a_source.obj",
-    aiProcessPreset_TargetRealtime_Quality | aiProcess_FlipUVs |
-    aiProcess_PreTransformVertices);
-
   for (unsigned i = 0; i < meshes_.size(); ++i) {
+    meshes_[i] = engine::make_unique<engine::MeshRenderer>(
+        kMeshFiles[i], std::move(meshes[i]));
+    meshes_[i]->generateLods(kLodCount);
     meshes_[i]->setupPositions(prog_ | "aPosition");
     meshes_[i]->setupTexCoords(prog_ | "aTexCoord");
     meshes_[i]->setupNormals(prog_ | "aNormal");
     meshes_[i]->setupDiffuseTextures(0);
   }
 
+  // The impostors are baked with the non-instanced render path, so this has
+  // to happen before the instance matrices are set up.
+  impostor_atlas_ = engine::make_unique<engine::ImpostorAtlas>(
+    std::vector<engine::MeshRenderer*>{meshes_[0].get(), meshes_[1].get(),
+                                       meshes_[2].get()},
+    kImpostorViewCount, kImpostorSize);
+
+  for (unsigned i = 0; i < meshes_.size(); ++i) {
+    meshes_[i]->setupInstanceMatrices(kModelMatrixLocation);
+  }
+
+  gl::Use(prog_);
   gl::UniformSampler(prog_, "uDiffuseTexture").set(0);
 
   prog_.validate();
 
+  gl::Use(impostor_prog_);
+  gl::UniformSampler(impostor_prog_, "uColorAtlas").set(0);
+  gl::UniformSampler(impostor_prog_, "uNormalAtlas").set(1);
+  gl::Uniform<int>(impostor_prog_, "uViewCount") = kImpostorViewCount;
+  gl::Uniform<int>(impostor_prog_, "uTypeCount") = meshes_.size();
+  impostor_prog_.validate();
+
+#ifdef glVertexAttribDivisor
+  if (glVertexAttribDivisor) {
+    // The pointers are set up before every draw call
+    gl::Bind(impostor_vao_);
+    impostor_center_rotation_ = impostor_prog_ | "aCenterRotation";
+    impostor_center_rotation_.enable();
+    impostor_center_rotation_.divisor(1);
+    impostor_size_type_ = impostor_prog_ | "aSizeType";
+    impostor_size_type_.enable();
+    impostor_size_type_.divisor(1);
+    gl::Unbind(impostor_vao_);
+  }
+#endif
+
   // Get the trees' positions.
   const int kTreeDist = 150;
   glm::vec2 extent = height_map.extent();
+  struct Placement {
+    glm::vec3 scale;
+    float rotation;
+    int type;
+  };
+  std::vector<Placement> placements;
+  std::vector<glm::vec2> coords;
   for (int i = kTreeDist; i + kTreeDist < extent.x; i += kTreeDist) {
     for (int j = kTreeDist; j + kTreeDist < extent.y; j += kTreeDist) {
       glm::ivec2 coord = glm::ivec2(i + rand()%(kTreeDist/2) - kTreeDist/4,
                                     j + rand()%(kTreeDist/2) - kTreeDist/4);
-      glm::vec3 pos =
-        glm::vec3(coord.x, height_map.heightAt(coord.x, coord.y)-1, coord.y);
       glm::vec3 scale = glm::vec3(1.0f + rand() / RAND_MAX,
                                   1.0f + rand() / RAND_MAX,
                                   1.0f + rand() / RAND_MAX) * 2.0f;
 
       float rotation = 2*M_PI * rand() / RAND_MAX;
 
-      glm::mat4 matrix = glm::rotate(glm::mat4(), rotation, glm::vec3(0, 1, 0));
-      matrix[3] = glm::vec4(pos, 1);
-      matrix = glm::scale(matrix, scale);
-
       int type = rand() % meshes_.size();
 
-      engine::BoundingBox bbox = meshes_[type]->boundingBox(matrix);
-      glm::vec4 bsphere = meshes_[type]->bSphere();
-      bsphere.w *= 1.2;  // removes peter panning (but decreases quality)
-
-      trees_.push_back(TreeInfo{type, matrix, bsphere, bbox});
+      coords.push_back(glm::vec2(coord));
+      placements.push_back(Placement{scale, rotation, type});
     }
   }
+
+  // The heights are sampled in one batch
+  std::vector<float> heights(coords.size());
+  height_map.sampleHeights(coords.data(), heights.data(), coords.size());
+
+  std::vector<engine::TransformSystem::Handle> handles;
+  for (size_t i = 0; i < placements.size(); ++i) {
+    const Placement& placement = placements[i];
+    glm::vec3 pos = glm::vec3(coords[i].x, heights[i]-1, coords[i].y);
+    handles.push_back(transforms_.create());
+    transforms_.set_local_pos(handles.back(), pos);
+    transforms_.set_local_rot(handles.back(), glm::angleAxis(
+        placement.rotation, glm::vec3(0, 1, 0)));
+    transforms_.set_local_scale(handles.back(), placement.scale);
+  }
+  transforms_.update();
+
+  std::vector<engine::BoundingBox> bboxes;
+  for (size_t i = 0; i < placements.size(); ++i) {
+    const Placement& placement = placements[i];
+    glm::vec3 scale = placement.scale;
+    float rotation = placement.rotation;
+    int type = placement.type;
+    const glm::mat4& matrix = transforms_.world_matrix(handles[i]);
+
+    engine::BoundingBox bbox = meshes_[type]->boundingBox(matrix);
+    glm::vec4 bsphere = meshes_[type]->bSphere();
+    bsphere.w *= 1.2;  // removes peter panning (but decreases quality)
+
+    glm::vec3 world_center =
+        glm::vec3(matrix * glm::vec4(glm::vec3(bsphere), 1));
+    float max_scale = std::max(std::max(scale.x, scale.y), scale.z);
+    glm::vec4 world_bsphere = glm::vec4(world_center, bsphere.w * max_scale);
+
+    // The impostors show the model's (not enlarged) bounding sphere
+    float radius = meshes_[type]->bSphereRadius();
+    Impostor impostor{world_center, rotation,
+                      radius * glm::vec2(std::max(scale.x, scale.z), scale.y),
+                      static_cast<float>(type), 0.0f};
+
+    trees_.push_back(TreeInfo{type, handles[i], bsphere, world_bsphere,
+                              impostor});
+    bboxes.push_back(bbox);
+  }
+  bvh_ = engine::StaticBvh{bboxes};
+  lods_.resize(trees_.size(), 0);
+}
+
+void Tree::screenResized(size_t width, size_t height) {
+  screen_height_ = height;
 }
 
 void Tree::shadowRender() {
@@ -82,15 +184,59 @@ void Tree::shadowRender() {
 
   const auto& cam = *scene_->camera();
   auto campos = cam.transform()->pos();
-  for (size_t i = 0; i < trees_.size() &&
-      shadow->getDepth() < shadow->getMaxDepth(); i++) {
-    if (glm::length(glm::vec3(trees_[i].mat[3]) - campos) < 150) {
-      shadow_uMCP_ = shadow->modelCamProjMat(
-          trees_[i].bsphere, trees_[i].mat, glm::mat4{});
-      meshes_[trees_[i].type]->render();
+
+  // The shadow of a tree falls away from the light, down to about the
+  // ground, so the casters are culled by their bounding spheres, swept in
+  // that direction. The low sun's long shadows are cut at 8 radii.
+  glm::vec3 light_dir = glm::normalize(shadow->getLightSourcePos());
+  bvh_.querySphere(campos, 150, &shadow_caster_indices_);
+  shadow_casters_.clear();
+  for (size_t i : shadow_caster_indices_) {
+    glm::vec4 bsphere = trees_[i].world_bsphere;
+    float shadow_length = 2*bsphere.w / std::max(light_dir.y, 0.25f);
+    shadow_casters_.addSphere(
+        glm::vec3(bsphere) - light_dir * (shadow_length / 2),
+        bsphere.w + shadow_length / 2);
+  }
+  shadow_casters_.cull(cam.frustum(), &visible_);
+
+  // The casters get the shadow maps type by type, so that every type can
+  // be drawn with a single instanced call
+  size_t max_depth = std::min(shadow->getMaxDepth(), kMaxShadowMaps);
+  size_t caster_count = 0;
+  for (auto& visible_trees : visible_of_type_) {
+    visible_trees.clear();
+  }
+  for (size_t j = 0; j < shadow_caster_indices_.size() &&
+      shadow->getDepth() + caster_count < max_depth; j++) {
+    if (engine::CullBatch::IsVisible(visible_, j)) {
+      size_t i = shadow_caster_indices_[j];
+      visible_of_type_[trees_[i].type].push_back(i);
+      caster_count++;
+    }
+  }
+
+  std::array<size_t, 3> first_shadow_map;
+  for (size_t type = 0; type < meshes_.size(); ++type) {
+    first_shadow_map[type] = shadow->getDepth();
+    instances_[type].clear();
+    for (size_t i : visible_of_type_[type]) {
+      const TreeInfo& tree = trees_[i];
+      const glm::mat4& matrix = transforms_.world_matrix(tree.transform);
+      shadow_uCamProjMatrices_[shadow->getDepth()] =
+          shadow->camProjMat(tree.bsphere, matrix);
+      instances_[type].push_back(matrix);
       shadow->push();
     }
   }
+
+  shadow_uShadowAtlasSize_ = shadow->getAtlasDimensions();
+  shadow->setAtlasViewPort();
+  for (size_t type = 0; type < meshes_.size(); ++type) {
+    shadow_uFirstShadowMap_ = first_shadow_map[type];
+    meshes_[type]->renderInstanced(instances_[type]);
+  }
+  shadow->setViewPort();
 }
 
 void Tree::render() {
@@ -105,19 +251,72 @@ void Tree::render() {
   gl::BlendFunc(gl::kSrcAlpha, gl::kOneMinusSrcAlpha);
 
   auto campos = cam.transform()->pos();
-  auto cam_mx = cam.cameraMatrix();
-  auto frustum = cam.frustum();
-  for (size_t i = 0; i < trees_.size(); i++) {
-    // Check for visibility
-    if (!trees_[i].bbox.collidesWithFrustum(frustum) ||
-      glm::length(glm::vec3(trees_[i].mat[3]) - campos) > 1500) {
-      continue;
+  uCameraMatrix_ = cam.cameraMatrix();
+
+  // All of the visible trees, the far ones are drawn as impostors
+  bvh_.queryFrustum(cam.frustum(), &visible_trees_);
+  for (auto& instances_of_type : lod_instances_) {
+    for (auto& instances : instances_of_type) {
+      instances.clear();
+    }
+  }
+  impostors_.clear();
+  for (size_t i : visible_trees_) {
+    const TreeInfo& tree = trees_[i];
+    float size = engine::LodSelector::ProjectedSize(
+        cam.projectionMatrix(), screen_height_, campos, tree.world_bsphere);
+    lods_[i] = lod_selector_.select(size, lods_[i]);
+    if (lods_[i] < kLodCount) {
+      lod_instances_[tree.type][lods_[i]].push_back(
+          transforms_.world_matrix(tree.transform));
+    } else {
+      impostors_.push_back(tree.impostor);
+    }
+  }
+
+  for (size_t type = 0; type < meshes_.size(); ++type) {
+    for (size_t lod = 0; lod < kLodCount; ++lod) {
+      meshes_[type]->renderInstanced(lod_instances_[type][lod], lod);
     }
+  }
+
+  renderImpostors();
+}
 
-    auto& mesh = meshes_[trees_[i].type];
-    glm::mat4 model_mx = trees_[i].mat;
-    uModelCameraMatrix_.set(cam_mx * model_mx);
-    uNormalMatrix_.set(glm::inverse(glm::mat3(model_mx)));
-    mesh->render();
+void Tree::renderImpostors() {
+#ifdef glDrawArraysInstanced
+  if (impostors_.empty()) {
+    return;
   }
+
+  gl::Use(impostor_prog_);
+  impostor_prog_.update();
+
+  const auto& cam = *scene_->camera();
+  impostor_uProjectionMatrix_ = cam.projectionMatrix();
+  impostor_uCameraMatrix_ = cam.cameraMatrix();
+  impostor_uCamPos_ = cam.transform()->pos();
+
+  size_t offset = impostor_buffer_.write(impostors_);
+
+  gl::BindToTexUnit(impostor_atlas_->colors(), 0);
+  gl::BindToTexUnit(impostor_atlas_->normals(), 1);
+
+  gl::Bind(impostor_vao_);
+  glBindBuffer(GL_ARRAY_BUFFER, impostor_buffer_.expose());
+  impostor_center_rotation_.pointer(4, gl::DataType::kFloat, false,
+                                    sizeof(Impostor),
+                                    reinterpret_cast<const void*>(offset));
+  impostor_size_type_.pointer(4, gl::DataType::kFloat, false,
+                              sizeof(Impostor), reinterpret_cast<const void*>(
+                                  offset + sizeof(glm::vec4)));
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  gl::DrawArraysInstanced(gl::kTriangleStrip, 0, 4, impostors_.size());
+  gl::Unbind(impostor_vao_);
+
+  impostor_buffer_.fence();
+
+  gl::UnbindFromTexUnit(impostor_atlas_->normals(), 1);
+  gl::UnbindFromTexUnit(impostor_atlas_->colors(), 0);
+#endif
 }
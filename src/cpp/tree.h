@@ -11,33 +11,99 @@
 #include "engine/game_object.h"
 #include "engine/shader_manager.h"
 #include "engine/mesh/mesh_renderer.h"
+#include "engine/mesh/lod_selector.h"
+#include "engine/mesh/impostor_atlas.h"
+#include "engine/stream_buffer.h"
+#include "engine/transform_system.h"
 #include "engine/height_map_interface.h"
+#include "engine/collision/cull_batch.h"
+#include "engine/collision/static_bvh.h"
 
 class Tree : public engine::GameObject {
  public:
-  Tree(GameObject *parent, const engine::HeightMapInterface& height_map);
+  // The meshes of the tree types, loaded in by ImportMesh
+  using MeshImports = std::array<std::unique_ptr<Assimp::Importer>, 3>;
+
+  Tree(GameObject *parent, const engine::HeightMapInterface& height_map,
+       MeshImports meshes);
   virtual ~Tree() {}
+
+  // Loads in the mesh of a tree type. It doesn't need the OpenGL context, so
+  // the scene can do it on the TaskScheduler.
+  static std::unique_ptr<Assimp::Importer> ImportMesh(size_t type);
+
   virtual void shadowRender() override;
   virtual void render() override;
+  virtual void screenResized(size_t width, size_t height) override;
 
  private:
+  void renderImpostors();
+
   // It should be std::array<engine::MeshRenderer, 3>, but calling its ctor
   // in the initializer list causes sigsegv in the visual c++ compiler.
   std::array<std::unique_ptr<engine::MeshRenderer>, 3> meshes_;
   engine::ShaderProgram prog_, shadow_prog_;
 
-  gl::LazyUniform<glm::mat4> uProjectionMatrix_, uModelCameraMatrix_;
-  gl::LazyUniform<glm::mat3> uNormalMatrix_;
-  gl::LazyUniform<glm::mat4> shadow_uMCP_;
+  gl::LazyUniform<glm::mat4> uProjectionMatrix_, uCameraMatrix_;
+  gl::LazyUniform<glm::mat4> shadow_uCamProjMatrices_;
+  gl::LazyUniform<int> shadow_uFirstShadowMap_;
+  gl::LazyUniform<glm::ivec2> shadow_uShadowAtlasSize_;
+
+  // The per instance data of tree_impostor.vert
+  struct Impostor {
+    glm::vec3 center;
+    float rotation;
+    glm::vec2 half_size;
+    float type;
+    float unused;
+  };
 
   struct TreeInfo {
     int type;
-    glm::mat4 mat;
+    engine::TransformSystem::Handle transform;
     glm::vec4 bsphere;
-    engine::BoundingBox bbox;
+    glm::vec4 world_bsphere;
+    Impostor impostor;
   };
 
   std::vector<TreeInfo> trees_;
+  // The model matrices of the trees, in one contiguous array
+  engine::TransformSystem transforms_;
+
+  // The bounding boxes of the trees, in the order of trees_
+  engine::StaticBvh bvh_;
+  std::vector<size_t> visible_trees_;
+  // The volumes of the shadows of the trees near the camera
+  engine::CullBatch shadow_casters_;
+  std::vector<size_t> shadow_caster_indices_;
+  std::vector<uint32_t> visible_;
+
+  // The visible trees of each type, drawn with instancing
+  std::array<std::vector<size_t>, 3> visible_of_type_;
+  std::array<std::vector<glm::mat4>, 3> instances_;
+
+  // The levels of detail are chosen by the trees' size on the screen, and
+  // their last levels. After the mesh levels, the trees are drawn as
+  // impostors.
+  static const size_t kLodCount = 4;
+  engine::LodSelector lod_selector_;
+  std::vector<GLubyte> lods_;
+  float screen_height_;
+  std::array<std::array<std::vector<glm::mat4>, kLodCount>, 3> lod_instances_;
+
+  // The far trees of every type, as camera facing quads, with a single
+  // instanced draw call
+  std::unique_ptr<engine::ImpostorAtlas> impostor_atlas_;
+  engine::ShaderProgram impostor_prog_;
+  gl::LazyUniform<glm::mat4> impostor_uProjectionMatrix_;
+  gl::LazyUniform<glm::mat4> impostor_uCameraMatrix_;
+  gl::LazyUniform<glm::vec3> impostor_uCamPos_;
+  gl::VertexArray impostor_vao_;
+  // The impostors of every frame go into the next part of the ring, and the
+  // attributes are pointed there before the draw call.
+  engine::StreamBuffer impostor_buffer_;
+  gl::VertexAttrib impostor_center_rotation_, impostor_size_type_;
+  std::vector<Impostor> impostors_;
 };
 
 #endif  // LOD_TREE_H_
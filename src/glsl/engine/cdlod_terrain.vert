@@ -3,6 +3,8 @@
 #version 430
 
 #export vec3 CDLODTerrain_worldPos();
+#export vec3 CDLODTerrain_relativePos();
+#export vec3 CDLODTerrain_toWorldPos(vec3 relative_pos);
 #export vec2 CDLODTerrain_texCoord(vec3 pos);
 #export vec3 CDLODTerrain_normal(vec3 pos);
 #export mat3 CDLODTerrain_normalMatrix(vec3 normal);
@@ -18,47 +20,125 @@ in vec2 CDLODTerrain_aPosition; // I hate the lack of namespaces
   uniform vec4 CDLODTerrain_uRenderData;
 #endif
 
+// Relative to CDLODTerrain_uOrigin
 vec2 CDLODTerrain_uOffset = CDLODTerrain_uRenderData.xy;
 float CDLODTerrain_uScale = CDLODTerrain_uRenderData.z;
 int CDLODTerrain_uLevel = int(CDLODTerrain_uRenderData.w);
 
-uniform sampler2D CDLODTerrain_uHeightMap;
+// Set if the heightmap is streamed in tiles (see engine::cdlod::TileCache)
+#define CDLODTerrain_STREAMING 0
+// Set if the normals are precomputed (see engine::NormalMap)
+#define CDLODTerrain_NORMAL_MAP 0
+
 uniform vec2 CDLODTerrain_uTexSize;
+// The world space xz position, that the render data is relative to. It is
+// near the camera, so the relative positions are small, and precise.
+uniform vec2 CDLODTerrain_uOrigin;
+// Relative to the origin
 uniform vec3 CDLODTerrain_uCamPos;
+// The distance ranges of the levels (see engine::cdlod::LodSettings)
+uniform float CDLODTerrain_uLodRanges[32];
+// The world space height is the sampled value * scale + offset
+// (see engine::HeightMapInterface::height_scale)
+uniform float CDLODTerrain_uHeightScale = 255, CDLODTerrain_uHeightOffset = 0;
+
+float CDLODTerrain_height(float value) {
+  return value * CDLODTerrain_uHeightScale + CDLODTerrain_uHeightOffset;
+}
+
+#if CDLODTerrain_STREAMING
+
+uniform sampler2DArray CDLODTerrain_uHeightTiles;
+// The {slot, level} of the finest resident tile for every finest level tile
+uniform usampler2D CDLODTerrain_uPageTable;
+uniform int CDLODTerrain_uTileSize;
 
 float CDLODTerrain_fetchHeight(vec2 tex_coord) {
-  return texture2D(CDLODTerrain_uHeightMap,
-                   tex_coord / vec2(CDLODTerrain_uTexSize)).r * 255;
+  vec2 pos = clamp(tex_coord, vec2(0), CDLODTerrain_uTexSize - 1);
+  ivec2 page = min(ivec2(pos) / CDLODTerrain_uTileSize,
+                   textureSize(CDLODTerrain_uPageTable, 0) - 1);
+  uvec2 entry = texelFetch(CDLODTerrain_uPageTable, page, 0).xy;
+  int level = int(entry.y);
+
+  // The tile's texels are 2^level apart, and its last row and column are
+  // shared with the next tile
+  vec2 tile_origin = vec2((page >> level) * (CDLODTerrain_uTileSize << level));
+  vec2 texel = (pos - tile_origin) / float(1 << level);
+  vec2 uv = (texel + 0.5) / float(CDLODTerrain_uTileSize + 1);
+  return CDLODTerrain_height(
+      texture(CDLODTerrain_uHeightTiles, vec3(uv, entry.x)).r);
 }
 
+#else
+
+uniform sampler2D CDLODTerrain_uHeightMap;
+
+float CDLODTerrain_fetchHeight(vec2 tex_coord) {
+  return CDLODTerrain_height(texture2D(CDLODTerrain_uHeightMap,
+      tex_coord / vec2(CDLODTerrain_uTexSize)).r);
+}
+
+#endif
+
 vec2 CDLODTerrain_frac(vec2 x) { return x - floor(x); }
 
-vec2 CDLODTerrain_morphVertex(vec2 vertex, float morph) {
-  vec2 frac_part = CDLODTerrain_frac(vertex / CDLODTerrain_uScale * 0.5 ) * 2.0;
+// The center of an instance is on the grid of the next level, so the
+// fractional part can be computed from the small, local grid position,
+// instead of the world position.
+vec2 CDLODTerrain_morphVertex(vec2 grid_pos, vec2 vertex, float morph) {
+  vec2 frac_part = CDLODTerrain_frac(grid_pos * 0.5) * 2.0;
   return vertex - frac_part * CDLODTerrain_uScale * morph;
 }
 
 const float CDLODTerrain_morph_start = 0.85;
 const float CDLODTerrain_morph_end_fudge = 0.99;
 
-vec3 CDLODTerrain_worldPos() {
+// The position relative to (CDLODTerrain_uOrigin.x, 0, CDLODTerrain_uOrigin.y)
+vec3 CDLODTerrain_relativePos() {
   vec2 pos = CDLODTerrain_uOffset + CDLODTerrain_uScale * CDLODTerrain_aPosition;
+  float height = CDLODTerrain_fetchHeight(pos + CDLODTerrain_uOrigin);
 
-  float max_dist = CDLODTerrain_morph_end_fudge * pow(2, CDLODTerrain_uLevel+1) * 128;
-  float dist = length(CDLODTerrain_uCamPos - vec3(pos.x, CDLODTerrain_fetchHeight(pos), pos.y));
+  // The node is used until the range of its parent's level, it has to be
+  // fully morphed into the parent's grid by then
+  float max_dist = CDLODTerrain_morph_end_fudge *
+                   CDLODTerrain_uLodRanges[CDLODTerrain_uLevel+1];
+  float dist = length(CDLODTerrain_uCamPos - vec3(pos.x, height, pos.y));
 
   float morph = clamp((dist - CDLODTerrain_morph_start*max_dist) /
       ((1-CDLODTerrain_morph_start) * max_dist), 0, 1);
 
-  vec2 morphed_pos = CDLODTerrain_morphVertex(pos, morph);
+  vec2 morphed_pos = CDLODTerrain_morphVertex(CDLODTerrain_aPosition, pos, morph);
+  height = CDLODTerrain_fetchHeight(morphed_pos + CDLODTerrain_uOrigin);
 
-  return vec3(morphed_pos.x, CDLODTerrain_fetchHeight(morphed_pos), morphed_pos.y);
+  return vec3(morphed_pos.x, height, morphed_pos.y);
+}
+
+vec3 CDLODTerrain_toWorldPos(vec3 relative_pos) {
+  return relative_pos + vec3(CDLODTerrain_uOrigin.x, 0, CDLODTerrain_uOrigin.y);
+}
+
+vec3 CDLODTerrain_worldPos() {
+  return CDLODTerrain_toWorldPos(CDLODTerrain_relativePos());
 }
 
 vec2 CDLODTerrain_texCoord(vec3 pos) {
   return pos.xz / CDLODTerrain_uTexSize;
 }
 
+#if CDLODTerrain_NORMAL_MAP
+
+// Hemi-octahedral encoding, see engine::NormalMap::Decode
+uniform sampler2D CDLODTerrain_uNormalMap;
+
+vec3 CDLODTerrain_normal(vec3 pos) {
+  vec2 e = texture(CDLODTerrain_uNormalMap,
+                   pos.xz / CDLODTerrain_uTexSize).rg * 2 - 1;
+  vec2 xz = vec2(e.x + e.y, e.x - e.y) * 0.5;
+  return normalize(vec3(xz.x, 1 - abs(xz.x) - abs(xz.y), xz.y));
+}
+
+#else
+
 vec3 CDLODTerrain_normal(vec3 pos) {
   vec3 u = vec3(1.0f, CDLODTerrain_fetchHeight(pos.xz + vec2(1, 0)) -
                       CDLODTerrain_fetchHeight(pos.xz - vec2(1, 0)), 0.0f);
@@ -67,10 +147,14 @@ vec3 CDLODTerrain_normal(vec3 pos) {
   return normalize(cross(u, -v));
 }
 
+#endif
+
+// The tangent is cross(normal, (0, 0, 1)) normalized, the bitangent is the
+// cross product of two orthogonal unit vectors, so it's already normalized.
 mat3 CDLODTerrain_normalMatrix(vec3 normal) {
-  vec3 tangent = normalize(cross(normal, vec3(0.0, 0.0, 1.0)));
-  vec3 bitangent = normalize(cross(normal, tangent));
-  tangent = normalize(cross(bitangent, normal));
+  vec3 tangent = vec3(normal.y, -normal.x, 0.0) *
+                 inversesqrt(normal.x*normal.x + normal.y*normal.y);
+  vec3 bitangent = cross(normal, tangent);
 
   return mat3(tangent, bitangent, normal);
 }
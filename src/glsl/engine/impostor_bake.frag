@@ -0,0 +1,23 @@
+// Copyright (c) 2014, Tamas Csala
+
+#version 430
+
+in vec3 m_vNormal;
+in vec2 vTexCoord;
+
+uniform sampler2D uDiffuseTexture;
+// Whether the normals or the colors are baked
+uniform bool uBakeNormals;
+
+out vec4 fragColor;
+
+void main() {
+  vec4 color = texture2D(uDiffuseTexture, vTexCoord);
+  if (color.a < 0.5) { discard; }
+
+  if (uBakeNormals) {
+    fragColor = vec4(normalize(m_vNormal)*0.5 + 0.5, 1.0);
+  } else {
+    fragColor = vec4(color.rgb, 1.0);
+  }
+}
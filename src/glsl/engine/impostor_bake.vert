@@ -0,0 +1,19 @@
+// Copyright (c) 2014, Tamas Csala
+
+#version 430
+
+// The same locations as the meshes are set up with
+layout(location = 0) in vec4 aPosition;
+layout(location = 1) in vec2 aTexCoord;
+layout(location = 2) in vec3 aNormal;
+
+uniform mat4 uProjectionMatrix, uCameraMatrix;
+
+out vec3 m_vNormal;
+out vec2 vTexCoord;
+
+void main() {
+  m_vNormal = aNormal;
+  vTexCoord = aTexCoord;
+  gl_Position = uProjectionMatrix * (uCameraMatrix * aPosition);
+}
@@ -4,7 +4,9 @@
 
 #include "engine/cdlod_terrain.vert"
 
-uniform mat4 uProjectionMatrix, uCameraMatrix, uModelMatrix;
+// uRebasedCameraMatrix works on the positions relative to the terrain's
+// origin (see engine::cdlod::TerrainMesh::rebasedCameraMatrix)
+uniform mat4 uProjectionMatrix, uRebasedCameraMatrix, uModelMatrix;
 uniform vec2 CDLODTerrain_uTexSize;
 
 out vec3  w_vNormal;
@@ -14,7 +16,8 @@ out float vInvalid;
 out mat3  vNormalMatrix;
 
 void main() {
-  vec3 w_pos = CDLODTerrain_worldPos();
+  vec3 r_pos = CDLODTerrain_relativePos();
+  vec3 w_pos = CDLODTerrain_toWorldPos(r_pos);
   vec2 tex_coord = CDLODTerrain_texCoord(w_pos);
   vec3 offseted_w_pos = (uModelMatrix * vec4(w_pos, 1)).xyz;
 
@@ -31,7 +34,9 @@ void main() {
   w_vPos = offseted_w_pos;
   vTexCoord = tex_coord;
 
-  vec4 c_pos = uCameraMatrix * vec4(offseted_w_pos, 1);
+  // The model matrix may only translate, so it can be applied before the
+  // origin is added
+  vec4 c_pos = uRebasedCameraMatrix * uModelMatrix * vec4(r_pos, 1);
   c_vPos = vec3(c_pos);
 
   vec3 w_normal = CDLODTerrain_normal(w_pos);
@@ -3,7 +3,6 @@
 #version 430
 
 #include "fog.frag"
-#include "visibility_range_limit.frag"
 #include "hemisphere_lighting.frag"
 
 in vec3 c_vPos;
@@ -22,8 +21,8 @@ void main() {
                   0.4*HemisphereLighting(-normal);
   vec3 final_color = color.rgb * lighting;
 
-  float actual_alpha = min(color.a, VisibilityRangeAlpha(c_vPos));
-  if (actual_alpha < 1e-1) { discard; }
+  // The far trees are drawn as impostors, so no visibility range limit
+  if (color.a < 1e-1) { discard; }
 
-  fragColor = vec4(ApplyFog(final_color, c_vPos), actual_alpha);
+  fragColor = vec4(ApplyFog(final_color, c_vPos), color.a);
 }
@@ -2,22 +2,33 @@
 
 #version 430
 
-in vec4 aPosition;
-in vec2 aTexCoord;
-in vec3 aNormal;
+// The impostor baker uses the same locations
+layout(location = 0) in vec4 aPosition;
+layout(location = 1) in vec2 aTexCoord;
+layout(location = 2) in vec3 aNormal;
 
-uniform mat4 uModelCameraMatrix, uProjectionMatrix;
-uniform mat3 uNormalMatrix;
+// Per instance
+layout(location = 12) in mat4 aModelMatrix;
+
+uniform mat4 uCameraMatrix, uProjectionMatrix;
 
 out vec3 c_vPos;
 out vec3 w_vNormal;
 out vec2 vTexCoord;
 
 void main() {
-  w_vNormal = aNormal * uNormalMatrix;
+  // The model matrices are a rotation and a scale (R * S), so the normal
+  // matrix, inverse(transpose(R * S)) is R * inverse(S), which is the model
+  // matrix with its columns divided by their squared lengths. This is much
+  // cheaper than an inverse per vertex. The fragment shader normalizes.
+  mat3 model = mat3(aModelMatrix);
+  vec3 inv_scale_sqr = 1.0 / vec3(dot(model[0], model[0]),
+                                  dot(model[1], model[1]),
+                                  dot(model[2], model[2]));
+  w_vNormal = model * (aNormal * inv_scale_sqr);
   vTexCoord = aTexCoord;
 
-  vec4 c_pos = uModelCameraMatrix * aPosition;
+  vec4 c_pos = uCameraMatrix * (aModelMatrix * aPosition);
   c_vPos = vec3(c_pos);
 
   gl_Position = uProjectionMatrix * c_pos;
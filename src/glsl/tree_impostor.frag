@@ -0,0 +1,33 @@
+// Copyright (c) 2014, Tamas Csala
+
+#version 430
+
+#include "fog.frag"
+#include "hemisphere_lighting.frag"
+
+in vec3 c_vPos;
+in vec2 vTexCoord;
+in float vRotation;
+
+uniform sampler2D uColorAtlas, uNormalAtlas;
+
+out vec4 fragColor;
+
+void main() {
+  vec4 color = texture2D(uColorAtlas, vTexCoord);
+  if (color.a < 0.5) { discard; }
+
+  // The baked normals are in the model space
+  vec3 m_normal = texture2D(uNormalAtlas, vTexCoord).xyz * 2 - 1;
+  float c = cos(vRotation), s = sin(vRotation);
+  vec3 normal = normalize(vec3(c*m_normal.x + s*m_normal.z,
+                               m_normal.y,
+                               -s*m_normal.x + c*m_normal.z));
+
+  // The same fake lighting as in tree.frag
+  vec3 lighting = 0.6*HemisphereLighting(normal) +
+                  0.4*HemisphereLighting(-normal);
+  vec3 final_color = color.rgb * lighting;
+
+  fragColor = vec4(ApplyFog(final_color, c_vPos), 1.0);
+}
@@ -0,0 +1,50 @@
+// Copyright (c) 2014, Tamas Csala
+
+#version 430
+
+// Per instance
+// xyz: the center of the bounding sphere, w: the rotation around the y axis
+layout(location = 0) in vec4 aCenterRotation;
+// xy: the half size of the quad, z: the type of the tree
+layout(location = 1) in vec4 aSizeType;
+
+uniform mat4 uCameraMatrix, uProjectionMatrix;
+uniform vec3 uCamPos;
+uniform int uViewCount, uTypeCount;
+
+out vec3 c_vPos;
+out vec2 vTexCoord;
+out float vRotation;
+
+const float kPi = 3.14159265358979;
+
+void main() {
+  // A triangle strip of four vertices
+  vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2 - 1;
+
+  vec3 center = aCenterRotation.xyz;
+  float rotation = aCenterRotation.w;
+
+  // The quad is only turned around the y axis, to face the camera
+  vec2 to_cam = uCamPos.xz - center.xz;
+  if (dot(to_cam, to_cam) < 1e-6) { to_cam = vec2(1, 0); }
+  to_cam = normalize(to_cam);
+  vec3 right = vec3(to_cam.y, 0, -to_cam.x);
+  vec3 w_pos = center + corner.x * aSizeType.x * right
+                      + corner.y * aSizeType.y * vec3(0, 1, 0);
+
+  // The baked view, that is the closest to the direction of the camera (in
+  // the model space of the tree)
+  float angle = atan(to_cam.y, to_cam.x) + rotation;
+  int view = int(round(angle / (2*kPi/uViewCount)));
+  view = ((view % uViewCount) + uViewCount) % uViewCount;
+
+  vec2 cell = vec2(view, aSizeType.z);
+  vTexCoord = (cell + (corner * 0.5 + 0.5)) / vec2(uViewCount, uTypeCount);
+  vRotation = rotation;
+
+  vec4 c_pos = uCameraMatrix * vec4(w_pos, 1);
+  c_vPos = vec3(c_pos);
+
+  gl_Position = uProjectionMatrix * c_pos;
+}
@@ -3,10 +3,15 @@
 #version 430
 
 in vec2 vTexCoord;
+in vec2 vShadowMapPos;
 
 uniform sampler2D uDiffuseTexture;
 
 void main() {
+  // The neighbouring shadow maps of the atlas aren't ours
+  if (any(greaterThan(abs(vShadowMapPos), vec2(1.0))))
+    discard;
+
   if (texture2D(uDiffuseTexture, vTexCoord).a < 1.0)
     discard;
 }
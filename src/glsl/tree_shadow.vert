@@ -2,14 +2,34 @@
 
 #version 430
 
-in vec4 aPosition;
-in vec2 aTexCoord;
+#define SHADOW_MAP_NUM 16
 
-uniform mat4 uMCP;
+// The same locations as in tree.vert
+layout(location = 0) in vec4 aPosition;
+layout(location = 1) in vec2 aTexCoord;
+
+// Per instance
+layout(location = 12) in mat4 aModelMatrix;
+
+// The instances are drawn into consecutive shadow maps of the atlas
+uniform mat4 uCamProjMatrices[SHADOW_MAP_NUM];
+uniform int uFirstShadowMap;
+uniform ivec2 uShadowAtlasSize;
 
 out vec2 vTexCoord;
+out vec2 vShadowMapPos;
 
 void main() {
   vTexCoord = aTexCoord;
-  gl_Position = uMCP * aPosition;
+
+  int shadow_map = uFirstShadowMap + gl_InstanceID;
+  vec4 pos = uCamProjMatrices[shadow_map] * (aModelMatrix * aPosition);
+  vShadowMapPos = pos.xy / pos.w;
+
+  // Move it to the place of the shadow map in the atlas (like
+  // Shadow::setViewPort does)
+  vec2 offset = vec2(shadow_map / uShadowAtlasSize.x,
+                     shadow_map % uShadowAtlasSize.x);
+  vec2 atlas_pos = (vShadowMapPos*0.5 + 0.5 + offset) / uShadowAtlasSize;
+  gl_Position = vec4((atlas_pos*2 - 1) * pos.w, pos.zw);
 }